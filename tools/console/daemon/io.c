@@ -21,6 +21,7 @@
 
 #include "utils.h"
 #include "io.h"
+#include "logfile.h"
 #include <xenevtchn.h>
 #include <xenforeignmemory.h>
 #include <xengnttab.h>
@@ -61,17 +62,15 @@
 #define RATE_LIMIT_PERIOD 200
 
 extern int log_reload;
+extern int log_stats;
 extern int log_guest;
 extern int log_hv;
 extern int log_time_hv;
 extern int log_time_guest;
 extern char *log_dir;
 extern int discard_overflowed_data;
-extern int replace_escape;
 
-static int log_time_hv_needts = 1;
-static int log_time_guest_needts = 1;
-static int log_hv_fd = -1;
+static struct logfile *log_hv_file;
 
 static xengnttab_handle *xgt_handle = NULL;
 static xenforeignmemory_handle *xfm_handle;
@@ -93,7 +92,7 @@ struct console {
 	int master_fd;
 	int master_pollfd_idx;
 	int slave_fd;
-	int log_fd;
+	struct logfile *log;
 	struct buffer buffer;
 	char *xspath;
 	const char *log_suffix;
@@ -226,76 +225,6 @@ static inline int console_iter_int_arg3(struct domain *d,
 	return ret;
 }
 
-static void do_replace_escape(const char *src, char *dest, int len)
-{
-	int i;
-
-	for (i = 0; i < len; i++) {
-		if (src[i] == '\033')
-			dest[i] = '.';
-		else
-			dest[i] = src[i];
-	}
-}
-
-static int write_all(int fd, const char* buf, size_t len)
-{
-	while (len) {
-		ssize_t ret;
-		if (replace_escape) {
-			char buf_replaced[1024];
-			size_t this_round;
-
-			if (len > sizeof(buf_replaced))
-				this_round = sizeof(buf_replaced);
-			else
-				this_round = len;
-			do_replace_escape(buf, buf_replaced, this_round);
-			ret = write(fd, buf_replaced, this_round);
-		} else
-			ret = write(fd, buf, len);
-		if (ret == -1 && errno == EINTR)
-			continue;
-		if (ret <= 0)
-			return -1;
-		len -= ret;
-		buf += ret;
-	}
-
-	return 0;
-}
-
-static int write_with_timestamp(int fd, const char *data, size_t sz,
-				int *needts)
-{
-	char ts[32];
-	time_t now = time(NULL);
-	const struct tm *tmnow = localtime(&now);
-	size_t tslen = strftime(ts, sizeof(ts), "[%Y-%m-%d %H:%M:%S] ", tmnow);
-	const char *last_byte = data + sz - 1;
-
-	while (data <= last_byte) {
-		const char *nl = memchr(data, '\n', last_byte + 1 - data);
-		int found_nl = (nl != NULL);
-		if (!found_nl)
-			nl = last_byte;
-
-		if ((*needts && write_all(fd, ts, tslen))
-		    || write_all(fd, data, nl + 1 - data))
-			return -1;
-
-		*needts = found_nl;
-		data = nl + 1;
-		if (found_nl) {
-			// If we printed a newline, strip all \r following it
-			while (data <= last_byte && *data == '\r')
-				data++;
-		}
-	}
-
-	return 0;
-}
-
 static inline bool buffer_available(struct console *con)
 {
 	if (discard_overflowed_data ||
@@ -309,7 +238,6 @@ static inline bool buffer_available(struct console *con)
 static void buffer_append(struct console *con)
 {
 	struct buffer *buffer = &con->buffer;
-	struct domain *dom = con->d;
 	XENCONS_RING_IDX cons, prod, size;
 	struct xencons_interface *intf = con->interface;
 
@@ -342,24 +270,7 @@ static void buffer_append(struct console *con)
 	 * no one is listening on the console pty then it will fill up
 	 * and handle_tty_write will stop being called.
 	 */
-	if (con->log_fd != -1) {
-		int logret;
-		if (log_time_guest) {
-			logret = write_with_timestamp(
-				con->log_fd,
-				buffer->data + buffer->size - size,
-				size, &log_time_guest_needts);
-		} else {
-			logret = write_all(
-				con->log_fd,
-				buffer->data + buffer->size - size,
-				size);
-		}
-		if (logret < 0)
-			dolog(LOG_ERR, "Write to log failed "
-			      "on domain %d: %d (%s)\n",
-			      dom->domid, errno, strerror(errno));
-	}
+	logfile_append(con->log, buffer->data + buffer->size - size, size);
 
 	if (discard_overflowed_data && buffer->max_capacity &&
 	    buffer->size > 5 * buffer->max_capacity / 4) {
@@ -408,36 +319,25 @@ static bool domain_is_valid(int domid)
 	return xc_domain_getinfo_single(xc, domid, NULL) == 0;
 }
 
-static int create_hv_log(void)
+static void hv_log_path(char *logfile)
 {
-	char logfile[PATH_MAX];
-	int fd;
 	snprintf(logfile, PATH_MAX-1, "%s/hypervisor.log", log_dir);
 	logfile[PATH_MAX-1] = '\0';
-
-	fd = open(logfile, O_WRONLY|O_CREAT|O_APPEND, 0644);
-	if (fd == -1)
-		dolog(LOG_ERR, "Failed to open log %s: %d (%s)",
-		      logfile, errno, strerror(errno));
-	if (fd != -1 && log_time_hv) {
-		if (write_with_timestamp(fd, "Logfile Opened\n",
-					 strlen("Logfile Opened\n"),
-					 &log_time_hv_needts) < 0) {
-			dolog(LOG_ERR, "Failed to log opening timestamp "
-				       "in %s: %d (%s)", logfile, errno,
-				       strerror(errno));
-			close(fd);
-			return -1;
-		}
-	}
-	return fd;
 }
 
-static int create_console_log(struct console *con)
+static struct logfile *create_hv_log(void)
 {
 	char logfile[PATH_MAX];
+
+	hv_log_path(logfile);
+
+	return logfile_open(logfile, -1, log_time_hv);
+}
+
+/* Returns false if the domain has no name (yet). */
+static bool console_log_path(struct console *con, char *logfile)
+{
 	char *namepath, *data, *s;
-	int fd;
 	unsigned int len;
 	struct domain *dom = con->d;
 
@@ -445,17 +345,17 @@ static int create_console_log(struct console *con)
 	s = realloc(namepath, strlen(namepath) + 6);
 	if (s == NULL) {
 		free(namepath);
-		return -1;
+		return false;
 	}
 	namepath = s;
 	strcat(namepath, "/name");
 	data = xs_read(xs, XBT_NULL, namepath, &len);
 	free(namepath);
 	if (!data)
-		return -1;
+		return false;
 	if (!len) {
 		free(data);
-		return -1;
+		return false;
 	}
 
 	snprintf(logfile, PATH_MAX-1, "%s/guest-%s%s.log",
@@ -464,22 +364,17 @@ static int create_console_log(struct console *con)
 	free(data);
 	logfile[PATH_MAX-1] = '\0';
 
-	fd = open(logfile, O_WRONLY|O_CREAT|O_APPEND, 0644);
-	if (fd == -1)
-		dolog(LOG_ERR, "Failed to open log %s: %d (%s)",
-		      logfile, errno, strerror(errno));
-	if (fd != -1 && log_time_guest) {
-		if (write_with_timestamp(fd, "Logfile Opened\n",
-					 strlen("Logfile Opened\n"),
-					 &log_time_guest_needts) < 0) {
-			dolog(LOG_ERR, "Failed to log opening timestamp "
-				       "in %s: %d (%s)", logfile, errno,
-				       strerror(errno));
-			close(fd);
-			return -1;
-		}
-	}
-	return fd;
+	return true;
+}
+
+static struct logfile *create_console_log(struct console *con)
+{
+	char logfile[PATH_MAX];
+
+	if (!console_log_path(con, logfile))
+		return NULL;
+
+	return logfile_open(logfile, con->d->domid, log_time_guest);
 }
 
 static void console_close_tty(struct console *con)
@@ -777,8 +672,8 @@ static int console_create_ring(struct console *con)
 		}
 	}
 
-	if (log_guest && (con->log_fd == -1))
-		con->log_fd = create_console_log(con);
+	if (log_guest && !con->log)
+		con->log = create_console_log(con);
 
  out:
 	return err;
@@ -822,7 +717,7 @@ static int console_init(struct console *con, struct domain *dom, void **data)
 	con->master_fd = -1;
 	con->master_pollfd_idx = -1;
 	con->slave_fd = -1;
-	con->log_fd = -1;
+	con->log = NULL;
 	con->ring_ref = -1;
 	con->local_port = -1;
 	con->remote_port = -1;
@@ -914,10 +809,8 @@ static void remove_domain(struct domain *dom)
 
 static void console_cleanup(struct console *con)
 {
-	if (con->log_fd != -1) {
-		close(con->log_fd);
-		con->log_fd = -1;
-	}
+	logfile_close(con->log);
+	con->log = NULL;
 
 	free(con->buffer.data);
 	con->buffer.data = NULL;
@@ -1171,22 +1064,12 @@ static void handle_hv_logs(xenevtchn_handle *xce_handle, bool force)
 
 	do
 	{
-		int logret;
-
 		size = sizeof(buffer);
 		if (xc_readconsolering(xc, bufptr, &size, 0, 1, &index) != 0 ||
 		    size == 0)
 			break;
 
-		if (log_time_hv)
-			logret = write_with_timestamp(log_hv_fd, buffer, size,
-						      &log_time_hv_needts);
-		else
-			logret = write_all(log_hv_fd, buffer, size);
-
-		if (logret < 0)
-			dolog(LOG_ERR, "Failed to write hypervisor log: "
-				       "%d (%s)", errno, strerror(errno));
+		logfile_append(log_hv_file, buffer, size);
 	} while (size == sizeof(buffer));
 
 	if (port != -1)
@@ -1195,11 +1078,22 @@ static void handle_hv_logs(xenevtchn_handle *xce_handle, bool force)
 
 static void console_open_log(struct console *con)
 {
-	if (console_enabled(con)) {
-		if (con->log_fd != -1)
-			close(con->log_fd);
-		con->log_fd = create_console_log(con);
-	}
+	char logfile[PATH_MAX];
+
+	if (!console_enabled(con))
+		return;
+
+	/*
+	 * The actual close and reopen happen on the log writer thread, so a
+	 * slow log disk doesn't hold up the main loop during rotation.
+	 */
+	if (!console_log_path(con, logfile)) {
+		logfile_close(con->log);
+		con->log = NULL;
+	} else if (con->log)
+		logfile_reopen(con->log, logfile);
+	else
+		con->log = logfile_open(logfile, con->d->domid, log_time_guest);
 }
 
 static void handle_log_reload(void)
@@ -1212,9 +1106,13 @@ static void handle_log_reload(void)
 	}
 
 	if (log_hv) {
-		if (log_hv_fd != -1)
-			close(log_hv_fd);
-		log_hv_fd = create_hv_log();
+		char logfile[PATH_MAX];
+
+		hv_log_path(logfile);
+		if (log_hv_file)
+			logfile_reopen(log_hv_file, logfile);
+		else
+			log_hv_file = create_hv_log();
 	}
 }
 
@@ -1321,6 +1219,9 @@ void handle_io(void)
 	int xs_pollfd_idx = -1;
 	xenevtchn_handle *xce_handle = NULL;
 
+	if (!logfile_writer_start())
+		return;
+
 	if (log_hv) {
 		xce_handle = xenevtchn_open(NULL, 0);
 		if (xce_handle == NULL) {
@@ -1328,8 +1229,8 @@ void handle_io(void)
 			      errno, strerror(errno));
 			goto out;
 		}
-		log_hv_fd = create_hv_log();
-		if (log_hv_fd == -1)
+		log_hv_file = create_hv_log();
+		if (!log_hv_file)
 			goto out;
 		log_hv_evtchn = xenevtchn_bind_virq(xce_handle, VIRQ_CON_RING);
 		if (log_hv_evtchn == -1) {
@@ -1407,6 +1308,11 @@ void handle_io(void)
 			errno = saved_errno;
 		}
 
+		if (log_stats) {
+			logfile_dump_stats();
+			log_stats = 0;
+		}
+
 		/* Abort if poll failed, except for EINTR cases
 		   which indicate a possible log reload */
 		if (ret == -1) {
@@ -1464,10 +1370,9 @@ void handle_io(void)
 	current_array_size = 0;
 
  out:
-	if (log_hv_fd != -1) {
-		close(log_hv_fd);
-		log_hv_fd = -1;
-	}
+	logfile_close(log_hv_file);
+	log_hv_file = NULL;
+	logfile_writer_stop();
 	if (xce_handle != NULL) {
 		xenevtchn_close(xce_handle);
 		xce_handle = NULL;
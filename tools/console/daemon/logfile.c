@@ -0,0 +1,551 @@
+/*
+ *  Xen Console Daemon - asynchronous log writer
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; under version 2 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+#include "utils.h"
+#include "logfile.h"
+
+#include <xen-tools/common-macros.h>
+
+/* Size of each buffer segment queued for the writer. */
+#define LOG_CHUNK_SIZE		8192
+/* Maximum amount of unwritten data per log file before output is dropped. */
+#define LOG_BACKLOG_MAX		(1024 * 1024)
+/* Maximum number of segments passed to a single writev(). */
+#define LOG_IOV_MAX		64
+
+extern int replace_escape;
+
+struct log_chunk {
+	struct log_chunk *next;
+	size_t len;
+	char data[LOG_CHUNK_SIZE];
+};
+
+struct logfile {
+	/* Protected by log_lock. */
+	struct logfile *all_next;
+	struct logfile *queue_next;
+	bool queued;
+	bool closing;
+	char *new_path;
+	struct log_chunk *head, *tail;
+	size_t backlog;
+	bool dropping;
+
+	/* Statistics, protected by log_lock. */
+	unsigned long long bytes_written;
+	unsigned long long bytes_dropped;
+	unsigned long long nr_writes;
+	unsigned long long dropped_episode;
+	unsigned long long slowest_write_us;
+	size_t peak_backlog;
+
+	/* Immutable after logfile_open(). */
+	int domid;
+	bool timestamps;
+
+	/* Only accessed by the main loop. */
+	bool needts;
+
+	/* Only accessed by the writer thread (or before it sees the file). */
+	int fd;
+	/* Only changed by the writer thread, with log_lock held. */
+	char *path;
+};
+
+static pthread_mutex_t log_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t log_cond = PTHREAD_COND_INITIALIZER;
+static struct logfile *log_all;
+static struct logfile *log_queue_head, **log_queue_tail = &log_queue_head;
+static bool log_stopping;
+static bool log_writer_running;
+static pthread_t log_writer;
+
+static const char *log_owner(const struct logfile *lf, char *buf, size_t len)
+{
+	if (lf->domid < 0)
+		return "hypervisor";
+
+	snprintf(buf, len, "domain %d", lf->domid);
+	return buf;
+}
+
+static size_t format_timestamp(char *buf, size_t len)
+{
+	time_t now = time(NULL);
+	const struct tm *tmnow = localtime(&now);
+
+	return strftime(buf, len, "[%Y-%m-%d %H:%M:%S] ", tmnow);
+}
+
+/* Called with log_lock held. */
+static void queue_logfile(struct logfile *lf)
+{
+	if (lf->queued)
+		return;
+
+	lf->queued = true;
+	lf->queue_next = NULL;
+	*log_queue_tail = lf;
+	log_queue_tail = &lf->queue_next;
+	pthread_cond_signal(&log_cond);
+}
+
+/* Called with log_lock held. */
+static void queue_bytes(struct logfile *lf, const char *data, size_t len)
+{
+	while (len) {
+		struct log_chunk *c = lf->tail;
+		size_t n, i;
+
+		if (!c || c->len == LOG_CHUNK_SIZE) {
+			c = malloc(sizeof(*c));
+			if (c == NULL) {
+				dolog(LOG_ERR, "Memory allocation failed");
+				exit(ENOMEM);
+			}
+			c->next = NULL;
+			c->len = 0;
+			if (lf->tail)
+				lf->tail->next = c;
+			else
+				lf->head = c;
+			lf->tail = c;
+		}
+
+		n = min(len, LOG_CHUNK_SIZE - c->len);
+		if (replace_escape) {
+			for (i = 0; i < n; i++)
+				c->data[c->len + i] =
+					data[i] == '\033' ? '.' : data[i];
+		} else
+			memcpy(c->data + c->len, data, n);
+
+		c->len += n;
+		lf->backlog += n;
+		data += n;
+		len -= n;
+	}
+
+	if (lf->backlog > lf->peak_backlog)
+		lf->peak_backlog = lf->backlog;
+}
+
+void logfile_append(struct logfile *lf, const char *data, size_t len)
+{
+	char ts[32], owner[32];
+	size_t tslen = 0;
+	const char *last_byte = data + len - 1;
+
+	if (!lf || !len)
+		return;
+
+	if (lf->timestamps)
+		tslen = format_timestamp(ts, sizeof(ts));
+
+	pthread_mutex_lock(&log_lock);
+
+	/*
+	 * Don't let a guest which produces output faster than the log can be
+	 * written consume unbounded memory: drop the data and remember that
+	 * we did, so the offender shows up in the statistics.
+	 */
+	if (lf->backlog + len > LOG_BACKLOG_MAX) {
+		if (!lf->dropping) {
+			lf->dropping = true;
+			dolog(LOG_WARNING, "Log writer for %s (%s) is %zu bytes "
+			      "behind, discarding output",
+			      log_owner(lf, owner, sizeof(owner)),
+			      lf->path, lf->backlog);
+		}
+		lf->bytes_dropped += len;
+		lf->dropped_episode += len;
+		pthread_mutex_unlock(&log_lock);
+		return;
+	}
+
+	if (!tslen) {
+		queue_bytes(lf, data, len);
+	} else {
+		while (data <= last_byte) {
+			const char *nl = memchr(data, '\n',
+						last_byte + 1 - data);
+			bool found_nl = (nl != NULL);
+
+			if (!found_nl)
+				nl = last_byte;
+
+			if (lf->needts)
+				queue_bytes(lf, ts, tslen);
+			queue_bytes(lf, data, nl + 1 - data);
+
+			lf->needts = found_nl;
+			data = nl + 1;
+			if (found_nl) {
+				/* If we queued a newline, strip all \r following it */
+				while (data <= last_byte && *data == '\r')
+					data++;
+			}
+		}
+	}
+
+	queue_logfile(lf);
+
+	pthread_mutex_unlock(&log_lock);
+}
+
+static int open_log(const char *path)
+{
+	int fd = open(path, O_WRONLY|O_CREAT|O_APPEND|O_CLOEXEC, 0644);
+
+	if (fd == -1)
+		dolog(LOG_ERR, "Failed to open log %s: %d (%s)",
+		      path, errno, strerror(errno));
+
+	return fd;
+}
+
+struct logfile *logfile_open(const char *path, int domid, bool timestamps)
+{
+	struct logfile *lf;
+	int fd = open_log(path);
+
+	if (fd == -1)
+		return NULL;
+
+	lf = calloc(1, sizeof(*lf));
+	if (lf == NULL || (lf->path = strdup(path)) == NULL) {
+		dolog(LOG_ERR, "Memory allocation failed");
+		exit(ENOMEM);
+	}
+
+	lf->fd = fd;
+	lf->domid = domid;
+	lf->timestamps = timestamps;
+	lf->needts = true;
+
+	pthread_mutex_lock(&log_lock);
+	lf->all_next = log_all;
+	log_all = lf;
+	pthread_mutex_unlock(&log_lock);
+
+	if (timestamps)
+		logfile_append(lf, "Logfile Opened\n", strlen("Logfile Opened\n"));
+
+	return lf;
+}
+
+void logfile_close(struct logfile *lf)
+{
+	if (!lf)
+		return;
+
+	pthread_mutex_lock(&log_lock);
+	lf->closing = true;
+	queue_logfile(lf);
+	pthread_mutex_unlock(&log_lock);
+}
+
+void logfile_reopen(struct logfile *lf, const char *path)
+{
+	char *p;
+
+	if (!lf)
+		return;
+
+	p = strdup(path);
+	if (p == NULL) {
+		dolog(LOG_ERR, "Memory allocation failed");
+		exit(ENOMEM);
+	}
+
+	pthread_mutex_lock(&log_lock);
+	free(lf->new_path);
+	lf->new_path = p;
+	queue_logfile(lf);
+	pthread_mutex_unlock(&log_lock);
+}
+
+/*
+ * Write out a detached list of chunks, coalescing up to LOG_IOV_MAX of them
+ * into each writev() call.  Returns the number of bytes consumed.
+ */
+static size_t write_chunks(struct logfile *lf, struct log_chunk *c)
+{
+	struct iovec iov[LOG_IOV_MAX];
+	unsigned long long written = 0, writes = 0, slowest = 0;
+	size_t consumed = 0;
+	char owner[32];
+	bool failed = lf->fd == -1;
+
+	while (c) {
+		struct iovec *v = iov;
+		unsigned int nr = 0;
+		struct log_chunk *next;
+
+		for (next = c; next && nr < LOG_IOV_MAX; next = next->next) {
+			iov[nr].iov_base = next->data;
+			iov[nr].iov_len = next->len;
+			consumed += next->len;
+			nr++;
+		}
+
+		while (!failed && nr) {
+			struct timespec t0, t1;
+			unsigned long long us;
+			ssize_t ret;
+
+			clock_gettime(CLOCK_MONOTONIC, &t0);
+			ret = writev(lf->fd, v, nr);
+			clock_gettime(CLOCK_MONOTONIC, &t1);
+
+			if (ret == -1 && errno == EINTR)
+				continue;
+			if (ret <= 0) {
+				dolog(LOG_ERR, "Write to log %s failed "
+				      "on %s: %d (%s)", lf->path,
+				      log_owner(lf, owner, sizeof(owner)),
+				      errno, strerror(errno));
+				failed = true;
+				break;
+			}
+
+			us = (t1.tv_sec - t0.tv_sec) * 1000000ULL +
+			     (t1.tv_nsec - t0.tv_nsec) / 1000;
+			if (us > slowest)
+				slowest = us;
+			writes++;
+			written += ret;
+
+			/* Skip over whatever was written, for short writes. */
+			while (nr && (size_t)ret >= v->iov_len) {
+				ret -= v->iov_len;
+				v++;
+				nr--;
+			}
+			if (nr) {
+				v->iov_base = (char *)v->iov_base + ret;
+				v->iov_len -= ret;
+			}
+		}
+
+		while (c != next) {
+			struct log_chunk *n = c->next;
+
+			free(c);
+			c = n;
+		}
+	}
+
+	pthread_mutex_lock(&log_lock);
+	lf->bytes_written += written;
+	lf->bytes_dropped += consumed - written;
+	lf->nr_writes += writes;
+	if (slowest > lf->slowest_write_us)
+		lf->slowest_write_us = slowest;
+	pthread_mutex_unlock(&log_lock);
+
+	return consumed;
+}
+
+static void reopen_log(struct logfile *lf, char *path)
+{
+	char ts[32], *old_path;
+	size_t tslen;
+
+	if (lf->fd != -1)
+		close(lf->fd);
+	lf->fd = open_log(path);
+
+	pthread_mutex_lock(&log_lock);
+	old_path = lf->path;
+	lf->path = path;
+	pthread_mutex_unlock(&log_lock);
+	free(old_path);
+
+	/*
+	 * The new file always starts on a fresh line, so it can be stamped
+	 * here rather than going through the queue behind older output.
+	 */
+	if (lf->fd != -1 && lf->timestamps) {
+		struct iovec iov[2];
+
+		tslen = format_timestamp(ts, sizeof(ts));
+		iov[0].iov_base = ts;
+		iov[0].iov_len = tslen;
+		iov[1].iov_base = "Logfile Opened\n";
+		iov[1].iov_len = strlen("Logfile Opened\n");
+		if (writev(lf->fd, iov, 2) < 0)
+			dolog(LOG_ERR, "Failed to log opening timestamp "
+			      "in %s: %d (%s)", path, errno, strerror(errno));
+	}
+}
+
+static void free_logfile(struct logfile *lf)
+{
+	struct logfile **pp;
+
+	pthread_mutex_lock(&log_lock);
+	for (pp = &log_all; *pp; pp = &(*pp)->all_next) {
+		if (*pp == lf) {
+			*pp = lf->all_next;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&log_lock);
+
+	if (lf->fd != -1)
+		close(lf->fd);
+	free(lf->new_path);
+	free(lf->path);
+	free(lf);
+}
+
+static void *logfile_writer_main(void *arg)
+{
+	pthread_mutex_lock(&log_lock);
+
+	for (;;) {
+		struct logfile *lf;
+		struct log_chunk *chunks;
+		char *new_path, owner[32];
+		bool closing;
+		size_t done;
+
+		while (!log_queue_head && !log_stopping)
+			pthread_cond_wait(&log_cond, &log_lock);
+
+		lf = log_queue_head;
+		if (!lf)
+			break;
+
+		log_queue_head = lf->queue_next;
+		if (!log_queue_head)
+			log_queue_tail = &log_queue_head;
+
+		/*
+		 * Take everything queued so far in one go.  Data appended from
+		 * here on requeues the file and is picked up next time round.
+		 */
+		lf->queued = false;
+		chunks = lf->head;
+		lf->head = lf->tail = NULL;
+		new_path = lf->new_path;
+		lf->new_path = NULL;
+		closing = lf->closing;
+
+		pthread_mutex_unlock(&log_lock);
+
+		/* Anything queued before a rotation belongs in the old file. */
+		done = write_chunks(lf, chunks);
+
+		if (new_path)
+			reopen_log(lf, new_path);
+
+		pthread_mutex_lock(&log_lock);
+		lf->backlog -= done;
+		if (lf->dropping && !lf->backlog) {
+			dolog(LOG_WARNING, "Log writer for %s (%s) caught up, "
+			      "%llu bytes were discarded",
+			      log_owner(lf, owner, sizeof(owner)), lf->path,
+			      lf->dropped_episode);
+			lf->dropping = false;
+			lf->dropped_episode = 0;
+		}
+		pthread_mutex_unlock(&log_lock);
+
+		if (closing)
+			free_logfile(lf);
+
+		pthread_mutex_lock(&log_lock);
+	}
+
+	pthread_mutex_unlock(&log_lock);
+
+	return NULL;
+}
+
+bool logfile_writer_start(void)
+{
+	sigset_t all, old;
+	int ret;
+
+	/* Leave signal handling (SIGHUP, SIGUSR1) to the main loop's poll(). */
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &old);
+	ret = pthread_create(&log_writer, NULL, logfile_writer_main, NULL);
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+	if (ret) {
+		dolog(LOG_ERR, "Failed to start log writer thread: %d (%s)",
+		      ret, strerror(ret));
+		return false;
+	}
+
+	log_writer_running = true;
+	return true;
+}
+
+void logfile_writer_stop(void)
+{
+	if (!log_writer_running)
+		return;
+
+	pthread_mutex_lock(&log_lock);
+	log_stopping = true;
+	pthread_cond_signal(&log_cond);
+	pthread_mutex_unlock(&log_lock);
+
+	pthread_join(log_writer, NULL);
+	log_writer_running = false;
+}
+
+void logfile_dump_stats(void)
+{
+	struct logfile *lf;
+	char owner[32];
+
+	pthread_mutex_lock(&log_lock);
+	for (lf = log_all; lf; lf = lf->all_next)
+		dolog(LOG_NOTICE, "Log %s (%s): %llu bytes in %llu writes, "
+		      "%llu bytes dropped, backlog %zu (peak %zu), "
+		      "slowest write %lluus",
+		      lf->path, log_owner(lf, owner, sizeof(owner)),
+		      lf->bytes_written, lf->nr_writes, lf->bytes_dropped,
+		      lf->backlog, lf->peak_backlog, lf->slowest_write_us);
+	pthread_mutex_unlock(&log_lock);
+}
+
+/*
+ * Local variables:
+ *  mode: C
+ *  c-file-style: "linux"
+ *  indent-tabs-mode: t
+ *  c-basic-offset: 8
+ *  tab-width: 8
+ * End:
+ */
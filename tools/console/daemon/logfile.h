@@ -0,0 +1,65 @@
+/*
+ *  Xen Console Daemon - asynchronous log writer
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; under version 2 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CONSOLED_LOGFILE_H
+#define CONSOLED_LOGFILE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * Console output destined for log files is queued by the main loop into
+ * per-file coalescing buffers and written out by a dedicated writer
+ * thread, so that a slow log disk or a chatty guest cannot stall the
+ * servicing of other console rings.
+ *
+ * A struct logfile is owned by the main loop between logfile_open() and
+ * logfile_close(); after logfile_close() it must not be touched again, the
+ * writer thread flushes any pending data and frees it.
+ */
+struct logfile;
+
+bool logfile_writer_start(void);
+void logfile_writer_stop(void);
+
+/* domid is only used for diagnostics, pass -1 for the hypervisor log. */
+struct logfile *logfile_open(const char *path, int domid, bool timestamps);
+void logfile_close(struct logfile *lf);
+
+/* Queue data for writing.  Never blocks on file I/O. */
+void logfile_append(struct logfile *lf, const char *data, size_t len);
+
+/*
+ * Switch to a (possibly different) path, e.g. after the log files have been
+ * rotated.  The old file is flushed and closed and the new one opened by the
+ * writer thread.
+ */
+void logfile_reopen(struct logfile *lf, const char *path);
+
+/* Report per log file backpressure statistics via syslog. */
+void logfile_dump_stats(void);
+
+#endif
+
+/*
+ * Local variables:
+ *  mode: C
+ *  c-file-style: "linux"
+ *  indent-tabs-mode: t
+ *  c-basic-offset: 8
+ *  tab-width: 8
+ * End:
+ */
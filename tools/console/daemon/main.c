@@ -33,6 +33,7 @@
 #include "io.h"
 
 int log_reload = 0;
+int log_stats = 0;
 int log_guest = 0;
 int log_hv = 0;
 int log_time_hv = 0;
@@ -46,10 +47,16 @@ static void handle_hup(int sig)
         log_reload = 1;
 }
 
+static void handle_usr1(int sig)
+{
+	log_stats = 1;
+}
+
 static void usage(char *name)
 {
 	printf("Usage: %s [-h] [-V] [-v] [-i] [--log=none|guest|hv|all] [--log-dir=DIR] [--pid-file=PATH] [-t, --timestamp=none|guest|hv|all] [-o, --overflow-data=discard|keep] [--replace-escape]\n", name);
 	printf("  --replace-escape  - replace ESC character with dot when writing console log\n");
+	printf("Send SIGHUP to reopen the log files, SIGUSR1 to report log writer statistics.\n");
 }
 
 static void version(char *name)
@@ -111,8 +118,8 @@ int main(int argc, char **argv)
 	bool is_interactive = false;
 	int ch;
 	int syslog_option = LOG_CONS;
-	int syslog_mask = LOG_MASK(LOG_WARNING)|LOG_MASK(LOG_ERR)|LOG_MASK(LOG_CRIT)|\
-		          LOG_MASK(LOG_ALERT)|LOG_MASK(LOG_EMERG);
+	int syslog_mask = LOG_MASK(LOG_NOTICE)|LOG_MASK(LOG_WARNING)|LOG_MASK(LOG_ERR)|\
+		          LOG_MASK(LOG_CRIT)|LOG_MASK(LOG_ALERT)|LOG_MASK(LOG_EMERG);
 	int opt_ind = 0;
 	char *pidfile = NULL;
 
@@ -128,8 +135,7 @@ int main(int argc, char **argv)
 #ifndef __sun__
 			syslog_option |= LOG_PERROR;
 #endif
-			syslog_mask |= LOG_MASK(LOG_NOTICE)|LOG_MASK(LOG_INFO)| \
-				      LOG_MASK(LOG_DEBUG);
+			syslog_mask |= LOG_MASK(LOG_INFO)|LOG_MASK(LOG_DEBUG);
 			break;
 		case 'i':
 			is_interactive = true;
@@ -191,6 +197,7 @@ int main(int argc, char **argv)
 	}
 
 	signal(SIGHUP, handle_hup);
+	signal(SIGUSR1, handle_usr1);
 
 	openlog("xenconsoled", syslog_option, LOG_DAEMON);
 	setlogmask(syslog_mask);
@@ -735,6 +735,14 @@ x.StreamVersion = uint32(xc.stream_version)
 x.ColoProxyScript = C.GoString(xc.colo_proxy_script)
 if err := x.UserspaceColoProxy.fromC(&xc.userspace_colo_proxy);err != nil {
 return fmt.Errorf("converting field UserspaceColoProxy: %v", err)
+}
+x.AuxFds = nil
+if n := int(xc.num_aux_fds); n > 0 {
+cAuxFds := (*[1<<28]C.int)(unsafe.Pointer(xc.aux_fds))[:n:n]
+x.AuxFds = make([]int, n)
+for i, v := range cAuxFds {
+x.AuxFds[i] = int(v)
+}
 }
 
  return nil}
@@ -751,6 +759,47 @@ xc.colo_proxy_script = C.CString(x.ColoProxyScript)}
 if err := x.UserspaceColoProxy.toC(&xc.userspace_colo_proxy); err != nil {
 return fmt.Errorf("converting field UserspaceColoProxy: %v", err)
 }
+if numAuxFds := len(x.AuxFds); numAuxFds > 0 {
+xc.aux_fds = (*C.int)(C.malloc(C.size_t(numAuxFds*numAuxFds)))
+xc.num_aux_fds = C.int(numAuxFds)
+cAuxFds := (*[1<<28]C.int)(unsafe.Pointer(xc.aux_fds))[:numAuxFds:numAuxFds]
+for i,v := range x.AuxFds {
+cAuxFds[i] = C.int(v)
+}
+}
+
+ return nil
+ }
+
+// NewDomainPrecopyParams returns an instance of DomainPrecopyParams initialized with defaults.
+func NewDomainPrecopyParams() (*DomainPrecopyParams, error) {
+var (
+x DomainPrecopyParams
+xc C.libxl_domain_precopy_params)
+
+C.libxl_domain_precopy_params_init(&xc)
+defer C.libxl_domain_precopy_params_dispose(&xc)
+
+if err := x.fromC(&xc); err != nil {
+return nil, err }
+
+return &x, nil}
+
+func (x *DomainPrecopyParams) fromC(xc *C.libxl_domain_precopy_params) error {
+ x.MaxDowntimeMs = uint32(xc.max_downtime_ms)
+x.MaxIterations = uint32(xc.max_iterations)
+x.MaxThrottle = uint32(xc.max_throttle)
+
+ return nil}
+
+func (x *DomainPrecopyParams) toC(xc *C.libxl_domain_precopy_params) (err error){defer func(){
+if err != nil{
+C.libxl_domain_precopy_params_dispose(xc)}
+}()
+
+xc.max_downtime_ms = C.uint32_t(x.MaxDowntimeMs)
+xc.max_iterations = C.uint32_t(x.MaxIterations)
+xc.max_throttle = C.uint32_t(x.MaxThrottle)
 
  return nil
  }
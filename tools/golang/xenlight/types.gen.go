@@ -234,6 +234,7 @@ ViridianEnlightenmentHcallIpi ViridianEnlightenment = 9
 ViridianEnlightenmentExProcessorMasks ViridianEnlightenment = 10
 ViridianEnlightenmentNoVpLimit ViridianEnlightenment = 11
 ViridianEnlightenmentCpuHotplug ViridianEnlightenment = 12
+ViridianEnlightenmentHcallXmmInput ViridianEnlightenment = 13
 )
 
 type Hdtype int
@@ -450,6 +451,13 @@ CheckpointedStream int
 StreamVersion uint32
 ColoProxyScript string
 UserspaceColoProxy Defbool
+AuxFds []int
+}
+
+type DomainPrecopyParams struct {
+MaxDowntimeMs uint32
+MaxIterations uint32
+MaxThrottle uint32
 }
 
 type SchedParams struct {
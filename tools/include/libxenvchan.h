@@ -91,6 +91,12 @@ struct libxenvchan {
 	 * during cleanup.
 	 * */
 	char *xs_path;
+	/* Grant list pages of rings larger than 1MB, server only */
+	void *read_grant_list, *write_grant_list;
+	/* see libxenvchan_set_notify_threshold() */
+	size_t notify_threshold;
+	/* bytes written/consumed since the peer was last notified */
+	size_t unsignalled_write, unsignalled_read;
 };
 
 /**
@@ -179,3 +185,60 @@ int libxenvchan_is_open(struct libxenvchan* ctrl);
 int libxenvchan_data_ready(struct libxenvchan *ctrl);
 /** Amount of data it is possible to send without blocking */
 int libxenvchan_buffer_space(struct libxenvchan *ctrl);
+
+/*
+ * Zero-copy access to the rings.
+ *
+ * The acquire functions return a pointer to, and the length of, the
+ * contiguous region of the ring that can currently be read or written.
+ * Because the ring wraps, this may be less than libxenvchan_data_ready()
+ * or libxenvchan_buffer_space(); once it has been committed, acquiring
+ * again returns the remainder.  At most one region per direction may be
+ * outstanding, and the ring must not be accessed by other means between
+ * acquire and commit.
+ */
+/**
+ * Get the contiguous region of data ready to be read.
+ * @param ctrl The vchan control structure
+ * @param data Set to the start of the region
+ * @return -1 on error, 0 if nonblocking and no data is available, or the
+ *         size of the region (blocking vchans wait for data)
+ */
+int libxenvchan_read_acquire(struct libxenvchan *ctrl, const void **data);
+/**
+ * Consume size bytes at the start of the region returned by
+ * libxenvchan_read_acquire().
+ * @return -1 on error, 0 on success
+ */
+int libxenvchan_read_commit(struct libxenvchan *ctrl, size_t size);
+/**
+ * Get the contiguous region of the ring available for writing.
+ * @param ctrl The vchan control structure
+ * @param data Set to the start of the region
+ * @return -1 on error, 0 if nonblocking and no space is available, or the
+ *         size of the region (blocking vchans wait for space)
+ */
+int libxenvchan_write_acquire(struct libxenvchan *ctrl, void **data);
+/**
+ * Publish size bytes written to the start of the region returned by
+ * libxenvchan_write_acquire().
+ * @return -1 on error, 0 on success
+ */
+int libxenvchan_write_commit(struct libxenvchan *ctrl, size_t size);
+
+/**
+ * Batch event channel notifications: the peer is only notified once at
+ * least threshold bytes have been written (or consumed) since it was last
+ * notified, or when the ring becomes full (or empty).  The default of 0
+ * notifies on every operation.
+ *
+ * libxenvchan_wait() flushes pending notifications before blocking; callers
+ * which wait by other means (e.g. libxenvchan_fd_for_select()) must call
+ * libxenvchan_notify_flush() first, or the peer may never be woken.
+ */
+void libxenvchan_set_notify_threshold(struct libxenvchan *ctrl, size_t threshold);
+/**
+ * Send any notifications held back by the notify threshold.
+ * @return -1 on error, 0 on success
+ */
+int libxenvchan_notify_flush(struct libxenvchan *ctrl);
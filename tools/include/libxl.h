@@ -376,6 +376,12 @@
  */
 #define LIBXL_HAVE_VIRIDIAN_HCALL_IPI 1
 
+/*
+ * LIBXL_HAVE_VIRIDIAN_HCALL_XMM_INPUT indicates that the 'hcall_xmm_input'
+ * value is present in the viridian enlightenment enumeration.
+ */
+#define LIBXL_HAVE_VIRIDIAN_HCALL_XMM_INPUT 1
+
 /*
  * LIBXL_HAVE_BUILDINFO_HVM_ACPI_LAPTOP_SLATE indicates that
  * libxl_domain_build_info has the u.hvm.acpi_laptop_slate field.
@@ -647,6 +653,21 @@
  */
 #define LIBXL_HAVE_DT_OVERLAY_DOMAIN 1
 
+/*
+ * LIBXL_HAVE_DOMAIN_SUSPEND_STREAMS indicates the presence of
+ * libxl_domain_suspend_streams(), and of the aux_fds field in
+ * libxl_domain_restore_params, to stripe the guest's memory across
+ * auxiliary file descriptors during a save or migration.
+ */
+#define LIBXL_HAVE_DOMAIN_SUSPEND_STREAMS 1
+
+/*
+ * LIBXL_HAVE_DOMAIN_PRECOPY_PARAMS indicates that
+ * libxl_domain_suspend_streams() takes a libxl_domain_precopy_params, to
+ * bound the downtime of a live migration and throttle the guest to reach it.
+ */
+#define LIBXL_HAVE_DOMAIN_PRECOPY_PARAMS 1
+
 /*
  * libxl memory management
  *
@@ -1863,6 +1884,28 @@ int libxl_domain_suspend(libxl_ctx *ctx, uint32_t domid, int fd,
 #define LIBXL_SUSPEND_DEBUG 1
 #define LIBXL_SUSPEND_LIVE 2
 
+/*
+ * As libxl_domain_suspend(), but with the guest's memory striped across
+ * num_aux_fds auxiliary file descriptors, which are written to in parallel.
+ * They must be in blocking mode, and numbered above 2.  The stream must be
+ * restored by libxl_domain_create_restore() with as many fds in the aux_fds
+ * field of libxl_domain_restore_params, which is only valid for a
+ * non-checkpointed stream of version 2.
+ *
+ * With LIBXL_SUSPEND_LIVE, precopy, if not NULL, tunes when the live phase
+ * ends: once the downtime predicted from the guest's dirty rate and the
+ * bandwidth achieved is at most max_downtime_ms, or after max_iterations.
+ * A guest dirtying its memory too fast is throttled, with a credit2 cap of
+ * up to max_throttle percent (below 100) of its cpu time.  Zero fields keep
+ * the defaults, and no throttling.
+ */
+int libxl_domain_suspend_streams(libxl_ctx *ctx, uint32_t domid, int fd,
+                                 const int *aux_fds, int num_aux_fds,
+                                 const libxl_domain_precopy_params *precopy,
+                                 int flags, /* LIBXL_SUSPEND_* */
+                                 const libxl_asyncop_how *ao_how)
+                                 LIBXL_EXTERNAL_CALLERS_ONLY;
+
 /*
  * Only suspend domain, do not save its state to file, do not destroy it.
  * Suspended domain can be resumed with libxl_domain_resume()
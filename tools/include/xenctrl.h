@@ -852,6 +852,18 @@ long long xc_logdirty_control(xc_interface *xch,
                               unsigned long pages,
                               unsigned int mode,
                               xc_shadow_op_stats_t *stats);
+/*
+ * Move up to nr pfns off the domain's dirty ring (enabled with
+ * XEN_DOMCTL_SHADOW_OP_DIRTY_RING_ENABLE) into pfns, an array of uint64_t.
+ * Returns the number of pfns written, or -1 with errno set.  *overflow is
+ * set if the ring has dropped pfns, in which case the remaining dirty pages
+ * must be collected with XEN_DOMCTL_SHADOW_OP_CLEAN.
+ */
+long long xc_logdirty_ring_harvest(xc_interface *xch,
+                                   uint32_t domid,
+                                   xc_hypercall_buffer_t *pfns,
+                                   unsigned long nr,
+                                   bool *overflow);
 
 int xc_get_paging_mempool_size(xc_interface *xch, uint32_t domid, uint64_t *size);
 int xc_set_paging_mempool_size(xc_interface *xch, uint32_t domid, uint64_t size);
@@ -1381,6 +1393,19 @@ int xc_perfc_query(xc_interface *xch,
                    xc_hypercall_buffer_t *desc,
                    xc_hypercall_buffer_t *val);
 
+typedef xen_sysctl_perfc_sel_t xc_perfc_sel_t;
+/*
+ * Sample the per CPU values of the nr_sel counters in sel into val, which
+ * must hold nr_sel * *nr_cpus values.  On return *nr_cpus is the number of
+ * CPU columns Xen can provide, which nr_sel == 0 can be used to query.
+ */
+int xc_perfc_sample(xc_interface *xch,
+                    xc_hypercall_buffer_t *sel,
+                    uint32_t nr_sel,
+                    xc_hypercall_buffer_t *val,
+                    uint32_t *nr_cpus,
+                    uint64_t *now);
+
 typedef xen_sysctl_lockprof_data_t xc_lockprof_data_t;
 int xc_lockprof_reset(xc_interface *xch);
 int xc_lockprof_query_number(xc_interface *xch,
@@ -1390,6 +1415,21 @@ int xc_lockprof_query(xc_interface *xch,
                       uint64_t *time,
                       xc_hypercall_buffer_t *data);
 
+/*
+ * Per call site and per CPU lock profile information.  On entry *n_elems is
+ * the number of elements the buffer has room for; on return the number
+ * available, which may be larger.  Pass a NULL buffer to query the number.
+ */
+typedef xen_sysctl_lockprof_site_t xc_lockprof_site_t;
+typedef xen_sysctl_lockprof_cpu_t xc_lockprof_cpu_t;
+int xc_lockprof_query_sites(xc_interface *xch,
+                            uint32_t *n_elems,
+                            uint64_t *time,
+                            xc_lockprof_site_t *sites);
+int xc_lockprof_query_cpus(xc_interface *xch,
+                           uint32_t *n_elems,
+                           xc_lockprof_cpu_t *cpus);
+
 void *xc_memalign(xc_interface *xch, size_t alignment, size_t size);
 
 /**
@@ -2074,6 +2114,16 @@ int xc_vm_event_get_version(xc_interface *xch);
  * Caller has to unmap this page when done.
  */
 void *xc_monitor_enable(xc_interface *xch, uint32_t domain_id, uint32_t *port);
+/*
+ * As xc_monitor_enable(), but Xen allocates a ring of nr_frames pages (a
+ * power of two, at most XEN_VM_EVENT_RING_MAX_FRAMES) rather than using the
+ * guest's ring page.  The caller maps it with xenforeignmemory_map_resource()
+ * (XENMEM_resource_vm_event, id XEN_DOMCTL_VM_EVENT_OP_MONITOR).  The ring
+ * is already initialised, and uses the notification protocol described
+ * alongside struct xen_domctl_vm_event_op.
+ */
+int xc_monitor_enable_frames(xc_interface *xch, uint32_t domain_id,
+                             unsigned int nr_frames, uint32_t *port);
 int xc_monitor_disable(xc_interface *xch, uint32_t domain_id);
 int xc_monitor_resume(xc_interface *xch, uint32_t domain_id);
 /*
@@ -2297,6 +2347,21 @@ int xc_memshr_range_share(xc_interface *xch,
                           uint64_t first_gfn,
                           uint64_t last_gfn);
 
+/* Shares each pair of pages in entries between the source and client
+ * domains, provided their contents are identical once both have been
+ * nominated.  The domains need not be paused.  The outcome for each pair is
+ * left in its rc field: 0 if shared, -EAGAIN if the contents differed, or
+ * the error xc_memshr_nominate_gfn/xc_memshr_share_gfns would report.
+ *
+ * Fails as a whole only on errors such as -ENOMEM, in which case later
+ * entries are left unprocessed.
+ */
+int xc_memshr_share_batch(xc_interface *xch,
+                          uint32_t source_domain,
+                          uint32_t client_domain,
+                          xen_mem_sharing_batch_entry_t *entries,
+                          uint32_t nr);
+
 int xc_memshr_fork(xc_interface *xch,
                    uint32_t source_domain,
                    uint32_t client_domain,
@@ -109,6 +109,15 @@ int xenevtchn_fd(xenevtchn_handle *xce);
  */
 int xenevtchn_notify(xenevtchn_handle *xce, evtchn_port_t port);
 
+/*
+ * Notify each of the @nr event channels in @ports, in one hypercall where
+ * the platform allows, for daemons which signal many guests at once.  All
+ * the ports are notified even if some fail. Returns -1 on failure, in which
+ * case errno will be set as for the first port which failed.
+ */
+int xenevtchn_notify_many(xenevtchn_handle *xce, const evtchn_port_t *ports,
+                          unsigned int nr);
+
 /*
  * Returns a new event port awaiting interdomain connection from the given
  * domain ID, or -1 on failure, in which case errno will be set appropriately.
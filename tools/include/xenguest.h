@@ -26,6 +26,7 @@
 
 #define XCFLAGS_LIVE      (1 << 0)
 #define XCFLAGS_DEBUG     (1 << 1)
+#define XCFLAGS_POSTCOPY  (1 << 2)
 
 #define X86_64_B_SIZE   64 
 #define X86_32_B_SIZE   32
@@ -439,6 +440,17 @@ struct precopy_stats
     unsigned int iteration;
     unsigned long total_written;
     long dirty_count; /* -1 if unknown */
+
+    /* Measured over the last iteration, once dirty_count is known. */
+    unsigned long iteration_ms;
+    unsigned long dirty_rate;  /* Pages dirtied per second. */
+    unsigned long bandwidth;   /* Pages sent per second. */
+
+    /* Predicted, to send the dirty pages with the guest suspended. */
+    unsigned long downtime_ms;
+
+    /* Share of the guest's cpu time withheld by throttling, in percent. */
+    unsigned int throttle;
 };
 
 /*
@@ -447,6 +459,34 @@ struct precopy_stats
  */
 typedef int (*precopy_policy_t)(struct precopy_stats, void *);
 
+/* Tunables of the precopy phase of a live migration. */
+struct xc_precopy_params
+{
+    /*
+     * Stop once the pages still dirty are predicted to be sent within this
+     * many milliseconds of the guest being suspended.  0 to only stop once
+     * fewer than 50 are dirty.
+     */
+    unsigned int max_downtime_ms;
+
+    /* Stop after this many iterations regardless.  0 for the default, 5. */
+    unsigned int max_iterations;
+
+    /*
+     * Throttle a guest which dirties its memory faster than half the rate it
+     * is sent at, by capping its cpu time with the credit2 scheduler, by up
+     * to this percentage.  0 not to throttle.
+     */
+    unsigned int max_throttle;
+};
+
+/*
+ * The decision of the default precopy policy, for the given params (NULL for
+ * the defaults).  For precopy_policy callbacks which build on it.
+ */
+int xc_precopy_policy(struct precopy_stats stats,
+                      const struct xc_precopy_params *params);
+
 /* callbacks provided by xc_domain_save */
 struct save_callbacks {
     /*
@@ -506,6 +546,17 @@ struct save_callbacks {
     /* Enable qemu-dm logging dirty pages to xen */
     int (*switch_qemu_logdirty)(uint32_t domid, unsigned enable, void *data); /* HVM only */
 
+    /*
+     * XCFLAGS_POSTCOPY only.  Called once all state but the guest's
+     * remaining memory is in the stream, for the caller to append any
+     * records of its own to io_fd, typically the device model state.  The
+     * remaining memory is sent once this returns.  From then on, the guest
+     * is only whole at the destination, and can't be resumed here.
+     *
+     * returns 0 on success, -1 on failure.
+     */
+    int (*postcopy_transition)(void *data);
+
     /* to be provided as the last argument to each callback function */
     void *data;
 };
@@ -526,14 +577,48 @@ typedef enum {
  * @param flags XCFLAGS_xxx
  * @param stream_type XC_STREAM_PLAIN if the far end of the stream
  *        doesn't use checkpointing
- * @param recv_fd Only used for XC_STREAM_COLO.  Contains backchannel from
- *        the destination side.
+ * @param recv_fd Only used for XC_STREAM_COLO and XCFLAGS_POSTCOPY.
+ *        Contains backchannel from the destination side.
  * @return 0 on success, -1 on failure
+ *
+ * With XCFLAGS_LIVE | XCFLAGS_POSTCOPY, for a plain stream of an HVM guest,
+ * the pages still dirty once the guest is suspended are not sent while it
+ * is suspended.  The destination pages them out of the new guest, which
+ * runs as soon as the callbacks->postcopy_transition() records are restored,
+ * while those pages are sent in the background, and on demand as the guest
+ * touches them.  This trades a shorter downtime for slower accesses to the
+ * pages left behind, and for the loss of the guest if either side fails
+ * before all of them are sent.  Paging needs CONFIG_MEM_PAGING at the
+ * destination: without it, all those pages are sent while the guest is
+ * suspended, as without XCFLAGS_POSTCOPY.
  */
 int xc_domain_save(xc_interface *xch, int io_fd, uint32_t dom,
                    uint32_t flags, struct save_callbacks *callbacks,
                    xc_stream_type_t stream_type, int recv_fd);
 
+/* The maximum number of auxiliary streams for a save or restore. */
+#define XC_MAX_AUX_STREAMS 64
+
+/**
+ * As xc_domain_save(), but with the guest's memory striped across auxiliary
+ * streams, which are written to in parallel.  All other state is still saved
+ * to io_fd.  The restore must supply as many streams, in any order, to
+ * xc_domain_restore_streams().
+ *
+ * @param aux_fds the auxiliary file descriptors, in blocking mode
+ * @param nr_aux_fds the number of auxiliary file descriptors, which must be
+ *        0 unless stream_type is XC_STREAM_PLAIN
+ * @param precopy tunables of the precopy phase, or NULL for the defaults.
+ *        max_downtime_ms and max_iterations only apply if
+ *        callbacks->precopy_policy is NULL.
+ */
+int xc_domain_save_streams(xc_interface *xch, int io_fd,
+                           const int *aux_fds, unsigned int nr_aux_fds,
+                           uint32_t dom, uint32_t flags,
+                           struct save_callbacks *callbacks,
+                           xc_stream_type_t stream_type, int recv_fd,
+                           const struct xc_precopy_params *precopy);
+
 /* callbacks provided by xc_domain_restore */
 struct restore_callbacks {
     /*
@@ -583,6 +668,17 @@ struct restore_callbacks {
     void (*restore_results)(xen_pfn_t store_gfn, xen_pfn_t console_gfn,
                             void *data);
 
+    /*
+     * Called on a POSTCOPY_TRANSITION record, after restore_results(), for
+     * the caller to restore the records which the saver appended in its
+     * postcopy_transition() callback, and to unpause the domain.  The
+     * remaining memory is then restored from io_fd, on demand first, until
+     * the end of the stream, before xc_domain_restore() returns.
+     *
+     * returns 0 on success, -1 on failure.
+     */
+    int (*postcopy_transition)(void *data);
+
     /* to be provided as the last argument to each callback function */
     void *data;
 };
@@ -605,8 +701,8 @@ struct restore_callbacks {
  *        checkpointing
  * @param callbacks non-NULL to receive a callback to restore toolstack
  *        specific data
- * @param send_back_fd Only used for XC_STREAM_COLO.  Contains backchannel to
- *        the source side.
+ * @param send_back_fd Only used for XC_STREAM_COLO, and for the post-copy
+ *        phase of a live migration.  Contains backchannel to the source side.
  * @return 0 on success, -1 on failure
  */
 int xc_domain_restore(xc_interface *xch, int io_fd, uint32_t dom,
@@ -616,6 +712,24 @@ int xc_domain_restore(xc_interface *xch, int io_fd, uint32_t dom,
                       xc_stream_type_t stream_type,
                       struct restore_callbacks *callbacks, int send_back_fd);
 
+/**
+ * As xc_domain_restore(), for a stream saved by xc_domain_save_streams().
+ *
+ * @param aux_fds the auxiliary file descriptors, in blocking mode
+ * @param nr_aux_fds the number of auxiliary file descriptors, which must
+ *        match the save, and be 0 unless stream_type is XC_STREAM_PLAIN
+ */
+int xc_domain_restore_streams(xc_interface *xch, int io_fd,
+                              const int *aux_fds, unsigned int nr_aux_fds,
+                              uint32_t dom, unsigned int store_evtchn,
+                              unsigned long *store_mfn, uint32_t store_domid,
+                              unsigned int console_evtchn,
+                              unsigned long *console_mfn,
+                              uint32_t console_domid,
+                              xc_stream_type_t stream_type,
+                              struct restore_callbacks *callbacks,
+                              int send_back_fd);
+
 /**
  * This function will create a domain for a paravirtualized Linux
  * using file names pointing to kernel and ramdisk
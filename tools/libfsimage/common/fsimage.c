@@ -24,6 +24,7 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <strings.h>
+#include <string.h>
 #include <unistd.h>
 #include <stdlib.h>
 #include <stdio.h>
@@ -36,6 +37,111 @@
 
 static pthread_mutex_t fsi_lock = PTHREAD_MUTEX_INITIALIZER;
 
+static int fsi_cache_init(fsi_t *fsi)
+{
+	int i;
+
+	fsi->f_cache = malloc(FSI_CACHE_SLOTS * sizeof(*fsi->f_cache));
+	fsi->f_cache_data = malloc((size_t)FSI_CACHE_SLOTS * FSI_CACHE_BLOCK);
+	if (fsi->f_cache == NULL || fsi->f_cache_data == NULL) {
+		free(fsi->f_cache);
+		free(fsi->f_cache_data);
+		return (-1);
+	}
+
+	for (i = 0; i < FSI_CACHE_SLOTS; i++)
+		fsi->f_cache[i].cs_blk = UINT64_MAX;
+	fsi->f_cache_next = UINT64_MAX;
+
+	return (0);
+}
+
+static void fsi_cache_free(fsi_t *fsi)
+{
+	free(fsi->f_cache);
+	free(fsi->f_cache_data);
+}
+
+/*
+ * Fill the slot of block 'blk', reading ahead into the following slots if
+ * the plugin appears to be scanning the disk sequentially.  Reads are
+ * always block aligned, which keeps raw devices happy.
+ */
+static int fsi_cache_fill(fsi_t *fsi, uint64_t blk)
+{
+	unsigned int idx = blk % FSI_CACHE_SLOTS;
+	unsigned int i, n = 1;
+	ssize_t ret;
+
+	if (blk == fsi->f_cache_next) {
+		n = FSI_CACHE_READAHEAD;
+		if (idx + n > FSI_CACHE_SLOTS)
+			n = FSI_CACHE_SLOTS - idx;
+	}
+
+	do {
+		ret = pread(fsi->f_fd, fsi->f_cache_data +
+		    (size_t)idx * FSI_CACHE_BLOCK, (size_t)n * FSI_CACHE_BLOCK,
+		    blk * FSI_CACHE_BLOCK);
+	} while (ret == -1 && errno == EINTR);
+
+	if (ret == -1)
+		return (-1);
+
+	for (i = 0; i < n; i++) {
+		fsi_cache_slot_t *slot = &fsi->f_cache[idx + i];
+
+		slot->cs_blk = blk + i;
+		if (ret >= (ssize_t)(i + 1) * FSI_CACHE_BLOCK)
+			slot->cs_len = FSI_CACHE_BLOCK;
+		else if (ret > (ssize_t)i * FSI_CACHE_BLOCK)
+			slot->cs_len = ret - (ssize_t)i * FSI_CACHE_BLOCK;
+		else
+			slot->cs_len = 0;
+	}
+
+	fsi->f_cache_next = blk + n;
+	return (0);
+}
+
+/*
+ * Read from the disk image at absolute offset 'off' through the block
+ * cache.  Returns the number of bytes read, which is short only at the end
+ * of the disk, or -1 on error.  Called with fsi_lock held.
+ */
+ssize_t fsi_disk_read(fsi_t *fsi, void *buf, size_t len, uint64_t off)
+{
+	char *p = buf;
+	size_t done = 0;
+
+	while (done < len) {
+		uint64_t blk = off / FSI_CACHE_BLOCK;
+		size_t boff = off % FSI_CACHE_BLOCK;
+		fsi_cache_slot_t *slot = &fsi->f_cache[blk % FSI_CACHE_SLOTS];
+		size_t n;
+
+		if (slot->cs_blk != blk && fsi_cache_fill(fsi, blk) == -1)
+			return (-1);
+
+		if (slot->cs_len <= boff)
+			break;
+
+		n = slot->cs_len - boff;
+		if (n > len - done)
+			n = len - done;
+
+		memcpy(p + done, fsi->f_cache_data +
+		    (size_t)(blk % FSI_CACHE_SLOTS) * FSI_CACHE_BLOCK + boff, n);
+		done += n;
+		off += n;
+
+		if (slot->cs_len < FSI_CACHE_BLOCK)
+			break;
+	}
+
+	return (done);
+}
+
 fsi_t *fsi_open_fsimage(const char *path, uint64_t off, const char *options)
 {
 	fsi_t *fsi = NULL;
@@ -53,11 +159,19 @@ fsi_t *fsi_open_fsimage(const char *path, uint64_t off, const char *options)
 	fsi->f_data = NULL;
 	fsi->f_bootstring = NULL;
 
+	if (fsi_cache_init(fsi) != 0) {
+		free(fsi);
+		fsi = NULL;
+		goto fail;
+	}
+
 	pthread_mutex_lock(&fsi_lock);
 	err = find_plugin(fsi, path, options);
 	pthread_mutex_unlock(&fsi_lock);
-	if (err != 0)
+	if (err != 0) {
+		fsi_cache_free(fsi);
 		goto fail;
+	}
 
 	return (fsi);
 
@@ -75,6 +189,7 @@ void fsi_close_fsimage(fsi_t *fsi)
 	pthread_mutex_lock(&fsi_lock);
         fsi->f_plugin->fp_ops->fpo_umount(fsi);
         (void) close(fsi->f_fd);
+	fsi_cache_free(fsi);
 	free(fsi);
 	pthread_mutex_unlock(&fsi_lock);
 }
@@ -41,12 +41,30 @@ struct fsi_plugin {
 	void *fp_data;
 };
 
+/*
+ * Disk blocks read by the plugins are cached in FSI_CACHE_SLOTS slots of
+ * FSI_CACHE_BLOCK bytes, direct mapped by block number.  A miss on the
+ * block following the previous miss is taken to be a sequential scan, and
+ * up to FSI_CACHE_READAHEAD blocks are read with a single pread().
+ */
+#define	FSI_CACHE_BLOCK		(64 * 1024)
+#define	FSI_CACHE_SLOTS		256
+#define	FSI_CACHE_READAHEAD	8
+
+typedef struct fsi_cache_slot {
+	uint64_t cs_blk;
+	size_t cs_len;
+} fsi_cache_slot_t;
+
 struct fsi {
 	int f_fd;
 	uint64_t f_off;
 	void *f_data;
 	fsi_plugin_t *f_plugin;
 	char *f_bootstring;
+	fsi_cache_slot_t *f_cache;
+	char *f_cache_data;
+	uint64_t f_cache_next;
 };
 
 struct fsi_file {
@@ -55,6 +73,7 @@ struct fsi_file {
 };
 
 int find_plugin(fsi_t *, const char *, const char *);
+ssize_t fsi_disk_read(fsi_t *, void *, size_t, uint64_t);
 
 #ifdef __cplusplus
 };
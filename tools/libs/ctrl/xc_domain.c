@@ -657,6 +657,36 @@ long long xc_logdirty_control(xc_interface *xch,
     return (rc == 0) ? domctl.u.shadow_op.pages : rc;
 }
 
+long long xc_logdirty_ring_harvest(xc_interface *xch,
+                                   uint32_t domid,
+                                   xc_hypercall_buffer_t *pfns,
+                                   unsigned long nr,
+                                   bool *overflow)
+{
+    int rc;
+    struct xen_domctl domctl = {
+        .cmd         = XEN_DOMCTL_shadow_op,
+        .domain      = domid,
+        .u.shadow_op = {
+            .op    = XEN_DOMCTL_SHADOW_OP_DIRTY_RING_HARVEST,
+            .pages = nr,
+        }
+    };
+    DECLARE_HYPERCALL_BUFFER_ARGUMENT(pfns);
+
+    set_xen_guest_handle(domctl.u.shadow_op.dirty_bitmap, pfns);
+
+    rc = do_domctl(xch, &domctl);
+    if ( rc )
+        return rc;
+
+    if ( overflow )
+        *overflow = domctl.u.shadow_op.mode &
+                    XEN_DOMCTL_SHADOW_DIRTY_RING_OVERFLOW;
+
+    return domctl.u.shadow_op.pages;
+}
+
 int xc_get_paging_mempool_size(xc_interface *xch, uint32_t domid, uint64_t *size)
 {
     int rc;
@@ -202,6 +202,38 @@ int xc_memshr_range_share(xc_interface *xch,
     return xc_memshr_memop(xch, source_domain, &mso);
 }
 
+int xc_memshr_share_batch(xc_interface *xch,
+                          uint32_t source_domain,
+                          uint32_t client_domain,
+                          xen_mem_sharing_batch_entry_t *entries,
+                          uint32_t nr)
+{
+    xen_mem_sharing_op_t mso;
+    int rc;
+    DECLARE_HYPERCALL_BOUNCE(entries, nr * sizeof(*entries),
+                             XC_HYPERCALL_BUFFER_BOUNCE_BOTH);
+
+    if ( xc_hypercall_bounce_pre(xch, entries) )
+    {
+        PERROR("Could not bounce memory for XENMEM_sharing_op_share_batch");
+        return -1;
+    }
+
+    memset(&mso, 0, sizeof(mso));
+
+    mso.op = XENMEM_sharing_op_share_batch;
+
+    mso.u.batch.client_domain = client_domain;
+    mso.u.batch.nr = nr;
+    set_xen_guest_handle(mso.u.batch.entries, entries);
+
+    rc = xc_memshr_memop(xch, source_domain, &mso);
+
+    xc_hypercall_bounce_post(xch, entries);
+
+    return rc;
+}
+
 int xc_memshr_domain_resume(xc_interface *xch,
                             uint32_t domid)
 {
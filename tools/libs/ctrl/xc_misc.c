@@ -501,6 +501,35 @@ int xc_perfc_query(xc_interface *xch,
     return do_sysctl(xch, &sysctl);
 }
 
+int xc_perfc_sample(xc_interface *xch,
+                    struct xc_hypercall_buffer *sel,
+                    uint32_t nr_sel,
+                    struct xc_hypercall_buffer *val,
+                    uint32_t *nr_cpus,
+                    uint64_t *now)
+{
+    int rc;
+    struct xen_sysctl sysctl = {};
+    DECLARE_HYPERCALL_BUFFER_ARGUMENT(sel);
+    DECLARE_HYPERCALL_BUFFER_ARGUMENT(val);
+
+    sysctl.cmd = XEN_SYSCTL_perfc_op;
+    sysctl.u.perfc_op.cmd = XEN_SYSCTL_PERFCOP_sample;
+    set_xen_guest_handle(sysctl.u.perfc_op.desc, HYPERCALL_BUFFER_NULL);
+    set_xen_guest_handle(sysctl.u.perfc_op.val, val);
+    set_xen_guest_handle(sysctl.u.perfc_op.sel, sel);
+    sysctl.u.perfc_op.nr_sel = nr_sel;
+    sysctl.u.perfc_op.nr_cpus = *nr_cpus;
+
+    rc = do_sysctl(xch, &sysctl);
+
+    *nr_cpus = sysctl.u.perfc_op.nr_cpus;
+    if ( now )
+        *now = sysctl.u.perfc_op.now;
+
+    return rc;
+}
+
 int xc_lockprof_reset(xc_interface *xch)
 {
     struct xen_sysctl sysctl = {};
@@ -546,6 +575,63 @@ int xc_lockprof_query(xc_interface *xch,
 
     rc = do_sysctl(xch, &sysctl);
 
+    *n_elems = sysctl.u.lockprof_op.nr_elem;
+    if ( time )
+        *time = sysctl.u.lockprof_op.time;
+
+    return rc;
+}
+
+int xc_lockprof_query_sites(xc_interface *xch,
+                            uint32_t *n_elems,
+                            uint64_t *time,
+                            xc_lockprof_site_t *sites)
+{
+    int rc;
+    struct xen_sysctl sysctl = {};
+    DECLARE_HYPERCALL_BOUNCE(sites, *n_elems * sizeof(*sites),
+                             XC_HYPERCALL_BUFFER_BOUNCE_OUT);
+
+    if ( xc_hypercall_bounce_pre(xch, sites) )
+        return -1;
+
+    sysctl.cmd = XEN_SYSCTL_lockprof_op;
+    sysctl.u.lockprof_op.cmd = XEN_SYSCTL_LOCKPROF_query_sites;
+    sysctl.u.lockprof_op.max_elem = sites ? *n_elems : 0;
+    set_xen_guest_handle(sysctl.u.lockprof_op.sites, sites);
+
+    rc = do_sysctl(xch, &sysctl);
+
+    xc_hypercall_bounce_post(xch, sites);
+
+    *n_elems = sysctl.u.lockprof_op.nr_elem;
+    if ( time )
+        *time = sysctl.u.lockprof_op.time;
+
+    return rc;
+}
+
+int xc_lockprof_query_cpus(xc_interface *xch,
+                           uint32_t *n_elems,
+                           xc_lockprof_cpu_t *cpus)
+{
+    int rc;
+    struct xen_sysctl sysctl = {};
+    DECLARE_HYPERCALL_BOUNCE(cpus, *n_elems * sizeof(*cpus),
+                             XC_HYPERCALL_BUFFER_BOUNCE_OUT);
+
+    if ( xc_hypercall_bounce_pre(xch, cpus) )
+        return -1;
+
+    sysctl.cmd = XEN_SYSCTL_lockprof_op;
+    sysctl.u.lockprof_op.cmd = XEN_SYSCTL_LOCKPROF_query_cpus;
+    sysctl.u.lockprof_op.max_elem = cpus ? *n_elems : 0;
+    set_xen_guest_handle(sysctl.u.lockprof_op.cpus, cpus);
+
+    rc = do_sysctl(xch, &sysctl);
+
+    xc_hypercall_bounce_post(xch, cpus);
+
     *n_elems = sysctl.u.lockprof_op.nr_elem;
 
     return rc;
@@ -28,6 +28,30 @@ void *xc_monitor_enable(xc_interface *xch, uint32_t domain_id, uint32_t *port)
                               port);
 }
 
+int xc_monitor_enable_frames(xc_interface *xch, uint32_t domain_id,
+                             unsigned int nr_frames, uint32_t *port)
+{
+    struct xen_domctl domctl = {};
+    int rc;
+
+    if ( !port || !nr_frames )
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    domctl.cmd = XEN_DOMCTL_vm_event_op;
+    domctl.domain = domain_id;
+    domctl.u.vm_event_op.op = XEN_VM_EVENT_ENABLE;
+    domctl.u.vm_event_op.mode = XEN_DOMCTL_VM_EVENT_OP_MONITOR;
+    domctl.u.vm_event_op.u.enable.nr_frames = nr_frames;
+
+    rc = do_domctl(xch, &domctl);
+    if ( !rc )
+        *port = domctl.u.vm_event_op.u.enable.port;
+    return rc;
+}
+
 int xc_monitor_disable(xc_interface *xch, uint32_t domain_id)
 {
     return xc_vm_event_control(xch, domain_id,
@@ -130,6 +130,30 @@ int xenevtchn_restrict(xenevtchn_handle *xce, domid_t domid)
     return osdep_evtchn_restrict(xce, domid);
 }
 
+int xenevtchn_notify_many(xenevtchn_handle *xce, const evtchn_port_t *ports,
+                          unsigned int nr)
+{
+    unsigned int i;
+    int rc, err = 0;
+
+    rc = osdep_evtchn_notify_many(xce, ports, nr);
+    if ( rc == 0 || errno != EOPNOTSUPP )
+        return rc;
+
+    /* No batched notification available: notify the ports one by one. */
+    for ( i = 0; i < nr; i++ )
+        if ( xenevtchn_notify(xce, ports[i]) == -1 && !err )
+            err = errno;
+
+    if ( err )
+    {
+        errno = err;
+        return -1;
+    }
+
+    return 0;
+}
+
 /*
  * Local variables:
  * mode: C
@@ -32,6 +32,7 @@
 #include <fcntl.h>
 #include <stdio.h>
 #include <stdint.h>
+#include <string.h>
 #include <unistd.h>
 #include <inttypes.h>
 #include <malloc.h>
@@ -160,6 +161,44 @@ int osdep_evtchn_restrict(xenevtchn_handle *xce, domid_t domid)
     return -1;
 }
 
+int osdep_evtchn_notify_many(xenevtchn_handle *xce, const evtchn_port_t *ports,
+                             unsigned int nr)
+{
+    union {
+        struct evtchn_send_many op;
+        uint32_t raw[1 + EVTCHN_SEND_MANY_MAX];
+    } u;
+    unsigned int done, n;
+    int ret, err = 0;
+
+    for ( done = 0; done < nr; done += n )
+    {
+        n = nr - done;
+        if ( n > EVTCHN_SEND_MANY_MAX )
+            n = EVTCHN_SEND_MANY_MAX;
+        u.op.nr_ports = n;
+        memcpy(u.op.ports, &ports[done], n * sizeof(*ports));
+
+        ret = HYPERVISOR_event_channel_op(EVTCHNOP_send_many, &u.op);
+        if ( ret == -ENOSYS && !done )
+        {
+            /* Let the caller fall back to sending one by one. */
+            errno = EOPNOTSUPP;
+            return -1;
+        }
+        if ( ret < 0 && !err )
+            err = -ret;
+    }
+
+    if ( err )
+    {
+        errno = err;
+        return -1;
+    }
+
+    return 0;
+}
+
 int xenevtchn_notify(xenevtchn_handle *xce, evtchn_port_t port)
 {
     int ret;
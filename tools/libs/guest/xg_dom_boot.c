@@ -110,6 +110,7 @@ int xc_dom_boot_xen_init(struct xc_dom_image *dom, xc_interface *xch, uint32_t d
 int xc_dom_boot_mem_init(struct xc_dom_image *dom)
 {
     long rc;
+    uint64_t start = xg_clock_ms();
 
     DOMPRINTF_CALLED(dom->xch);
 
@@ -122,6 +123,8 @@ int xc_dom_boot_mem_init(struct xc_dom_image *dom)
         return rc;
     }
 
+    DOMPRINTF("%s: done in %"PRIu64"ms", __func__, xg_clock_ms() - start);
+
     return 0;
 }
 
@@ -166,6 +169,7 @@ int xc_dom_boot_image(struct xc_dom_image *dom)
 {
     xc_domaininfo_t info;
     int rc;
+    uint64_t start = xg_clock_ms();
 
     DOMPRINTF_CALLED(dom->xch);
 
@@ -206,6 +210,8 @@ int xc_dom_boot_image(struct xc_dom_image *dom)
         return rc;
     xc_dom_unmap_all(dom);
 
+    DOMPRINTF("%s: done in %"PRIu64"ms", __func__, xg_clock_ms() - start);
+
     return rc;
 }
 
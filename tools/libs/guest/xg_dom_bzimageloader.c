@@ -677,7 +677,9 @@ static int check_magic(struct xc_dom_image *dom, const void *magic, size_t len)
 static int xc_dom_probe_bzimage_kernel(struct xc_dom_image *dom)
 {
     struct setup_header *hdr;
+    struct xc_dom_kcache_key key;
     uint64_t payload_offset, payload_length;
+    void *payload;
     int ret;
 
     if ( dom->kernel_blob == NULL )
@@ -731,6 +733,11 @@ static int xc_dom_probe_bzimage_kernel(struct xc_dom_image *dom)
     dom->kernel_blob = dom->kernel_blob + payload_offset;
     dom->kernel_size = payload_length;
 
+    if ( xc_dom_kcache_lookup(dom, &key, &dom->kernel_blob, &dom->kernel_size) )
+        return elf_loader.probe(dom);
+
+    payload = dom->kernel_blob;
+
     if ( check_magic(dom, "\037\213", 2) )
     {
         ret = xc_dom_try_gunzip(dom, &dom->kernel_blob, &dom->kernel_size);
@@ -814,7 +821,11 @@ static int xc_dom_probe_bzimage_kernel(struct xc_dom_image *dom)
         return -EINVAL;
     }
 
-    return elf_loader.probe(dom);
+    ret = elf_loader.probe(dom);
+    if ( !ret && dom->kernel_blob != payload )
+        xc_dom_kcache_store(dom, &key, dom->kernel_blob, dom->kernel_size);
+
+    return ret;
 }
 
 static int xc_dom_parse_bzimage_kernel(struct xc_dom_image *dom)
@@ -33,6 +33,7 @@
 
 #define XG_NEED_UNALIGNED
 #include "xg_private.h"
+#include "xg_dom_decompress.h"
 
 /* ------------------------------------------------------------------------ */
 /* debugging                                                                */
@@ -806,6 +807,27 @@ int xc_dom_devicetree_max_size(struct xc_dom_image *dom, size_t sz)
     return 0;
 }
 
+/* Decompress a gzipped kernel, going through the kernel cache if enabled. */
+static int xc_dom_kernel_gunzip(struct xc_dom_image *dom)
+{
+    struct xc_dom_kcache_key key;
+    void *blob = dom->kernel_blob;
+
+    if ( !xc_dom_check_gzip(dom->xch, dom->kernel_blob, dom->kernel_size) )
+        return 0;
+
+    if ( xc_dom_kcache_lookup(dom, &key, &dom->kernel_blob, &dom->kernel_size) )
+        return 0;
+
+    if ( xc_dom_try_gunzip(dom, &dom->kernel_blob, &dom->kernel_size) )
+        return -1;
+
+    if ( dom->kernel_blob != blob )
+        xc_dom_kcache_store(dom, &key, dom->kernel_blob, dom->kernel_size);
+
+    return 0;
+}
+
 int xc_dom_kernel_file(struct xc_dom_image *dom, const char *filename)
 {
     DOMPRINTF("%s: filename=\"%s\"", __FUNCTION__, filename);
@@ -813,7 +835,7 @@ int xc_dom_kernel_file(struct xc_dom_image *dom, const char *filename)
                                              dom->max_kernel_size);
     if ( dom->kernel_blob == NULL )
         return -1;
-    return xc_dom_try_gunzip(dom, &dom->kernel_blob, &dom->kernel_size);
+    return xc_dom_kernel_gunzip(dom);
 }
 
 int xc_dom_module_file(struct xc_dom_image *dom, const char *filename, const char *cmdline)
@@ -865,7 +887,7 @@ int xc_dom_kernel_mem(struct xc_dom_image *dom, const void *mem, size_t memsize)
     DOMPRINTF_CALLED(dom->xch);
     dom->kernel_blob = (void *)mem;
     dom->kernel_size = memsize;
-    return xc_dom_try_gunzip(dom, &dom->kernel_blob, &dom->kernel_size);
+    return xc_dom_kernel_gunzip(dom);
 }
 
 int xc_dom_module_mem(struct xc_dom_image *dom, const void *mem,
@@ -1114,6 +1136,7 @@ int xc_dom_build_image(struct xc_dom_image *dom)
     unsigned int page_size;
     bool unmapped_initrd;
     unsigned int mod;
+    uint64_t start = xg_clock_ms();
 
     DOMPRINTF_CALLED(dom->xch);
 
@@ -1237,6 +1260,8 @@ int xc_dom_build_image(struct xc_dom_image *dom)
         dom->p2m_seg.vstart = dom->parms->p2m_base;
     }
 
+    DOMPRINTF("%s: done in %"PRIu64"ms", __func__, xg_clock_ms() - start);
+
     return 0;
 
  err:
@@ -4,3 +4,43 @@
 
 int xc_try_lz4_decode(struct xc_dom_image *dom, void **blob, size_t *size);
 
+
+/*
+ * Cache of decompressed kernel images, see xg_dom_kcache.c.  Not
+ * available in stub domains, which have no persistent storage.
+ */
+#define XC_DOM_KCACHE_DIGEST_LEN 32
+
+struct xc_dom_kcache_key {
+    bool valid;
+    uint8_t digest[XC_DOM_KCACHE_DIGEST_LEN];
+    size_t size;
+    uint64_t start;
+};
+
+#ifndef __MINIOS__
+/*
+ * Look up the decompressed form of *blob.  Returns 1 and replaces
+ * *blob and *size with a mapping of the cached image on a hit, 0 otherwise.
+ */
+int xc_dom_kcache_lookup(struct xc_dom_image *dom,
+                         struct xc_dom_kcache_key *key,
+                         void **blob, size_t *size);
+/* Store the decompressed image after a miss from xc_dom_kcache_lookup(). */
+void xc_dom_kcache_store(struct xc_dom_image *dom,
+                         const struct xc_dom_kcache_key *key,
+                         const void *blob, size_t size);
+#else
+static inline int xc_dom_kcache_lookup(struct xc_dom_image *dom,
+                                       struct xc_dom_kcache_key *key,
+                                       void **blob, size_t *size)
+{
+    key->valid = false;
+    return 0;
+}
+static inline void xc_dom_kcache_store(struct xc_dom_image *dom,
+                                       const struct xc_dom_kcache_key *key,
+                                       const void *blob, size_t size)
+{
+}
+#endif
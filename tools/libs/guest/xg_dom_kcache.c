@@ -0,0 +1,479 @@
+/* SPDX-License-Identifier: LGPL-2.1 */
+/*
+ * Xen domain builder -- decompressed kernel cache.
+ *
+ * Decompressing a large kernel dominates the userspace part of a PV
+ * domain build.  When XEN_KERNEL_CACHE_DIR names a directory, the
+ * decompressed image is stored there, keyed by the SHA-256 digest and
+ * length of the compressed data, and later builds of the same kernel
+ * map the cached copy read-only instead of decompressing it again.
+ * The mapping is MAP_SHARED, so concurrent builds share the page cache
+ * pages of a single copy.
+ *
+ * Entries are written to a temporary file and renamed into place, so
+ * readers only ever see complete entries.  The total size of the cache
+ * is bounded by XEN_KERNEL_CACHE_MAX_MB (default 512); the least
+ * recently used entries are evicted when a new entry is stored.  An
+ * entry whose header does not match the current format or the lookup
+ * key is discarded.
+ *
+ * A cache entry is trusted to be the decompressed form of the kernel,
+ * so the directory and its entries must be owned by the caller's
+ * effective user and must not be writable by anyone else; the cache is
+ * ignored otherwise.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "xg_private.h"
+#include "xg_dom_decompress.h"
+
+#define KCACHE_MAGIC        "XENKCACH"
+#define KCACHE_VERSION      1
+#define KCACHE_DATA_OFFSET  4096
+#define KCACHE_SUFFIX       ".kimg"
+#define KCACHE_TMP_PREFIX   "tmp."
+#define KCACHE_TMP_MAX_AGE  3600 /* seconds */
+#define KCACHE_DEFAULT_MB   512
+
+struct kcache_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t data_offset;
+    uint64_t src_size;
+    uint64_t size;
+    uint8_t digest[XC_DOM_KCACHE_DIGEST_LEN];
+};
+
+/* ------------------------------------------------------------------------ */
+/* SHA-256 (FIPS 180-4)                                                     */
+
+struct sha256_ctx {
+    uint32_t h[8];
+    uint64_t len;
+    uint8_t buf[64];
+    unsigned int used;
+};
+
+static const uint32_t sha256_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+    0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+    0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+    0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+    0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+    0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+#define ROR32(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static void sha256_block(struct sha256_ctx *ctx, const uint8_t *p)
+{
+    uint32_t w[64], a, b, c, d, e, f, g, h, t1, t2;
+    unsigned int i;
+
+    for ( i = 0; i < 16; i++ )
+        w[i] = ((uint32_t)p[4 * i] << 24) | ((uint32_t)p[4 * i + 1] << 16) |
+               ((uint32_t)p[4 * i + 2] << 8) | p[4 * i + 3];
+    for ( ; i < 64; i++ )
+        w[i] = w[i - 16] + w[i - 7] +
+               (ROR32(w[i - 15], 7) ^ ROR32(w[i - 15], 18) ^ (w[i - 15] >> 3)) +
+               (ROR32(w[i - 2], 17) ^ ROR32(w[i - 2], 19) ^ (w[i - 2] >> 10));
+
+    a = ctx->h[0]; b = ctx->h[1]; c = ctx->h[2]; d = ctx->h[3];
+    e = ctx->h[4]; f = ctx->h[5]; g = ctx->h[6]; h = ctx->h[7];
+
+    for ( i = 0; i < 64; i++ )
+    {
+        t1 = h + (ROR32(e, 6) ^ ROR32(e, 11) ^ ROR32(e, 25)) +
+             ((e & f) ^ (~e & g)) + sha256_k[i] + w[i];
+        t2 = (ROR32(a, 2) ^ ROR32(a, 13) ^ ROR32(a, 22)) +
+             ((a & b) ^ (a & c) ^ (b & c));
+        h = g; g = f; f = e; e = d + t1;
+        d = c; c = b; b = a; a = t1 + t2;
+    }
+
+    ctx->h[0] += a; ctx->h[1] += b; ctx->h[2] += c; ctx->h[3] += d;
+    ctx->h[4] += e; ctx->h[5] += f; ctx->h[6] += g; ctx->h[7] += h;
+}
+
+static void sha256(const void *data, size_t len, uint8_t *digest)
+{
+    static const uint32_t iv[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+        0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+    };
+    struct sha256_ctx ctx = { .len = len };
+    const uint8_t *p = data;
+    unsigned int i;
+
+    memcpy(ctx.h, iv, sizeof(iv));
+
+    for ( ; len >= 64; p += 64, len -= 64 )
+        sha256_block(&ctx, p);
+
+    memcpy(ctx.buf, p, len);
+    ctx.used = len;
+    ctx.buf[ctx.used++] = 0x80;
+    if ( ctx.used > 56 )
+    {
+        memset(ctx.buf + ctx.used, 0, 64 - ctx.used);
+        sha256_block(&ctx, ctx.buf);
+        ctx.used = 0;
+    }
+    memset(ctx.buf + ctx.used, 0, 56 - ctx.used);
+    for ( i = 0; i < 8; i++ )
+        ctx.buf[56 + i] = (ctx.len * 8) >> (56 - 8 * i);
+    sha256_block(&ctx, ctx.buf);
+
+    for ( i = 0; i < 8; i++ )
+    {
+        digest[4 * i]     = ctx.h[i] >> 24;
+        digest[4 * i + 1] = ctx.h[i] >> 16;
+        digest[4 * i + 2] = ctx.h[i] >> 8;
+        digest[4 * i + 3] = ctx.h[i];
+    }
+}
+
+/* ------------------------------------------------------------------------ */
+/* cache directory                                                          */
+
+static const char *kcache_dir(struct xc_dom_image *dom)
+{
+    const char *dir = getenv("XEN_KERNEL_CACHE_DIR");
+    struct stat st;
+
+    if ( !dir || !*dir )
+        return NULL;
+
+    if ( stat(dir, &st) )
+    {
+        DOMPRINTF("%s: %s: %s, cache disabled", __FUNCTION__, dir,
+                  strerror(errno));
+        return NULL;
+    }
+
+    if ( !S_ISDIR(st.st_mode) || st.st_uid != geteuid() ||
+         (st.st_mode & (S_IWGRP | S_IWOTH)) )
+    {
+        DOMPRINTF("%s: %s: not a private directory, cache disabled",
+                  __FUNCTION__, dir);
+        return NULL;
+    }
+
+    return dir;
+}
+
+static uint64_t kcache_max_bytes(void)
+{
+    const char *s = getenv("XEN_KERNEL_CACHE_MAX_MB");
+    unsigned long mb = KCACHE_DEFAULT_MB;
+    char *end;
+
+    if ( s && *s )
+    {
+        mb = strtoul(s, &end, 0);
+        if ( *end )
+            mb = KCACHE_DEFAULT_MB;
+    }
+
+    return (uint64_t)mb << 20;
+}
+
+static void kcache_path(char *path, size_t len, const char *dir,
+                        const struct xc_dom_kcache_key *key)
+{
+    char hex[2 * XC_DOM_KCACHE_DIGEST_LEN + 1];
+    unsigned int i;
+
+    for ( i = 0; i < XC_DOM_KCACHE_DIGEST_LEN; i++ )
+        snprintf(hex + 2 * i, 3, "%02x", key->digest[i]);
+
+    snprintf(path, len, "%s/%s-%zx" KCACHE_SUFFIX, dir, hex, key->size);
+}
+
+struct kcache_entry {
+    char *name;
+    off_t size;
+    time_t mtime;
+};
+
+static int kcache_entry_cmp(const void *a, const void *b)
+{
+    const struct kcache_entry *x = a, *y = b;
+
+    return (x->mtime > y->mtime) - (x->mtime < y->mtime);
+}
+
+/*
+ * Trim the cache to its size limit, oldest entries first.  Entries are
+ * touched on every hit, so the modification time orders them by last
+ * use.  Temporary files left behind by builders which died while
+ * storing an entry are removed once they are old enough not to belong
+ * to a store in progress.
+ */
+static void kcache_evict(struct xc_dom_image *dom, const char *dir)
+{
+    struct kcache_entry *ents = NULL, *tmp;
+    unsigned int nr = 0, max = 0, i;
+    uint64_t total = 0, limit = kcache_max_bytes();
+    time_t now = time(NULL);
+    struct dirent *de;
+    struct stat st;
+    size_t len;
+    DIR *d;
+    int dfd;
+
+    d = opendir(dir);
+    if ( !d )
+        return;
+    dfd = dirfd(d);
+
+    while ( (de = readdir(d)) != NULL )
+    {
+        if ( fstatat(dfd, de->d_name, &st, AT_SYMLINK_NOFOLLOW) ||
+             !S_ISREG(st.st_mode) )
+            continue;
+
+        if ( !strncmp(de->d_name, KCACHE_TMP_PREFIX,
+                      strlen(KCACHE_TMP_PREFIX)) )
+        {
+            if ( now - st.st_mtime > KCACHE_TMP_MAX_AGE )
+                unlinkat(dfd, de->d_name, 0);
+            continue;
+        }
+
+        len = strlen(de->d_name);
+        if ( len <= strlen(KCACHE_SUFFIX) ||
+             strcmp(de->d_name + len - strlen(KCACHE_SUFFIX), KCACHE_SUFFIX) )
+            continue;
+
+        if ( nr == max )
+        {
+            max = max ? max * 2 : 16;
+            tmp = realloc(ents, max * sizeof(*ents));
+            if ( !tmp )
+                goto out;
+            ents = tmp;
+        }
+
+        ents[nr].name = strdup(de->d_name);
+        if ( !ents[nr].name )
+            goto out;
+        ents[nr].size = st.st_size;
+        ents[nr].mtime = st.st_mtime;
+        total += st.st_size;
+        nr++;
+    }
+
+    if ( total <= limit )
+        goto out;
+
+    qsort(ents, nr, sizeof(*ents), kcache_entry_cmp);
+
+    for ( i = 0; i < nr && total > limit; i++ )
+    {
+        if ( unlinkat(dfd, ents[i].name, 0) )
+            continue;
+        total -= ents[i].size;
+        DOMPRINTF("%s: evicted %s", __FUNCTION__, ents[i].name);
+    }
+
+ out:
+    for ( i = 0; i < nr; i++ )
+        free(ents[i].name);
+    free(ents);
+    closedir(d);
+}
+
+/* ------------------------------------------------------------------------ */
+/* lookup and store                                                         */
+
+static int kcache_write(int fd, const void *data, size_t len, off_t off)
+{
+    const char *p = data;
+    ssize_t rc;
+
+    while ( len )
+    {
+        rc = pwrite(fd, p, len, off);
+        if ( rc < 0 && errno == EINTR )
+            continue;
+        if ( rc <= 0 )
+            return -1;
+        p += rc;
+        off += rc;
+        len -= rc;
+    }
+
+    return 0;
+}
+
+int xc_dom_kcache_lookup(struct xc_dom_image *dom,
+                         struct xc_dom_kcache_key *key,
+                         void **blob, size_t *size)
+{
+    const struct kcache_header *hdr;
+    struct xc_dom_mem *block = NULL;
+    const char *dir;
+    char path[PATH_MAX];
+    void *ptr = MAP_FAILED;
+    struct stat st;
+    uint64_t start;
+    int fd = -1;
+
+    key->valid = false;
+
+    dir = kcache_dir(dom);
+    if ( !dir )
+        return 0;
+
+    start = xg_clock_ms();
+    sha256(*blob, *size, key->digest);
+    key->size = *size;
+    key->valid = true;
+
+    kcache_path(path, sizeof(path), dir, key);
+
+    fd = open(path, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+    if ( fd < 0 )
+        goto miss;
+
+    if ( fstat(fd, &st) || !S_ISREG(st.st_mode) ||
+         st.st_uid != geteuid() || (st.st_mode & (S_IWGRP | S_IWOTH)) ||
+         st.st_size <= KCACHE_DATA_OFFSET )
+        goto stale;
+
+    ptr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if ( ptr == MAP_FAILED )
+        goto miss;
+
+    hdr = ptr;
+    if ( memcmp(hdr->magic, KCACHE_MAGIC, sizeof(hdr->magic)) ||
+         hdr->version != KCACHE_VERSION ||
+         hdr->data_offset != KCACHE_DATA_OFFSET ||
+         hdr->src_size != key->size ||
+         memcmp(hdr->digest, key->digest, sizeof(hdr->digest)) ||
+         hdr->size != st.st_size - KCACHE_DATA_OFFSET )
+        goto stale;
+
+    if ( xc_dom_kernel_check_size(dom, hdr->size) )
+        goto miss;
+
+    block = calloc(1, sizeof(*block));
+    if ( !block )
+        goto miss;
+
+    /* Record the use for LRU eviction; failure only affects eviction order. */
+    futimens(fd, NULL);
+    close(fd);
+
+    block->ptr = ptr;
+    block->len = st.st_size;
+    block->type = XC_DOM_MEM_TYPE_MMAP;
+    block->next = dom->memblocks;
+    dom->memblocks = block;
+    dom->alloc_malloc += sizeof(*block);
+    dom->alloc_file_map += block->len;
+
+    *blob = (char *)ptr + KCACHE_DATA_OFFSET;
+    *size = hdr->size;
+
+    DOMPRINTF("%s: hit %s (0x%zx -> 0x%zx bytes) in %"PRIu64"ms",
+              __FUNCTION__, path, key->size, *size, xg_clock_ms() - start);
+    return 1;
+
+ stale:
+    DOMPRINTF("%s: discarding stale entry %s", __FUNCTION__, path);
+    unlink(path);
+ miss:
+    if ( ptr != MAP_FAILED )
+        munmap(ptr, st.st_size);
+    if ( fd >= 0 )
+        close(fd);
+    DOMPRINTF("%s: miss for 0x%zx bytes", __FUNCTION__, key->size);
+    key->start = xg_clock_ms();
+    return 0;
+}
+
+void xc_dom_kcache_store(struct xc_dom_image *dom,
+                         const struct xc_dom_kcache_key *key,
+                         const void *blob, size_t size)
+{
+    struct kcache_header hdr = {
+        .version = KCACHE_VERSION,
+        .data_offset = KCACHE_DATA_OFFSET,
+        .src_size = key->size,
+        .size = size,
+    };
+    char path[PATH_MAX], tmp[PATH_MAX];
+    const char *dir;
+    int fd, rc;
+
+    if ( !key->valid )
+        return;
+
+    DOMPRINTF("%s: decompressed 0x%zx -> 0x%zx bytes in %"PRIu64"ms",
+              __FUNCTION__, key->size, size, xg_clock_ms() - key->start);
+
+    dir = kcache_dir(dom);
+    if ( !dir || (uint64_t)size + KCACHE_DATA_OFFSET > kcache_max_bytes() )
+        return;
+
+    memcpy(hdr.magic, KCACHE_MAGIC, sizeof(hdr.magic));
+    memcpy(hdr.digest, key->digest, sizeof(hdr.digest));
+    kcache_path(path, sizeof(path), dir, key);
+    snprintf(tmp, sizeof(tmp), "%s/" KCACHE_TMP_PREFIX "XXXXXX", dir);
+
+    fd = mkstemp(tmp);
+    if ( fd < 0 )
+    {
+        DOMPRINTF("%s: %s: %s", __FUNCTION__, tmp, strerror(errno));
+        return;
+    }
+
+    rc = fchmod(fd, 0644) ||
+         kcache_write(fd, &hdr, sizeof(hdr), 0) ||
+         kcache_write(fd, blob, size, KCACHE_DATA_OFFSET);
+    if ( close(fd) || rc )
+    {
+        DOMPRINTF("%s: failed to write %s: %s", __FUNCTION__, tmp,
+                  strerror(errno));
+        unlink(tmp);
+        return;
+    }
+
+    if ( rename(tmp, path) )
+    {
+        DOMPRINTF("%s: failed to rename %s: %s", __FUNCTION__, tmp,
+                  strerror(errno));
+        unlink(tmp);
+        return;
+    }
+
+    DOMPRINTF("%s: stored %s", __FUNCTION__, path);
+    kcache_evict(dom, dir);
+}
+
+/*
+ * Local variables:
+ * mode: C
+ * c-file-style: "BSD"
+ * c-basic-offset: 4
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
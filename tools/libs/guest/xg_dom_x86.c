@@ -27,6 +27,9 @@
 #include <string.h>
 #include <inttypes.h>
 #include <assert.h>
+#ifndef __MINIOS__
+#include <pthread.h>
+#endif
 
 #include <xen/xen.h>
 #include <xen/foreign/x86_32.h>
@@ -1180,11 +1183,291 @@ static int x86_compat(xc_interface *xch, uint32_t domid,
     return rc;
 }
 
+/*
+ * Populating the memory of a large guest is dominated by populate_physmap
+ * hypercalls, which Xen can serve concurrently for disjoint GFN ranges.
+ * The guest's memory ranges are therefore cut into chunks aligned to 1GB,
+ * so that the superpage logic sees the same boundaries, which several
+ * threads populate in parallel.  Each thread has a home physical node and
+ * prefers chunks backed by it, so that all nodes are populated side by side
+ * rather than one after another.
+ *
+ * Mini-OS has no threads: there, the caller populates the chunks in turn.
+ */
+#define MEMINIT_CHUNK_PAGES (4 * SUPERPAGE_1GB_NR_PFNS)
+#ifndef __MINIOS__
+#define MEMINIT_MAX_THREADS 8
+#else
+#define MEMINIT_MAX_THREADS 1
+#endif
+
+struct meminit_stats {
+    unsigned long normal_pages, sp_2mb_pages, sp_1gb_pages;
+};
+
+struct meminit_chunk {
+    xen_pfn_t start, end;
+    unsigned int memflags;
+    unsigned int pnode;
+    bool claimed;
+};
+
+struct meminit_state {
+    struct xc_dom_image *dom;
+    int (*populate)(struct xc_dom_image *dom,
+                    const struct meminit_chunk *chunk,
+                    struct meminit_stats *stats);
+#ifndef __MINIOS__
+    pthread_mutex_t lock;
+#endif
+    struct meminit_chunk *chunks;
+    unsigned int nr_chunks, max_chunks;
+    int rc;
+    struct meminit_stats stats;
+};
+
+struct meminit_thread {
+    struct meminit_state *state;
+#ifndef __MINIOS__
+    pthread_t thread;
+#endif
+    unsigned int pnode;
+};
+
+/* Queue [start, end) for population, split into chunks. */
+static int meminit_add_range(struct meminit_state *s, xen_pfn_t start,
+                             xen_pfn_t end, unsigned int memflags,
+                             unsigned int pnode)
+{
+    while ( start < end )
+    {
+        struct meminit_chunk *c;
+        xen_pfn_t next = (start | (MEMINIT_CHUNK_PAGES - 1)) + 1;
+
+        if ( s->nr_chunks == s->max_chunks )
+        {
+            unsigned int max = s->max_chunks ? s->max_chunks * 2 : 64;
+
+            c = realloc(s->chunks, max * sizeof(*c));
+            if ( !c )
+                return -1;
+            s->chunks = c;
+            s->max_chunks = max;
+        }
+
+        c = &s->chunks[s->nr_chunks++];
+        c->start = start;
+        c->end = min(next, end);
+        c->memflags = memflags;
+        c->pnode = pnode;
+        c->claimed = false;
+
+        start = c->end;
+    }
+
+    return 0;
+}
+
+static void meminit_lock(struct meminit_state *s)
+{
+#ifndef __MINIOS__
+    pthread_mutex_lock(&s->lock);
+#endif
+}
+
+static void meminit_unlock(struct meminit_state *s)
+{
+#ifndef __MINIOS__
+    pthread_mutex_unlock(&s->lock);
+#endif
+}
+
+static void *meminit_worker(void *arg)
+{
+    struct meminit_thread *t = arg;
+    struct meminit_state *s = t->state;
+    struct meminit_stats stats = {};
+    int rc = 0;
+
+    while ( !rc )
+    {
+        struct meminit_chunk *c = NULL;
+        unsigned int i;
+
+        meminit_lock(s);
+        for ( i = 0; !s->rc && i < s->nr_chunks; i++ )
+        {
+            if ( s->chunks[i].claimed )
+                continue;
+            if ( !c )
+                c = &s->chunks[i];
+            if ( s->chunks[i].pnode == t->pnode )
+            {
+                c = &s->chunks[i];
+                break;
+            }
+        }
+        if ( c )
+            c->claimed = true;
+        meminit_unlock(s);
+
+        if ( !c )
+            break;
+
+        rc = s->populate(s->dom, c, &stats);
+    }
+
+    meminit_lock(s);
+    if ( rc && !s->rc )
+        s->rc = rc;
+    s->stats.normal_pages += stats.normal_pages;
+    s->stats.sp_2mb_pages += stats.sp_2mb_pages;
+    s->stats.sp_1gb_pages += stats.sp_1gb_pages;
+    meminit_unlock(s);
+
+    return NULL;
+}
+
+/* Populate all queued chunks, using the calling thread as one worker. */
+static int meminit_run(struct meminit_state *s)
+{
+    struct xc_dom_image *dom = s->dom;
+    struct meminit_thread threads[MEMINIT_MAX_THREADS];
+    unsigned int pnodes[MEMINIT_MAX_THREADS];
+    unsigned int i, j, nr_threads, nr_pnodes = 0, started = 1;
+    uint64_t start = xg_clock_ms();
+
+    nr_threads = min_t(unsigned int, s->nr_chunks, MEMINIT_MAX_THREADS);
+#ifndef __MINIOS__
+    {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+        if ( cpus > 0 && nr_threads > cpus )
+            nr_threads = cpus;
+    }
+#endif
+    if ( !nr_threads )
+        nr_threads = 1;
+
+    /* Spread the threads' home nodes over the nodes in use. */
+    for ( i = 0; i < s->nr_chunks && nr_pnodes < nr_threads; i++ )
+    {
+        for ( j = 0; j < nr_pnodes; j++ )
+            if ( pnodes[j] == s->chunks[i].pnode )
+                break;
+        if ( j == nr_pnodes )
+            pnodes[nr_pnodes++] = s->chunks[i].pnode;
+    }
+
+    for ( i = 0; i < nr_threads; i++ )
+    {
+        threads[i].state = s;
+        threads[i].pnode = nr_pnodes ? pnodes[i % nr_pnodes]
+                                     : XC_NUMA_NO_NODE;
+    }
+
+#ifndef __MINIOS__
+    for ( ; started < nr_threads; started++ )
+        if ( pthread_create(&threads[started].thread, NULL, meminit_worker,
+                            &threads[started]) )
+            break;
+#endif
+
+    meminit_worker(&threads[0]);
+
+#ifndef __MINIOS__
+    for ( i = 1; i < started; i++ )
+        pthread_join(threads[i].thread, NULL);
+#endif
+
+    DOMPRINTF("%s: populated %u chunks with %u threads in %"PRIu64"ms",
+              __func__, s->nr_chunks, started, xg_clock_ms() - start);
+
+    return s->rc;
+}
+
+static void meminit_free(struct meminit_state *s)
+{
+#ifndef __MINIOS__
+    pthread_mutex_destroy(&s->lock);
+#endif
+    free(s->chunks);
+}
+
+static int meminit_pv_chunk(struct xc_dom_image *dom,
+                            const struct meminit_chunk *chunk,
+                            struct meminit_stats *stats)
+{
+    xen_pfn_t extents[SUPERPAGE_BATCH_SIZE];
+    xen_pfn_t pfn, allocsz, mfn;
+    xen_pfn_t pfn_base = chunk->start, pfn_base_idx = pfn_base;
+    uint64_t pages = chunk->end - chunk->start;
+    uint64_t super_pages = pages >> SUPERPAGE_2MB_SHIFT;
+    uint64_t j;
+    int rc, k;
+
+    while ( super_pages ) {
+        uint64_t count = min_t(uint64_t, super_pages, SUPERPAGE_BATCH_SIZE);
+        super_pages -= count;
+
+        for ( pfn = pfn_base_idx, j = 0;
+              pfn < pfn_base_idx + (count << SUPERPAGE_2MB_SHIFT);
+              pfn += SUPERPAGE_2MB_NR_PFNS, j++ )
+            extents[j] = dom->pv_p2m[pfn];
+        rc = xc_domain_populate_physmap(dom->xch, dom->guest_domid, count,
+                                        SUPERPAGE_2MB_SHIFT, chunk->memflags,
+                                        extents);
+        if ( rc < 0 )
+            return rc;
+
+        /* Expand the returned mfns into the p2m array. */
+        pfn = pfn_base_idx;
+        for ( j = 0; j < rc; j++ )
+        {
+            mfn = extents[j];
+            for ( k = 0; k < SUPERPAGE_2MB_NR_PFNS; k++, pfn++ )
+                dom->pv_p2m[pfn] = mfn + k;
+        }
+        stats->sp_2mb_pages += rc;
+        pfn_base_idx = pfn;
+    }
+
+    for ( j = pfn_base_idx - pfn_base; j < pages; j += allocsz )
+    {
+        allocsz = min_t(uint64_t, 1024 * 1024, pages - j);
+        rc = xc_domain_populate_physmap_exact(dom->xch, dom->guest_domid,
+                 allocsz, 0, chunk->memflags, &dom->pv_p2m[pfn_base + j]);
+
+        if ( rc )
+        {
+            if ( chunk->pnode != XC_NUMA_NO_NODE )
+                xc_dom_panic(dom->xch, XC_INTERNAL_ERROR,
+                             "%s: failed to allocate 0x%"PRIx64" pages (p=%d)",
+                             __func__, pages, chunk->pnode);
+            else
+                xc_dom_panic(dom->xch, XC_INTERNAL_ERROR,
+                             "%s: failed to allocate 0x%"PRIx64" pages",
+                             __func__, pages);
+            return rc;
+        }
+        stats->normal_pages += allocsz;
+    }
+
+    return 0;
+}
+
 static int meminit_pv(struct xc_dom_image *dom)
 {
     int rc;
-    xen_pfn_t pfn, allocsz, mfn, total, pfn_base;
-    int i, j, k;
+    xen_pfn_t pfn, total, pfn_base;
+    int i;
+    struct meminit_state state = {
+        .dom = dom,
+        .populate = meminit_pv_chunk,
+#ifndef __MINIOS__
+        .lock = PTHREAD_MUTEX_INITIALIZER,
+#endif
+    };
     xen_vmemrange_t dummy_vmemrange[1];
     unsigned int dummy_vnode_to_pnode[1];
     xen_vmemrange_t *vmemranges;
@@ -1260,70 +1543,26 @@ static int meminit_pv(struct xc_dom_image *dom)
     /* allocate guest memory */
     for ( i = 0; i < nr_vmemranges; i++ )
     {
-        unsigned int memflags;
-        uint64_t pages, super_pages;
+        unsigned int memflags = XENMEMF_prefer_scrubbed;
         unsigned int pnode = vnode_to_pnode[vmemranges[i].nid];
-        xen_pfn_t extents[SUPERPAGE_BATCH_SIZE];
-        xen_pfn_t pfn_base_idx;
+        xen_pfn_t pfn_end = vmemranges[i].end >> PAGE_SHIFT;
 
-        memflags = 0;
         if ( pnode != XC_NUMA_NO_NODE )
             memflags |= XENMEMF_exact_node(pnode);
 
-        pages = (vmemranges[i].end - vmemranges[i].start) >> PAGE_SHIFT;
-        super_pages = pages >> SUPERPAGE_2MB_SHIFT;
         pfn_base = vmemranges[i].start >> PAGE_SHIFT;
-
-        for ( pfn = pfn_base; pfn < pfn_base+pages; pfn++ )
+        for ( pfn = pfn_base; pfn < pfn_end; pfn++ )
             dom->pv_p2m[pfn] = pfn;
 
-        pfn_base_idx = pfn_base;
-        while ( super_pages ) {
-            uint64_t count = min_t(uint64_t, super_pages, SUPERPAGE_BATCH_SIZE);
-            super_pages -= count;
-
-            for ( pfn = pfn_base_idx, j = 0;
-                  pfn < pfn_base_idx + (count << SUPERPAGE_2MB_SHIFT);
-                  pfn += SUPERPAGE_2MB_NR_PFNS, j++ )
-                extents[j] = dom->pv_p2m[pfn];
-            rc = xc_domain_populate_physmap(dom->xch, dom->guest_domid, count,
-                                            SUPERPAGE_2MB_SHIFT, memflags,
-                                            extents);
-            if ( rc < 0 )
-                return rc;
-
-            /* Expand the returned mfns into the p2m array. */
-            pfn = pfn_base_idx;
-            for ( j = 0; j < rc; j++ )
-            {
-                mfn = extents[j];
-                for ( k = 0; k < SUPERPAGE_2MB_NR_PFNS; k++, pfn++ )
-                    dom->pv_p2m[pfn] = mfn + k;
-            }
-            pfn_base_idx = pfn;
-        }
+        rc = meminit_add_range(&state, pfn_base, pfn_end, memflags, pnode);
+        if ( rc )
+            goto out;
+    }
 
-        for ( j = pfn_base_idx - pfn_base; j < pages; j += allocsz )
-        {
-            allocsz = min_t(uint64_t, 1024 * 1024, pages - j);
-            rc = xc_domain_populate_physmap_exact(dom->xch, dom->guest_domid,
-                     allocsz, 0, memflags, &dom->pv_p2m[pfn_base + j]);
+    rc = meminit_run(&state);
 
-            if ( rc )
-            {
-                if ( pnode != XC_NUMA_NO_NODE )
-                    xc_dom_panic(dom->xch, XC_INTERNAL_ERROR,
-                                 "%s: failed to allocate 0x%"PRIx64" pages (v=%d, p=%d)",
-                                 __func__, pages, i, pnode);
-                else
-                    xc_dom_panic(dom->xch, XC_INTERNAL_ERROR,
-                                 "%s: failed to allocate 0x%"PRIx64" pages",
-                                 __func__, pages);
-                return rc;
-            }
-        }
-        rc = 0;
-    }
+ out:
+    meminit_free(&state);
 
     /* Ensure no unclaimed pages are left unused.
      * OK to call if hadn't done the earlier claim call. */
@@ -1345,15 +1584,141 @@ static int check_mmio_hole(uint64_t start, uint64_t memsize,
         return 1;
 }
 
+static int meminit_hvm_chunk(struct xc_dom_image *dom,
+                             const struct meminit_chunk *chunk,
+                             struct meminit_stats *stats)
+{
+    xc_interface *xch = dom->xch;
+    uint32_t domid = dom->guest_domid;
+    unsigned int new_memflags = chunk->memflags;
+    unsigned long i, cur_pfn;
+    unsigned long cur_pages = chunk->start, end_pages = chunk->end;
+    int rc = 0;
+
+    while ( (rc == 0) && (end_pages > cur_pages) )
+    {
+        /* Clip count to maximum 1GB extent. */
+        unsigned long count = end_pages - cur_pages;
+        unsigned long max_pages = SUPERPAGE_1GB_NR_PFNS;
+
+        if ( count > max_pages )
+            count = max_pages;
+
+        cur_pfn = cur_pages;
+
+        /* Take care the corner cases of super page tails */
+        if ( ((cur_pfn & (SUPERPAGE_1GB_NR_PFNS-1)) != 0) &&
+             (count > (-cur_pfn & (SUPERPAGE_1GB_NR_PFNS-1))) )
+            count = -cur_pfn & (SUPERPAGE_1GB_NR_PFNS-1);
+        else if ( ((count & (SUPERPAGE_1GB_NR_PFNS-1)) != 0) &&
+                  (count > SUPERPAGE_1GB_NR_PFNS) )
+            count &= ~(SUPERPAGE_1GB_NR_PFNS - 1);
+
+        /* Attemp to allocate 1GB super page. Because in each pass
+         * we only allocate at most 1GB, we don't have to clip
+         * super page boundaries.
+         */
+        if ( ((count | cur_pfn) & (SUPERPAGE_1GB_NR_PFNS - 1)) == 0 &&
+             /* Check if there exists MMIO hole in the 1GB memory
+              * range */
+             !check_mmio_hole(cur_pfn << PAGE_SHIFT,
+                              SUPERPAGE_1GB_NR_PFNS << PAGE_SHIFT,
+                              dom->mmio_start, dom->mmio_size) )
+        {
+            long done;
+            unsigned long nr_extents = count >> SUPERPAGE_1GB_SHIFT;
+            xen_pfn_t sp_extents[nr_extents];
+
+            for ( i = 0; i < nr_extents; i++ )
+                sp_extents[i] = cur_pages + (i << SUPERPAGE_1GB_SHIFT);
+
+            done = xc_domain_populate_physmap(xch, domid, nr_extents,
+                                              SUPERPAGE_1GB_SHIFT,
+                                              new_memflags, sp_extents);
+
+            if ( done > 0 )
+            {
+                stats->sp_1gb_pages += done;
+                done <<= SUPERPAGE_1GB_SHIFT;
+                cur_pages += done;
+                count -= done;
+            }
+        }
+
+        if ( count != 0 )
+        {
+            /* Clip count to maximum 8MB extent. */
+            max_pages = SUPERPAGE_2MB_NR_PFNS * 4;
+            if ( count > max_pages )
+                count = max_pages;
+
+            /* Clip partial superpage extents to superpage
+             * boundaries. */
+            if ( ((cur_pfn & (SUPERPAGE_2MB_NR_PFNS-1)) != 0) &&
+                 (count > (-cur_pfn & (SUPERPAGE_2MB_NR_PFNS-1))) )
+                count = -cur_pfn & (SUPERPAGE_2MB_NR_PFNS-1);
+            else if ( ((count & (SUPERPAGE_2MB_NR_PFNS-1)) != 0) &&
+                      (count > SUPERPAGE_2MB_NR_PFNS) )
+                count &= ~(SUPERPAGE_2MB_NR_PFNS - 1); /* clip non-s.p. tail */
+
+            /* Attempt to allocate superpage extents. */
+            if ( ((count | cur_pfn) & (SUPERPAGE_2MB_NR_PFNS - 1)) == 0 )
+            {
+                long done;
+                unsigned long nr_extents = count >> SUPERPAGE_2MB_SHIFT;
+                xen_pfn_t sp_extents[nr_extents];
+
+                for ( i = 0; i < nr_extents; i++ )
+                    sp_extents[i] = cur_pages + (i << SUPERPAGE_2MB_SHIFT);
+
+                done = xc_domain_populate_physmap(xch, domid, nr_extents,
+                                                  SUPERPAGE_2MB_SHIFT,
+                                                  new_memflags, sp_extents);
+
+                if ( done > 0 )
+                {
+                    stats->sp_2mb_pages += done;
+                    done <<= SUPERPAGE_2MB_SHIFT;
+                    cur_pages += done;
+                    count -= done;
+                }
+            }
+        }
+
+        /* Fall back to 4kB extents. */
+        if ( count != 0 )
+        {
+            xen_pfn_t extents[count];
+
+            for ( i = 0; i < count; ++i )
+                extents[i] = cur_pages + i;
+
+            rc = xc_domain_populate_physmap_exact(
+                xch, domid, count, 0, new_memflags, extents);
+            cur_pages += count;
+            stats->normal_pages += count;
+        }
+    }
+
+    return rc;
+}
+
 static int meminit_hvm(struct xc_dom_image *dom)
 {
     unsigned long i, vmemid, nr_pages = dom->total_pages;
     unsigned long p2m_size;
     unsigned long target_pages = dom->target_pages;
-    unsigned long cur_pages, cur_pfn;
+    unsigned long cur_pages;
     int rc;
     unsigned long stat_normal_pages = 0, stat_2mb_pages = 0,
         stat_1gb_pages = 0;
+    struct meminit_state state = {
+        .dom = dom,
+        .populate = meminit_hvm_chunk,
+#ifndef __MINIOS__
+        .lock = PTHREAD_MUTEX_INITIALIZER,
+#endif
+    };
     unsigned int memflags = 0;
     int claim_enabled = dom->claim_enabled;
     uint64_t total_pages;
@@ -1502,6 +1867,8 @@ static int meminit_hvm(struct xc_dom_image *dom)
 
         if ( pnode != XC_NUMA_NO_NODE )
             new_memflags |= XENMEMF_exact_node(pnode);
+        if ( !(memflags & XENMEMF_populate_on_demand) )
+            new_memflags |= XENMEMF_prefer_scrubbed;
 
         end_pages = vmemranges[vmemid].end >> PAGE_SHIFT;
         /*
@@ -1517,119 +1884,23 @@ static int meminit_hvm(struct xc_dom_image *dom)
         else
             cur_pages = vmemranges[vmemid].start >> PAGE_SHIFT;
 
-        rc = 0;
-        while ( (rc == 0) && (end_pages > cur_pages) )
-        {
-            /* Clip count to maximum 1GB extent. */
-            unsigned long count = end_pages - cur_pages;
-            unsigned long max_pages = SUPERPAGE_1GB_NR_PFNS;
-
-            if ( count > max_pages )
-                count = max_pages;
-
-            cur_pfn = cur_pages;
-
-            /* Take care the corner cases of super page tails */
-            if ( ((cur_pfn & (SUPERPAGE_1GB_NR_PFNS-1)) != 0) &&
-                 (count > (-cur_pfn & (SUPERPAGE_1GB_NR_PFNS-1))) )
-                count = -cur_pfn & (SUPERPAGE_1GB_NR_PFNS-1);
-            else if ( ((count & (SUPERPAGE_1GB_NR_PFNS-1)) != 0) &&
-                      (count > SUPERPAGE_1GB_NR_PFNS) )
-                count &= ~(SUPERPAGE_1GB_NR_PFNS - 1);
-
-            /* Attemp to allocate 1GB super page. Because in each pass
-             * we only allocate at most 1GB, we don't have to clip
-             * super page boundaries.
-             */
-            if ( ((count | cur_pfn) & (SUPERPAGE_1GB_NR_PFNS - 1)) == 0 &&
-                 /* Check if there exists MMIO hole in the 1GB memory
-                  * range */
-                 !check_mmio_hole(cur_pfn << PAGE_SHIFT,
-                                  SUPERPAGE_1GB_NR_PFNS << PAGE_SHIFT,
-                                  dom->mmio_start, dom->mmio_size) )
-            {
-                long done;
-                unsigned long nr_extents = count >> SUPERPAGE_1GB_SHIFT;
-                xen_pfn_t sp_extents[nr_extents];
-
-                for ( i = 0; i < nr_extents; i++ )
-                    sp_extents[i] = cur_pages + (i << SUPERPAGE_1GB_SHIFT);
-
-                done = xc_domain_populate_physmap(xch, domid, nr_extents,
-                                                  SUPERPAGE_1GB_SHIFT,
-                                                  new_memflags, sp_extents);
-
-                if ( done > 0 )
-                {
-                    stat_1gb_pages += done;
-                    done <<= SUPERPAGE_1GB_SHIFT;
-                    cur_pages += done;
-                    count -= done;
-                }
-            }
-
-            if ( count != 0 )
-            {
-                /* Clip count to maximum 8MB extent. */
-                max_pages = SUPERPAGE_2MB_NR_PFNS * 4;
-                if ( count > max_pages )
-                    count = max_pages;
-
-                /* Clip partial superpage extents to superpage
-                 * boundaries. */
-                if ( ((cur_pfn & (SUPERPAGE_2MB_NR_PFNS-1)) != 0) &&
-                     (count > (-cur_pfn & (SUPERPAGE_2MB_NR_PFNS-1))) )
-                    count = -cur_pfn & (SUPERPAGE_2MB_NR_PFNS-1);
-                else if ( ((count & (SUPERPAGE_2MB_NR_PFNS-1)) != 0) &&
-                          (count > SUPERPAGE_2MB_NR_PFNS) )
-                    count &= ~(SUPERPAGE_2MB_NR_PFNS - 1); /* clip non-s.p. tail */
-
-                /* Attempt to allocate superpage extents. */
-                if ( ((count | cur_pfn) & (SUPERPAGE_2MB_NR_PFNS - 1)) == 0 )
-                {
-                    long done;
-                    unsigned long nr_extents = count >> SUPERPAGE_2MB_SHIFT;
-                    xen_pfn_t sp_extents[nr_extents];
-
-                    for ( i = 0; i < nr_extents; i++ )
-                        sp_extents[i] = cur_pages + (i << SUPERPAGE_2MB_SHIFT);
-
-                    done = xc_domain_populate_physmap(xch, domid, nr_extents,
-                                                      SUPERPAGE_2MB_SHIFT,
-                                                      new_memflags, sp_extents);
-
-                    if ( done > 0 )
-                    {
-                        stat_2mb_pages += done;
-                        done <<= SUPERPAGE_2MB_SHIFT;
-                        cur_pages += done;
-                        count -= done;
-                    }
-                }
-            }
-
-            /* Fall back to 4kB extents. */
-            if ( count != 0 )
-            {
-                xen_pfn_t extents[count];
-
-                for ( i = 0; i < count; ++i )
-                    extents[i] = cur_pages + i;
-
-                rc = xc_domain_populate_physmap_exact(
-                    xch, domid, count, 0, new_memflags, extents);
-                cur_pages += count;
-                stat_normal_pages += count;
-            }
-        }
-
+        rc = meminit_add_range(&state, cur_pages, end_pages, new_memflags,
+                               pnode);
         if ( rc != 0 )
-        {
-            DOMPRINTF("Could not allocate memory for HVM guest.");
             goto error_out;
-        }
     }
 
+    rc = meminit_run(&state);
+    if ( rc != 0 )
+    {
+        DOMPRINTF("Could not allocate memory for HVM guest.");
+        goto error_out;
+    }
+
+    stat_normal_pages += state.stats.normal_pages;
+    stat_2mb_pages = state.stats.sp_2mb_pages;
+    stat_1gb_pages = state.stats.sp_1gb_pages;
+
     DPRINTF("PHYSICAL MEMORY ALLOCATION:\n");
     DPRINTF("  4KB PAGES: 0x%016lx\n", stat_normal_pages);
     DPRINTF("  2MB PAGES: 0x%016lx\n", stat_2mb_pages);
@@ -1640,6 +1911,7 @@ static int meminit_hvm(struct xc_dom_image *dom)
  error_out:
     rc = -1;
  out:
+    meminit_free(&state);
 
     /* ensure no unclaimed pages are left unused */
     xc_domain_claim_pages(xch, domid, 0 /* cancels the claim */);
@@ -39,6 +39,39 @@ int xc_domain_restore(xc_interface *xch, int io_fd, uint32_t dom,
     return -1;
 }
 
+int xc_domain_save_streams(xc_interface *xch, int io_fd,
+                           const int *aux_fds, unsigned int nr_aux_fds,
+                           uint32_t dom, uint32_t flags,
+                           struct save_callbacks *callbacks,
+                           xc_stream_type_t stream_type, int recv_fd,
+                           const struct xc_precopy_params *precopy)
+{
+    errno = ENOSYS;
+    return -1;
+}
+
+int xc_domain_restore_streams(xc_interface *xch, int io_fd,
+                              const int *aux_fds, unsigned int nr_aux_fds,
+                              uint32_t dom, unsigned int store_evtchn,
+                              unsigned long *store_mfn, uint32_t store_domid,
+                              unsigned int console_evtchn,
+                              unsigned long *console_mfn,
+                              uint32_t console_domid,
+                              xc_stream_type_t stream_type,
+                              struct restore_callbacks *callbacks,
+                              int send_back_fd)
+{
+    errno = ENOSYS;
+    return -1;
+}
+
+int xc_precopy_policy(struct precopy_stats stats,
+                      const struct xc_precopy_params *params)
+{
+    errno = ENOSYS;
+    return XGS_POLICY_ABORT;
+}
+
 /*
  * Local variables:
  * mode: C
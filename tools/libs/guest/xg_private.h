@@ -23,6 +23,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <sys/mman.h>
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -88,6 +89,16 @@ static inline unsigned int get_unaligned_le32(const uint8_t *buf)
 
 #endif /* !__MINIOS__ || XG_NEED_UNALIGNED */
 
+/* Milliseconds on a monotonic clock, for timing domain build phases. */
+static inline uint64_t xg_clock_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1000ULL + ts.tv_nsec / 1000000;
+}
+
 unsigned long csum_page (void * page);
 
 #define _PAGE_PRESENT   0x001
@@ -17,6 +17,8 @@ const char *rec_type_to_str(uint32_t type);
 
 struct xc_sr_context;
 struct xc_sr_record;
+struct xc_sr_stripe;
+struct xc_sr_postcopy;
 
 /**
  * Save operations.  To be implemented for each type of guest, for use by the
@@ -96,6 +98,16 @@ struct xc_sr_save_ops
      */
     int (*check_vm_state)(struct xc_sr_context *ctx);
 
+    /**
+     * Fill 'pfns' with at most 'max' pfns which the toolstack or device model
+     * may access before the guest runs at the destination.  These are sent
+     * while the guest is suspended, rather than left for the post-copy phase.
+     *
+     * @returns the number of pfns, or -1 for failure.
+     */
+    int (*eager_pfns)(struct xc_sr_context *ctx, xen_pfn_t *pfns,
+                      unsigned int max);
+
     /**
      * Clean up the local environment.  Will be called exactly once, either
      * after a successful save, or upon encountering an error.
@@ -217,6 +229,14 @@ struct xc_sr_context
     uint32_t domid;
     int fd;
 
+    /* Auxiliary streams which PAGE_DATA records are striped across. */
+    const int *aux_fds;
+    unsigned int nr_aux_fds;
+    struct xc_sr_stripe *stripe;
+
+    /* State of the post-copy phase of a live migration, if any. */
+    struct xc_sr_postcopy *postcopy;
+
     /* Plain VM, or checkpoints over time. */
     xc_stream_type_t stream_type;
 
@@ -237,15 +257,38 @@ struct xc_sr_context
             /* Further debugging information in the stream. */
             bool debug;
 
+            /* Leave the final dirty pages for after the guest resumes. */
+            bool postcopy;
+
             unsigned long p2m_size;
 
             struct precopy_stats stats;
 
+            /* Tunables of the precopy phase, and its measurements. */
+            struct xc_precopy_params precopy;
+            uint64_t collect_ns, send_ns;
+            unsigned long nr_sent;
+
+            /* The guest's credit2 cap before throttling, if throttled. */
+            bool throttled;
+            uint16_t orig_cap;
+
             xen_pfn_t *batch_pfns;
             unsigned int nr_batch_pfns;
             unsigned long *deferred_pages;
             unsigned long nr_deferred_pages;
             xc_hypercall_buffer_t dirty_bitmap_hbuf;
+
+            /*
+             * Dirty ring, if Xen offers one for this guest.  Pfns harvested
+             * from it are gathered in dirty_pfns, and are marked in the
+             * dirty bitmap only until they are sent.
+             */
+            bool dirty_ring;
+            unsigned long dirty_ring_size;
+            xc_hypercall_buffer_t dirty_ring_hbuf;
+            xen_pfn_t *dirty_pfns;
+            unsigned long nr_dirty_pfns;
         } save;
 
         struct /* Restore data. */
@@ -455,6 +498,109 @@ int populate_pfns(struct xc_sr_context *ctx, unsigned int count,
 /* Handle a STATIC_DATA_END record. */
 int handle_static_data_end(struct xc_sr_context *ctx);
 
+/*
+ * Striping of PAGE_DATA records across the auxiliary streams.  See
+ * xg_sr_stripe.c.
+ */
+
+/* Start a thread for each of ctx->aux_fds, writing to it if save. */
+int stripe_init(struct xc_sr_context *ctx, bool save);
+
+/* Stop the threads, and release any records still queued. */
+void stripe_cleanup(struct xc_sr_context *ctx);
+
+/*
+ * Queue a PAGE_DATA record on the least busy auxiliary stream, opening a
+ * window first if needed.  release(opaque) is called once the record has been
+ * written, possibly from another thread.  On failure, the caller keeps
+ * ownership of the record.
+ */
+int stripe_write_batch(struct xc_sr_context *ctx,
+                       const struct iovec *iov, int iovcnt,
+                       void (*release)(void *opaque), void *opaque);
+
+/* Close the current window, if any, ahead of any other record. */
+int stripe_flush(struct xc_sr_context *ctx);
+
+/* Close the current window, and wait for all the records to be written. */
+int stripe_finish(struct xc_sr_context *ctx);
+
+/*
+ * Read the next record to process, as read_record() would, taking the
+ * PAGE_DATA records of a window from the auxiliary streams.
+ */
+int stripe_read_record(struct xc_sr_context *ctx, struct xc_sr_record *rec);
+
+/*
+ * Post-copy phase of a live migration.  See xg_sr_postcopy.c.
+ */
+
+/* Send a set of pfns as PAGE_DATA records.  Implemented in xg_sr_save.c. */
+int send_pages(struct xc_sr_context *ctx, const xen_pfn_t *pfns,
+               unsigned int nr);
+
+/* Check the stream is suitable for post-copy, and set up the saver's state. */
+int postcopy_save_init(struct xc_sr_context *ctx);
+
+/*
+ * With the guest suspended, leave the pfns set in dirty_bitmap for the
+ * post-copy phase, in place of sending them.
+ */
+int postcopy_begin(struct xc_sr_context *ctx,
+                   const unsigned long *dirty_bitmap);
+
+/*
+ * Once the rest of the guest's state is in the stream, announce the pfns
+ * left, and send those which the restorer can't page out.  Then hand over to
+ * the restorer, via the postcopy_transition() callback, and send the pfns
+ * left, those which the restorer asks for first.
+ */
+int postcopy_send(struct xc_sr_context *ctx);
+
+/* Once the END record is written, wait for the restorer to be done. */
+int postcopy_finish(struct xc_sr_context *ctx);
+
+/* Handle a POSTCOPY_PFNS record, paging the pfns out of the guest. */
+int handle_postcopy_pfns(struct xc_sr_context *ctx, struct xc_sr_record *rec);
+
+/* Handle a POSTCOPY_BEGIN record. */
+int handle_postcopy_begin(struct xc_sr_context *ctx);
+
+/*
+ * On a POSTCOPY_TRANSITION record, complete the restore of the guest, have
+ * the caller resume it, and page in the rest of its memory from the stream.
+ */
+int postcopy_restore(struct xc_sr_context *ctx);
+
+/* Release the post-copy state, and stop paging the guest if started. */
+void postcopy_cleanup(struct xc_sr_context *ctx);
+
+/*
+ * Measurements of the precopy phase of a live migration, and throttling of
+ * the guest.  See xg_sr_precopy.c.
+ */
+
+/* Start measuring, with the dirty bitmap freshly cleared. */
+void precopy_start(struct xc_sr_context *ctx);
+
+/* An iteration starts sending pages. */
+void precopy_sending(struct xc_sr_context *ctx);
+
+/* An iteration has sent nr pages. */
+void precopy_sent(struct xc_sr_context *ctx, unsigned long nr);
+
+/*
+ * The dirty pages have been collected into ctx->save.stats.dirty_count.
+ * Update the rest of ctx->save.stats.
+ */
+void precopy_collected(struct xc_sr_context *ctx);
+
+/* Throttle the guest further, if its dirty rate is too high to converge. */
+void precopy_throttle(struct xc_sr_context *ctx);
+
+/* Lift any throttling of the guest. */
+void precopy_cleanup(struct xc_sr_context *ctx);
+
 /* Page type known to the migration logic? */
 static inline bool is_known_page_type(uint32_t type)
 {
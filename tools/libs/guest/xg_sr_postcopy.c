@@ -0,0 +1,1103 @@
+/*
+ * Post-copy phase of a live migration.
+ *
+ * Rather than sending the pages still dirty once the guest is suspended, the
+ * saver leaves them until after the guest has resumed at the destination:
+ *
+ *  - Once the rest of the guest's state is in the stream, POSTCOPY_PFNS
+ *    records list the pages left behind.  The restorer pages them out of the
+ *    new guest, with the paging interface which xenpaging uses, and answers
+ *    the POSTCOPY_BEGIN record which follows with a POSTCOPY_FAULT record on
+ *    the back channel, of the pages which it couldn't page out.  The saver
+ *    sends these straight away.
+ *  - After the POSTCOPY_TRANSITION record, and the records which the
+ *    toolstack appends, the restorer resumes the guest.
+ *  - The guest's accesses to pages left behind reach the restorer as requests
+ *    on the paging ring, which it forwards to the saver in POSTCOPY_FAULT
+ *    records.  The saver sends the pages asked for ahead of the others, which
+ *    it sends in ascending order, then an END record, which the restorer
+ *    acknowledges with an END record of its own on the back channel.
+ *
+ * The pages which the toolstack or the device model may access before the
+ * guest runs are sent while it is suspended, rather than left behind.
+ *
+ * Paging needs a hypervisor built with CONFIG_MEM_PAGING, which is
+ * unsupported, and a guest using HAP, without passthrough or PoD.  Where the
+ * restorer can't page the guest, it answers POSTCOPY_BEGIN with all the pfns
+ * left behind, so that they are sent before the guest runs, as without
+ * post-copy.
+ */
+#include <poll.h>
+
+#include <xenevtchn.h>
+#include <xen/vm_event.h>
+
+#include "xg_sr_common.h"
+
+/* Pages sent between checks for POSTCOPY_FAULT records. */
+#define POSTCOPY_BATCH_SIZE 64
+
+/* Pfns per POSTCOPY_PFNS record. */
+#define POSTCOPY_PFNS_PER_RECORD 1024
+
+/* Pfns which the toolstack or device model may access early, at most. */
+#define POSTCOPY_MAX_EAGER 64
+
+struct xc_sr_postcopy
+{
+    /* Pfns which have yet to be sent (save), or received (restore). */
+    unsigned long *pending;
+    unsigned long nr_pending;
+    xen_pfn_t nr_bits;
+
+    /* Save: where to look for the next pending pfns to send. */
+    xen_pfn_t next;
+
+    /* Pages sent or received after the transition, and how many on demand. */
+    unsigned long nr_sent, nr_faulted;
+
+    /* Restore: a POSTCOPY_BEGIN record has been seen. */
+    bool begun;
+
+    /* Restore: the guest can't be paged, so no pfn is left pending. */
+    bool no_paging;
+
+    /* Restore: pfns which couldn't be paged out. */
+    uint64_t *busy;
+    unsigned int nr_busy, max_busy;
+
+    /* Restore: pfns asked for, of those pending. */
+    unsigned long *requested;
+
+    /* Restore: the paging ring. */
+    void *ring_page;
+    vm_event_back_ring_t back_ring;
+    xenevtchn_handle *xce;
+    xenevtchn_port_or_error_t port;
+
+    /* Restore: requests to answer once their page is received. */
+    vm_event_request_t *waiting;
+    unsigned int nr_waiting, max_waiting;
+};
+
+/* Make room for one more element in an array grown by doubling. */
+static int grow_array(void **array, unsigned int nr, unsigned int *max,
+                      size_t size)
+{
+    unsigned int new_max = *max ? *max * 2 : 16;
+    void *new;
+
+    if ( nr < *max )
+        return 0;
+
+    new = realloc(*array, new_max * size);
+    if ( !new )
+        return -1;
+
+    *array = new;
+    *max = new_max;
+
+    return 0;
+}
+
+/* Write a POSTCOPY_{PFNS,FAULT} record to fd. */
+static int write_pfns(struct xc_sr_context *ctx, int fd, uint32_t type,
+                      const uint64_t *pfns, unsigned int count)
+{
+    xc_interface *xch = ctx->xch;
+    struct xc_sr_rec_postcopy_pfns hdr = {
+        .count = count,
+    };
+    struct xc_sr_rhdr rhdr = {
+        .type = type,
+        .length = sizeof(hdr) + count * sizeof(*pfns),
+    };
+    struct iovec iov[] = {
+        { .iov_base = &rhdr, .iov_len = sizeof(rhdr) },
+        { .iov_base = &hdr, .iov_len = sizeof(hdr) },
+        { .iov_base = (void *)pfns, .iov_len = count * sizeof(*pfns) },
+    };
+
+    if ( writev_exact(fd, iov, ARRAY_SIZE(iov)) )
+    {
+        PERROR("Failed to write %s record", rec_type_to_str(type));
+        return -1;
+    }
+
+    return 0;
+}
+
+static int check_pfns(struct xc_sr_context *ctx,
+                      const struct xc_sr_record *rec)
+{
+    xc_interface *xch = ctx->xch;
+    const struct xc_sr_rec_postcopy_pfns *pfns = rec->data;
+
+    if ( rec->length < sizeof(*pfns) ||
+         rec->length != sizeof(*pfns) + (size_t)pfns->count * sizeof(uint64_t) )
+    {
+        ERROR("%s record wrong size: length %u",
+              rec_type_to_str(rec->type), rec->length);
+        return -1;
+    }
+
+    return 0;
+}
+
+int postcopy_save_init(struct xc_sr_context *ctx)
+{
+    xc_interface *xch = ctx->xch;
+    struct xc_sr_postcopy *pc;
+
+    if ( !ctx->save.live || ctx->stream_type != XC_STREAM_PLAIN ||
+         ctx->nr_aux_fds || !(ctx->dominfo.flags & XEN_DOMINF_hvm_guest) ||
+         ctx->save.recv_fd < 0 || !ctx->save.callbacks->postcopy_transition )
+    {
+        ERROR("Post-copy needs the live migration of an HVM guest, over a"
+              " single plain stream with a back channel");
+        errno = EINVAL;
+        return -1;
+    }
+
+    pc = calloc(1, sizeof(*pc));
+    if ( pc )
+        pc->pending = bitmap_alloc(ctx->save.p2m_size);
+    if ( !pc || !pc->pending )
+    {
+        ERROR("Unable to allocate memory for post-copy state");
+        free(pc);
+        return -1;
+    }
+
+    pc->nr_bits = ctx->save.p2m_size;
+    ctx->postcopy = pc;
+
+    return 0;
+}
+
+int postcopy_begin(struct xc_sr_context *ctx,
+                   const unsigned long *dirty_bitmap)
+{
+    struct xc_sr_postcopy *pc = ctx->postcopy;
+    xen_pfn_t p;
+
+    memcpy(pc->pending, dirty_bitmap, bitmap_size(pc->nr_bits));
+
+    for ( p = 0; p < pc->nr_bits; p++ )
+        if ( test_bit(p, pc->pending) )
+            pc->nr_pending++;
+
+    return 0;
+}
+
+/* Send those of pfns which are still pending. */
+static int send_pending(struct xc_sr_context *ctx, const uint64_t *pfns,
+                        unsigned int count)
+{
+    struct xc_sr_postcopy *pc = ctx->postcopy;
+    xen_pfn_t batch[POSTCOPY_BATCH_SIZE];
+    unsigned int i, nr = 0;
+
+    for ( i = 0; i < count; i++ )
+    {
+        if ( pfns[i] >= pc->nr_bits ||
+             !test_and_clear_bit(pfns[i], pc->pending) )
+            continue;
+
+        pc->nr_pending--;
+        batch[nr++] = pfns[i];
+
+        if ( nr == ARRAY_SIZE(batch) )
+        {
+            if ( send_pages(ctx, batch, nr) )
+                return -1;
+            nr = 0;
+        }
+    }
+
+    return nr ? send_pages(ctx, batch, nr) : 0;
+}
+
+/* Read a POSTCOPY_FAULT record from the back channel, and send its pages. */
+static int handle_fault(struct xc_sr_context *ctx)
+{
+    xc_interface *xch = ctx->xch;
+    struct xc_sr_postcopy *pc = ctx->postcopy;
+    struct xc_sr_rec_postcopy_pfns *fault;
+    struct xc_sr_record rec;
+    unsigned long pending = pc->nr_pending;
+    int rc;
+
+    rc = read_record(ctx, ctx->save.recv_fd, &rec);
+    if ( rc )
+        return rc;
+
+    if ( rec.type != REC_TYPE_POSTCOPY_FAULT )
+    {
+        ERROR("Unexpected record (0x%08x, %s) on the back channel",
+              rec.type, rec_type_to_str(rec.type));
+        rc = -1;
+    }
+    else
+        rc = check_pfns(ctx, &rec);
+
+    if ( !rc )
+    {
+        fault = rec.data;
+        rc = send_pending(ctx, fault->pfn, fault->count);
+        pc->nr_faulted += pending - pc->nr_pending;
+    }
+
+    free(rec.data);
+
+    return rc;
+}
+
+/* Announce the pfns left for the post-copy phase. */
+static int write_pending(struct xc_sr_context *ctx)
+{
+    xc_interface *xch = ctx->xch;
+    struct xc_sr_postcopy *pc = ctx->postcopy;
+    uint64_t *pfns = malloc(POSTCOPY_PFNS_PER_RECORD * sizeof(*pfns));
+    unsigned int nr = 0;
+    xen_pfn_t p;
+    int rc = 0;
+
+    if ( !pfns )
+    {
+        ERROR("Unable to allocate memory for POSTCOPY_PFNS records");
+        return -1;
+    }
+
+    for ( p = 0; !rc && p < pc->nr_bits; p++ )
+    {
+        if ( !test_bit(p, pc->pending) )
+            continue;
+
+        pfns[nr++] = p;
+        if ( nr == POSTCOPY_PFNS_PER_RECORD )
+        {
+            rc = write_pfns(ctx, ctx->fd, REC_TYPE_POSTCOPY_PFNS, pfns, nr);
+            nr = 0;
+        }
+    }
+
+    if ( !rc && nr )
+        rc = write_pfns(ctx, ctx->fd, REC_TYPE_POSTCOPY_PFNS, pfns, nr);
+
+    free(pfns);
+
+    return rc;
+}
+
+int postcopy_send(struct xc_sr_context *ctx)
+{
+    xc_interface *xch = ctx->xch;
+    struct xc_sr_postcopy *pc = ctx->postcopy;
+    struct xc_sr_record rec = { .type = REC_TYPE_POSTCOPY_BEGIN };
+    struct pollfd pfd = { .fd = ctx->save.recv_fd, .events = POLLIN };
+    xen_pfn_t eager[POSTCOPY_MAX_EAGER], batch[POSTCOPY_BATCH_SIZE];
+    uint64_t pfns[POSTCOPY_MAX_EAGER];
+    unsigned long total;
+    unsigned int nr;
+    int i, rc;
+
+    rc = ctx->save.ops.eager_pfns(ctx, eager, ARRAY_SIZE(eager));
+    if ( rc < 0 )
+        return rc;
+
+    for ( i = 0; i < rc; i++ )
+        pfns[i] = eager[i];
+
+    rc = send_pending(ctx, pfns, rc);
+    if ( rc )
+        return rc;
+
+    rc = write_pending(ctx);
+    if ( rc )
+        return rc;
+
+    rc = write_record(ctx, &rec);
+    if ( rc )
+        return rc;
+
+    /* The reply lists the pfns which the restorer couldn't page out. */
+    rc = handle_fault(ctx);
+    if ( rc )
+        return rc;
+
+    DPRINTF("%lu pages left for the post-copy phase, %lu sent now",
+            pc->nr_pending, pc->nr_faulted);
+    if ( !pc->nr_pending && pc->nr_faulted )
+        IPRINTF("Restorer asked for all %lu pages before the guest runs:"
+                " no post-copy phase", pc->nr_faulted);
+    pc->nr_faulted = 0;
+    total = pc->nr_pending;
+
+    rec.type = REC_TYPE_POSTCOPY_TRANSITION;
+    rc = write_record(ctx, &rec);
+    if ( rc )
+        return rc;
+
+    rc = ctx->save.callbacks->postcopy_transition(ctx->save.callbacks->data);
+    if ( rc )
+    {
+        ERROR("postcopy_transition() callback failed: %d", rc);
+        return -1;
+    }
+
+    xc_set_progress_prefix(xch, "Post-copy");
+
+    while ( pc->nr_pending )
+    {
+        /* Pages asked for go first, without waiting for them. */
+        rc = poll(&pfd, 1, 0);
+        if ( rc < 0 )
+        {
+            if ( errno == EINTR )
+                continue;
+            PERROR("Failed to poll the back channel");
+            goto out;
+        }
+
+        if ( rc )
+        {
+            rc = handle_fault(ctx);
+            if ( rc )
+                goto out;
+            continue;
+        }
+
+        for ( nr = 0; nr < ARRAY_SIZE(batch) && pc->next < pc->nr_bits;
+              pc->next++ )
+        {
+            if ( !test_and_clear_bit(pc->next, pc->pending) )
+                continue;
+
+            pc->nr_pending--;
+            batch[nr++] = pc->next;
+        }
+
+        rc = send_pages(ctx, batch, nr);
+        if ( rc )
+            goto out;
+
+        xc_report_progress_step(xch, total - pc->nr_pending, total);
+    }
+
+    xc_report_progress_step(xch, total, total);
+    DPRINTF("%lu pages sent after the transition, %lu on demand",
+            total, pc->nr_faulted);
+
+ out:
+    xc_set_progress_prefix(xch, NULL);
+
+    return rc;
+}
+
+int postcopy_finish(struct xc_sr_context *ctx)
+{
+    xc_interface *xch = ctx->xch;
+    struct xc_sr_record rec;
+    int rc;
+
+    /* Requests crossing the last pages are moot. */
+    for ( ;; )
+    {
+        rc = read_record(ctx, ctx->save.recv_fd, &rec);
+        if ( rc )
+            return rc;
+
+        free(rec.data);
+
+        if ( rec.type == REC_TYPE_END )
+            return 0;
+
+        if ( rec.type != REC_TYPE_POSTCOPY_FAULT )
+        {
+            ERROR("Unexpected record (0x%08x, %s) on the back channel",
+                  rec.type, rec_type_to_str(rec.type));
+            return -1;
+        }
+    }
+}
+
+static int restore_init(struct xc_sr_context *ctx)
+{
+    xc_interface *xch = ctx->xch;
+    struct xc_sr_postcopy *pc;
+
+    if ( ctx->postcopy )
+        return 0;
+
+    if ( ctx->stream_type != XC_STREAM_PLAIN || ctx->stripe ||
+         ctx->restore.guest_type != DHDR_TYPE_X86_HVM ||
+         ctx->restore.send_back_fd < 0 || !ctx->restore.callbacks ||
+         !ctx->restore.callbacks->postcopy_transition )
+    {
+        ERROR("Post-copy needs the restore of an HVM guest, from a single"
+              " plain stream with a back channel");
+        return -1;
+    }
+
+    pc = calloc(1, sizeof(*pc));
+    if ( !pc )
+    {
+        ERROR("Unable to allocate memory for post-copy state");
+        return -1;
+    }
+
+    pc->port = -1;
+    ctx->postcopy = pc;
+
+    return 0;
+}
+
+/* Grow the restorer's bitmaps to cover pfn. */
+static int cover_pfn(struct xc_sr_context *ctx, xen_pfn_t pfn)
+{
+    xc_interface *xch = ctx->xch;
+    struct xc_sr_postcopy *pc = ctx->postcopy;
+    xen_pfn_t nr_bits = pc->nr_bits ?: 32 * 1024;
+    size_t old_size = bitmap_size(pc->nr_bits), new_size;
+    unsigned long *p;
+
+    if ( pfn < pc->nr_bits )
+        return 0;
+
+    while ( pfn >= nr_bits )
+        nr_bits *= 2;
+    new_size = bitmap_size(nr_bits);
+
+    p = realloc(pc->pending, new_size);
+    if ( !p )
+        goto err;
+    memset((void *)p + old_size, 0, new_size - old_size);
+    pc->pending = p;
+
+    p = realloc(pc->requested, new_size);
+    if ( !p )
+        goto err;
+    memset((void *)p + old_size, 0, new_size - old_size);
+    pc->requested = p;
+
+    pc->nr_bits = nr_bits;
+
+    return 0;
+
+ err:
+    ERROR("Unable to allocate memory for %#"PRIpfn" post-copy pfns", nr_bits);
+    return -1;
+}
+
+/* Enable paging of the guest, as xenpaging does. */
+static int start_paging(struct xc_sr_context *ctx)
+{
+    xc_interface *xch = ctx->xch;
+    struct xc_sr_postcopy *pc = ctx->postcopy;
+    uint64_t ring_pfn;
+    uint32_t port;
+
+    /* xc_vm_event_enable() would otherwise take pfn 0 from the guest. */
+    if ( xc_hvm_param_get(xch, ctx->domid, HVM_PARAM_PAGING_RING_PFN,
+                          &ring_pfn) || !ring_pfn )
+    {
+        ERROR("No paging ring pfn for the guest");
+        return -1;
+    }
+
+    pc->ring_page = xc_vm_event_enable(xch, ctx->domid,
+                                       HVM_PARAM_PAGING_RING_PFN, &port);
+    if ( !pc->ring_page )
+    {
+        switch ( errno )
+        {
+        case ENOSYS:     /* !CONFIG_MEM_PAGING */
+        case EOPNOTSUPP: /* HVM hardware domain */
+        case ENODEV:     /* No HAP */
+        case EMLINK:     /* Passthrough */
+        case EXDEV:      /* PoD */
+            IPRINTF("Paging unavailable for the guest (%d = %s), sending all"
+                    " pages before it runs instead of post-copy",
+                    errno, xc_strerror(xch, errno));
+            pc->no_paging = true;
+            return 0;
+        }
+
+        PERROR("Failed to enable paging");
+        return -1;
+    }
+
+    pc->xce = xenevtchn_open(NULL, 0);
+    if ( !pc->xce )
+    {
+        PERROR("Failed to open event channel");
+        return -1;
+    }
+
+    pc->port = xenevtchn_bind_interdomain(pc->xce, ctx->domid, port);
+    if ( pc->port < 0 )
+    {
+        PERROR("Failed to bind event channel");
+        return -1;
+    }
+
+    SHARED_RING_INIT((vm_event_sring_t *)pc->ring_page);
+    BACK_RING_INIT(&pc->back_ring, (vm_event_sring_t *)pc->ring_page,
+                   XC_PAGE_SIZE);
+
+    return 0;
+}
+
+static int stop_paging(struct xc_sr_context *ctx)
+{
+    xc_interface *xch = ctx->xch;
+    struct xc_sr_postcopy *pc = ctx->postcopy;
+    int rc = 0;
+
+    if ( pc->ring_page )
+    {
+        rc = xc_mem_paging_disable(xch, ctx->domid);
+        if ( rc )
+            PERROR("Failed to disable paging");
+
+        xenforeignmemory_unmap(xch->fmem, pc->ring_page, 1);
+        pc->ring_page = NULL;
+    }
+
+    if ( pc->xce )
+    {
+        if ( pc->port >= 0 )
+            xenevtchn_unbind(pc->xce, pc->port);
+        xenevtchn_close(pc->xce);
+        pc->xce = NULL;
+        pc->port = -1;
+    }
+
+    return rc;
+}
+
+/* Ask for pfn before the guest runs. */
+static int add_busy(struct xc_sr_context *ctx, xen_pfn_t pfn)
+{
+    xc_interface *xch = ctx->xch;
+    struct xc_sr_postcopy *pc = ctx->postcopy;
+
+    if ( grow_array((void **)&pc->busy, pc->nr_busy, &pc->max_busy,
+                    sizeof(*pc->busy)) )
+    {
+        ERROR("Unable to allocate memory for busy pfns");
+        return -1;
+    }
+
+    pc->busy[pc->nr_busy++] = pfn;
+
+    return 0;
+}
+
+int handle_postcopy_pfns(struct xc_sr_context *ctx, struct xc_sr_record *rec)
+{
+    xc_interface *xch = ctx->xch;
+    struct xc_sr_rec_postcopy_pfns *hdr = rec->data;
+    struct xc_sr_postcopy *pc;
+    xen_pfn_t *pfns = NULL;
+    unsigned int i;
+    int rc;
+
+    rc = restore_init(ctx);
+    if ( rc )
+        return rc;
+    pc = ctx->postcopy;
+
+    rc = -1;
+    if ( pc->begun )
+    {
+        ERROR("POSTCOPY_PFNS record after POSTCOPY_BEGIN");
+        goto err;
+    }
+
+    if ( check_pfns(ctx, rec) || hdr->count == 0 )
+        goto err;
+
+    pfns = malloc(hdr->count * sizeof(*pfns));
+    if ( !pfns )
+    {
+        ERROR("Unable to allocate memory for %u pfns", hdr->count);
+        goto err;
+    }
+
+    for ( i = 0; i < hdr->count; i++ )
+    {
+        pfns[i] = hdr->pfn[i];
+        if ( hdr->pfn[i] > PAGE_DATA_PFN_MASK ||
+             !ctx->restore.ops.pfn_is_valid(ctx, pfns[i]) )
+        {
+            ERROR("pfn %#"PRIx64" (index %u) outside domain maximum",
+                  hdr->pfn[i], i);
+            goto err;
+        }
+
+        if ( cover_pfn(ctx, pfns[i]) )
+            goto err;
+    }
+
+    if ( !pc->ring_page && !pc->no_paging && start_paging(ctx) )
+        goto err;
+
+    /* Any page not sent before is paged out as if it had been. */
+    if ( populate_pfns(ctx, hdr->count, pfns, NULL) )
+        goto err;
+
+    for ( i = 0; i < hdr->count; i++ )
+    {
+        if ( test_bit(pfns[i], pc->pending) )
+            continue;
+
+        if ( pc->no_paging ||
+             xc_mem_paging_nominate(xch, ctx->domid, pfns[i]) )
+        {
+            if ( !pc->no_paging && errno != EBUSY )
+            {
+                PERROR("Failed to nominate pfn %#"PRIpfn, pfns[i]);
+                goto err;
+            }
+
+            if ( add_busy(ctx, pfns[i]) )
+                goto err;
+            continue;
+        }
+
+        if ( xc_mem_paging_evict(xch, ctx->domid, pfns[i]) )
+        {
+            PERROR("Failed to evict pfn %#"PRIpfn, pfns[i]);
+            goto err;
+        }
+
+        set_bit(pfns[i], pc->pending);
+        pc->nr_pending++;
+    }
+
+    rc = 0;
+
+ err:
+    free(pfns);
+
+    return rc;
+}
+
+int handle_postcopy_begin(struct xc_sr_context *ctx)
+{
+    xc_interface *xch = ctx->xch;
+    struct xc_sr_postcopy *pc;
+    int rc;
+
+    rc = restore_init(ctx);
+    if ( rc )
+        return rc;
+    pc = ctx->postcopy;
+
+    if ( pc->begun )
+    {
+        ERROR("Duplicate POSTCOPY_BEGIN record");
+        return -1;
+    }
+    pc->begun = true;
+
+    DPRINTF("%lu pages left for the post-copy phase, %u busy",
+            pc->nr_pending, pc->nr_busy);
+
+    if ( sizeof(struct xc_sr_rec_postcopy_pfns) +
+         (size_t)pc->nr_busy * sizeof(*pc->busy) > REC_LENGTH_MAX )
+    {
+        ERROR("%u busy pfns are too many for a POSTCOPY_FAULT record",
+              pc->nr_busy);
+        return -1;
+    }
+
+    return write_pfns(ctx, ctx->restore.send_back_fd, REC_TYPE_POSTCOPY_FAULT,
+                      pc->busy, pc->nr_busy);
+}
+
+static void put_response(struct xc_sr_postcopy *pc,
+                         const vm_event_request_t *req)
+{
+    vm_event_response_t rsp = {
+        .version = VM_EVENT_INTERFACE_VERSION,
+        .flags = req->flags,
+        .reason = req->reason,
+        .vcpu_id = req->vcpu_id,
+        .u.mem_paging = req->u.mem_paging,
+    };
+
+    memcpy(RING_GET_RESPONSE(&pc->back_ring, pc->back_ring.rsp_prod_pvt),
+           &rsp, sizeof(rsp));
+    pc->back_ring.rsp_prod_pvt++;
+    RING_PUSH_RESPONSES(&pc->back_ring);
+}
+
+/* Answer the requests waiting for pfn.  Returns whether there were any. */
+static bool wake_waiters(struct xc_sr_postcopy *pc, xen_pfn_t pfn)
+{
+    unsigned int i = 0;
+    bool woken = false;
+
+    while ( i < pc->nr_waiting )
+    {
+        if ( pc->waiting[i].u.mem_paging.gfn != pfn )
+        {
+            i++;
+            continue;
+        }
+
+        put_response(pc, &pc->waiting[i]);
+        pc->waiting[i] = pc->waiting[--pc->nr_waiting];
+        woken = true;
+    }
+
+    return woken;
+}
+
+/*
+ * Handle the requests on the paging ring.  Those for pending pfns wait for
+ * their page, which is asked for from the saver if it hasn't been already.
+ */
+static int handle_requests(struct xc_sr_context *ctx)
+{
+    xc_interface *xch = ctx->xch;
+    struct xc_sr_postcopy *pc = ctx->postcopy;
+    uint64_t faults[POSTCOPY_BATCH_SIZE];
+    unsigned int nr_faults = 0;
+    vm_event_request_t req;
+    RING_IDX cons;
+    bool notify = false;
+    xen_pfn_t gfn;
+
+    while ( RING_HAS_UNCONSUMED_REQUESTS(&pc->back_ring) )
+    {
+        cons = pc->back_ring.req_cons;
+        memcpy(&req, RING_GET_REQUEST(&pc->back_ring, cons), sizeof(req));
+        pc->back_ring.req_cons = ++cons;
+        pc->back_ring.sring->req_event = cons + 1;
+
+        if ( req.version != VM_EVENT_INTERFACE_VERSION ||
+             req.reason != VM_EVENT_REASON_MEM_PAGING )
+        {
+            ERROR("Unexpected paging request: version %#x, reason %u",
+                  req.version, req.reason);
+            return -1;
+        }
+
+        gfn = req.u.mem_paging.gfn;
+        if ( gfn < pc->nr_bits && test_bit(gfn, pc->pending) )
+        {
+            if ( req.u.mem_paging.flags & MEM_PAGING_DROP_PAGE )
+            {
+                /* Released by the guest, so its page is no longer needed. */
+                clear_bit(gfn, pc->pending);
+                pc->nr_pending--;
+            }
+            else
+            {
+                if ( grow_array((void **)&pc->waiting, pc->nr_waiting,
+                                &pc->max_waiting, sizeof(*pc->waiting)) )
+                {
+                    ERROR("Unable to allocate memory for paging requests");
+                    return -1;
+                }
+                pc->waiting[pc->nr_waiting++] = req;
+
+                if ( test_and_set_bit(gfn, pc->requested) )
+                    continue;
+
+                faults[nr_faults++] = gfn;
+                if ( nr_faults == ARRAY_SIZE(faults) )
+                {
+                    if ( write_pfns(ctx, ctx->restore.send_back_fd,
+                                    REC_TYPE_POSTCOPY_FAULT, faults,
+                                    nr_faults) )
+                        return -1;
+                    nr_faults = 0;
+                }
+                continue;
+            }
+        }
+
+        put_response(pc, &req);
+        notify = true;
+    }
+
+    if ( nr_faults &&
+         write_pfns(ctx, ctx->restore.send_back_fd, REC_TYPE_POSTCOPY_FAULT,
+                    faults, nr_faults) )
+        return -1;
+
+    if ( notify && xenevtchn_notify(pc->xce, pc->port) < 0 )
+    {
+        PERROR("Failed to notify the paging ring");
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Load the pages of a PAGE_DATA record into the guest.  HVM pages need no
+ * localisation.  Pages of no data are loaded as zeroes, so that the guest
+ * doesn't wait for them.
+ */
+static int load_page_data(struct xc_sr_context *ctx, struct xc_sr_record *rec)
+{
+    static uint8_t zero_page[PAGE_SIZE];
+    xc_interface *xch = ctx->xch;
+    struct xc_sr_postcopy *pc = ctx->postcopy;
+    struct xc_sr_rec_page_data_header *pages = rec->data;
+    unsigned int i, pages_of_data = 0;
+    bool notify = false;
+    uint8_t *data, *page;
+    xen_pfn_t pfn;
+    uint32_t type;
+
+    if ( rec->length < sizeof(*pages) ||
+         rec->length < sizeof(*pages) + (size_t)pages->count * sizeof(uint64_t) )
+    {
+        ERROR("PAGE_DATA record truncated: length %u", rec->length);
+        return -1;
+    }
+
+    for ( i = 0; i < pages->count; i++ )
+    {
+        type = (pages->pfn[i] & PAGE_DATA_TYPE_MASK) >> 32;
+        if ( !is_known_page_type(type) || type == XEN_DOMCTL_PFINFO_BROKEN )
+        {
+            ERROR("Invalid type %#"PRIx32" for pfn %#"PRIx64" after the"
+                  " post-copy transition",
+                  type, (uint64_t)(pages->pfn[i] & PAGE_DATA_PFN_MASK));
+            return -1;
+        }
+
+        if ( page_type_has_stream_data(type) )
+            pages_of_data++;
+    }
+
+    if ( rec->length != sizeof(*pages) +
+         (size_t)pages->count * sizeof(uint64_t) +
+         (size_t)pages_of_data * PAGE_SIZE )
+    {
+        ERROR("PAGE_DATA record wrong size: length %u", rec->length);
+        return -1;
+    }
+
+    data = (uint8_t *)&pages->pfn[pages->count];
+
+    for ( i = 0; i < pages->count; i++ )
+    {
+        pfn = pages->pfn[i] & PAGE_DATA_PFN_MASK;
+        type = (pages->pfn[i] & PAGE_DATA_TYPE_MASK) >> 32;
+
+        page = zero_page;
+        if ( page_type_has_stream_data(type) )
+        {
+            page = data;
+            data += PAGE_SIZE;
+        }
+
+        /* Unless the guest released it meanwhile. */
+        if ( pfn >= pc->nr_bits || !test_and_clear_bit(pfn, pc->pending) )
+            continue;
+
+        if ( xc_mem_paging_load(xch, ctx->domid, pfn, page) )
+        {
+            PERROR("Failed to load pfn %#"PRIpfn, pfn);
+            return -1;
+        }
+
+        pc->nr_pending--;
+        pc->nr_sent++;
+        if ( test_and_clear_bit(pfn, pc->requested) )
+            pc->nr_faulted++;
+
+        notify |= wake_waiters(pc, pfn);
+    }
+
+    if ( notify && xenevtchn_notify(pc->xce, pc->port) < 0 )
+    {
+        PERROR("Failed to notify the paging ring");
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Answer any request which crossed the last pages, with the guest paused so
+ * that no more can arrive, then stop paging it.
+ */
+static int finish_paging(struct xc_sr_context *ctx)
+{
+    xc_interface *xch = ctx->xch;
+    struct xc_sr_postcopy *pc = ctx->postcopy;
+    int rc;
+
+    if ( !pc->ring_page )
+        return 0;
+
+    rc = xc_domain_pause(xch, ctx->domid);
+    if ( rc )
+    {
+        PERROR("Failed to pause domain");
+        return rc;
+    }
+
+    rc = handle_requests(ctx);
+    if ( !rc )
+        rc = stop_paging(ctx);
+
+    if ( xc_domain_unpause(xch, ctx->domid) )
+    {
+        PERROR("Failed to unpause domain");
+        rc = -1;
+    }
+
+    return rc;
+}
+
+int postcopy_restore(struct xc_sr_context *ctx)
+{
+    xc_interface *xch = ctx->xch;
+    struct xc_sr_postcopy *pc = ctx->postcopy;
+    struct restore_callbacks *callbacks = ctx->restore.callbacks;
+    struct xc_sr_rhdr end = { .type = REC_TYPE_END };
+    struct iovec iov = { .iov_base = &end, .iov_len = sizeof(end) };
+    struct xc_sr_record rec;
+    xenevtchn_port_or_error_t port;
+    bool done = false;
+    int rc;
+
+    if ( !pc || !pc->begun )
+    {
+        ERROR("POSTCOPY_TRANSITION record without POSTCOPY_BEGIN");
+        return -1;
+    }
+
+    rc = ctx->restore.ops.stream_complete(ctx);
+    if ( rc )
+        return rc;
+
+    if ( callbacks->restore_results )
+        callbacks->restore_results(ctx->restore.xenstore_gfn,
+                                   ctx->restore.console_gfn, callbacks->data);
+
+    rc = callbacks->postcopy_transition(callbacks->data);
+    if ( rc )
+    {
+        ERROR("postcopy_transition() callback failed: %d", rc);
+        return -1;
+    }
+
+    while ( !done )
+    {
+        struct pollfd pfds[] = {
+            { .fd = ctx->fd, .events = POLLIN },
+            { .fd = pc->xce ? xenevtchn_fd(pc->xce) : -1, .events = POLLIN },
+        };
+
+        rc = poll(pfds, ARRAY_SIZE(pfds), -1);
+        if ( rc < 0 )
+        {
+            if ( errno == EINTR )
+                continue;
+            PERROR("Failed to poll the stream and paging ring");
+            return -1;
+        }
+
+        if ( pfds[1].revents )
+        {
+            port = xenevtchn_pending(pc->xce);
+            if ( port < 0 || xenevtchn_unmask(pc->xce, port) < 0 )
+            {
+                PERROR("Failed to consume paging ring event");
+                return -1;
+            }
+
+            rc = handle_requests(ctx);
+            if ( rc )
+                return rc;
+        }
+
+        if ( !pfds[0].revents )
+            continue;
+
+        rc = read_record(ctx, ctx->fd, &rec);
+        if ( rc )
+            return rc;
+
+        switch ( rec.type )
+        {
+        case REC_TYPE_PAGE_DATA:
+            rc = load_page_data(ctx, &rec);
+            break;
+
+        case REC_TYPE_END:
+            done = true;
+            break;
+
+        default:
+            ERROR("Unexpected record (0x%08x, %s) after the post-copy"
+                  " transition", rec.type, rec_type_to_str(rec.type));
+            rc = -1;
+            break;
+        }
+
+        free(rec.data);
+        if ( rc )
+            return rc;
+    }
+
+    if ( pc->nr_pending )
+    {
+        ERROR("Stream ended with %lu pages not received", pc->nr_pending);
+        return -1;
+    }
+
+    rc = finish_paging(ctx);
+    if ( rc )
+        return rc;
+
+    if ( writev_exact(ctx->restore.send_back_fd, &iov, 1) )
+    {
+        PERROR("Failed to write END record to the back channel");
+        return -1;
+    }
+
+    DPRINTF("%lu pages received after the post-copy transition, %lu on"
+            " demand", pc->nr_sent, pc->nr_faulted);
+
+    return 0;
+}
+
+void postcopy_cleanup(struct xc_sr_context *ctx)
+{
+    struct xc_sr_postcopy *pc = ctx->postcopy;
+
+    if ( !pc )
+        return;
+
+    stop_paging(ctx);
+
+    free(pc->waiting);
+    free(pc->requested);
+    free(pc->busy);
+    free(pc->pending);
+    free(pc);
+    ctx->postcopy = NULL;
+}
+
+/*
+ * Local variables:
+ * mode: C
+ * c-file-style: "BSD"
+ * c-basic-offset: 4
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
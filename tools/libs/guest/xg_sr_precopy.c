@@ -0,0 +1,181 @@
+/*
+ * Measurements of the precopy phase of a live migration, the default policy
+ * built on them, and throttling of guests which wouldn't converge otherwise.
+ *
+ * Each iteration is measured from one collection of the dirty pages to the
+ * next: the pages dirtied meanwhile give the guest's dirty rate, and the
+ * pages sent, over the time spent sending them, the bandwidth.  The pages
+ * still dirty, at that bandwidth, give the downtime to expect if the guest
+ * were suspended now.
+ *
+ * A guest which dirties its memory faster than half the rate it is sent at
+ * is throttled by capping its cpu time with the credit2 scheduler, more at
+ * each iteration for as long as it keeps up, and uncapped once the save ends.
+ */
+#include <time.h>
+
+#include "xg_sr_common.h"
+
+/*
+ * The policy of xc_domain_save(): proceed to the stop-and-copy phase once
+ * fewer than 50 pages are dirty, or after 5 iterations.  With a maximum
+ * downtime, proceed as soon as the dirty pages are predicted to be sent
+ * within it.
+ */
+#define SPP_MAX_ITERATIONS      5
+#define SPP_TARGET_DIRTY_COUNT 50
+
+/* Throttling, in percent of the guest's cpu time, as qemu's auto-converge. */
+#define THROTTLE_INITIAL 20
+#define THROTTLE_STEP    10
+
+int xc_precopy_policy(struct precopy_stats stats,
+                      const struct xc_precopy_params *params)
+{
+    unsigned int max_iterations = SPP_MAX_ITERATIONS;
+
+    if ( params && params->max_iterations )
+        max_iterations = params->max_iterations;
+
+    if ( stats.iteration >= max_iterations )
+        return XGS_POLICY_STOP_AND_COPY;
+
+    if ( stats.dirty_count < 0 )
+        return XGS_POLICY_CONTINUE_PRECOPY;
+
+    if ( stats.dirty_count < SPP_TARGET_DIRTY_COUNT )
+        return XGS_POLICY_STOP_AND_COPY;
+
+    if ( params && params->max_downtime_ms && stats.bandwidth &&
+         stats.downtime_ms <= params->max_downtime_ms )
+        return XGS_POLICY_STOP_AND_COPY;
+
+    return XGS_POLICY_CONTINUE_PRECOPY;
+}
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* count per elapsed ns, per second. */
+static unsigned long per_second(unsigned long count, uint64_t ns)
+{
+    return ns ? count * 1000000000ULL / ns : 0;
+}
+
+void precopy_start(struct xc_sr_context *ctx)
+{
+    ctx->save.collect_ns = now_ns();
+}
+
+void precopy_sending(struct xc_sr_context *ctx)
+{
+    ctx->save.send_ns = now_ns();
+}
+
+void precopy_sent(struct xc_sr_context *ctx, unsigned long nr)
+{
+    ctx->save.send_ns = now_ns() - ctx->save.send_ns;
+    ctx->save.nr_sent = nr;
+}
+
+void precopy_collected(struct xc_sr_context *ctx)
+{
+    xc_interface *xch = ctx->xch;
+    struct precopy_stats *stats = &ctx->save.stats;
+    uint64_t now = now_ns(), ns = now - ctx->save.collect_ns;
+    unsigned long remaining = stats->dirty_count + ctx->save.nr_deferred_pages;
+
+    ctx->save.collect_ns = now;
+
+    stats->iteration_ms = ns / 1000000;
+    stats->dirty_rate = per_second(stats->dirty_count, ns);
+    if ( ctx->save.nr_sent )
+        stats->bandwidth = per_second(ctx->save.nr_sent, ctx->save.send_ns);
+    stats->downtime_ms = stats->bandwidth
+        ? remaining * 1000ULL / stats->bandwidth : 0;
+    ctx->save.nr_sent = 0;
+
+    DPRINTF("Iteration %u: %ld pages dirty after %lums, at %lu pages/s,"
+            " sent at %lu pages/s, %lums predicted downtime",
+            stats->iteration, stats->dirty_count, stats->iteration_ms,
+            stats->dirty_rate, stats->bandwidth, stats->downtime_ms);
+}
+
+void precopy_throttle(struct xc_sr_context *ctx)
+{
+    xc_interface *xch = ctx->xch;
+    struct precopy_stats *stats = &ctx->save.stats;
+    struct xen_domctl_sched_credit2 sdom = {};
+    unsigned int max_throttle = ctx->save.precopy.max_throttle;
+    unsigned int throttle, full;
+
+    if ( !max_throttle || stats->throttle >= max_throttle ||
+         !stats->bandwidth || stats->dirty_rate * 2 <= stats->bandwidth )
+        return;
+
+    if ( !ctx->save.throttled )
+    {
+        /* Fails unless the guest is in a credit2 cpupool. */
+        if ( xc_sched_credit2_domain_get(xch, ctx->domid, &sdom) )
+        {
+            IPRINTF("Unable to throttle the guest: %d = %s",
+                    errno, xc_strerror(xch, errno));
+            ctx->save.precopy.max_throttle = 0;
+            return;
+        }
+        ctx->save.orig_cap = sdom.cap;
+    }
+
+    throttle = min(stats->throttle ? stats->throttle + THROTTLE_STEP
+                                   : THROTTLE_INITIAL, max_throttle);
+    full = ctx->save.orig_cap ?: 100 * (ctx->dominfo.max_vcpu_id + 1);
+
+    /* A weight of 0 leaves it unchanged. */
+    sdom.weight = 0;
+    sdom.cap = max(full * (100 - throttle) / 100, 1U);
+
+    if ( xc_sched_credit2_domain_set(xch, ctx->domid, &sdom) )
+    {
+        IPRINTF("Unable to throttle the guest to a cap of %u: %d = %s",
+                sdom.cap, errno, xc_strerror(xch, errno));
+        ctx->save.precopy.max_throttle = 0;
+        return;
+    }
+
+    ctx->save.throttled = true;
+    stats->throttle = throttle;
+
+    DPRINTF("Throttling the guest by %u%%, to a credit2 cap of %u",
+            throttle, sdom.cap);
+}
+
+void precopy_cleanup(struct xc_sr_context *ctx)
+{
+    xc_interface *xch = ctx->xch;
+    /* A cap of 0 lifts it. */
+    struct xen_domctl_sched_credit2 sdom = { .cap = ctx->save.orig_cap };
+
+    if ( !ctx->save.throttled )
+        return;
+
+    if ( xc_sched_credit2_domain_set(xch, ctx->domid, &sdom) )
+        PERROR("Failed to restore the guest's credit2 cap of %u", sdom.cap);
+
+    ctx->save.throttled = false;
+}
+
+/*
+ * Local variables:
+ * mode: C
+ * c-file-style: "BSD"
+ * c-basic-offset: 4
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
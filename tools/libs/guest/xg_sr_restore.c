@@ -670,6 +670,24 @@ static int process_record(struct xc_sr_context *ctx, struct xc_sr_record *rec)
         rc = handle_static_data_end(ctx);
         break;
 
+    case REC_TYPE_STRIPE_START:
+        /* Consumed by stripe_read_record() when auxiliary streams exist. */
+        ERROR("Page data striped across auxiliary streams, but none supplied");
+        rc = -1;
+        break;
+
+    case REC_TYPE_POSTCOPY_PFNS:
+        rc = handle_postcopy_pfns(ctx, rec);
+        break;
+
+    case REC_TYPE_POSTCOPY_BEGIN:
+        rc = handle_postcopy_begin(ctx);
+        break;
+
+    case REC_TYPE_POSTCOPY_TRANSITION:
+        /* Ends the loop in restore(). */
+        break;
+
     default:
         rc = ctx->restore.ops.process_record(ctx, rec);
         break;
@@ -725,6 +743,9 @@ static int setup(struct xc_sr_context *ctx)
     }
     ctx->restore.allocated_rec_num = DEFAULT_BUF_RECORDS;
 
+    if ( ctx->nr_aux_fds )
+        rc = stripe_init(ctx, false);
+
  err:
     return rc;
 }
@@ -736,6 +757,9 @@ static void cleanup(struct xc_sr_context *ctx)
     DECLARE_HYPERCALL_BUFFER_SHADOW(unsigned long, dirty_bitmap,
                                     &ctx->restore.dirty_bitmap_hbuf);
 
+    stripe_cleanup(ctx);
+    postcopy_cleanup(ctx);
+
     for ( i = 0; i < ctx->restore.buffered_rec_num; i++ )
         free(ctx->restore.buffered_records[i].data);
 
@@ -767,7 +791,10 @@ static int restore(struct xc_sr_context *ctx)
 
     do
     {
-        rc = read_record(ctx, ctx->fd, &rec);
+        if ( ctx->stripe )
+            rc = stripe_read_record(ctx, &rec);
+        else
+            rc = read_record(ctx, ctx->fd, &rec);
         if ( rc )
         {
             if ( ctx->restore.buffer_all_records )
@@ -806,7 +833,19 @@ static int restore(struct xc_sr_context *ctx)
                 goto err;
         }
 
-    } while ( rec.type != REC_TYPE_END );
+    } while ( rec.type != REC_TYPE_END &&
+              rec.type != REC_TYPE_POSTCOPY_TRANSITION );
+
+    if ( rec.type == REC_TYPE_POSTCOPY_TRANSITION )
+    {
+        /* The rest of the stream is processed as the guest runs. */
+        rc = postcopy_restore(ctx);
+        if ( rc )
+            goto err;
+
+        IPRINTF("Restore successful");
+        goto done;
+    }
 
  remus_failover:
     if ( ctx->stream_type == XC_STREAM_COLO )
@@ -851,12 +890,31 @@ int xc_domain_restore(xc_interface *xch, int io_fd, uint32_t dom,
                       unsigned long *console_gfn, uint32_t console_domid,
                       xc_stream_type_t stream_type,
                       struct restore_callbacks *callbacks, int send_back_fd)
+{
+    return xc_domain_restore_streams(xch, io_fd, NULL, 0, dom, store_evtchn,
+                                     store_mfn, store_domid, console_evtchn,
+                                     console_gfn, console_domid, stream_type,
+                                     callbacks, send_back_fd);
+}
+
+int xc_domain_restore_streams(xc_interface *xch, int io_fd,
+                              const int *aux_fds, unsigned int nr_aux_fds,
+                              uint32_t dom, unsigned int store_evtchn,
+                              unsigned long *store_mfn, uint32_t store_domid,
+                              unsigned int console_evtchn,
+                              unsigned long *console_gfn,
+                              uint32_t console_domid,
+                              xc_stream_type_t stream_type,
+                              struct restore_callbacks *callbacks,
+                              int send_back_fd)
 {
     bool hvm;
     xen_pfn_t nr_pfns;
     struct xc_sr_context ctx = {
         .xch = xch,
         .fd = io_fd,
+        .aux_fds = aux_fds,
+        .nr_aux_fds = nr_aux_fds,
         .stream_type = stream_type,
     };
 
@@ -888,6 +946,15 @@ int xc_domain_restore(xc_interface *xch, int io_fd, uint32_t dom,
         break;
     }
 
+    if ( nr_aux_fds > XC_MAX_AUX_STREAMS ||
+         (nr_aux_fds && stream_type != XC_STREAM_PLAIN) )
+    {
+        ERROR("%u auxiliary streams not supported for stream type %d",
+              nr_aux_fds, stream_type);
+        errno = EINVAL;
+        return -1;
+    }
+
     if ( xc_domain_getinfo_single(xch, dom, &ctx.dominfo) < 0 )
     {
         PERROR("Failed to get dominfo for dom%u", dom);
@@ -895,8 +962,8 @@ int xc_domain_restore(xc_interface *xch, int io_fd, uint32_t dom,
     }
 
     hvm = ctx.dominfo.flags & XEN_DOMINF_hvm_guest;
-    DPRINTF("fd %d, dom %u, hvm %u, stream_type %d",
-            io_fd, dom, hvm, stream_type);
+    DPRINTF("fd %d, %u auxiliary, dom %u, hvm %u, stream_type %d",
+            io_fd, nr_aux_fds, dom, hvm, stream_type);
 
     ctx.domid = dom;
 
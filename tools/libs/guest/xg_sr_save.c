@@ -74,6 +74,39 @@ static int write_checkpoint_record(struct xc_sr_context *ctx)
     return write_record(ctx, &checkpoint);
 }
 
+/*
+ * The buffers making up a PAGE_DATA record, which live until it is written.
+ * With auxiliary streams, that is after write_batch() has returned.
+ */
+struct batch_record
+{
+    xenforeignmemory_handle *fmem;
+    void *guest_mapping;
+    unsigned int nr_pages_mapped;
+    void **local_pages;
+    unsigned int nr_pfns;
+    uint64_t *rec_pfns;
+    struct iovec *iov;
+    struct xc_sr_rhdr rhdr;
+    struct xc_sr_rec_page_data_header hdr;
+};
+
+static void free_batch_record(void *opaque)
+{
+    struct batch_record *br = opaque;
+    unsigned int i;
+
+    if ( br->guest_mapping )
+        xenforeignmemory_unmap(br->fmem, br->guest_mapping,
+                               br->nr_pages_mapped);
+    for ( i = 0; br->local_pages && i < br->nr_pfns; ++i )
+        free(br->local_pages[i]);
+    free(br->local_pages);
+    free(br->rec_pfns);
+    free(br->iov);
+    free(br);
+}
+
 /*
  * Writes a batch of memory as a PAGE_DATA record into the stream.  The batch
  * is constructed in ctx->save.batch_pfns.
@@ -88,22 +121,27 @@ static int write_batch(struct xc_sr_context *ctx)
 {
     xc_interface *xch = ctx->xch;
     xen_pfn_t *mfns = NULL, *types = NULL;
-    void *guest_mapping = NULL;
     void **guest_data = NULL;
-    void **local_pages = NULL;
     int *errors = NULL, rc = -1;
-    unsigned int i, p, nr_pages = 0, nr_pages_mapped = 0;
+    unsigned int i, p, nr_pages = 0;
     unsigned int nr_pfns = ctx->save.nr_batch_pfns;
     void *page, *orig_page;
-    uint64_t *rec_pfns = NULL;
-    struct iovec *iov = NULL; int iovcnt = 0;
-    struct xc_sr_rec_page_data_header hdr = { 0 };
-    struct xc_sr_record rec = {
-        .type = REC_TYPE_PAGE_DATA,
-    };
+    struct batch_record *br;
+    struct iovec *iov;
+    int iovcnt = 0;
 
     assert(nr_pfns != 0);
 
+    /* The record, and what must be kept until it is written. */
+    br = calloc(1, sizeof(*br));
+    if ( !br )
+    {
+        ERROR("Unable to allocate memory for a batch of %u pages", nr_pfns);
+        return -1;
+    }
+    br->fmem = xch->fmem;
+    br->nr_pfns = nr_pfns;
+
     /* Mfns of the batch pfns. */
     mfns = malloc(nr_pfns * sizeof(*mfns));
     /* Types of the batch pfns. */
@@ -113,11 +151,12 @@ static int write_batch(struct xc_sr_context *ctx)
     /* Pointers to page data to send.  Mapped gfns or local allocations. */
     guest_data = calloc(nr_pfns, sizeof(*guest_data));
     /* Pointers to locally allocated pages.  Need freeing. */
-    local_pages = calloc(nr_pfns, sizeof(*local_pages));
+    br->local_pages = calloc(nr_pfns, sizeof(*br->local_pages));
     /* iovec[] for writev(). */
-    iov = malloc((nr_pfns + 4) * sizeof(*iov));
+    iov = br->iov = malloc((nr_pfns + 3) * sizeof(*iov));
 
-    if ( !mfns || !types || !errors || !guest_data || !local_pages || !iov )
+    if ( !mfns || !types || !errors || !guest_data || !br->local_pages ||
+         !iov )
     {
         ERROR("Unable to allocate arrays for a batch of %u pages",
               nr_pfns);
@@ -161,14 +200,14 @@ static int write_batch(struct xc_sr_context *ctx)
 
     if ( nr_pages > 0 )
     {
-        guest_mapping = xenforeignmemory_map(
+        br->guest_mapping = xenforeignmemory_map(
             xch->fmem, ctx->domid, PROT_READ, nr_pages, mfns, errors);
-        if ( !guest_mapping )
+        if ( !br->guest_mapping )
         {
             PERROR("Failed to map guest pages");
             goto err;
         }
-        nr_pages_mapped = nr_pages;
+        br->nr_pages_mapped = nr_pages;
 
         for ( i = 0, p = 0; i < nr_pfns; ++i )
         {
@@ -182,11 +221,11 @@ static int write_batch(struct xc_sr_context *ctx)
                 goto err;
             }
 
-            orig_page = page = guest_mapping + (p * PAGE_SIZE);
+            orig_page = page = br->guest_mapping + (p * PAGE_SIZE);
             rc = ctx->save.ops.normalise_page(ctx, types[i], &page);
 
             if ( orig_page != page )
-                local_pages[i] = page;
+                br->local_pages[i] = page;
 
             if ( rc )
             {
@@ -208,36 +247,35 @@ static int write_batch(struct xc_sr_context *ctx)
         }
     }
 
-    rec_pfns = malloc(nr_pfns * sizeof(*rec_pfns));
-    if ( !rec_pfns )
+    br->rec_pfns = malloc(nr_pfns * sizeof(*br->rec_pfns));
+    if ( !br->rec_pfns )
     {
         ERROR("Unable to allocate %zu bytes of memory for page data pfn list",
-              nr_pfns * sizeof(*rec_pfns));
+              nr_pfns * sizeof(*br->rec_pfns));
         goto err;
     }
 
-    hdr.count = nr_pfns;
+    br->hdr.count = nr_pfns;
 
-    rec.length = sizeof(hdr);
-    rec.length += nr_pfns * sizeof(*rec_pfns);
-    rec.length += nr_pages * PAGE_SIZE;
+    br->rhdr.type = REC_TYPE_PAGE_DATA;
+    br->rhdr.length = sizeof(br->hdr);
+    br->rhdr.length += nr_pfns * sizeof(*br->rec_pfns);
+    br->rhdr.length += nr_pages * PAGE_SIZE;
 
     for ( i = 0; i < nr_pfns; ++i )
-        rec_pfns[i] = ((uint64_t)(types[i]) << 32) | ctx->save.batch_pfns[i];
-
-    iov[0].iov_base = &rec.type;
-    iov[0].iov_len = sizeof(rec.type);
+        br->rec_pfns[i] = ((uint64_t)(types[i]) << 32) |
+                          ctx->save.batch_pfns[i];
 
-    iov[1].iov_base = &rec.length;
-    iov[1].iov_len = sizeof(rec.length);
+    iov[0].iov_base = &br->rhdr;
+    iov[0].iov_len = sizeof(br->rhdr);
 
-    iov[2].iov_base = &hdr;
-    iov[2].iov_len = sizeof(hdr);
+    iov[1].iov_base = &br->hdr;
+    iov[1].iov_len = sizeof(br->hdr);
 
-    iov[3].iov_base = rec_pfns;
-    iov[3].iov_len = nr_pfns * sizeof(*rec_pfns);
+    iov[2].iov_base = br->rec_pfns;
+    iov[2].iov_len = nr_pfns * sizeof(*br->rec_pfns);
 
-    iovcnt = 4;
+    iovcnt = 3;
 
     if ( nr_pages )
     {
@@ -253,24 +291,28 @@ static int write_batch(struct xc_sr_context *ctx)
         }
     }
 
-    if ( writev_exact(ctx->fd, iov, iovcnt) )
+    /* Sanity check we are sending all the pages we expected to. */
+    assert(nr_pages == 0);
+
+    if ( ctx->stripe )
+    {
+        if ( stripe_write_batch(ctx, iov, iovcnt, free_batch_record, br) )
+            goto err;
+
+        /* Released by the auxiliary stream once written. */
+        br = NULL;
+    }
+    else if ( writev_exact(ctx->fd, iov, iovcnt) )
     {
         PERROR("Failed to write page data to stream");
         goto err;
     }
 
-    /* Sanity check we have sent all the pages we expected to. */
-    assert(nr_pages == 0);
     rc = ctx->save.nr_batch_pfns = 0;
 
  err:
-    free(rec_pfns);
-    if ( guest_mapping )
-        xenforeignmemory_unmap(xch->fmem, guest_mapping, nr_pages_mapped);
-    for ( i = 0; local_pages && i < nr_pfns; ++i )
-        free(local_pages[i]);
-    free(iov);
-    free(local_pages);
+    if ( br )
+        free_batch_record(br);
     free(guest_data);
     free(errors);
     free(types);
@@ -301,6 +343,21 @@ static int flush_batch(struct xc_sr_context *ctx)
     return rc;
 }
 
+/*
+ * Flush the last batch of pfns of an iteration into the stream, and close the
+ * window of PAGE_DATA records striped across the auxiliary streams, so that
+ * they are all processed ahead of any record which follows.
+ */
+static int flush_iteration(struct xc_sr_context *ctx)
+{
+    int rc = flush_batch(ctx);
+
+    if ( !rc && ctx->stripe )
+        rc = stripe_flush(ctx);
+
+    return rc;
+}
+
 /*
  * Add a single pfn to the batch, flushing the batch if full.
  */
@@ -317,6 +374,21 @@ static int add_to_batch(struct xc_sr_context *ctx, xen_pfn_t pfn)
     return rc;
 }
 
+/*
+ * Send a set of pfns, outside of the iterations over the dirty bitmap.
+ */
+int send_pages(struct xc_sr_context *ctx, const xen_pfn_t *pfns,
+               unsigned int nr)
+{
+    unsigned int i;
+    int rc = 0;
+
+    for ( i = 0; rc == 0 && i < nr; ++i )
+        rc = add_to_batch(ctx, pfns[i]);
+
+    return rc ?: flush_batch(ctx);
+}
+
 /*
  * Pause/suspend the domain, and refresh ctx->dominfo if required.
  */
@@ -388,7 +460,7 @@ static int send_dirty_pages(struct xc_sr_context *ctx,
         ++written;
     }
 
-    rc = flush_batch(ctx);
+    rc = flush_iteration(ctx);
     if ( rc )
         return rc;
 
@@ -414,6 +486,42 @@ static int send_all_pages(struct xc_sr_context *ctx)
     return send_dirty_pages(ctx, ctx->save.p2m_size);
 }
 
+/*
+ * Send the pages harvested from the dirty ring.  Used in place of
+ * send_dirty_pages() when the ring has kept up with the guest, so the
+ * bitmap needn't be scanned.
+ */
+static int send_dirty_pfns(struct xc_sr_context *ctx)
+{
+    xc_interface *xch = ctx->xch;
+    unsigned long i, entries = ctx->save.nr_dirty_pfns;
+    int rc;
+    DECLARE_HYPERCALL_BUFFER_SHADOW(unsigned long, dirty_bitmap,
+                                    &ctx->save.dirty_bitmap_hbuf);
+
+    for ( i = 0; i < entries; ++i )
+    {
+        clear_bit(ctx->save.dirty_pfns[i], dirty_bitmap);
+
+        rc = add_to_batch(ctx, ctx->save.dirty_pfns[i]);
+        if ( rc )
+            return rc;
+
+        /* Update progress every 4MB worth of memory sent. */
+        if ( (i & ((1U << (22 - 12)) - 1)) == 0 )
+            xc_report_progress_step(xch, i, entries);
+    }
+
+    rc = flush_iteration(ctx);
+    if ( rc )
+        return rc;
+
+    ctx->save.nr_dirty_pfns = 0;
+    xc_report_progress_step(xch, entries, entries);
+
+    return ctx->save.ops.check_vm_state(ctx);
+}
+
 static int enable_logdirty(struct xc_sr_context *ctx)
 {
     xc_interface *xch = ctx->xch;
@@ -448,6 +556,144 @@ static int enable_logdirty(struct xc_sr_context *ctx)
     return 0;
 }
 
+/*
+ * Ask Xen to also queue dirtied pfns on a ring, so that each round of the
+ * live loop can collect them without fetching and scanning the whole
+ * logdirty bitmap.  Only some guests support this; the bitmap is used
+ * otherwise.
+ */
+#define DIRTY_RING_ENTRIES (1UL << 18)
+
+static void enable_dirty_ring(struct xc_sr_context *ctx)
+{
+    xc_interface *xch = ctx->xch;
+    unsigned long entries = min(DIRTY_RING_ENTRIES, ctx->save.p2m_size);
+    long long size;
+    DECLARE_HYPERCALL_BUFFER_SHADOW(uint64_t, ring_pfns,
+                                    &ctx->save.dirty_ring_hbuf);
+
+    size = xc_logdirty_control(xch, ctx->domid,
+                               XEN_DOMCTL_SHADOW_OP_DIRTY_RING_ENABLE,
+                               NULL, entries, 0, NULL);
+    if ( size <= 0 )
+    {
+        DPRINTF("No dirty ring (%d), using the logdirty bitmap", errno);
+        return;
+    }
+
+    ring_pfns = xc_hypercall_buffer_alloc_pages(
+        xch, ring_pfns, NRPAGES(size * sizeof(*ring_pfns)));
+    ctx->save.dirty_pfns = malloc(size * sizeof(*ctx->save.dirty_pfns));
+    if ( !ring_pfns || !ctx->save.dirty_pfns )
+    {
+        DPRINTF("Unable to allocate dirty ring buffers, using the logdirty"
+                " bitmap");
+        if ( ring_pfns )
+            xc_hypercall_buffer_free_pages(
+                xch, ring_pfns, NRPAGES(size * sizeof(*ring_pfns)));
+        free(ctx->save.dirty_pfns);
+        ctx->save.dirty_pfns = NULL;
+        return;
+    }
+
+    ctx->save.dirty_ring_size = size;
+    ctx->save.dirty_ring = true;
+}
+
+/*
+ * Drain the dirty ring into dirty_pfns, using the dirty bitmap to weed out
+ * repeats.  Gives up after a ring's worth of pfns, so a guest dirtying
+ * memory as fast as it is harvested can't keep us here.
+ */
+static int harvest_dirty_ring(struct xc_sr_context *ctx, bool *overflow)
+{
+    xc_interface *xch = ctx->xch;
+    unsigned long i, harvested = 0, size = ctx->save.dirty_ring_size;
+    long long n;
+    bool ovf;
+    DECLARE_HYPERCALL_BUFFER_SHADOW(unsigned long, dirty_bitmap,
+                                    &ctx->save.dirty_bitmap_hbuf);
+    DECLARE_HYPERCALL_BUFFER_SHADOW(uint64_t, ring_pfns,
+                                    &ctx->save.dirty_ring_hbuf);
+
+    *overflow = false;
+
+    while ( harvested < size )
+    {
+        n = xc_logdirty_ring_harvest(xch, ctx->domid,
+                                     HYPERCALL_BUFFER(ring_pfns),
+                                     size - harvested, &ovf);
+        if ( n < 0 )
+        {
+            PERROR("Failed to harvest dirty ring");
+            return -1;
+        }
+
+        *overflow |= ovf;
+        if ( n == 0 )
+            break;
+        harvested += n;
+
+        for ( i = 0; i < n; ++i )
+        {
+            xen_pfn_t pfn = ring_pfns[i];
+
+            if ( pfn >= ctx->save.p2m_size ||
+                 test_and_set_bit(pfn, dirty_bitmap) )
+                continue;
+
+            ctx->save.dirty_pfns[ctx->save.nr_dirty_pfns++] = pfn;
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * Find the pages dirtied since the previous round.  They come from the
+ * dirty ring where possible, and from the logdirty bitmap otherwise.
+ */
+static int collect_dirty_pages(struct xc_sr_context *ctx,
+                               xc_shadow_op_stats_t *stats)
+{
+    xc_interface *xch = ctx->xch;
+    unsigned long i;
+    bool overflow = false;
+    int rc;
+    DECLARE_HYPERCALL_BUFFER_SHADOW(unsigned long, dirty_bitmap,
+                                    &ctx->save.dirty_bitmap_hbuf);
+
+    if ( ctx->save.dirty_ring )
+    {
+        rc = harvest_dirty_ring(ctx, &overflow);
+        if ( rc )
+            return rc;
+
+        if ( !overflow )
+        {
+            stats->dirty_count = ctx->save.nr_dirty_pfns;
+            return 0;
+        }
+    }
+
+    if ( xc_logdirty_control(
+             xch, ctx->domid, XEN_DOMCTL_SHADOW_OP_CLEAN,
+             &ctx->save.dirty_bitmap_hbuf, ctx->save.p2m_size,
+             0, stats) != ctx->save.p2m_size )
+    {
+        PERROR("Failed to retrieve logdirty bitmap");
+        return -1;
+    }
+
+    /* Pages already harvested are no longer dirty in Xen's bitmap. */
+    for ( i = 0; i < ctx->save.nr_dirty_pfns; ++i )
+        set_bit(ctx->save.dirty_pfns[i], dirty_bitmap);
+    stats->dirty_count += ctx->save.nr_dirty_pfns;
+    ctx->save.nr_dirty_pfns = 0;
+
+    return 0;
+}
+
 static int update_progress_string(struct xc_sr_context *ctx, char **str)
 {
     xc_interface *xch = ctx->xch;
@@ -472,19 +718,28 @@ static int update_progress_string(struct xc_sr_context *ctx, char **str)
  * the precopy phase of live migrations, and is responsible for deciding when
  * the precopy phase should terminate and what should be done next.
  *
- * The policy implemented here behaves identically to the policy previously
- * hard-coded into xc_domain_save() - it proceeds to the stop-and-copy phase of
- * the live migration when there are either fewer than 50 dirty pages, or more
- * than 5 precopy rounds have completed.
+ * Without tunables, it behaves identically to the policy previously
+ * hard-coded into xc_domain_save().  See xc_precopy_policy().
  */
-#define SPP_MAX_ITERATIONS      5
-#define SPP_TARGET_DIRTY_COUNT 50
-
 static int simple_precopy_policy(struct precopy_stats stats, void *user)
 {
-    return ((stats.dirty_count >= 0 &&
-             stats.dirty_count < SPP_TARGET_DIRTY_COUNT) ||
-            stats.iteration >= SPP_MAX_ITERATIONS)
+    const struct xc_sr_context *ctx = user;
+
+    return xc_precopy_policy(stats, &ctx->save.precopy);
+}
+
+/*
+ * The default policy with XCFLAGS_POSTCOPY.  The pages still dirty at the end
+ * of precopy are left for the post-copy phase, rather than sent while the
+ * domain is suspended, so further iterations only trade a longer precopy
+ * phase for fewer pages fetched on demand.  Stop once all of memory has been
+ * sent once.
+ */
+#define SPP_POSTCOPY_ITERATIONS 1
+
+static int postcopy_precopy_policy(struct precopy_stats stats, void *user)
+{
+    return stats.iteration >= SPP_POSTCOPY_ITERATIONS
         ? XGS_POLICY_STOP_AND_COPY
         : XGS_POLICY_CONTINUE_PRECOPY;
 }
@@ -519,24 +774,47 @@ static int send_memory_live(struct xc_sr_context *ctx)
     policy_stats = &ctx->save.stats;
 
     if ( precopy_policy == NULL )
-        precopy_policy = simple_precopy_policy;
+    {
+        precopy_policy = ctx->save.postcopy ? postcopy_precopy_policy
+                                            : simple_precopy_policy;
+        data = ctx;
+    }
 
     bitmap_set(dirty_bitmap, ctx->save.p2m_size);
 
+    enable_dirty_ring(ctx);
+    precopy_start(ctx);
+
     for ( ; ; )
     {
         policy_decision = precopy_policy(*policy_stats, data);
         x++;
 
+        if ( policy_decision == XGS_POLICY_CONTINUE_PRECOPY )
+            precopy_throttle(ctx);
+
         if ( stats.dirty_count > 0 && policy_decision != XGS_POLICY_ABORT )
         {
             rc = update_progress_string(ctx, &progress_str);
             if ( rc )
                 goto out;
 
-            rc = send_dirty_pages(ctx, stats.dirty_count);
+            precopy_sending(ctx);
+
+            if ( ctx->save.nr_dirty_pfns )
+                rc = send_dirty_pfns(ctx);
+            else
+            {
+                rc = send_dirty_pages(ctx, stats.dirty_count);
+
+                /* The ring relies on the bitmap starting out clear. */
+                if ( !rc && ctx->save.dirty_ring )
+                    bitmap_clear(dirty_bitmap, ctx->save.p2m_size);
+            }
             if ( rc )
                 goto out;
+
+            precopy_sent(ctx, stats.dirty_count);
         }
 
         if ( policy_decision != XGS_POLICY_CONTINUE_PRECOPY )
@@ -551,18 +829,12 @@ static int send_memory_live(struct xc_sr_context *ctx)
         if ( policy_decision != XGS_POLICY_CONTINUE_PRECOPY )
             break;
 
-        if ( xc_logdirty_control(
-                 xch, ctx->domid, XEN_DOMCTL_SHADOW_OP_CLEAN,
-                 &ctx->save.dirty_bitmap_hbuf, ctx->save.p2m_size,
-                 0, &stats) != ctx->save.p2m_size )
-        {
-            PERROR("Failed to retrieve logdirty bitmap");
-            rc = -1;
+        rc = collect_dirty_pages(ctx, &stats);
+        if ( rc )
             goto out;
-        }
 
         policy_stats->dirty_count = stats.dirty_count;
-
+        precopy_collected(ctx);
     }
 
     if ( policy_decision == XGS_POLICY_ABORT )
@@ -680,7 +952,11 @@ static int suspend_and_send_dirty(struct xc_sr_context *ctx)
         }
     }
 
-    rc = send_dirty_pages(ctx, stats.dirty_count + ctx->save.nr_deferred_pages);
+    if ( ctx->save.postcopy )
+        rc = postcopy_begin(ctx, dirty_bitmap);
+    else
+        rc = send_dirty_pages(ctx,
+                              stats.dirty_count + ctx->save.nr_deferred_pages);
     if ( rc )
         goto out;
 
@@ -747,7 +1023,9 @@ static int send_domain_memory_live(struct xc_sr_context *ctx)
     if ( rc )
         goto out;
 
-    if ( ctx->save.debug && ctx->stream_type == XC_STREAM_PLAIN )
+    /* The pages left for the post-copy phase can't be verified yet. */
+    if ( ctx->save.debug && ctx->stream_type == XC_STREAM_PLAIN &&
+         !ctx->save.postcopy )
     {
         rc = verify_frames(ctx);
         if ( rc )
@@ -815,7 +1093,11 @@ static int setup(struct xc_sr_context *ctx)
         goto err;
     }
 
-    rc = 0;
+    if ( ctx->nr_aux_fds )
+        rc = stripe_init(ctx, true);
+
+    if ( !rc && ctx->save.postcopy )
+        rc = postcopy_save_init(ctx);
 
  err:
     return rc;
@@ -826,7 +1108,13 @@ static void cleanup(struct xc_sr_context *ctx)
     xc_interface *xch = ctx->xch;
     DECLARE_HYPERCALL_BUFFER_SHADOW(unsigned long, dirty_bitmap,
                                     &ctx->save.dirty_bitmap_hbuf);
+    DECLARE_HYPERCALL_BUFFER_SHADOW(uint64_t, ring_pfns,
+                                    &ctx->save.dirty_ring_hbuf);
+
 
+    stripe_cleanup(ctx);
+    postcopy_cleanup(ctx);
+    precopy_cleanup(ctx);
 
     xc_shadow_control(xch, ctx->domid, XEN_DOMCTL_SHADOW_OP_OFF,
                       NULL, 0);
@@ -836,6 +1124,11 @@ static void cleanup(struct xc_sr_context *ctx)
 
     xc_hypercall_buffer_free_pages(xch, dirty_bitmap,
                                    NRPAGES(bitmap_size(ctx->save.p2m_size)));
+    if ( ctx->save.dirty_ring )
+        xc_hypercall_buffer_free_pages(
+            xch, ring_pfns,
+            NRPAGES(ctx->save.dirty_ring_size * sizeof(*ring_pfns)));
+    free(ctx->save.dirty_pfns);
     free(ctx->save.deferred_pages);
     free(ctx->save.batch_pfns);
 }
@@ -903,6 +1196,13 @@ static int save(struct xc_sr_context *ctx, uint16_t guest_type)
         if ( rc )
             goto err;
 
+        if ( ctx->postcopy )
+        {
+            rc = postcopy_send(ctx);
+            if ( rc )
+                goto err;
+        }
+
         if ( ctx->stream_type != XC_STREAM_PLAIN )
         {
             /*
@@ -954,10 +1254,24 @@ static int save(struct xc_sr_context *ctx, uint16_t guest_type)
 
     xc_report_progress_single(xch, "End of stream");
 
+    if ( ctx->stripe )
+    {
+        rc = stripe_finish(ctx);
+        if ( rc )
+            goto err;
+    }
+
     rc = write_end_record(ctx);
     if ( rc )
         goto err;
 
+    if ( ctx->postcopy )
+    {
+        rc = postcopy_finish(ctx);
+        if ( rc )
+            goto err;
+    }
+
     xc_report_progress_single(xch, "Complete");
     goto done;
 
@@ -981,10 +1295,23 @@ static int save(struct xc_sr_context *ctx, uint16_t guest_type)
 int xc_domain_save(xc_interface *xch, int io_fd, uint32_t dom,
                    uint32_t flags, struct save_callbacks *callbacks,
                    xc_stream_type_t stream_type, int recv_fd)
+{
+    return xc_domain_save_streams(xch, io_fd, NULL, 0, dom, flags, callbacks,
+                                  stream_type, recv_fd, NULL);
+}
+
+int xc_domain_save_streams(xc_interface *xch, int io_fd,
+                           const int *aux_fds, unsigned int nr_aux_fds,
+                           uint32_t dom, uint32_t flags,
+                           struct save_callbacks *callbacks,
+                           xc_stream_type_t stream_type, int recv_fd,
+                           const struct xc_precopy_params *precopy)
 {
     struct xc_sr_context ctx = {
         .xch = xch,
         .fd = io_fd,
+        .aux_fds = aux_fds,
+        .nr_aux_fds = nr_aux_fds,
         .stream_type = stream_type,
     };
     bool hvm;
@@ -993,8 +1320,20 @@ int xc_domain_save(xc_interface *xch, int io_fd, uint32_t dom,
     ctx.save.callbacks = callbacks;
     ctx.save.live  = !!(flags & XCFLAGS_LIVE);
     ctx.save.debug = !!(flags & XCFLAGS_DEBUG);
+    ctx.save.postcopy = !!(flags & XCFLAGS_POSTCOPY);
     ctx.save.recv_fd = recv_fd;
 
+    if ( precopy )
+    {
+        if ( precopy->max_throttle >= 100 )
+        {
+            ERROR("Invalid precopy throttle %u%%", precopy->max_throttle);
+            errno = EINVAL;
+            return -1;
+        }
+        ctx.save.precopy = *precopy;
+    }
+
     if ( xc_domain_getinfo_single(xch, dom, &ctx.dominfo) < 0 )
     {
         PERROR("Failed to get domain info");
@@ -1022,8 +1361,17 @@ int xc_domain_save(xc_interface *xch, int io_fd, uint32_t dom,
         break;
     }
 
-    DPRINTF("fd %d, dom %u, flags %u, hvm %d",
-            io_fd, dom, flags, hvm);
+    if ( nr_aux_fds > XC_MAX_AUX_STREAMS ||
+         (nr_aux_fds && stream_type != XC_STREAM_PLAIN) )
+    {
+        ERROR("%u auxiliary streams not supported for stream type %d",
+              nr_aux_fds, stream_type);
+        errno = EINVAL;
+        return -1;
+    }
+
+    DPRINTF("fd %d, %u auxiliary, dom %u, flags %u, hvm %d",
+            io_fd, nr_aux_fds, dom, flags, hvm);
 
     ctx.domid = dom;
 
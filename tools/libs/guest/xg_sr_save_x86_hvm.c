@@ -211,6 +211,56 @@ static int x86_hvm_end_of_checkpoint(struct xc_sr_context *ctx)
     return 0;
 }
 
+static int x86_hvm_eager_pfns(struct xc_sr_context *ctx, xen_pfn_t *pfns,
+                              unsigned int max)
+{
+    /* Parameters holding a pfn, or the address of a page. */
+    static const struct {
+        unsigned int index;
+        unsigned int shift;
+    } params[] = {
+        { HVM_PARAM_STORE_PFN,             0 },
+        { HVM_PARAM_IOREQ_PFN,             0 },
+        { HVM_PARAM_BUFIOREQ_PFN,          0 },
+        { HVM_PARAM_PAGING_RING_PFN,       0 },
+        { HVM_PARAM_MONITOR_RING_PFN,      0 },
+        { HVM_PARAM_SHARING_RING_PFN,      0 },
+        { HVM_PARAM_CONSOLE_PFN,           0 },
+        { HVM_PARAM_IDENT_PT,              PAGE_SHIFT },
+        { HVM_PARAM_VM_GENERATION_ID_ADDR, PAGE_SHIFT },
+    };
+
+    xc_interface *xch = ctx->xch;
+    uint64_t value, base = 0;
+    unsigned int i, nr = 0;
+
+    for ( i = 0; i < ARRAY_SIZE(params); i++ )
+    {
+        if ( xc_hvm_param_get(xch, ctx->domid, params[i].index, &value) )
+        {
+            PERROR("Failed to get HVMPARAM at index %u", params[i].index);
+            return -1;
+        }
+
+        if ( value && nr < max )
+            pfns[nr++] = value >> params[i].shift;
+    }
+
+    if ( xc_hvm_param_get(xch, ctx->domid, HVM_PARAM_IOREQ_SERVER_PFN,
+                          &base) ||
+         xc_hvm_param_get(xch, ctx->domid, HVM_PARAM_NR_IOREQ_SERVER_PAGES,
+                          &value) )
+    {
+        PERROR("Failed to get ioreq server pages");
+        return -1;
+    }
+
+    for ( i = 0; base && i < value && nr < max; i++ )
+        pfns[nr++] = base + i;
+
+    return nr;
+}
+
 static int x86_hvm_cleanup(struct xc_sr_context *ctx)
 {
     xc_interface *xch = ctx->xch;
@@ -237,6 +287,7 @@ struct xc_sr_save_ops save_ops_x86_hvm =
     .start_of_checkpoint = x86_hvm_start_of_checkpoint,
     .end_of_checkpoint   = x86_hvm_end_of_checkpoint,
     .check_vm_state      = x86_hvm_check_vm_state,
+    .eager_pfns          = x86_hvm_eager_pfns,
     .cleanup             = x86_hvm_cleanup,
 };
 
@@ -1116,6 +1116,13 @@ static int x86_pv_check_vm_state(struct xc_sr_context *ctx)
     return x86_pv_check_vm_state_p2m_list(ctx);
 }
 
+/* Post-copy is only offered for HVM guests. */
+static int x86_pv_eager_pfns(struct xc_sr_context *ctx, xen_pfn_t *pfns,
+                             unsigned int max)
+{
+    return 0;
+}
+
 static int x86_pv_cleanup(struct xc_sr_context *ctx)
 {
     free(ctx->x86.pv.p2m_pfns);
@@ -1142,6 +1149,7 @@ struct xc_sr_save_ops save_ops_x86_pv =
     .start_of_checkpoint = x86_pv_start_of_checkpoint,
     .end_of_checkpoint   = x86_pv_end_of_checkpoint,
     .check_vm_state      = x86_pv_check_vm_state,
+    .eager_pfns          = x86_pv_eager_pfns,
     .cleanup             = x86_pv_cleanup,
 };
 
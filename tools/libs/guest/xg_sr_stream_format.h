@@ -76,6 +76,12 @@ struct xc_sr_rhdr
 #define REC_TYPE_STATIC_DATA_END            0x00000010U
 #define REC_TYPE_X86_CPUID_POLICY           0x00000011U
 #define REC_TYPE_X86_MSR_POLICY             0x00000012U
+#define REC_TYPE_STRIPE_START               0x00000013U
+#define REC_TYPE_STRIPE_END                 0x00000014U
+#define REC_TYPE_POSTCOPY_PFNS              0x00000015U
+#define REC_TYPE_POSTCOPY_BEGIN             0x00000016U
+#define REC_TYPE_POSTCOPY_TRANSITION        0x00000017U
+#define REC_TYPE_POSTCOPY_FAULT             0x00000018U
 
 #define REC_TYPE_OPTIONAL             0x80000000U
 
@@ -138,6 +144,21 @@ struct xc_sr_rec_hvm_params
     struct xc_sr_rec_hvm_params_entry param[0];
 };
 
+/* STRIPE_{START,END} */
+struct xc_sr_rec_stripe
+{
+    uint32_t window;
+    uint32_t count;
+};
+
+/* POSTCOPY_{PFNS,FAULT} */
+struct xc_sr_rec_postcopy_pfns
+{
+    uint32_t count;
+    uint32_t _res1;
+    uint64_t pfn[0];
+};
+
 #endif
 /*
  * Local variables:
@@ -0,0 +1,708 @@
+/*
+ * Striping of PAGE_DATA records across auxiliary streams.
+ *
+ * The main stream carries every record other than PAGE_DATA, in order.
+ * PAGE_DATA records are sent in windows: a STRIPE_START record on the main
+ * stream opens a window, the PAGE_DATA records of the window are spread
+ * across the auxiliary streams, and a STRIPE_END record on each auxiliary
+ * stream closes it.  A pfn is sent at most once per window, so the restorer
+ * may process the records of a window in any order, but it only returns to
+ * the main stream once every auxiliary stream has closed the window.
+ *
+ * Each auxiliary stream has a thread moving records between its fd and a
+ * short queue, so the copies to and from the kernel of the streams proceed
+ * in parallel.  Pages are mapped and normalised by the saver, and records
+ * are processed by the restorer, in the main thread.
+ */
+#include <pthread.h>
+
+#include "xg_sr_common.h"
+
+/* Records queued per auxiliary stream. */
+#define STRIPE_QUEUE_DEPTH 4
+
+struct stripe_entry
+{
+    struct stripe_entry *next;
+
+    /* Save: the record to write, and how to release it once written. */
+    const struct iovec *iov;
+    int iovcnt;
+    void (*release)(void *opaque);
+    void *opaque;
+
+    /* Save: storage for a STRIPE_END record. */
+    struct {
+        struct xc_sr_rhdr rhdr;
+        struct xc_sr_rec_stripe body;
+    } end;
+    struct iovec end_iov;
+
+    /* Restore: the record read. */
+    struct xc_sr_record rec;
+};
+
+struct stripe_stream
+{
+    struct xc_sr_stripe *stripe;
+    unsigned int idx;
+    int fd;
+    pthread_t thread;
+    bool started;
+
+    struct stripe_entry *head, *tail;
+    unsigned int queued;
+
+    /* PAGE_DATA records in the current window. */
+    uint32_t records;
+
+    /* Restore: the stream has closed the current window. */
+    bool closed;
+
+    /* The thread has stopped, on error or end of stream, with errno. */
+    bool stopped;
+    int error;
+};
+
+struct xc_sr_stripe
+{
+    pthread_mutex_t lock;
+    /* Signalled on any change to the queues, or to the stopped flags. */
+    pthread_cond_t cond;
+    bool stopping;
+
+    bool in_window;
+    uint32_t window;
+    unsigned int next;
+    unsigned int nr_closed;
+
+    unsigned int nr_streams;
+    struct stripe_stream streams[];
+};
+
+static void enqueue(struct stripe_stream *st, struct stripe_entry *e)
+{
+    e->next = NULL;
+    if ( st->tail )
+        st->tail->next = e;
+    else
+        st->head = e;
+    st->tail = e;
+    st->queued++;
+}
+
+static struct stripe_entry *dequeue(struct stripe_stream *st)
+{
+    struct stripe_entry *e = st->head;
+
+    st->head = e->next;
+    if ( !st->head )
+        st->tail = NULL;
+    st->queued--;
+
+    return e;
+}
+
+static void free_entry(struct stripe_entry *e)
+{
+    if ( e->release )
+        e->release(e->opaque);
+    free(e->rec.data);
+    free(e);
+}
+
+/*
+ * Threads may only be cancelled, by stripe_cleanup(), while blocked on their
+ * fd.  Anything else they are doing at the time is leaked.
+ */
+static void *stripe_writer(void *arg)
+{
+    struct stripe_stream *st = arg;
+    struct xc_sr_stripe *s = st->stripe;
+    struct stripe_entry *e;
+    int rc;
+
+    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+    pthread_mutex_lock(&s->lock);
+
+    for ( ;; )
+    {
+        while ( !st->head && !s->stopping )
+            pthread_cond_wait(&s->cond, &s->lock);
+        if ( !st->head )
+            break;
+
+        /* Left queued while written, for stripe_cleanup() to release. */
+        e = st->head;
+        pthread_mutex_unlock(&s->lock);
+
+        pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
+        rc = writev_exact(st->fd, e->iov, e->iovcnt);
+        pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+
+        pthread_mutex_lock(&s->lock);
+        if ( rc )
+        {
+            st->stopped = true;
+            st->error = errno;
+            pthread_cond_broadcast(&s->cond);
+            break;
+        }
+
+        dequeue(st);
+        pthread_cond_broadcast(&s->cond);
+        pthread_mutex_unlock(&s->lock);
+
+        free_entry(e);
+
+        pthread_mutex_lock(&s->lock);
+    }
+
+    pthread_mutex_unlock(&s->lock);
+
+    return NULL;
+}
+
+/*
+ * Read a record from an auxiliary stream.  Unlike read_record(), nothing is
+ * logged, as the end of an auxiliary stream is only an error within a window,
+ * and as the main thread owns the error state of xch.
+ */
+static int read_aux_record(int fd, struct xc_sr_record *rec)
+{
+    struct xc_sr_rhdr rhdr;
+    size_t datasz;
+
+    if ( read_exact(fd, &rhdr, sizeof(rhdr)) )
+        return -1;
+
+    if ( rhdr.length > REC_LENGTH_MAX )
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    datasz = ROUNDUP(rhdr.length, REC_ALIGN_ORDER);
+    rec->data = NULL;
+
+    if ( datasz )
+    {
+        rec->data = malloc(datasz);
+        if ( !rec->data )
+            return -1;
+
+        if ( read_exact(fd, rec->data, datasz) )
+        {
+            if ( !errno )
+                errno = EPIPE;
+            return -1;
+        }
+    }
+
+    rec->type   = rhdr.type;
+    rec->length = rhdr.length;
+
+    return 0;
+}
+
+static void *stripe_reader(void *arg)
+{
+    struct stripe_stream *st = arg;
+    struct xc_sr_stripe *s = st->stripe;
+    struct stripe_entry *e;
+    int rc;
+
+    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+    pthread_mutex_lock(&s->lock);
+
+    for ( ;; )
+    {
+        while ( st->queued >= STRIPE_QUEUE_DEPTH && !s->stopping )
+            pthread_cond_wait(&s->cond, &s->lock);
+        if ( s->stopping )
+            break;
+
+        pthread_mutex_unlock(&s->lock);
+
+        e = calloc(1, sizeof(*e));
+        if ( e )
+        {
+            pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
+            rc = read_aux_record(st->fd, &e->rec);
+            pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+        }
+        else
+            rc = -1;
+
+        pthread_mutex_lock(&s->lock);
+        if ( rc )
+        {
+            st->stopped = true;
+            st->error = errno;
+            pthread_cond_broadcast(&s->cond);
+            if ( e )
+                free_entry(e);
+            break;
+        }
+
+        enqueue(st, e);
+        pthread_cond_broadcast(&s->cond);
+    }
+
+    pthread_mutex_unlock(&s->lock);
+
+    return NULL;
+}
+
+int stripe_init(struct xc_sr_context *ctx, bool save)
+{
+    xc_interface *xch = ctx->xch;
+    struct xc_sr_stripe *s;
+    unsigned int i;
+    int rc;
+
+    s = calloc(1, sizeof(*s) + ctx->nr_aux_fds * sizeof(*s->streams));
+    if ( !s )
+    {
+        ERROR("Unable to allocate memory for %u auxiliary streams",
+              ctx->nr_aux_fds);
+        return -1;
+    }
+
+    pthread_mutex_init(&s->lock, NULL);
+    pthread_cond_init(&s->cond, NULL);
+    s->nr_streams = ctx->nr_aux_fds;
+    ctx->stripe = s;
+
+    for ( i = 0; i < s->nr_streams; i++ )
+    {
+        struct stripe_stream *st = &s->streams[i];
+
+        st->stripe = s;
+        st->idx = i;
+        st->fd = ctx->aux_fds[i];
+
+        rc = pthread_create(&st->thread, NULL,
+                            save ? stripe_writer : stripe_reader, st);
+        if ( rc )
+        {
+            errno = rc;
+            PERROR("Unable to start thread for auxiliary stream %u", i);
+            stripe_cleanup(ctx);
+            return -1;
+        }
+        st->started = true;
+    }
+
+    return 0;
+}
+
+void stripe_cleanup(struct xc_sr_context *ctx)
+{
+    struct xc_sr_stripe *s = ctx->stripe;
+    struct stripe_stream *st;
+    unsigned int i;
+
+    if ( !s )
+        return;
+
+    pthread_mutex_lock(&s->lock);
+    s->stopping = true;
+    pthread_cond_broadcast(&s->cond);
+    pthread_mutex_unlock(&s->lock);
+
+    for ( i = 0; i < s->nr_streams; i++ )
+        if ( s->streams[i].started )
+            pthread_cancel(s->streams[i].thread);
+
+    for ( i = 0; i < s->nr_streams; i++ )
+    {
+        st = &s->streams[i];
+
+        if ( st->started )
+            pthread_join(st->thread, NULL);
+
+        while ( st->head )
+            free_entry(dequeue(st));
+    }
+
+    pthread_cond_destroy(&s->cond);
+    pthread_mutex_destroy(&s->lock);
+    free(s);
+    ctx->stripe = NULL;
+}
+
+/* Report a stopped stream.  Must be called with the lock held. */
+static bool write_failed(struct xc_sr_context *ctx)
+{
+    xc_interface *xch = ctx->xch;
+    struct xc_sr_stripe *s = ctx->stripe;
+    unsigned int i;
+
+    for ( i = 0; i < s->nr_streams; i++ )
+    {
+        if ( !s->streams[i].stopped )
+            continue;
+
+        errno = s->streams[i].error;
+        PERROR("Failed to write to auxiliary stream %u", i);
+        return true;
+    }
+
+    return false;
+}
+
+int stripe_write_batch(struct xc_sr_context *ctx,
+                       const struct iovec *iov, int iovcnt,
+                       void (*release)(void *opaque), void *opaque)
+{
+    xc_interface *xch = ctx->xch;
+    struct xc_sr_stripe *s = ctx->stripe;
+    struct stripe_stream *st;
+    struct stripe_entry *e;
+    unsigned int i;
+
+    if ( !s->in_window )
+    {
+        struct xc_sr_rec_stripe start = {
+            .window = s->window,
+            .count = s->nr_streams,
+        };
+        struct xc_sr_record rec = {
+            .type = REC_TYPE_STRIPE_START,
+            .length = sizeof(start),
+            .data = &start,
+        };
+
+        if ( write_record(ctx, &rec) )
+            return -1;
+
+        s->in_window = true;
+    }
+
+    e = calloc(1, sizeof(*e));
+    if ( !e )
+    {
+        ERROR("Unable to allocate memory for auxiliary stream record");
+        return -1;
+    }
+
+    e->iov = iov;
+    e->iovcnt = iovcnt;
+    e->release = release;
+    e->opaque = opaque;
+
+    pthread_mutex_lock(&s->lock);
+
+    for ( ;; )
+    {
+        if ( write_failed(ctx) )
+        {
+            pthread_mutex_unlock(&s->lock);
+            free(e);
+            return -1;
+        }
+
+        /* The least busy stream, starting after the last one used. */
+        st = NULL;
+        for ( i = 0; i < s->nr_streams; i++ )
+        {
+            struct stripe_stream *t =
+                &s->streams[(s->next + i) % s->nr_streams];
+
+            if ( t->queued < STRIPE_QUEUE_DEPTH &&
+                 (!st || t->queued < st->queued) )
+                st = t;
+        }
+
+        if ( st )
+            break;
+
+        pthread_cond_wait(&s->cond, &s->lock);
+    }
+
+    enqueue(st, e);
+    st->records++;
+    s->next = (st->idx + 1) % s->nr_streams;
+    pthread_cond_broadcast(&s->cond);
+
+    pthread_mutex_unlock(&s->lock);
+
+    return 0;
+}
+
+int stripe_flush(struct xc_sr_context *ctx)
+{
+    xc_interface *xch = ctx->xch;
+    struct xc_sr_stripe *s = ctx->stripe;
+    struct stripe_entry *ends[s->nr_streams];
+    unsigned int i;
+
+    if ( !s->in_window )
+        return 0;
+
+    for ( i = 0; i < s->nr_streams; i++ )
+    {
+        ends[i] = calloc(1, sizeof(*ends[i]));
+        if ( !ends[i] )
+        {
+            ERROR("Unable to allocate memory for auxiliary stream record");
+            while ( i-- )
+                free(ends[i]);
+            return -1;
+        }
+    }
+
+    pthread_mutex_lock(&s->lock);
+
+    /* STRIPE_END records may overfill the queues. */
+    for ( i = 0; i < s->nr_streams; i++ )
+    {
+        struct stripe_stream *st = &s->streams[i];
+        struct stripe_entry *e = ends[i];
+
+        e->end.rhdr.type = REC_TYPE_STRIPE_END;
+        e->end.rhdr.length = sizeof(e->end.body);
+        e->end.body.window = s->window;
+        e->end.body.count = st->records;
+        e->end_iov.iov_base = &e->end;
+        e->end_iov.iov_len = sizeof(e->end);
+        e->iov = &e->end_iov;
+        e->iovcnt = 1;
+
+        enqueue(st, e);
+        st->records = 0;
+    }
+
+    pthread_cond_broadcast(&s->cond);
+    pthread_mutex_unlock(&s->lock);
+
+    s->in_window = false;
+    s->window++;
+
+    return 0;
+}
+
+int stripe_finish(struct xc_sr_context *ctx)
+{
+    struct xc_sr_stripe *s = ctx->stripe;
+    unsigned int i;
+    int rc;
+
+    rc = stripe_flush(ctx);
+    if ( rc )
+        return rc;
+
+    pthread_mutex_lock(&s->lock);
+
+    for ( i = 0; i < s->nr_streams; )
+    {
+        if ( write_failed(ctx) )
+        {
+            rc = -1;
+            break;
+        }
+
+        if ( s->streams[i].head )
+            pthread_cond_wait(&s->cond, &s->lock);
+        else
+            i++;
+    }
+
+    pthread_mutex_unlock(&s->lock);
+
+    return rc;
+}
+
+/* Open a window on a STRIPE_START record from the main stream. */
+static int open_window(struct xc_sr_context *ctx, struct xc_sr_record *rec)
+{
+    xc_interface *xch = ctx->xch;
+    struct xc_sr_stripe *s = ctx->stripe;
+    struct xc_sr_rec_stripe *start = rec->data;
+    int rc = -1;
+
+    if ( rec->length != sizeof(*start) )
+        ERROR("STRIPE_START record wrong size: length %u, expected %zu",
+              rec->length, sizeof(*start));
+    else if ( start->window != s->window )
+        ERROR("STRIPE_START record for window %u, expected %u",
+              start->window, s->window);
+    else if ( start->count != s->nr_streams )
+        ERROR("Stream striped across %u auxiliary streams, %u supplied",
+              start->count, s->nr_streams);
+    else
+    {
+        s->in_window = true;
+        rc = 0;
+    }
+
+    free(rec->data);
+    rec->data = NULL;
+
+    return rc;
+}
+
+/* Handle a record from an auxiliary stream, other than PAGE_DATA. */
+static int close_window(struct xc_sr_context *ctx, struct stripe_stream *st,
+                        struct xc_sr_record *rec)
+{
+    xc_interface *xch = ctx->xch;
+    struct xc_sr_stripe *s = ctx->stripe;
+    struct xc_sr_rec_stripe *end = rec->data;
+
+    if ( rec->type != REC_TYPE_STRIPE_END )
+    {
+        ERROR("Unexpected record (0x%08x, %s) on auxiliary stream %u",
+              rec->type, rec_type_to_str(rec->type), st->idx);
+        return -1;
+    }
+
+    if ( rec->length != sizeof(*end) )
+    {
+        ERROR("STRIPE_END record wrong size: length %u, expected %zu",
+              rec->length, sizeof(*end));
+        return -1;
+    }
+
+    if ( end->window != s->window || end->count != st->records )
+    {
+        ERROR("Auxiliary stream %u: STRIPE_END record for window %u with %u"
+              " records, expected window %u with %u records", st->idx,
+              end->window, end->count, s->window, st->records);
+        return -1;
+    }
+
+    st->closed = true;
+    st->records = 0;
+    s->nr_closed++;
+
+    return 0;
+}
+
+/*
+ * Return the next PAGE_DATA record of the current window, 1 once all the
+ * auxiliary streams have closed it, or -1 on error.
+ */
+static int next_in_window(struct xc_sr_context *ctx, struct xc_sr_record *rec)
+{
+    xc_interface *xch = ctx->xch;
+    struct xc_sr_stripe *s = ctx->stripe;
+    struct stripe_stream *st;
+    struct stripe_entry *e;
+    unsigned int i;
+    int rc;
+
+    pthread_mutex_lock(&s->lock);
+
+    for ( ;; )
+    {
+        if ( s->nr_closed == s->nr_streams )
+            break;
+
+        st = NULL;
+        for ( i = 0; i < s->nr_streams; i++ )
+        {
+            struct stripe_stream *t =
+                &s->streams[(s->next + i) % s->nr_streams];
+
+            if ( !t->closed && t->head )
+            {
+                st = t;
+                break;
+            }
+        }
+
+        if ( !st )
+        {
+            for ( i = 0; i < s->nr_streams; i++ )
+            {
+                struct stripe_stream *t = &s->streams[i];
+
+                if ( t->closed || !t->stopped )
+                    continue;
+
+                pthread_mutex_unlock(&s->lock);
+                if ( t->error )
+                {
+                    errno = t->error;
+                    PERROR("Failed to read from auxiliary stream %u", i);
+                }
+                else
+                    ERROR("Auxiliary stream %u ended within window %u",
+                          i, s->window);
+                return -1;
+            }
+
+            pthread_cond_wait(&s->cond, &s->lock);
+            continue;
+        }
+
+        e = dequeue(st);
+        pthread_cond_broadcast(&s->cond);
+        s->next = (st->idx + 1) % s->nr_streams;
+
+        if ( e->rec.type == REC_TYPE_PAGE_DATA )
+        {
+            pthread_mutex_unlock(&s->lock);
+
+            st->records++;
+            *rec = e->rec;
+            free(e);
+
+            return 0;
+        }
+
+        rc = close_window(ctx, st, &e->rec);
+        free_entry(e);
+        if ( rc )
+        {
+            pthread_mutex_unlock(&s->lock);
+            return -1;
+        }
+    }
+
+    for ( i = 0; i < s->nr_streams; i++ )
+        s->streams[i].closed = false;
+    s->nr_closed = 0;
+    s->in_window = false;
+    s->window++;
+
+    pthread_mutex_unlock(&s->lock);
+
+    return 1;
+}
+
+int stripe_read_record(struct xc_sr_context *ctx, struct xc_sr_record *rec)
+{
+    struct xc_sr_stripe *s = ctx->stripe;
+    int rc;
+
+    for ( ;; )
+    {
+        if ( s->in_window )
+        {
+            rc = next_in_window(ctx, rec);
+            if ( rc <= 0 )
+                return rc;
+        }
+
+        rc = read_record(ctx, ctx->fd, rec);
+        if ( rc || rec->type != REC_TYPE_STRIPE_START )
+            return rc;
+
+        rc = open_window(ctx, rec);
+        if ( rc )
+            return rc;
+    }
+}
+
+/*
+ * Local variables:
+ * mode: C
+ * c-file-style: "BSD"
+ * c-basic-offset: 4
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -4,6 +4,7 @@ from __future__ import print_function
 
 import sys
 import re
+import hashlib
 
 import idl
 
@@ -548,6 +549,181 @@ def libxl_C_type_from_json(ty, v, w, indent = "    "):
         s = indent + s
     return s.replace("\n", "\n%s" % indent).rstrip(indent)
 
+def libxl_C_type_gen_bin(ty, v, indent = "    ", parent = None):
+    s = ""
+    if isinstance(ty, idl.Array):
+        if parent is None:
+            raise Exception("Array type must have a parent")
+        s += "{\n"
+        s += "    int i;\n"
+        s += "    libxl__uint_gen_bin(b, %s);\n" % (parent + ty.lenvar.name)
+        s += "    for (i=0; i<%s; i++) {\n" % (parent + ty.lenvar.name)
+        s += libxl_C_type_gen_bin(ty.elem_type, v+"[i]", "        ", parent)
+        s += "    }\n"
+        s += "}\n"
+    elif isinstance(ty, idl.Enumeration):
+        s += "libxl__int_gen_bin(b, %s);\n" % ty.pass_arg(v, parent is None)
+    elif isinstance(ty, idl.Number):
+        s += "libxl__%s_gen_bin(b, %s);\n" % ("int" if ty.signed else "uint",
+                                              ty.pass_arg(v, parent is None))
+    elif isinstance(ty, idl.KeyedUnion):
+        if parent is None:
+            raise Exception("KeyedUnion type must have a parent")
+        s += "libxl__int_gen_bin(b, %s);\n" % (parent + ty.keyvar.name)
+        s += "switch (%s) {\n" % (parent + ty.keyvar.name)
+        for f in ty.fields:
+            (nparent,fexpr) = ty.member(v, f, parent is None)
+            s += "case %s:\n" % f.enumname
+            if f.type is not None:
+                s += libxl_C_type_gen_bin(f.type, fexpr, "    ", nparent)
+            s += "    break;\n"
+        s += "}\n"
+    elif isinstance(ty, idl.Struct) and (parent is None or ty.bin_gen_fn is None):
+        for f in [f for f in ty.fields if not f.const and not f.type.private]:
+            (nparent,fexpr) = ty.member(v, f, parent is None)
+            s += libxl_C_type_gen_bin(f.type, fexpr, "", nparent)
+    else:
+        if ty.bin_gen_fn is None:
+            raise Exception("No binary encoding for %s" % ty.typename)
+        s += "%s(b, %s);\n" % (ty.bin_gen_fn, ty.pass_arg(v, parent is None))
+
+    if s != "":
+        s = indent + s
+    return s.replace("\n", "\n%s" % indent).rstrip(indent)
+
+def libxl_C_type_parse_bin(ty, v, indent = "    ", parent = None):
+    s = ""
+    if parent is None:
+        s += "int rc = 0;\n"
+
+    if isinstance(ty, idl.Array):
+        if parent is None:
+            raise Exception("Array type must have a parent")
+        lenvar = parent + ty.lenvar.name
+        s += "{\n"
+        s += "    int i;\n"
+        s += "    rc = libxl__bin_get_count(c, &%s);\n" % lenvar
+        s += "    if (rc)\n"
+        s += "        goto out;\n"
+        s += "    if (%s)\n" % lenvar
+        s += "        %s = libxl__calloc(NOGC, %s, sizeof(*%s));\n" % (v, lenvar, v)
+        s += "    for (i=0; i<%s; i++) {\n" % lenvar
+        s += libxl_C_type_do_init(ty.elem_type,
+                    lambda by: ("&" if by == idl.PASS_BY_REFERENCE else "")+
+                               ("%s[i]" % v),
+                                  need_zero=False, indent="        ")
+        s += libxl_C_type_parse_bin(ty.elem_type, v+"[i]", "        ", parent)
+        s += "    }\n"
+        s += "}\n"
+    elif isinstance(ty, idl.Enumeration):
+        s += "{\n"
+        s += "    int64_t val;\n"
+        s += "    rc = libxl__int_parse_bin(c, &val);\n"
+        s += "    if (rc)\n"
+        s += "        goto out;\n"
+        s += "    if (val < INT_MIN || val > INT_MAX || !%s_to_string(val)) {\n" % ty.typename
+        s += "        rc = ERROR_INVAL;\n"
+        s += "        goto out;\n"
+        s += "    }\n"
+        s += "    %s = val;\n" % ty.pass_arg(v, parent is None, passby=idl.PASS_BY_VALUE)
+        s += "}\n"
+    elif isinstance(ty, idl.Number):
+        s += "{\n"
+        s += "    %s val;\n" % ("int64_t" if ty.signed else "uint64_t")
+        s += "    rc = libxl__%s_parse_bin(c, &val);\n" % ("int" if ty.signed else "uint")
+        s += "    if (rc)\n"
+        s += "        goto out;\n"
+        s += "    %s = val;\n" % ty.pass_arg(v, parent is None, passby=idl.PASS_BY_VALUE)
+        s += "    if (%s != val) {\n" % ty.pass_arg(v, parent is None, passby=idl.PASS_BY_VALUE)
+        s += "        rc = ERROR_INVAL;\n"
+        s += "        goto out;\n"
+        s += "    }\n"
+        s += "}\n"
+    elif isinstance(ty, idl.KeyedUnion):
+        if parent is None:
+            raise Exception("KeyedUnion type must have a parent")
+        s += "switch (%s) {\n" % (parent + ty.keyvar.name)
+        for f in ty.fields:
+            (nparent,fexpr) = ty.member(v, f, parent is None)
+            s += "case %s:\n" % f.enumname
+            if f.type is not None:
+                s += libxl_C_type_parse_bin(f.type, fexpr, "    ", nparent)
+            s += "    break;\n"
+        s += "}\n"
+    elif isinstance(ty, idl.Struct) and (parent is None or ty.bin_parse_fn is None):
+        for f in [f for f in ty.fields if not f.const and not f.type.private]:
+            (nparent,fexpr) = ty.member(v, f, parent is None)
+            if isinstance(f.type, idl.KeyedUnion):
+                if parent is not None:
+                    raise Exception("KeyedUnion must be a member of a named type")
+                s += "{\n"
+                s += "    int64_t key;\n"
+                s += "    rc = libxl__int_parse_bin(c, &key);\n"
+                s += "    if (rc)\n"
+                s += "        goto out;\n"
+                s += "    if (key < INT_MIN || key > INT_MAX ||\n"
+                s += "        !%s_to_string(key)) {\n" % f.type.keyvar.type.typename
+                s += "        rc = ERROR_INVAL;\n"
+                s += "        goto out;\n"
+                s += "    }\n"
+                s += "    %s_init_%s(%s, key);\n" % (ty.typename, f.type.keyvar.name, v)
+                s += "}\n"
+            s += libxl_C_type_parse_bin(f.type, fexpr, "", nparent)
+    else:
+        if ty.bin_parse_fn is None:
+            raise Exception("No binary encoding for %s" % ty.typename)
+        s += "rc = %s(gc, c, &%s);\n" % (ty.bin_parse_fn, v)
+        s += "if (rc)\n"
+        s += "    goto out;\n"
+
+    if parent is None:
+        s += "out:\n"
+        s += "return rc;\n"
+
+    if s != "":
+        s = indent + s
+    return s.replace("\n", "\n%s" % indent).rstrip(indent)
+
+# Bump this whenever the binary encoding itself changes.
+BIN_ENCODING_VERSION = 1
+
+def libxl_C_bin_schema(types):
+    """Returns a hash identifying the layout of the binary encoding of types"""
+
+    def describe(ty):
+        if ty is None:
+            return "-"
+        if isinstance(ty, idl.Array):
+            return "array(%s,%s)" % (describe(ty.elem_type), ty.lenvar.name)
+        if isinstance(ty, idl.Enumeration):
+            return "enum %s{%s}" % (ty.typename,
+                                   ",".join(["%s=%d" % (v.name, v.value)
+                                             for v in ty.values]))
+        if isinstance(ty, idl.KeyedUnion):
+            return "keyed(%s:%s){%s}" % (ty.keyvar.name,
+                                         describe(ty.keyvar.type),
+                                         ",".join(["%s:%s" % (f.enumname, describe(f.type))
+                                                   for f in ty.fields]))
+        if isinstance(ty, idl.Aggregate) and ty.typename is None:
+            return "%s{%s}" % (ty.kind,
+                               ",".join(["%s:%s" % (f.name, describe(f.type))
+                                         for f in ty.fields
+                                         if not f.const and not f.type.private]))
+        if isinstance(ty, idl.Number):
+            return "%s%s" % (ty.typename, "/s" if ty.signed else "")
+        return ty.typename
+
+    s = "v%d\n" % BIN_ENCODING_VERSION
+    for ty in types:
+        if isinstance(ty, idl.Aggregate) and ty.typename is not None:
+            s += "%s=%s{%s}\n" % (ty.typename, ty.kind,
+                                  ",".join(["%s:%s" % (f.name, describe(f.type))
+                                            for f in ty.fields
+                                            if not f.const and not f.type.private]))
+        else:
+            s += describe(ty) + "\n"
+    return hashlib.sha256(s.encode("utf-8")).hexdigest()[:16]
+
 def libxl_C_enum_to_string(ty, e, indent = "    "):
     s = ""
     s += "switch(%s) {\n" % e
@@ -597,6 +773,11 @@ if __name__ == '__main__':
 
     (builtins,types) = idl.parse(idlname)
 
+    bin_types = [t for t in types if isinstance(t, idl.Aggregate) and
+                 t.bin_gen_fn is not None and t.autogenerate_json]
+    bin_schema_define = "LIBXL__" + \
+        idlname.split('/')[-1].split('.')[0].upper().replace("LIBXL_", "", 1)
+
     print("outputting libxl type definitions to %s" % header)
 
     f = open(header, "w")
@@ -693,6 +874,16 @@ if __name__ == '__main__':
                 (ty.hidden(), ty.namespace + "_" + ty.rawname,
                  ty.make_arg("p", passby=idl.PASS_BY_REFERENCE)))
 
+    f.write("\n")
+    f.write("#define %s_BIN_SCHEMA UINT64_C(0x%s)\n" % \
+            (bin_schema_define, libxl_C_bin_schema(types)))
+    f.write("\n")
+    for ty in bin_types:
+        f.write("_hidden void %s(libxl__bin_buf *b, %s);\n" % \
+                (ty.bin_gen_fn, ty.make_arg("p", passby=idl.PASS_BY_REFERENCE)))
+        f.write("_hidden int %s(libxl__gc *gc, libxl__bin_cursor *c, %s);\n" % \
+                (ty.bin_parse_fn, ty.make_arg("p", passby=idl.PASS_BY_REFERENCE)))
+
     f.write("\n")
     f.write("""#endif /* %s */\n""" % header_json_define)
     f.close()
@@ -709,6 +900,7 @@ if __name__ == '__main__':
 
 #include "libxl_osdeps.h"
 
+#include <limits.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
@@ -797,4 +989,19 @@ if __name__ == '__main__':
         f.write("}\n")
         f.write("\n")
 
+    for ty in bin_types:
+        f.write("void %s(libxl__bin_buf *b, %s)\n" % \
+                (ty.bin_gen_fn, ty.make_arg("p", passby=idl.PASS_BY_REFERENCE)))
+        f.write("{\n")
+        f.write(libxl_C_type_gen_bin(ty, "p"))
+        f.write("}\n")
+        f.write("\n")
+
+        f.write("int %s(libxl__gc *gc, libxl__bin_cursor *c, %s)\n" % \
+                (ty.bin_parse_fn, ty.make_arg("p", passby=idl.PASS_BY_REFERENCE)))
+        f.write("{\n")
+        f.write(libxl_C_type_parse_bin(ty, "p"))
+        f.write("}\n")
+        f.write("\n")
+
     f.close()
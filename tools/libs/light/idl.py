@@ -93,6 +93,16 @@ class Type(object):
 
         self.autogenerate_json = kwargs.setdefault('autogenerate_json', True)
 
+        if self.typename is not None and not self.private and \
+           self.namespace is not None:
+            self.bin_gen_fn = kwargs.setdefault('bin_gen_fn',
+                                                self.namespace + "_" + self.rawname + "_gen_bin")
+            self.bin_parse_fn = kwargs.setdefault('bin_parse_fn',
+                                                  self.namespace + "_" + self.rawname + "_parse_bin")
+        else:
+            self.bin_gen_fn = kwargs.setdefault('bin_gen_fn', None)
+            self.bin_parse_fn = kwargs.setdefault('bin_parse_fn', None)
+
     def marshal_in(self):
         return self.dir in [DIR_IN, DIR_BOTH]
     def marshal_out(self):
@@ -292,6 +302,8 @@ bool = Builtin("bool", namespace = None,
                json_gen_fn = "yajl_gen_bool",
                json_parse_type = "JSON_BOOL",
                json_parse_fn = "libxl__bool_parse_json",
+               bin_gen_fn = "libxl__bool_gen_bin",
+               bin_parse_fn = "libxl__bool_parse_bin",
                autogenerate_json = False)
 
 size_t = Number("size_t", namespace = None)
@@ -307,6 +319,8 @@ string = Builtin("char *", namespace = None, copy_fn = "libxl_string_copy", disp
                  json_gen_fn = "libxl__string_gen_json",
                  json_parse_type = "JSON_STRING | JSON_NULL",
                  json_parse_fn = "libxl__string_parse_json",
+                 bin_gen_fn = "libxl__string_gen_bin",
+                 bin_parse_fn = "libxl__string_parse_bin",
                  autogenerate_json = False,
                  check_default_fn="libxl__string_is_default")
 
@@ -184,6 +184,8 @@ int libxl_ctx_free(libxl_ctx *ctx)
 
     free(ctx->watch_slots);
 
+    libxl__domconfig_cache_free(ctx);
+
     discard_events(&ctx->occurred);
 
     /* If we have outstanding children, then the application inherits
@@ -234,4 +234,5 @@ DEFINE_DEVICE_TYPE_STRUCT(p9, 9PFS, p9s,
     .set_xenstore_config = (device_set_xenstore_config_fn_t)
                            libxl__set_xenstore_p9,
     .dm_needed = libxl__device_p9_dm_needed,
+    .concurrent_attach = 1,
 );
@@ -555,7 +555,8 @@ static void async_exec_done(libxl__egc *egc,
 
     libxl__ev_time_deregister(gc, &aes->time);
 
-    if (status) {
+    /* run's exit status is the caller's to interpret. */
+    if (status && !(aes->run && WIFEXITED(status))) {
         if (!aes->rc)
             libxl_report_child_exitstatus(CTX, LIBXL__LOG_ERROR,
                                           aes->what, pid, status);
@@ -568,6 +569,7 @@ void libxl__async_exec_init(libxl__async_exec_state *aes)
 {
     libxl__ev_time_init(&aes->time);
     libxl__ev_child_init(&aes->child);
+    aes->run = NULL;
 }
 
 int libxl__async_exec_start(libxl__async_exec_state *aes)
@@ -601,6 +603,8 @@ int libxl__async_exec_start(libxl__async_exec_state *aes)
 
     if (!pid) {
         /* child */
+        if (aes->run)
+            _exit(aes->run(gc, aes));
         libxl__exec(gc, aes->stdfds[0], aes->stdfds[1],
                     aes->stdfds[2], args[0], args, aes->env);
     }
@@ -0,0 +1,512 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; version 2.1 only. with the special
+ * exception on linking described in file LICENSE.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ */
+
+/*
+ * Compact binary encoding of libxl IDL types.
+ *
+ * The per-type encoders and decoders are generated by gentypes.py; this
+ * file provides the primitives they are built from and the encodings of
+ * the builtin types.  Integers are stored as LEB128 varints (signed ones
+ * zigzag-encoded first), strings and arrays are length prefixed.
+ *
+ * The encoding is private to the host that wrote it: it is only used to
+ * cache data whose canonical form is JSON, and every blob is tagged with
+ * the LIBXL__*_BIN_SCHEMA hash of the IDL it was generated from.
+ */
+
+#include "libxl_osdeps.h" /* must come before any other headers */
+
+#include "libxl_internal.h"
+
+void libxl__bin_buf_init(libxl__gc *gc, libxl__bin_buf *b)
+{
+    b->gc = gc;
+    b->data = NULL;
+    b->used = 0;
+    b->size = 0;
+    b->rc = 0;
+}
+
+void libxl__bin_put(libxl__bin_buf *b, const void *data, size_t len)
+{
+    if (b->used + len > b->size) {
+        size_t size = b->size ? b->size : 256;
+
+        while (size < b->used + len)
+            size *= 2;
+        b->data = libxl__realloc(b->gc, b->data, size);
+        b->size = size;
+    }
+
+    memcpy(b->data + b->used, data, len);
+    b->used += len;
+}
+
+void libxl__bin_cursor_init(libxl__bin_cursor *c,
+                            const void *data, size_t len)
+{
+    c->p = data;
+    c->end = c->p + len;
+}
+
+int libxl__bin_get(libxl__bin_cursor *c, void *data, size_t len)
+{
+    if (len > (size_t)(c->end - c->p))
+        return ERROR_INVAL;
+
+    memcpy(data, c->p, len);
+    c->p += len;
+    return 0;
+}
+
+void libxl__uint_gen_bin(libxl__bin_buf *b, uint64_t v)
+{
+    uint8_t buf[10];
+    unsigned int n = 0;
+
+    do {
+        buf[n] = v & 0x7f;
+        v >>= 7;
+        if (v)
+            buf[n] |= 0x80;
+        n++;
+    } while (v);
+
+    libxl__bin_put(b, buf, n);
+}
+
+void libxl__int_gen_bin(libxl__bin_buf *b, int64_t v)
+{
+    libxl__uint_gen_bin(b, ((uint64_t)v << 1) ^ (uint64_t)(v >> 63));
+}
+
+int libxl__uint_parse_bin(libxl__bin_cursor *c, uint64_t *v)
+{
+    uint64_t r = 0;
+    unsigned int shift;
+
+    for (shift = 0; shift < 64; shift += 7) {
+        uint8_t byte;
+
+        if (c->p == c->end)
+            return ERROR_INVAL;
+
+        byte = *c->p++;
+        r |= (uint64_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            *v = r;
+            return 0;
+        }
+    }
+
+    return ERROR_INVAL;
+}
+
+int libxl__int_parse_bin(libxl__bin_cursor *c, int64_t *v)
+{
+    uint64_t u;
+    int rc;
+
+    rc = libxl__uint_parse_bin(c, &u);
+    if (rc)
+        return rc;
+
+    *v = (int64_t)(u >> 1) ^ -(int64_t)(u & 1);
+    return 0;
+}
+
+int libxl__bin_get_count(libxl__bin_cursor *c, int *count)
+{
+    uint64_t u;
+    int rc;
+
+    rc = libxl__uint_parse_bin(c, &u);
+    if (rc)
+        return rc;
+
+    /*
+     * Every element takes at least one byte, so a count larger than what
+     * is left can only come from a corrupt blob.  Refuse it before anyone
+     * tries to allocate for it.
+     */
+    if (u > INT_MAX || u > (uint64_t)(c->end - c->p))
+        return ERROR_INVAL;
+
+    *count = u;
+    return 0;
+}
+
+/*
+ * Builtin types
+ */
+
+void libxl__bool_gen_bin(libxl__bin_buf *b, bool v)
+{
+    uint8_t byte = v;
+
+    libxl__bin_put(b, &byte, 1);
+}
+
+int libxl__bool_parse_bin(libxl__gc *gc, libxl__bin_cursor *c, bool *p)
+{
+    uint8_t byte;
+    int rc;
+
+    rc = libxl__bin_get(c, &byte, 1);
+    if (rc)
+        return rc;
+    if (byte > 1)
+        return ERROR_INVAL;
+
+    *p = byte;
+    return 0;
+}
+
+void libxl__string_gen_bin(libxl__bin_buf *b, const char *p)
+{
+    size_t len;
+
+    /* 0 encodes NULL, otherwise the length plus one. */
+    if (!p) {
+        libxl__uint_gen_bin(b, 0);
+        return;
+    }
+
+    len = strlen(p);
+    libxl__uint_gen_bin(b, len + 1);
+    libxl__bin_put(b, p, len);
+}
+
+int libxl__string_parse_bin(libxl__gc *gc, libxl__bin_cursor *c, char **p)
+{
+    uint64_t len;
+    char *s;
+    int rc;
+
+    rc = libxl__uint_parse_bin(c, &len);
+    if (rc)
+        return rc;
+
+    if (!len) {
+        *p = NULL;
+        return 0;
+    }
+
+    len--;
+    if (len > (uint64_t)(c->end - c->p))
+        return ERROR_INVAL;
+
+    s = libxl__malloc(NOGC, len + 1);
+    memcpy(s, c->p, len);
+    s[len] = '\0';
+    c->p += len;
+
+    *p = s;
+    return 0;
+}
+
+void libxl__defbool_gen_bin(libxl__bin_buf *b, libxl_defbool *p)
+{
+    libxl__int_gen_bin(b, p->val);
+}
+
+int libxl__defbool_parse_bin(libxl__gc *gc, libxl__bin_cursor *c,
+                             libxl_defbool *p)
+{
+    int64_t v;
+    int rc;
+
+    rc = libxl__int_parse_bin(c, &v);
+    if (rc)
+        return rc;
+
+    switch (v) {
+    case LIBXL__DEFBOOL_DEFAULT:
+    case LIBXL__DEFBOOL_TRUE:
+    case LIBXL__DEFBOOL_FALSE:
+        p->val = v;
+        return 0;
+    default:
+        return ERROR_INVAL;
+    }
+}
+
+void libxl__domid_gen_bin(libxl__bin_buf *b, libxl_domid v)
+{
+    libxl__uint_gen_bin(b, v);
+}
+
+int libxl__domid_parse_bin(libxl__gc *gc, libxl__bin_cursor *c,
+                           libxl_domid *p)
+{
+    uint64_t v;
+    int rc;
+
+    rc = libxl__uint_parse_bin(c, &v);
+    if (rc)
+        return rc;
+    if (v > UINT32_MAX)
+        return ERROR_INVAL;
+
+    *p = v;
+    return 0;
+}
+
+void libxl__devid_gen_bin(libxl__bin_buf *b, libxl_devid v)
+{
+    libxl__int_gen_bin(b, v);
+}
+
+int libxl__devid_parse_bin(libxl__gc *gc, libxl__bin_cursor *c,
+                           libxl_devid *p)
+{
+    int64_t v;
+    int rc;
+
+    rc = libxl__int_parse_bin(c, &v);
+    if (rc)
+        return rc;
+    if (v < INT_MIN || v > INT_MAX)
+        return ERROR_INVAL;
+
+    *p = v;
+    return 0;
+}
+
+void libxl__uuid_gen_bin(libxl__bin_buf *b, libxl_uuid *p)
+{
+    libxl__bin_put(b, libxl_uuid_bytearray(p), 16);
+}
+
+int libxl__uuid_parse_bin(libxl__gc *gc, libxl__bin_cursor *c,
+                          libxl_uuid *p)
+{
+    return libxl__bin_get(c, libxl_uuid_bytearray(p), 16);
+}
+
+void libxl__mac_gen_bin(libxl__bin_buf *b, libxl_mac *p)
+{
+    libxl__bin_put(b, *p, sizeof(*p));
+}
+
+int libxl__mac_parse_bin(libxl__gc *gc, libxl__bin_cursor *c, libxl_mac *p)
+{
+    return libxl__bin_get(c, *p, sizeof(*p));
+}
+
+void libxl__bitmap_gen_bin(libxl__bin_buf *b, libxl_bitmap *p)
+{
+    libxl__uint_gen_bin(b, p->size);
+    if (p->size)
+        libxl__bin_put(b, p->map, p->size);
+}
+
+int libxl__bitmap_parse_bin(libxl__gc *gc, libxl__bin_cursor *c,
+                            libxl_bitmap *p)
+{
+    uint64_t size;
+    int rc;
+
+    rc = libxl__uint_parse_bin(c, &size);
+    if (rc)
+        return rc;
+
+    if (!size) {
+        libxl_bitmap_init(p);
+        return 0;
+    }
+
+    if (size > (uint64_t)(c->end - c->p))
+        return ERROR_INVAL;
+
+    p->size = size;
+    p->map = libxl__malloc(NOGC, size);
+    return libxl__bin_get(c, p->map, size);
+}
+
+void libxl__string_list_gen_bin(libxl__bin_buf *b, libxl_string_list *p)
+{
+    int i, n = libxl_string_list_length(p);
+
+    libxl__uint_gen_bin(b, n);
+    for (i = 0; i < n; i++)
+        libxl__string_gen_bin(b, (*p)[i]);
+}
+
+int libxl__string_list_parse_bin(libxl__gc *gc, libxl__bin_cursor *c,
+                                 libxl_string_list *p)
+{
+    libxl_string_list l;
+    int i, n, rc;
+
+    rc = libxl__bin_get_count(c, &n);
+    if (rc)
+        return rc;
+
+    if (!n) {
+        *p = NULL;
+        return 0;
+    }
+
+    /* need one extra slot as sentinel */
+    l = *p = libxl__calloc(NOGC, n + 1, sizeof(char *));
+
+    for (i = 0; i < n; i++) {
+        rc = libxl__string_parse_bin(gc, c, &l[i]);
+        if (rc)
+            return rc;
+        if (!l[i])
+            return ERROR_INVAL;
+    }
+
+    return 0;
+}
+
+void libxl__key_value_list_gen_bin(libxl__bin_buf *b,
+                                   libxl_key_value_list *p)
+{
+    libxl_key_value_list kvl = *p;
+    int i, n = 0;
+
+    if (kvl)
+        for (n = 0; kvl[n * 2]; n++)
+            ;
+
+    libxl__uint_gen_bin(b, n);
+    for (i = 0; i < n * 2; i++)
+        libxl__string_gen_bin(b, kvl[i]);
+}
+
+int libxl__key_value_list_parse_bin(libxl__gc *gc, libxl__bin_cursor *c,
+                                    libxl_key_value_list *p)
+{
+    libxl_key_value_list kvl;
+    int i, n, rc;
+
+    rc = libxl__bin_get_count(c, &n);
+    if (rc)
+        return rc;
+
+    if (!n) {
+        *p = NULL;
+        return 0;
+    }
+
+    kvl = *p = libxl__calloc(NOGC, n * 2 + 1, sizeof(char *));
+
+    for (i = 0; i < n * 2; i++) {
+        rc = libxl__string_parse_bin(gc, c, &kvl[i]);
+        if (rc)
+            return rc;
+        /* Only values may be NULL, a NULL key would end the list. */
+        if (!(i & 1) && !kvl[i])
+            return ERROR_INVAL;
+    }
+
+    return 0;
+}
+
+void libxl__hwcap_gen_bin(libxl__bin_buf *b, libxl_hwcap *p)
+{
+    int i;
+
+    for (i = 0; i < ARRAY_SIZE(*p); i++)
+        libxl__uint_gen_bin(b, (*p)[i]);
+}
+
+int libxl__hwcap_parse_bin(libxl__gc *gc, libxl__bin_cursor *c,
+                           libxl_hwcap *p)
+{
+    uint64_t v;
+    int i, rc;
+
+    for (i = 0; i < ARRAY_SIZE(*p); i++) {
+        rc = libxl__uint_parse_bin(c, &v);
+        if (rc)
+            return rc;
+        if (v > UINT32_MAX)
+            return ERROR_INVAL;
+        (*p)[i] = v;
+    }
+
+    return 0;
+}
+
+void libxl__ms_vm_genid_gen_bin(libxl__bin_buf *b, libxl_ms_vm_genid *p)
+{
+    libxl__bin_put(b, p->bytes, LIBXL_MS_VM_GENID_LEN);
+}
+
+int libxl__ms_vm_genid_parse_bin(libxl__gc *gc, libxl__bin_cursor *c,
+                                 libxl_ms_vm_genid *p)
+{
+    return libxl__bin_get(c, p->bytes, LIBXL_MS_VM_GENID_LEN);
+}
+
+/*
+ * The CPUID policy has no fixed layout of its own (it is architecture
+ * specific and opaque to the IDL), so it is carried as its JSON form.
+ * This is rarely set and small when it is.
+ */
+void libxl__cpuid_policy_list_gen_bin(libxl__bin_buf *b,
+                                      libxl_cpuid_policy_list *p)
+{
+    libxl__gc *gc = b->gc;
+    char *json;
+
+    if (libxl__cpuid_policy_is_empty(p)) {
+        libxl__string_gen_bin(b, NULL);
+        return;
+    }
+
+    json = libxl__object_to_json(CTX, "libxl_cpuid_policy_list",
+                (libxl__gen_json_callback)&libxl_cpuid_policy_list_gen_json,
+                p);
+    if (!json) {
+        if (!b->rc)
+            b->rc = ERROR_FAIL;
+        libxl__string_gen_bin(b, NULL);
+        return;
+    }
+
+    libxl__string_gen_bin(b, json);
+    free(json);
+}
+
+int libxl__cpuid_policy_list_parse_bin(libxl__gc *gc, libxl__bin_cursor *c,
+                                       libxl_cpuid_policy_list *p)
+{
+    const libxl__json_object *o;
+    char *json;
+    int rc;
+
+    rc = libxl__string_parse_bin(gc, c, &json);
+    if (rc)
+        return rc;
+    if (!json)
+        return 0;
+
+    o = libxl__json_parse(gc, json);
+    free(json);
+    if (!o)
+        return ERROR_INVAL;
+
+    return libxl__cpuid_policy_list_parse_json(gc, o, p);
+}
+
+/*
+ * Local variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
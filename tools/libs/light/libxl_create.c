@@ -1975,25 +1975,44 @@ static void domcreate_attach_devices(libxl__egc *egc,
     libxl_domain_config *const d_config = dcs->guest_config;
     const libxl__device_type *dt;
     char *tty_path;
+    bool attach = false;
+    int i;
 
     if (ret) {
-        LOGD(ERROR, domid, "unable to add %s devices",
-             libxl__device_kind_to_string(device_type_tbl[dcs->device_type_idx]->type));
+        for (i = dcs->device_type_first; i <= dcs->device_type_idx; i++)
+            LOGD(ERROR, domid, "unable to add %s devices",
+                 libxl__device_kind_to_string(device_type_tbl[i]->type));
         goto error_out;
     }
 
+    /*
+     * Consecutive types which allow it are attached in a single multidev
+     * round, so that e.g. nic and vtpm hotplug run concurrently.
+     */
     dcs->device_type_idx++;
-    dt = device_type_tbl[dcs->device_type_idx];
-    if (dt) {
+    dcs->device_type_first = dcs->device_type_idx;
+    while ((dt = device_type_tbl[dcs->device_type_idx])) {
         if (*libxl__device_type_get_num(dt, d_config) > 0 && !dt->skip_attach) {
-            /* Attach devices */
-            libxl__multidev_begin(ao, &dcs->multidev);
-            dcs->multidev.callback = domcreate_attach_devices;
+            if (!attach) {
+                libxl__multidev_begin(ao, &dcs->multidev);
+                dcs->multidev.callback = domcreate_attach_devices;
+                attach = true;
+            }
             dt->add(egc, ao, domid, d_config, &dcs->multidev);
-            libxl__multidev_prepared(egc, &dcs->multidev, 0);
-            return;
         }
+        if (!dt->concurrent_attach ||
+            !device_type_tbl[dcs->device_type_idx + 1] ||
+            !device_type_tbl[dcs->device_type_idx + 1]->concurrent_attach)
+            break;
+        dcs->device_type_idx++;
+    }
 
+    if (attach) {
+        libxl__multidev_prepared(egc, &dcs->multidev, 0);
+        return;
+    }
+
+    if (dt) {
         domcreate_attach_devices(egc, &dcs->multidev, 0);
         return;
     }
@@ -2139,7 +2158,26 @@ static int do_domain_create(libxl_ctx *ctx, libxl_domain_config *d_config,
 {
     AO_CREATE(ctx, 0, ao_how);
     libxl__app_domain_create_state *cdcs;
-    int rc;
+    int i, rc;
+
+    if (restore_fd >= 0 && params->num_aux_fds) {
+        if (params->checkpointed_stream != LIBXL_CHECKPOINTED_STREAM_NONE ||
+            params->stream_version == 1 ||
+            params->num_aux_fds > XC_MAX_AUX_STREAMS) {
+            LOG(ERROR, "%d auxiliary streams not supported by this stream",
+                params->num_aux_fds);
+            rc = ERROR_INVAL;
+            goto out_err;
+        }
+        for (i = 0; i < params->num_aux_fds; i++) {
+            if (params->aux_fds[i] <= 2) {
+                LOG(ERROR, "Invalid auxiliary stream fd %d",
+                    params->aux_fds[i]);
+                rc = ERROR_INVAL;
+                goto out_err;
+            }
+        }
+    }
 
     GCNEW(cdcs);
     cdcs->dcs.ao = ao;
@@ -728,6 +728,7 @@ void libxl__prepare_ao_device(libxl__ao *ao, libxl__ao_device *aodev)
     /* We init this here because we might call device_hotplug_done
      * without actually calling any hotplug script */
     libxl__async_exec_init(&aodev->aes);
+    aodev->native_ni = false;
     libxl__ev_child_init(&aodev->child);
 
     libxl__ev_qmp_init(&aodev->qmp);
@@ -968,6 +969,9 @@ static void device_hotplug_child_death_cb(libxl__egc *egc,
                                           libxl__async_exec_state *aes,
                                           int rc, int status);
 
+static void device_hotplug_script_done(libxl__egc *egc,
+                                       libxl__ao_device *aodev, int rc);
+
 static void device_destroy_be_watch_cb(libxl__egc *egc,
                                        libxl__xswait_state *xswait,
                                        int rc, const char *data);
@@ -1213,12 +1217,58 @@ static void device_backend_cleanup(libxl__gc *gc, libxl__ao_device *aodev)
     libxl__ev_devstate_cancel(gc, &aodev->backend_ds);
 }
 
+/*
+ * Returns the in-process handler to use instead of running script, or NULL.
+ * Only the stock scripts are replaced, and only if native hotplug has been
+ * enabled, since the handlers implement just the common subset of what
+ * the scripts do.
+ */
+static const libxl__hotplug_handler *device_hotplug_native_handler(
+    libxl__gc *gc, const char *script)
+{
+    const libxl__hotplug_handler *h;
+    const char *dir = libxl__xen_script_dir_path();
+    const char *env = getenv("LIBXL_HOTPLUG_NATIVE");
+    size_t len = strlen(dir);
+
+    if (!env || strcmp(env, "1"))
+        return NULL;
+    if (strncmp(script, dir, len) || script[len] != '/')
+        return NULL;
+
+    for (h = libxl__hotplug_handlers; h->script; h++)
+        if (!strcmp(script + len + 1, h->script))
+            return h;
+
+    return NULL;
+}
+
+/*
+ * Runs in the child, in place of the script.  The exit status is the
+ * handler's libxl error code, negated.
+ */
+static int device_hotplug_native_run(libxl__gc *gc,
+                                     libxl__async_exec_state *aes)
+{
+    libxl__ao_device *aodev = CONTAINER_OF(aes, *aodev, aes);
+    const libxl__hotplug_handler *handler =
+        device_hotplug_native_handler(gc, aes->args[0]);
+    int rc;
+
+    rc = libxl__ev_child_xenstore_reopen(gc, aes->what);
+    if (!rc)
+        rc = handler->run(gc, aodev->dev, aodev->action, aes->args, aes->env);
+
+    return -rc;
+}
+
 static void device_hotplug(libxl__egc *egc, libxl__ao_device *aodev)
 {
     STATE_AO_GC(aodev->ao);
     libxl__async_exec_state *aes = &aodev->aes;
     char *be_path = libxl__device_backend_path(gc, aodev->dev);
     char **args = NULL, **env = NULL;
+    const libxl__hotplug_handler *handler;
     int rc = 0;
     int hotplug, nullfd = -1;
     uint32_t domid;
@@ -1307,10 +1357,16 @@ static void device_hotplug(libxl__egc *egc, libxl__ao_device *aodev)
         goto out;
     }
 
+    handler = aodev->native_ni ? NULL
+                               : device_hotplug_native_handler(gc, args[0]);
+
     aes->ao = ao;
-    aes->what = GCSPRINTF("%s %s", args[0], args[1]);
+    aes->what = handler
+        ? GCSPRINTF("native hotplug %s %s", handler->script, args[1])
+        : GCSPRINTF("%s %s", args[0], args[1]);
     aes->env = env;
     aes->args = args;
+    aes->run = handler ? device_hotplug_native_run : NULL;
     aes->callback = device_hotplug_child_death_cb;
     aes->timeout_ms = LIBXL_HOTPLUG_TIMEOUT * 1000;
     aes->stdfds[0] = nullfd;
@@ -1344,6 +1400,20 @@ static void device_hotplug_child_death_cb(libxl__egc *egc,
 
     device_hotplug_clean(gc, aodev);
 
+    if (aes->run && !rc && WIFEXITED(status)) {
+        rc = -WEXITSTATUS(status);
+        if (rc == ERROR_NI) {
+            LOGD(DEBUG, aodev->dev->domid,
+                 "%s does not handle this device, running script", aes->what);
+            aodev->native_ni = true;
+            device_hotplug(egc, aodev);
+            return;
+        }
+        LOGD(DEBUG, aodev->dev->domid, "%s: rc %d", aes->what, rc);
+        device_hotplug_script_done(egc, aodev, rc);
+        return;
+    }
+
     if (status && !rc) {
         hotplug_error = libxl__xs_read(gc, XBT_NULL,
                                        GCSPRINTF("%s/hotplug-error", be_path));
@@ -1352,6 +1422,16 @@ static void device_hotplug_child_death_cb(libxl__egc *egc,
         rc = ERROR_FAIL;
     }
 
+    device_hotplug_script_done(egc, aodev, rc);
+}
+
+/*
+ * Called once a hotplug script, or the native handler replacing it, has
+ * completed with result rc.
+ */
+static void device_hotplug_script_done(libxl__egc *egc,
+                                       libxl__ao_device *aodev, int rc)
+{
     if (rc) {
         if (!aodev->rc)
             aodev->rc = rc;
@@ -1367,6 +1447,7 @@ static void device_hotplug_child_death_cb(libxl__egc *egc,
      * If no more executions are needed, device_hotplug will call
      * device_hotplug_done breaking the loop.
      */
+    aodev->native_ni = false;
     aodev->num_exec++;
     device_hotplug(egc, aodev);
 
@@ -1296,6 +1296,39 @@ out:
     return;
 }
 
+/*
+ * Make sure the mtime of the new copy of a userdata file, open as fd, is
+ * later than that of the copy it is about to replace at filename.  Those
+ * checking whether a userdata file changed (see domconfig_stamp) can then
+ * rely on the mtime even when a rewrite lands within the timestamp
+ * granularity of the filesystem, or the clock goes backwards.
+ */
+static int userdata_advance_mtime(libxl__gc *gc, int fd, const char *filename)
+{
+    struct stat old, new;
+    struct timespec ts[2];
+
+    if (stat(filename, &old))
+        return errno == ENOENT ? 0 : ERROR_FAIL;
+    if (fstat(fd, &new))
+        return ERROR_FAIL;
+
+    if (new.st_mtim.tv_sec > old.st_mtim.tv_sec ||
+        (new.st_mtim.tv_sec == old.st_mtim.tv_sec &&
+         new.st_mtim.tv_nsec > old.st_mtim.tv_nsec))
+        return 0;
+
+    ts[0].tv_sec = 0;
+    ts[0].tv_nsec = UTIME_OMIT;
+    ts[1] = old.st_mtim;
+    if (++ts[1].tv_nsec == 1000000000L) {
+        ts[1].tv_sec++;
+        ts[1].tv_nsec = 0;
+    }
+
+    return futimens(fd, ts) ? ERROR_FAIL : 0;
+}
+
 int libxl__userdata_store(libxl__gc *gc, uint32_t domid,
                           const char *userdata_userid,
                           const uint8_t *data, int datalen)
@@ -1331,6 +1364,9 @@ int libxl__userdata_store(libxl__gc *gc, uint32_t domid,
     if (libxl_write_exactly(CTX, fd, data, datalen, "userdata", newfilename))
         goto err;
 
+    if (userdata_advance_mtime(gc, fd, filename))
+        goto err;
+
     if (close(fd) < 0) {
         fd = -1;
         goto err;
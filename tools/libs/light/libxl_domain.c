@@ -502,11 +502,13 @@ static void domain_suspend_cb(libxl__egc *egc,
 
 }
 
-int libxl_domain_suspend(libxl_ctx *ctx, uint32_t domid, int fd, int flags,
-                         const libxl_asyncop_how *ao_how)
+static int domain_suspend(libxl_ctx *ctx, uint32_t domid, int fd,
+                          const int *aux_fds, int num_aux_fds,
+                          const libxl_domain_precopy_params *precopy,
+                          int flags, const libxl_asyncop_how *ao_how)
 {
     AO_CREATE(ctx, domid, ao_how);
-    int rc;
+    int i, rc;
 
     libxl_domain_type type = libxl__domain_type(gc, domid);
     if (type == LIBXL_DOMAIN_TYPE_INVALID) {
@@ -514,6 +516,26 @@ int libxl_domain_suspend(libxl_ctx *ctx, uint32_t domid, int fd, int flags,
         goto out_err;
     }
 
+    if (num_aux_fds < 0 || num_aux_fds > XC_MAX_AUX_STREAMS) {
+        LOGD(ERROR, domid, "Invalid number of auxiliary streams %d",
+             num_aux_fds);
+        rc = ERROR_INVAL;
+        goto out_err;
+    }
+    for (i = 0; i < num_aux_fds; i++) {
+        if (aux_fds[i] <= 2) {
+            LOGD(ERROR, domid, "Invalid auxiliary stream fd %d", aux_fds[i]);
+            rc = ERROR_INVAL;
+            goto out_err;
+        }
+    }
+    if (precopy && precopy->max_throttle >= 100) {
+        LOGD(ERROR, domid, "Invalid precopy throttle %u%%",
+             precopy->max_throttle);
+        rc = ERROR_INVAL;
+        goto out_err;
+    }
+
     libxl__domain_save_state *dss;
     GCNEW(dss);
 
@@ -522,10 +544,20 @@ int libxl_domain_suspend(libxl_ctx *ctx, uint32_t domid, int fd, int flags,
 
     dss->domid = domid;
     dss->fd = fd;
+    if (num_aux_fds) {
+        int *fds;
+
+        GCNEW_ARRAY(fds, num_aux_fds);
+        memcpy(fds, aux_fds, num_aux_fds * sizeof(*fds));
+        dss->aux_fds = fds;
+    }
+    dss->num_aux_fds = num_aux_fds;
     dss->type = type;
     dss->live = flags & LIBXL_SUSPEND_LIVE;
     dss->debug = flags & LIBXL_SUSPEND_DEBUG;
     dss->checkpointed_stream = LIBXL_CHECKPOINTED_STREAM_NONE;
+    if (precopy)
+        dss->precopy = *precopy;
 
     rc = libxl__fd_flags_modify_save(gc, dss->fd,
                                      ~(O_NONBLOCK|O_NDELAY), 0,
@@ -539,6 +571,21 @@ int libxl_domain_suspend(libxl_ctx *ctx, uint32_t domid, int fd, int flags,
     return AO_CREATE_FAIL(rc);
 }
 
+int libxl_domain_suspend(libxl_ctx *ctx, uint32_t domid, int fd, int flags,
+                         const libxl_asyncop_how *ao_how)
+{
+    return domain_suspend(ctx, domid, fd, NULL, 0, NULL, flags, ao_how);
+}
+
+int libxl_domain_suspend_streams(libxl_ctx *ctx, uint32_t domid, int fd,
+                                 const int *aux_fds, int num_aux_fds,
+                                 const libxl_domain_precopy_params *precopy,
+                                 int flags, const libxl_asyncop_how *ao_how)
+{
+    return domain_suspend(ctx, domid, fd, aux_fds, num_aux_fds, precopy,
+                          flags, ao_how);
+}
+
 static void domain_suspend_empty_cb(libxl__egc *egc,
                               libxl__domain_suspend_state *dss, int rc)
 {
@@ -1571,9 +1618,17 @@ static void devices_destroy_cb(libxl__egc *egc,
         if (!ctx->xch) goto badchild;
 
         if (!dis->soft_reset) {
+            struct timespec start, end;
+
             rc = libxl__mark_domid_recent(gc, domid);
             if (rc) goto badchild;
+            clock_gettime(CLOCK_MONOTONIC, &start);
             rc = xc_domain_destroy(ctx->xch, domid);
+            clock_gettime(CLOCK_MONOTONIC, &end);
+            if (!rc)
+                LOGD(DEBUG, domid, "Hypervisor teardown took %ldms",
+                     (long)((end.tv_sec - start.tv_sec) * 1000 +
+                            (end.tv_nsec - start.tv_nsec) / 1000000));
         } else {
             rc = xc_domain_pause(ctx->xch, domid);
             if (rc < 0) goto badchild;
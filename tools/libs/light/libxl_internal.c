@@ -515,12 +515,276 @@ libxl__flock *libxl__lock_domid_history(libxl__gc *gc)
     return libxl__lock_file(gc, lockfile);
 }
 
+/*
+ * Binary domain configuration store and cache.
+ *
+ * The libxl-bin userdata file consists of a domconfig_bin_header followed
+ * by the output of libxl__domain_config_gen_bin.  The header records the
+ * stamp of the libxl-json file the configuration was taken from; the
+ * binary copy is only used while that still matches, so a libxl-json
+ * written by anyone else (or an older libxl-bin left over from a failed
+ * update) is never mistaken for current.
+ */
+
+#define DOMCONFIG_BIN_MAGIC 0x4342584cU /* "LXBC" */
+
+typedef struct {
+    uint32_t magic;
+    uint32_t csum;
+    uint64_t schema;
+    uint64_t len;
+    libxl__domconfig_stamp stamp;
+} domconfig_bin_header;
+
+static uint32_t domconfig_bin_csum(const uint8_t *data, size_t len)
+{
+    /* FNV-1a, only to catch torn or truncated files. */
+    uint32_t h = 2166136261U;
+
+    while (len--) {
+        h ^= *data++;
+        h *= 16777619U;
+    }
+
+    return h;
+}
+
+int libxl__domain_config_to_bin(libxl__gc *gc, libxl_domain_config *d_config,
+                                uint8_t **data_r, size_t *len_r)
+{
+    libxl__bin_buf b;
+
+    libxl__bin_buf_init(gc, &b);
+    libxl__domain_config_gen_bin(&b, d_config);
+    if (b.rc)
+        return b.rc;
+
+    *data_r = b.data;
+    *len_r = b.used;
+    return 0;
+}
+
+int libxl__domain_config_from_bin(libxl__gc *gc,
+                                  libxl_domain_config *d_config,
+                                  const uint8_t *data, size_t len)
+{
+    libxl__bin_cursor c;
+    int rc;
+
+    libxl_domain_config_init(d_config);
+
+    libxl__bin_cursor_init(&c, data, len);
+    rc = libxl__domain_config_parse_bin(gc, &c, d_config);
+    if (!rc && c.p != c.end)
+        rc = ERROR_INVAL;
+
+    if (rc) {
+        libxl_domain_config_dispose(d_config);
+        libxl_domain_config_init(d_config);
+    }
+    return rc;
+}
+
+static int domconfig_stamp(const char *path, libxl__domconfig_stamp *stamp)
+{
+    struct stat st;
+
+    if (stat(path, &st))
+        return ERROR_FAIL;
+
+    stamp->dev = st.st_dev;
+    stamp->ino = st.st_ino;
+    stamp->size = st.st_size;
+    stamp->mtime = st.st_mtim.tv_sec * 1000000000ULL + st.st_mtim.tv_nsec;
+    stamp->ctime = st.st_ctim.tv_sec * 1000000000ULL + st.st_ctim.tv_nsec;
+    return 0;
+}
+
+static bool domconfig_stamp_equal(const libxl__domconfig_stamp *a,
+                                  const libxl__domconfig_stamp *b)
+{
+    return a->dev == b->dev && a->ino == b->ino && a->size == b->size &&
+           a->mtime == b->mtime && a->ctime == b->ctime;
+}
+
+/* Returns a copy of the cached blob, allocated from gc. */
+static int domconfig_cache_get(libxl__gc *gc, const char *path,
+                               const libxl__domconfig_stamp *stamp,
+                               uint8_t **data_r, size_t *len_r)
+{
+    libxl__domconfig_cache_entry *e;
+    int i, rc = ERROR_NOTFOUND;
+
+    CTX_LOCK;
+    for (i = 0; i < LIBXL__DOMCONFIG_CACHE_SIZE; i++) {
+        e = &CTX->domconfig_cache[i];
+        if (!e->path || strcmp(e->path, path))
+            continue;
+        if (!domconfig_stamp_equal(&e->stamp, stamp))
+            break;
+
+        *data_r = libxl__malloc(gc, e->len);
+        memcpy(*data_r, e->data, e->len);
+        *len_r = e->len;
+        e->last_used = ++CTX->domconfig_cache_clock;
+        rc = 0;
+        break;
+    }
+    CTX_UNLOCK;
+
+    return rc;
+}
+
+static void domconfig_cache_put(libxl__gc *gc, const char *path,
+                                const libxl__domconfig_stamp *stamp,
+                                const uint8_t *data, size_t len)
+{
+    libxl__domconfig_cache_entry *e, *victim = NULL;
+    int i;
+
+    CTX_LOCK;
+    for (i = 0; i < LIBXL__DOMCONFIG_CACHE_SIZE; i++) {
+        e = &CTX->domconfig_cache[i];
+        if (e->path && !strcmp(e->path, path)) {
+            victim = e;
+            break;
+        }
+        /* Otherwise prefer a free slot, then the least recently used. */
+        if (!victim ||
+            (victim->path && (!e->path || e->last_used < victim->last_used)))
+            victim = e;
+    }
+
+    free(victim->path);
+    free(victim->data);
+    victim->path = libxl__strdup(NOGC, path);
+    victim->stamp = *stamp;
+    victim->data = libxl__malloc(NOGC, len);
+    memcpy(victim->data, data, len);
+    victim->len = len;
+    victim->last_used = ++CTX->domconfig_cache_clock;
+    CTX_UNLOCK;
+}
+
+void libxl__domconfig_cache_free(libxl_ctx *ctx)
+{
+    int i;
+
+    for (i = 0; i < LIBXL__DOMCONFIG_CACHE_SIZE; i++) {
+        free(ctx->domconfig_cache[i].path);
+        free(ctx->domconfig_cache[i].data);
+    }
+    memset(ctx->domconfig_cache, 0, sizeof(ctx->domconfig_cache));
+}
+
+/* Returns the payload of libxl-bin if it matches stamp, allocated from gc. */
+static int domconfig_bin_load(libxl__gc *gc, uint32_t domid,
+                              const libxl__domconfig_stamp *stamp,
+                              uint8_t **data_r, size_t *len_r)
+{
+    domconfig_bin_header hdr;
+    uint8_t *data = NULL;
+    int rc, len = 0;
+
+    rc = libxl__userdata_retrieve(gc, domid, "libxl-bin", &data, &len);
+    if (rc)
+        return rc;
+    libxl__ptr_add(gc, data);
+
+    if (len < sizeof(hdr))
+        return ERROR_NOTFOUND;
+    memcpy(&hdr, data, sizeof(hdr));
+
+    if (hdr.magic != DOMCONFIG_BIN_MAGIC ||
+        hdr.schema != LIBXL__TYPES_BIN_SCHEMA ||
+        hdr.len != len - sizeof(hdr) ||
+        !domconfig_stamp_equal(&hdr.stamp, stamp) ||
+        hdr.csum != domconfig_bin_csum(data + sizeof(hdr), hdr.len))
+        return ERROR_NOTFOUND;
+
+    *data_r = data + sizeof(hdr);
+    *len_r = hdr.len;
+    return 0;
+}
+
+static void domconfig_bin_save(libxl__gc *gc, uint32_t domid,
+                               const libxl__domconfig_stamp *stamp,
+                               const uint8_t *data, size_t len)
+{
+    domconfig_bin_header hdr;
+    uint8_t *buf;
+    int rc;
+
+    if (len > INT_MAX - sizeof(hdr))
+        return;
+
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = DOMCONFIG_BIN_MAGIC;
+    hdr.csum = domconfig_bin_csum(data, len);
+    hdr.schema = LIBXL__TYPES_BIN_SCHEMA;
+    hdr.len = len;
+    hdr.stamp = *stamp;
+
+    buf = libxl__malloc(gc, sizeof(hdr) + len);
+    memcpy(buf, &hdr, sizeof(hdr));
+    memcpy(buf + sizeof(hdr), data, len);
+
+    rc = libxl__userdata_store(gc, domid, "libxl-bin", buf, sizeof(hdr) + len);
+    if (rc)
+        LOGD(WARN, domid, "failed to store binary domain configuration");
+}
+
+/*
+ * Record d_config, which must be what the libxl-json file identified by
+ * path and stamp contains, in libxl-bin and the cache.  Failure here only
+ * costs performance, so it is not reported to the caller.
+ */
+static void domconfig_bin_refresh(libxl__gc *gc, uint32_t domid,
+                                  const char *path,
+                                  const libxl__domconfig_stamp *stamp,
+                                  libxl_domain_config *d_config)
+{
+    uint8_t *data;
+    size_t len;
+
+    if (libxl__domain_config_to_bin(gc, d_config, &data, &len)) {
+        LOGD(WARN, domid, "failed to encode domain configuration");
+        return;
+    }
+
+    domconfig_bin_save(gc, domid, stamp, data, len);
+    domconfig_cache_put(gc, path, stamp, data, len);
+}
+
 int libxl__get_domain_configuration(libxl__gc *gc, uint32_t domid,
                                     libxl_domain_config *d_config)
 {
-    uint8_t *data = NULL;
+    libxl__domconfig_stamp stamp;
+    const char *path;
+    uint8_t *data = NULL, *bin;
+    size_t bin_len;
     int rc, len;
 
+    /*
+     * The caller holds the userdata lock, so libxl-json cannot change
+     * between taking its stamp and reading it.  If it does not exist we
+     * let libxl__userdata_retrieve below sort out what that means.
+     */
+    path = libxl__userdata_path(gc, domid, "libxl-json", "d");
+    if (path && !domconfig_stamp(path, &stamp)) {
+        if (!domconfig_cache_get(gc, path, &stamp, &bin, &bin_len) &&
+            !libxl__domain_config_from_bin(gc, d_config, bin, bin_len))
+            return 0;
+
+        if (!domconfig_bin_load(gc, domid, &stamp, &bin, &bin_len) &&
+            !libxl__domain_config_from_bin(gc, d_config, bin, bin_len)) {
+            domconfig_cache_put(gc, path, &stamp, bin, bin_len);
+            return 0;
+        }
+    } else {
+        path = NULL;
+    }
+
     rc = libxl__userdata_retrieve(gc, domid, "libxl-json", &data, &len);
     if (rc) {
         LOGEVD(ERROR, rc, domid,
@@ -536,6 +800,9 @@ int libxl__get_domain_configuration(libxl__gc *gc, uint32_t domid,
     }
     rc = libxl_domain_config_from_json(CTX, d_config, (const char *)data);
 
+    if (!rc && path)
+        domconfig_bin_refresh(gc, domid, path, &stamp, d_config);
+
 out:
     free(data);
     return rc;
@@ -544,6 +811,8 @@ out:
 int libxl__set_domain_configuration(libxl__gc *gc, uint32_t domid,
                                     libxl_domain_config *d_config)
 {
+    libxl__domconfig_stamp stamp;
+    const char *path;
     char *d_config_json;
     int rc;
 
@@ -564,6 +833,10 @@ int libxl__set_domain_configuration(libxl__gc *gc, uint32_t domid,
         goto out;
     }
 
+    path = libxl__userdata_path(gc, domid, "libxl-json", "d");
+    if (path && !domconfig_stamp(path, &stamp))
+        domconfig_bin_refresh(gc, domid, path, &stamp, d_config);
+
 out:
     free(d_config_json);
     return rc;
@@ -663,6 +663,28 @@ struct libxl__gc {
     libxl_ctx *owner;
 };
 
+/*
+ * Per-ctx cache of binary encoded domain configurations, see
+ * libxl__get_domain_configuration.  An entry is valid for as long as the
+ * libxl-json userdata file it was derived from is unchanged, which is
+ * what the stamp records.  The times are in nanoseconds; a rewrite of the
+ * file by libxl__userdata_store always moves its mtime forward, so the
+ * stamp changes even if the inode is reused and the size is the same.
+ */
+typedef struct {
+    uint64_t dev, ino, size, mtime, ctime;
+} libxl__domconfig_stamp;
+
+#define LIBXL__DOMCONFIG_CACHE_SIZE 16
+
+typedef struct {
+    char *path; /* libxl-json userdata file; NULL if the slot is free */
+    libxl__domconfig_stamp stamp;
+    uint8_t *data;
+    size_t len;
+    uint64_t last_used;
+} libxl__domconfig_cache_entry;
+
 struct libxl__ctx {
     xentoollog_logger *lg;
     xc_interface *xch;
@@ -733,6 +755,9 @@ struct libxl__ctx {
 
     bool libxl_domain_need_memory_0x041200_called,
          libxl_domain_need_memory_called;
+
+    libxl__domconfig_cache_entry domconfig_cache[LIBXL__DOMCONFIG_CACHE_SIZE];
+    uint64_t domconfig_cache_clock;
 };
 
 /*
@@ -2693,6 +2718,12 @@ struct libxl__async_exec_state {
     int stdfds[3];
     char **args; /* execution arguments */
     char **env; /* execution environment */
+    /*
+     * optional, NULL after init: called in the child instead of
+     * executing args, whose return value is the child's exit status
+     * (which is then the caller's to interpret and report)
+     */
+    int (*run)(libxl__gc *gc, libxl__async_exec_state *aes);
 
     /* private */
     libxl__ev_time time;
@@ -2765,6 +2796,8 @@ struct libxl__ao_device {
     int num_exec;
     /* for calling hotplug scripts */
     libxl__async_exec_state aes;
+    /* the native handler doesn't cover this execution */
+    bool native_ni;
     /* If we need to update JSON config */
     bool update_json;
     /* for asynchronous execution of synchronous-only syscalls etc. */
@@ -3055,6 +3088,32 @@ _hidden int libxl__get_hotplug_script_info(libxl__gc *gc, libxl__device *dev,
                                            libxl__device_action action,
                                            int num_exec);
 
+/*
+ * In-process hotplug handlers.
+ *
+ * Each OS may provide native implementations of some of the stock hotplug
+ * scripts in libxl__hotplug_handlers[], terminated by an entry with a NULL
+ * script.  When the script libxl__get_hotplug_script_info asks for is one of
+ * the stock ones (in libxl__xen_script_dir_path()) and native hotplug is enabled
+ * (LIBXL_HOTPLUG_NATIVE=1 in the environment), device_hotplug calls the
+ * handler's run function instead of executing the script, in a child
+ * process with the script's timeout, since it may block.
+ *
+ * run is given the same args and env the script would have received and
+ * may use xenstore, but nothing else of the libxl event machinery.  It
+ * returns 0 on success, a libxl error code on failure (in which case it
+ * should have written hotplug-error to the backend, as a script would),
+ * or ERROR_NI if it does not handle this particular configuration, in
+ * which case the script is run as usual.
+ */
+typedef struct {
+    const char *script;
+    int (*run)(libxl__gc *gc, libxl__device *dev,
+               libxl__device_action action, char **args, char **env);
+} libxl__hotplug_handler;
+
+_hidden extern const libxl__hotplug_handler libxl__hotplug_handlers[];
+
 /*----- local disk attach: attach a disk locally to run the bootloader -----*/
 
 typedef struct libxl__disk_local_state libxl__disk_local_state;
@@ -3643,10 +3702,13 @@ struct libxl__domain_save_state {
     int fd;
     int fdfl; /* original flags on fd */
     int recv_fd;
+    const int *aux_fds;
+    int num_aux_fds;
     libxl_domain_type type;
     int live;
     int debug;
     int checkpointed_stream;
+    libxl_domain_precopy_params precopy;
     const libxl_domain_remus_info *remus;
     /* private */
     int rc;
@@ -3937,6 +3999,7 @@ typedef int (*device_set_xenstore_config_fn_t)(libxl__gc *, uint32_t, void *,
 struct libxl__device_type {
     libxl__device_kind type;
     int skip_attach;   /* Skip entry in domcreate_attach_devices() if 1 */
+    int concurrent_attach; /* May be attached together with the next type */
     int ptr_offset;    /* Offset of device array ptr in libxl_domain_config */
     int num_offset;    /* Offset of # of devices in libxl_domain_config */
     int dev_elem_size; /* Size of one device element in array */
@@ -4217,7 +4280,7 @@ struct libxl__domain_create_state {
     libxl_asyncprogress_how aop_console_how;
     /* private to domain_create */
     int guest_domid;
-    int device_type_idx;
+    int device_type_first, device_type_idx;
     const char *colo_proxy_script;
     libxl__domain_build_state build_state;
     libxl__colo_restore_state crs;
@@ -4682,6 +4745,86 @@ int libxl__string_parse_json(libxl__gc *gc, const libxl__json_object *o,
 
 int libxl__random_bytes(libxl__gc *gc, uint8_t *buf, size_t len);
 
+/*
+ * Binary encoding of IDL types, see libxl_bin.c.
+ *
+ * Encoders append to a libxl__bin_buf, whose data is allocated from the
+ * buf's gc.  They cannot fail individually; the rare failure (for types
+ * that have to go via JSON) is recorded in rc and must be checked once
+ * encoding is complete.  Decoders consume a libxl__bin_cursor and return
+ * ERROR_INVAL on truncated or malformed input; like the JSON parsers,
+ * whatever they allocate is owned by the object being decoded.
+ */
+typedef struct {
+    libxl__gc *gc;
+    uint8_t *data;
+    size_t used, size;
+    int rc;
+} libxl__bin_buf;
+
+typedef struct {
+    const uint8_t *p, *end;
+} libxl__bin_cursor;
+
+_hidden void libxl__bin_buf_init(libxl__gc *gc, libxl__bin_buf *b);
+_hidden void libxl__bin_put(libxl__bin_buf *b, const void *data, size_t len);
+_hidden void libxl__bin_cursor_init(libxl__bin_cursor *c,
+                                    const void *data, size_t len);
+_hidden int libxl__bin_get(libxl__bin_cursor *c, void *data, size_t len);
+/* Reads an array length, sanity checked against the remaining input. */
+_hidden int libxl__bin_get_count(libxl__bin_cursor *c, int *count);
+
+_hidden void libxl__uint_gen_bin(libxl__bin_buf *b, uint64_t v);
+_hidden void libxl__int_gen_bin(libxl__bin_buf *b, int64_t v);
+_hidden int libxl__uint_parse_bin(libxl__bin_cursor *c, uint64_t *v);
+_hidden int libxl__int_parse_bin(libxl__bin_cursor *c, int64_t *v);
+
+_hidden void libxl__bool_gen_bin(libxl__bin_buf *b, bool v);
+_hidden int libxl__bool_parse_bin(libxl__gc *gc, libxl__bin_cursor *c,
+                                  bool *p);
+_hidden void libxl__string_gen_bin(libxl__bin_buf *b, const char *p);
+_hidden int libxl__string_parse_bin(libxl__gc *gc, libxl__bin_cursor *c,
+                                    char **p);
+_hidden void libxl__defbool_gen_bin(libxl__bin_buf *b, libxl_defbool *p);
+_hidden int libxl__defbool_parse_bin(libxl__gc *gc, libxl__bin_cursor *c,
+                                     libxl_defbool *p);
+_hidden void libxl__domid_gen_bin(libxl__bin_buf *b, libxl_domid v);
+_hidden int libxl__domid_parse_bin(libxl__gc *gc, libxl__bin_cursor *c,
+                                   libxl_domid *p);
+_hidden void libxl__devid_gen_bin(libxl__bin_buf *b, libxl_devid v);
+_hidden int libxl__devid_parse_bin(libxl__gc *gc, libxl__bin_cursor *c,
+                                   libxl_devid *p);
+_hidden void libxl__uuid_gen_bin(libxl__bin_buf *b, libxl_uuid *p);
+_hidden int libxl__uuid_parse_bin(libxl__gc *gc, libxl__bin_cursor *c,
+                                  libxl_uuid *p);
+_hidden void libxl__mac_gen_bin(libxl__bin_buf *b, libxl_mac *p);
+_hidden int libxl__mac_parse_bin(libxl__gc *gc, libxl__bin_cursor *c,
+                                 libxl_mac *p);
+_hidden void libxl__bitmap_gen_bin(libxl__bin_buf *b, libxl_bitmap *p);
+_hidden int libxl__bitmap_parse_bin(libxl__gc *gc, libxl__bin_cursor *c,
+                                    libxl_bitmap *p);
+_hidden void libxl__string_list_gen_bin(libxl__bin_buf *b,
+                                        libxl_string_list *p);
+_hidden int libxl__string_list_parse_bin(libxl__gc *gc, libxl__bin_cursor *c,
+                                         libxl_string_list *p);
+_hidden void libxl__key_value_list_gen_bin(libxl__bin_buf *b,
+                                           libxl_key_value_list *p);
+_hidden int libxl__key_value_list_parse_bin(libxl__gc *gc,
+                                            libxl__bin_cursor *c,
+                                            libxl_key_value_list *p);
+_hidden void libxl__hwcap_gen_bin(libxl__bin_buf *b, libxl_hwcap *p);
+_hidden int libxl__hwcap_parse_bin(libxl__gc *gc, libxl__bin_cursor *c,
+                                   libxl_hwcap *p);
+_hidden void libxl__ms_vm_genid_gen_bin(libxl__bin_buf *b,
+                                        libxl_ms_vm_genid *p);
+_hidden int libxl__ms_vm_genid_parse_bin(libxl__gc *gc, libxl__bin_cursor *c,
+                                         libxl_ms_vm_genid *p);
+_hidden void libxl__cpuid_policy_list_gen_bin(libxl__bin_buf *b,
+                                              libxl_cpuid_policy_list *p);
+_hidden int libxl__cpuid_policy_list_parse_bin(libxl__gc *gc,
+                                               libxl__bin_cursor *c,
+                                               libxl_cpuid_policy_list *p);
+
 #include "_libxl_types_private.h"
 #include "_libxl_types_internal_private.h"
 
@@ -4733,6 +4876,25 @@ int libxl__get_domain_configuration(libxl__gc *gc, uint32_t domid,
 int libxl__set_domain_configuration(libxl__gc *gc, uint32_t domid,
                                     libxl_domain_config *d_config);
 
+/*
+ * The JSON stored under "libxl-json" is the canonical copy of a domain's
+ * configuration.  Alongside it libxl keeps the same configuration in the
+ * binary encoding (see libxl_bin.c) under "libxl-bin", tagged with the
+ * identity of the JSON file it was derived from, and caches recently used
+ * ones in the ctx.  Lookups prefer the cache, then libxl-bin, and only
+ * parse the JSON if neither matches it; it is therefore always safe to
+ * modify or delete libxl-json (e.g. via libxl_userdata_store) without
+ * telling anyone.
+ */
+_hidden int libxl__domain_config_to_bin(libxl__gc *gc,
+                                        libxl_domain_config *d_config,
+                                        uint8_t **data_r, size_t *len_r);
+/* On failure d_config is left initialised but empty. */
+_hidden int libxl__domain_config_from_bin(libxl__gc *gc,
+                                          libxl_domain_config *d_config,
+                                          const uint8_t *data, size_t len);
+_hidden void libxl__domconfig_cache_free(libxl_ctx *ctx);
+
 /* ------ Things related to updating domain configurations ----- */
 void libxl__update_domain_configuration(libxl__gc *gc,
                                         libxl_domain_config *dst,
@@ -0,0 +1,568 @@
+/*
+ * In-process implementations of the common Linux hotplug scripts.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; version 2.1 only. with the special
+ * exception on linking described in file LICENSE.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ */
+
+#include "libxl_osdeps.h" /* must come before any other headers */
+
+#include <dirent.h>
+#include <mntent.h>
+#include <net/if.h>
+#include <sys/socket.h>
+#include <sys/sysmacros.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+/* Also defined, slightly differently, by xen-tools/common-macros.h */
+#undef __AC
+#undef _AC
+
+#include "libxl_internal.h"
+
+/*
+ * These mirror what vif-bridge and block do in the configurations they
+ * are most commonly used with.  Anything else (a vif without a configured
+ * bridge, iptables rules, vif-post.d hooks, non-phy disks, ...) makes the
+ * handler return ERROR_NI so that the real script is run instead.
+ */
+
+#define HOTPLUG_LOCK_DIR "/var/run/xen-hotplug"
+
+static const char *hotplug_getenv(char **env, const char *key)
+{
+    unsigned int x;
+
+    if (!env)
+        return NULL;
+    for (x = 0; env[x]; x += 2)
+        if (!strcmp(env[x], key))
+            return env[x+1];
+    return NULL;
+}
+
+/* Equivalent of the scripts' fatal(): report the error via xenstore. */
+static void hotplug_fatal(libxl__gc *gc, libxl__device *dev,
+                          const char *be_path, const char *msg)
+{
+    LOGD(ERROR, dev->domid, "%s", msg);
+    libxl__xs_printf(gc, XBT_NULL, GCSPRINTF("%s/hotplug-error", be_path),
+                     "%s", msg);
+    libxl__xs_printf(gc, XBT_NULL, GCSPRINTF("%s/hotplug-status", be_path),
+                     "error");
+}
+
+static int hotplug_success(libxl__gc *gc, const char *be_path)
+{
+    return libxl__xs_printf(gc, XBT_NULL,
+                            GCSPRINTF("%s/hotplug-status", be_path),
+                            "connected");
+}
+
+/*----- rtnetlink -----*/
+
+typedef struct {
+    struct nlmsghdr nh;
+    struct ifinfomsg ifi;
+    char attrs[128];
+} link_req;
+
+static void link_req_init(link_req *req, int ifindex)
+{
+    memset(req, 0, sizeof(*req));
+    req->nh.nlmsg_len = NLMSG_LENGTH(sizeof(req->ifi));
+    req->nh.nlmsg_type = RTM_NEWLINK;
+    req->nh.nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK;
+    req->ifi.ifi_family = AF_UNSPEC;
+    req->ifi.ifi_index = ifindex;
+}
+
+static void link_req_flags(link_req *req, bool up)
+{
+    req->ifi.ifi_change |= IFF_UP;
+    req->ifi.ifi_flags = up ? IFF_UP : 0;
+}
+
+static void link_req_attr(link_req *req, int type, const void *data,
+                          size_t len)
+{
+    struct rtattr *rta;
+    size_t off = NLMSG_ALIGN(req->nh.nlmsg_len);
+
+    assert(off + RTA_SPACE(len) <= sizeof(*req));
+    rta = (struct rtattr *)((char *)req + off);
+    rta->rta_type = type;
+    rta->rta_len = RTA_LENGTH(len);
+    memcpy(RTA_DATA(rta), data, len);
+    req->nh.nlmsg_len = off + RTA_SPACE(len);
+}
+
+static void link_req_u32(link_req *req, int type, uint32_t val)
+{
+    link_req_attr(req, type, &val, sizeof(val));
+}
+
+/* Sends req and waits for the kernel's ack.  Returns 0 or an errno value. */
+static int link_req_send(int fd, link_req *req)
+{
+    static const struct sockaddr_nl kernel = { .nl_family = AF_NETLINK };
+    char buf[1024];
+    struct nlmsghdr *nh;
+    ssize_t r;
+
+    r = sendto(fd, req, req->nh.nlmsg_len, 0,
+               (const struct sockaddr *)&kernel, sizeof(kernel));
+    if (r < 0)
+        return errno;
+
+    for (;;) {
+        r = recv(fd, buf, sizeof(buf), 0);
+        if (r < 0) {
+            if (errno == EINTR)
+                continue;
+            return errno;
+        }
+        for (nh = (struct nlmsghdr *)buf; NLMSG_OK(nh, r);
+             nh = NLMSG_NEXT(nh, r)) {
+            if (nh->nlmsg_type == NLMSG_ERROR) {
+                struct nlmsgerr *err = NLMSG_DATA(nh);
+                return -err->error;
+            }
+        }
+    }
+}
+
+/*----- vif-bridge -----*/
+
+static int sysfs_net_exists(libxl__gc *gc, const char *dev, const char *what)
+{
+    return !access(GCSPRINTF("/sys/class/net/%s%s", dev, what), F_OK);
+}
+
+static uint32_t sysfs_net_mtu(libxl__gc *gc, const char *dev)
+{
+    FILE *f;
+    unsigned int mtu = 0;
+
+    f = fopen(GCSPRINTF("/sys/class/net/%s/mtu", dev), "r");
+    if (!f)
+        return 0;
+    if (fscanf(f, "%u", &mtu) != 1)
+        mtu = 0;
+    fclose(f);
+    return mtu;
+}
+
+static bool vif_post_hooks_present(libxl__gc *gc)
+{
+    DIR *dir;
+    struct dirent *de;
+    bool found = false;
+    size_t len;
+
+    dir = opendir(GCSPRINTF("%s/vif-post.d", libxl__xen_script_dir_path()));
+    if (!dir)
+        return false;
+    while ((de = readdir(dir))) {
+        len = strlen(de->d_name);
+        if (len > 5 && !strcmp(de->d_name + len - 5, ".hook")) {
+            found = true;
+            break;
+        }
+    }
+    closedir(dir);
+    return found;
+}
+
+/*
+ * Whether vif-common.sh's handle_iptable would find an iptables binary,
+ * searching the directories xen-hotplug-common.sh puts on the PATH.
+ */
+static bool iptables_present(libxl__gc *gc)
+{
+    static const char *const dirs[] = { "/sbin", "/bin", "/usr/bin",
+                                        "/usr/sbin" };
+    const char *path = getenv("PATH");
+    char *p, *dir, *saveptr;
+    unsigned int i;
+
+    for (i = 0; i < ARRAY_SIZE(dirs); i++)
+        if (!access(GCSPRINTF("%s/iptables", dirs[i]), X_OK))
+            return true;
+    if (!path)
+        return false;
+    p = libxl__strdup(gc, path);
+    for (dir = strtok_r(p, ":", &saveptr); dir;
+         dir = strtok_r(NULL, ":", &saveptr))
+        if (*dir && !access(GCSPRINTF("%s/iptables", dir), X_OK))
+            return true;
+    return false;
+}
+
+static int hotplug_vif_bridge(libxl__gc *gc, libxl__device *dev,
+                              libxl__device_action action,
+                              char **args, char **env)
+{
+    const char *be_path = libxl__device_backend_path(gc, dev);
+    const char *command = args[1];
+    bool is_vif, online;
+    const char *devname, *vifname, *bridge, *mtu_str, *ip;
+    static const uint8_t mac[6] = { 0xfe, 0xff, 0xff, 0xff, 0xff, 0xff };
+    uint32_t mtu = 0;
+    int ifindex, brindex, fd = -1, r, rc;
+    link_req req;
+
+    if (!args[2])
+        return ERROR_NI;
+    if (!strcmp(args[2], "type_if=vif")) {
+        is_vif = true;
+        devname = hotplug_getenv(env, "vif");
+    } else if (!strcmp(args[2], "type_if=tap")) {
+        is_vif = false;
+        devname = hotplug_getenv(env, "INTERFACE");
+    } else {
+        return ERROR_NI;
+    }
+    if (!devname)
+        return ERROR_NI;
+
+    if (!strcmp(command, "online") || !strcmp(command, "add"))
+        online = true;
+    else if (!strcmp(command, "offline") || !strcmp(command, "remove"))
+        online = false;
+    else
+        return ERROR_NI;
+
+    ip = libxl__xs_read(gc, XBT_NULL, GCSPRINTF("%s/ip", be_path));
+    if (ip && *ip)
+        return ERROR_NI; /* antispoofing rules are left to the script */
+    /*
+     * Even without ip=, the script adds (and on offline removes) FORWARD
+     * ACCEPT rules for the device through handle_iptable.
+     */
+    if (iptables_present(gc))
+        return ERROR_NI;
+    if (vif_post_hooks_present(gc))
+        return ERROR_NI;
+
+    bridge = libxl__xs_read(gc, XBT_NULL, GCSPRINTF("%s/bridge", be_path));
+    if (!bridge || !*bridge)
+        return ERROR_NI; /* let the script pick a default bridge */
+    if (!sysfs_net_exists(gc, bridge, "") &&
+        !strncmp(bridge, "xenbr", 5)) {
+        const char *eth = GCSPRINTF("eth%s", bridge + 5);
+        if (sysfs_net_exists(gc, eth, "/bridge"))
+            bridge = eth;
+    }
+
+    vifname = libxl__xs_read(gc, XBT_NULL, GCSPRINTF("%s/vifname", be_path));
+    if (vifname && *vifname) {
+        if (!is_vif)
+            vifname = GCSPRINTF("%s-emu", vifname);
+    } else {
+        vifname = NULL;
+    }
+
+    fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+    if (fd < 0) {
+        LOGED(ERROR, dev->domid, "unable to open rtnetlink socket");
+        rc = ERROR_FAIL;
+        goto out;
+    }
+
+    if (!online) {
+        /* Like the script, ignore errors: the device may already be gone. */
+        ifindex = if_nametoindex(vifname ? : devname);
+        if (ifindex) {
+            link_req_init(&req, ifindex);
+            link_req_u32(&req, IFLA_MASTER, 0);
+            link_req_flags(&req, false);
+            r = link_req_send(fd, &req);
+            if (r)
+                LOGEVD(DEBUG, r, dev->domid, "unable to detach %s from %s",
+                       vifname ? : devname, bridge);
+        }
+        rc = 0;
+        goto out;
+    }
+
+    brindex = if_nametoindex(bridge);
+    if (!brindex || !sysfs_net_exists(gc, bridge, "/bridge")) {
+        hotplug_fatal(gc, dev, be_path,
+                      GCSPRINTF("Could not find bridge device %s", bridge));
+        rc = ERROR_FAIL;
+        goto out;
+    }
+
+    ifindex = if_nametoindex(devname);
+    if (vifname && if_nametoindex(vifname)) {
+        /* Already renamed, e.g. by an earlier attempt. */
+        ifindex = if_nametoindex(vifname);
+        devname = vifname;
+        vifname = NULL;
+    }
+    if (!ifindex) {
+        hotplug_fatal(gc, dev, be_path,
+                      GCSPRINTF("Cannot find device %s", devname));
+        rc = ERROR_FAIL;
+        goto out;
+    }
+
+    link_req_init(&req, ifindex);
+    link_req_flags(&req, false);
+    r = link_req_send(fd, &req);
+    if (r) {
+        LOGEVD(ERROR, r, dev->domid, "unable to bring %s down", devname);
+        goto fail;
+    }
+
+    mtu_str = libxl__xs_read(gc, XBT_NULL, GCSPRINTF("%s/mtu", be_path));
+    if (mtu_str && *mtu_str)
+        mtu = strtoul(mtu_str, NULL, 10);
+    else
+        mtu = sysfs_net_mtu(gc, bridge);
+
+    link_req_init(&req, ifindex);
+    if (vifname) {
+        link_req_attr(&req, IFLA_IFNAME, vifname, strlen(vifname) + 1);
+        devname = vifname;
+    }
+    link_req_attr(&req, IFLA_ADDRESS, mac, sizeof(mac));
+    if (mtu)
+        link_req_u32(&req, IFLA_MTU, mtu);
+    r = link_req_send(fd, &req);
+    if (r) {
+        LOGEVD(ERROR, r, dev->domid, "unable to configure %s", devname);
+        goto fail;
+    }
+
+    if (is_vif && mtu) {
+        rc = libxl__xs_printf(gc, XBT_NULL,
+                              GCSPRINTF("/local/domain/%u/device/vif/%d/mtu",
+                                        dev->domid, dev->devid),
+                              "%u", mtu);
+        if (rc) goto out;
+    }
+
+    link_req_init(&req, ifindex);
+    link_req_u32(&req, IFLA_MASTER, brindex);
+    link_req_flags(&req, true);
+    r = link_req_send(fd, &req);
+    if (r) {
+        LOGEVD(ERROR, r, dev->domid, "unable to add %s to bridge %s",
+               devname, bridge);
+        goto fail;
+    }
+
+    LOGD(DEBUG, dev->domid, "Successful vif-bridge %s for %s, bridge %s",
+         command, devname, bridge);
+
+    rc = 0;
+    if (is_vif)
+        rc = hotplug_success(gc, be_path);
+    goto out;
+
+fail:
+    hotplug_fatal(gc, dev, be_path,
+                  GCSPRINTF("vif-bridge %s failed for %s: %s",
+                            command, devname, strerror(r)));
+    rc = ERROR_FAIL;
+out:
+    if (fd >= 0) close(fd);
+    return rc;
+}
+
+/*----- block -----*/
+
+/* Same as canonicalise_mode in block-common.sh. */
+static char block_mode(const char *mode)
+{
+    if (!mode || !strchr(mode, 'w'))
+        return 'r';
+    if (!strchr(mode, '!'))
+        return 'w';
+    return '!';
+}
+
+/* Same as same_vm in the block script. */
+static bool block_same_vm(libxl__gc *gc, libxl__device *dev,
+                          const char *frontend_vm, const char *otherdom)
+{
+    const char *othervm, *target, *targetvm;
+
+    othervm = libxl__xs_read(gc, XBT_NULL,
+                             GCSPRINTF("/local/domain/%s/vm", otherdom));
+    if (!othervm)
+        othervm = frontend_vm;
+    if (!strcmp(othervm, frontend_vm))
+        return true;
+
+    target = libxl__xs_read(gc, XBT_NULL,
+                            GCSPRINTF("/local/domain/%u/target", dev->domid));
+    if (!target)
+        return false;
+    if (!strcmp(target, otherdom))
+        return true;
+    targetvm = libxl__xs_read(gc, XBT_NULL,
+                              GCSPRINTF("/local/domain/%s/vm", target));
+    return targetvm && !strcmp(targetvm, frontend_vm);
+}
+
+/*
+ * Returns NULL if the device may be used in the requested mode, or else
+ * a description of the conflicting user.
+ */
+static const char *block_check_sharing(libxl__gc *gc, libxl__device *dev,
+                                       const char *be_path, dev_t rdev,
+                                       char mode)
+{
+    const char *frontend_vm, *devmm, *base, *m, *pd;
+    char **doms, **devs;
+    unsigned int ndoms, ndevs, i, j;
+    struct mntent *ent;
+    struct stat st;
+    FILE *mounts;
+
+    mounts = setmntent("/proc/mounts", "r");
+    if (mounts) {
+        while ((ent = getmntent(mounts))) {
+            if (mode != 'w' && hasmntopt(ent, "ro"))
+                continue;
+            if (stat(ent->mnt_fsname, &st) || !S_ISBLK(st.st_mode))
+                continue;
+            if (st.st_rdev == rdev) {
+                endmntent(mounts);
+                return "local";
+            }
+        }
+        endmntent(mounts);
+    }
+
+    frontend_vm = libxl__xs_read(gc, XBT_NULL,
+                                 GCSPRINTF("/local/domain/%u/vm", dev->domid));
+    if (!frontend_vm)
+        frontend_vm = "unknown";
+
+    devmm = GCSPRINTF("%x:%x", major(rdev), minor(rdev));
+    base = GCSPRINTF("/local/domain/%u/backend/vbd", dev->backend_domid);
+    doms = libxl__xs_directory(gc, XBT_NULL, base, &ndoms);
+    for (i = 0; i < ndoms; i++) {
+        devs = libxl__xs_directory(gc, XBT_NULL,
+                                   GCSPRINTF("%s/%s", base, doms[i]), &ndevs);
+        for (j = 0; j < ndevs; j++) {
+            const char *p = GCSPRINTF("%s/%s/%s", base, doms[i], devs[j]);
+
+            if (!strcmp(p, be_path))
+                continue;
+            pd = libxl__xs_read(gc, XBT_NULL,
+                                GCSPRINTF("%s/physical-device", p));
+            if (!pd || strcmp(pd, devmm))
+                continue;
+            if (mode != 'w') {
+                m = libxl__xs_read(gc, XBT_NULL, GCSPRINTF("%s/mode", p));
+                if (block_mode(m) != 'w')
+                    continue;
+            }
+            if (!block_same_vm(gc, dev, frontend_vm, doms[i]))
+                return "guest";
+        }
+    }
+
+    return NULL;
+}
+
+static int hotplug_block(libxl__gc *gc, libxl__device *dev,
+                         libxl__device_action action,
+                         char **args, char **env)
+{
+    const char *be_path = libxl__device_backend_path(gc, dev);
+    const char *type, *params, *mode, *conflict;
+    char *path, *real;
+    libxl__flock *lock = NULL;
+    struct stat st;
+    char m;
+    int rc;
+
+    type = libxl__xs_read(gc, XBT_NULL, GCSPRINTF("%s/type", be_path));
+    if (!type || strcmp(type, "phy"))
+        return ERROR_NI;
+
+    if (action == LIBXL__DEVICE_ACTION_REMOVE)
+        return 0; /* nothing to undo for phy devices */
+
+    if (libxl__xs_read(gc, XBT_NULL,
+                       GCSPRINTF("%s/physical-device", be_path)))
+        return 0; /* already done */
+
+    params = libxl__xs_read(gc, XBT_NULL, GCSPRINTF("%s/params", be_path));
+    if (!params || !*params)
+        return ERROR_NI;
+    path = params[0] == '/' ? libxl__strdup(gc, params)
+                            : GCSPRINTF("/dev/%s", params);
+    real = realpath(path, NULL);
+    if (!real || stat(real, &st) || !S_ISBLK(st.st_mode)) {
+        free(real);
+        return ERROR_NI; /* let the script produce the diagnostic */
+    }
+    path = libxl__strdup(gc, real);
+    free(real);
+
+    mode = libxl__xs_read(gc, XBT_NULL, GCSPRINTF("%s/mode", be_path));
+    m = block_mode(mode);
+
+    if (mkdir(HOTPLUG_LOCK_DIR, 0755) && errno != EEXIST) {
+        LOGED(ERROR, dev->domid, "unable to create %s", HOTPLUG_LOCK_DIR);
+        return ERROR_FAIL;
+    }
+    lock = libxl__lock_file(gc, HOTPLUG_LOCK_DIR "/block");
+    if (!lock)
+        return ERROR_LOCK_FAIL;
+
+    if (m != '!') {
+        conflict = block_check_sharing(gc, dev, be_path, st.st_rdev, m);
+        if (conflict) {
+            hotplug_fatal(gc, dev, be_path,
+                !strcmp(conflict, "local")
+                ? GCSPRINTF("Device %s is mounted in the privileged domain,"
+                            " and so cannot be mounted by a guest.", path)
+                : GCSPRINTF("Device %s is already in use by a guest.", path));
+            rc = ERROR_FAIL;
+            goto out;
+        }
+    }
+
+    rc = libxl__xs_printf(gc, XBT_NULL,
+                          GCSPRINTF("%s/physical-device", be_path),
+                          "%x:%x", major(st.st_rdev), minor(st.st_rdev));
+    if (rc) goto out;
+    rc = libxl__xs_printf(gc, XBT_NULL,
+                          GCSPRINTF("%s/physical-device-path", be_path),
+                          "%s", path);
+    if (rc) goto out;
+    rc = hotplug_success(gc, be_path);
+
+out:
+    libxl__unlock_file(lock);
+    return rc;
+}
+
+const libxl__hotplug_handler libxl__hotplug_handlers[] = {
+    { "vif-bridge", hotplug_vif_bridge },
+    { "block",      hotplug_block },
+    { NULL, NULL }
+};
+
+/*
+ * Local variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -108,6 +108,11 @@ out:
     return rc;
 }
 
+/* No in-process hotplug handlers, always run the scripts. */
+const libxl__hotplug_handler libxl__hotplug_handlers[] = {
+    { NULL, NULL }
+};
+
 int libxl__pci_numdevs(libxl__gc *gc)
 {
     return ERROR_NI;
@@ -555,6 +555,7 @@ DEFINE_DEVICE_TYPE_STRUCT(nic, VIF, nics,
     .from_xenstore = (device_from_xenstore_fn_t)libxl__nic_from_xenstore,
     .set_xenstore_config = (device_set_xenstore_config_fn_t)
                            libxl__set_xenstore_nic,
+    .concurrent_attach = 1,
 );
 
 /*
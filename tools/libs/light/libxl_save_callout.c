@@ -38,6 +38,10 @@ static void helper_stdout_readable(libxl__egc *egc, libxl__ev_fd *ev,
 static void helper_exited(libxl__egc *egc, libxl__ev_child *ch,
                           pid_t pid, int status);
 static void helper_done(libxl__egc *egc, libxl__save_helper_state *shs);
+static unsigned long *aux_fd_argnums(libxl__gc *gc,
+                                     const unsigned long *argnums,
+                                     int *num_argnums,
+                                     const int *aux_fds, int num_aux_fds);
 
 /*----- entrypoints -----*/
 
@@ -51,6 +55,7 @@ void libxl__xc_domain_restore(libxl__egc *egc, libxl__domain_create_state *dcs,
     const int restore_fd = dcs->libxc_fd;
     const int send_back_fd = dcs->send_back_fd;
     libxl__domain_build_state *const state = &dcs->build_state;
+    const libxl_domain_restore_params *const params = &dcs->restore_params;
 
     unsigned cbflags =
         libxl__srm_callout_enumcallbacks_restore(&shs->callbacks.restore.a);
@@ -62,6 +67,10 @@ void libxl__xc_domain_restore(libxl__egc *egc, libxl__domain_create_state *dcs,
         state->console_domid,
         cbflags, dcs->restore_params.checkpointed_stream,
     };
+    int num_argnums = ARRAY_SIZE(argnums);
+    const unsigned long *all_argnums =
+        aux_fd_argnums(gc, argnums, &num_argnums,
+                       params->aux_fds, params->num_aux_fds);
 
     shs->ao = ao;
     shs->domid = domid;
@@ -74,8 +83,9 @@ void libxl__xc_domain_restore(libxl__egc *egc, libxl__domain_create_state *dcs,
     shs->caller_state = dcs;
     shs->need_results = 1;
 
-    run_helper(egc, shs, "--restore-domain", restore_fd, send_back_fd, 0, 0,
-               argnums, ARRAY_SIZE(argnums));
+    run_helper(egc, shs, "--restore-domain", restore_fd, send_back_fd,
+               params->aux_fds, params->num_aux_fds,
+               all_argnums, num_argnums);
 }
 
 void libxl__xc_domain_save(libxl__egc *egc, libxl__domain_save_state *dss,
@@ -89,7 +99,13 @@ void libxl__xc_domain_save(libxl__egc *egc, libxl__domain_save_state *dss,
     const unsigned long argnums[] = {
         dss->domid, dss->xcflags, cbflags,
         dss->checkpointed_stream,
+        dss->precopy.max_downtime_ms, dss->precopy.max_iterations,
+        dss->precopy.max_throttle,
     };
+    int num_argnums = ARRAY_SIZE(argnums);
+    const unsigned long *all_argnums =
+        aux_fd_argnums(gc, argnums, &num_argnums,
+                       dss->aux_fds, dss->num_aux_fds);
 
     shs->ao = ao;
     shs->domid = dss->domid;
@@ -99,8 +115,8 @@ void libxl__xc_domain_save(libxl__egc *egc, libxl__domain_save_state *dss,
     shs->need_results = 0;
 
     run_helper(egc, shs, "--save-domain", dss->fd, dss->recv_fd,
-               NULL, 0,
-               argnums, ARRAY_SIZE(argnums));
+               dss->aux_fds, dss->num_aux_fds,
+               all_argnums, num_argnums);
     return;
 }
 
@@ -122,6 +138,27 @@ void libxl__save_helper_init(libxl__save_helper_state *shs)
 
 /*----- helper execution -----*/
 
+/*
+ * Both save and restore pass their auxiliary stream fds, if any, to the
+ * helper after their specific parameters, preceded by how many there are.
+ */
+static unsigned long *aux_fd_argnums(libxl__gc *gc,
+                                     const unsigned long *argnums,
+                                     int *num_argnums,
+                                     const int *aux_fds, int num_aux_fds)
+{
+    unsigned long *all;
+    int i;
+
+    GCNEW_ARRAY(all, *num_argnums + 1 + num_aux_fds);
+    memcpy(all, argnums, *num_argnums * sizeof(*all));
+    all[(*num_argnums)++] = num_aux_fds;
+    for (i = 0; i < num_aux_fds; i++)
+        all[(*num_argnums)++] = aux_fds[i];
+
+    return all;
+}
+
 /* This function can not fail. */
 static int dup_cloexec(libxl__gc *gc, int fd, const char *what)
 {
@@ -416,6 +453,20 @@ void libxl__srm_callout_callback_progress(const char *context,
     xtl_progress(CTX->lg, context, doing_what, done, total);
 }
 
+void libxl__srm_callout_callback_precopy_stats(unsigned iteration,
+                   unsigned long dirty_count, unsigned long dirty_rate,
+                   unsigned long bandwidth, unsigned long downtime_ms,
+                   unsigned throttle, void *user)
+{
+    libxl__save_helper_state *shs = user;
+    STATE_AO_GC(shs->ao);
+    LOGD(INFO, shs->domid, "Precopy iteration %u: %lu pages dirty,"
+         " dirtied at %lu pages/s, sent at %lu pages/s,"
+         " %lums predicted downtime, throttled by %u%%",
+         iteration, dirty_count, dirty_rate, bandwidth, downtime_ms,
+         throttle);
+}
+
 int libxl__srm_callout_callback_complete(int retval, int errnoval,
                                          void *user)
 {
@@ -90,6 +90,9 @@ static xentoollog_logger logger = {
 };
 static xc_interface *xch;
 static int io_fd;
+static int *aux_fds;
+static unsigned nr_aux_fds;
+static struct xc_precopy_params precopy_params;
 
 /*----- error handling -----*/
 
@@ -136,7 +139,7 @@ static void save_signal_handler(int num)
      * to execute its error path to put the guest back to sanity.
      *
      * So what we do is this: when we get the signal, we dup2
-     * the result of open("/dev/null",O_RDONLY) onto the output fd.
+     * the result of open("/dev/null",O_RDONLY) onto the output fds.
      *
      * This is guaranteed to 1. interrupt libxc's write (causing it to
      * return short, or maybe EINTR); 2. make the next write give
@@ -147,6 +150,7 @@ static void save_signal_handler(int num)
      * That's libxl's job.
      */
     int esave = errno;
+    unsigned i;
 
     int r = dup2(unwriteable_fd, io_fd);
     if (r != io_fd)
@@ -155,6 +159,10 @@ static void save_signal_handler(int num)
          * because it's not async-signal-safe */
         abort();
 
+    for (i = 0; i < nr_aux_fds; i++)
+        if (dup2(unwriteable_fd, aux_fds[i]) != aux_fds[i])
+            abort();
+
     errno = esave;
 }
 
@@ -232,13 +240,38 @@ static void complete(int retval) {
     exit(0);
 }
 
+/* libxenguest's policy, reporting each iteration's figures to libxl. */
+static int precopy_policy(struct precopy_stats stats, void *user)
+{
+    if (stats.dirty_count >= 0)
+        helper_stub_precopy_stats(stats.iteration, stats.dirty_count,
+                                  stats.dirty_rate, stats.bandwidth,
+                                  stats.downtime_ms, stats.throttle, 0);
+
+    return xc_precopy_policy(stats, &precopy_params);
+}
+
+#define NEXTARG (++argv, assert(*argv), *argv)
+
+/* The number of auxiliary stream fds, followed by the fds. */
+static void get_aux_fds(char ***argvp)
+{
+    char **argv = *argvp;
+    unsigned i;
+
+    nr_aux_fds = strtoul(NEXTARG,0,10);
+    aux_fds = xmalloc(nr_aux_fds * sizeof(*aux_fds));
+    for (i = 0; i < nr_aux_fds; i++)
+        aux_fds[i] = atoi(NEXTARG);
+
+    *argvp = argv;
+}
+
 int main(int argc, char **argv)
 {
     int r;
     int send_back_fd, recv_fd;
 
-#define NEXTARG (++argv, assert(*argv), *argv)
-
     const char *mode = *++argv;
     assert(mode);
 
@@ -251,14 +284,23 @@ int main(int argc, char **argv)
         uint32_t flags =                    strtoul(NEXTARG,0,10);
         unsigned cbflags =                  strtoul(NEXTARG,0,10);
         xc_stream_type_t stream_type =      strtoul(NEXTARG,0,10);
+        precopy_params.max_downtime_ms =    strtoul(NEXTARG,0,10);
+        precopy_params.max_iterations =     strtoul(NEXTARG,0,10);
+        precopy_params.max_throttle =       strtoul(NEXTARG,0,10);
+        get_aux_fds(&argv);
         assert(!*++argv);
 
         helper_setcallbacks_save(&cb, cbflags);
+        /* Post-copy's own policy stops after the first pass. */
+        if (!(flags & XCFLAGS_POSTCOPY))
+            cb.precopy_policy = precopy_policy;
 
         startup("save");
         setup_signals(save_signal_handler);
 
-        r = xc_domain_save(xch, io_fd, dom, flags, &cb, stream_type, recv_fd);
+        r = xc_domain_save_streams(xch, io_fd, aux_fds, nr_aux_fds, dom, flags,
+                                   &cb, stream_type, recv_fd,
+                                   &precopy_params);
         complete(r);
 
     } else if (!strcmp(mode,"--restore-domain")) {
@@ -273,6 +315,7 @@ int main(int argc, char **argv)
         domid_t console_domid =             strtoul(NEXTARG,0,10);
         unsigned cbflags =                  strtoul(NEXTARG,0,10);
         xc_stream_type_t stream_type =      strtoul(NEXTARG,0,10);
+        get_aux_fds(&argv);
         assert(!*++argv);
 
         helper_setcallbacks_restore(&cb, cbflags);
@@ -283,9 +326,11 @@ int main(int argc, char **argv)
         startup("restore");
         setup_signals(SIG_DFL);
 
-        r = xc_domain_restore(xch, io_fd, dom, store_evtchn, &store_mfn,
-                              store_domid, console_evtchn, &console_mfn,
-                              console_domid, stream_type, &cb, send_back_fd);
+        r = xc_domain_restore_streams(xch, io_fd, aux_fds, nr_aux_fds, dom,
+                                      store_evtchn, &store_mfn, store_domid,
+                                      console_evtchn, &console_mfn,
+                                      console_domid, stream_type, &cb,
+                                      send_back_fd);
         helper_stub_restore_results(store_mfn,console_mfn,0);
         complete(r);
 
@@ -23,6 +23,12 @@ our @msgs = (
                                              STRING doing_what),
                                             'unsigned long', 'done',
                                             'unsigned long', 'total'] ],
+    [ 's',      "precopy_stats",         [qw(unsigned iteration),
+                                            'unsigned long', 'dirty_count',
+                                            'unsigned long', 'dirty_rate',
+                                            'unsigned long', 'bandwidth',
+                                            'unsigned long', 'downtime_ms',
+                                          qw(unsigned throttle)] ],
     [ 'srcxA',  "suspend", [] ],
     [ 'srcxA',  "postcopy", [] ],
     [ 'srcxA',  "checkpoint", [] ],
@@ -0,0 +1,72 @@
+/*
+ * domconfig test case for the binary domain configuration cache
+ *
+ * test_domconfig times libxl_retrieve_domain_configuration over the
+ * running guests.  This is the part of it which needs to be inside
+ * libxl: checking that a configuration survives a round trip through
+ * the binary encoding unchanged (by comparing the JSON of both), and
+ * emptying the ctx cache between measurements.
+ */
+
+#include "libxl_internal.h"
+
+#include "libxl_test_domconfig.h"
+
+int libxl_test_domconfig_roundtrip(libxl_ctx *ctx,
+                                   libxl_domain_config *d_config)
+{
+    GC_INIT(ctx);
+    libxl_domain_config copy;
+    char *json = NULL, *json2 = NULL;
+    uint8_t *bin;
+    size_t bin_len;
+    int rc;
+
+    libxl_domain_config_init(&copy);
+
+    json = libxl_domain_config_to_json(CTX, d_config);
+    if (!json) {
+        rc = ERROR_FAIL;
+        goto out;
+    }
+
+    rc = libxl__domain_config_to_bin(gc, d_config, &bin, &bin_len);
+    if (rc) goto out;
+
+    rc = libxl__domain_config_from_bin(gc, &copy, bin, bin_len);
+    if (rc) goto out;
+
+    json2 = libxl_domain_config_to_json(CTX, &copy);
+    if (!json2 || strcmp(json, json2)) {
+        LOG(ERROR, "domain configuration changed by binary round trip");
+        rc = ERROR_FAIL;
+        goto out;
+    }
+
+    /* A truncated blob must be rejected, not misread. */
+    libxl_domain_config_dispose(&copy);
+    if (!libxl__domain_config_from_bin(gc, &copy, bin, bin_len - 1)) {
+        LOG(ERROR, "truncated binary domain configuration accepted");
+        rc = ERROR_FAIL;
+        goto out;
+    }
+
+    rc = 0;
+
+out:
+    libxl_domain_config_dispose(&copy);
+    free(json);
+    free(json2);
+    GC_FREE;
+    return rc;
+}
+
+void libxl_test_domconfig_cache_flush(libxl_ctx *ctx)
+{
+    GC_INIT(ctx);
+
+    CTX_LOCK;
+    libxl__domconfig_cache_free(CTX);
+    CTX_UNLOCK;
+    GC_FREE;
+}
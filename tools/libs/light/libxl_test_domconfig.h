@@ -0,0 +1,12 @@
+#ifndef TEST_DOMCONFIG_H
+#define TEST_DOMCONFIG_H
+
+int libxl_test_domconfig_roundtrip(libxl_ctx *ctx,
+                                   libxl_domain_config *d_config)
+    LIBXL_EXTERNAL_CALLERS_ONLY;
+
+/* Forget all binary configurations cached in ctx. */
+void libxl_test_domconfig_cache_flush(libxl_ctx *ctx)
+    LIBXL_EXTERNAL_CALLERS_ONLY;
+
+#endif /*TEST_DOMCONFIG_H*/
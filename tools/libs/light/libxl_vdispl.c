@@ -210,7 +210,8 @@ DEFINE_DEVICE_TYPE_STRUCT(vdispl, VDISPL, vdispls,
     .update_config = (device_update_config_fn_t)libxl__update_config_vdispl,
     .from_xenstore = (device_from_xenstore_fn_t)libxl__vdispl_from_xenstore,
     .set_xenstore_config = (device_set_xenstore_config_fn_t)
-                           libxl__set_xenstore_vdispl
+                           libxl__set_xenstore_vdispl,
+    .concurrent_attach = 1
 );
 
 /*
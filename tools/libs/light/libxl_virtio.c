@@ -151,7 +151,8 @@ DEFINE_DEVICE_TYPE_STRUCT(virtio, VIRTIO, virtios,
     .set_xenstore_config = (device_set_xenstore_config_fn_t)
                            libxl__set_xenstore_virtio,
     .from_xenstore = (device_from_xenstore_fn_t)libxl__virtio_from_xenstore,
-    .skip_attach = 1
+    .skip_attach = 1,
+    .concurrent_attach = 1
 );
 
 /*
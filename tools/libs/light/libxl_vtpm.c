@@ -236,6 +236,7 @@ DEFINE_DEVICE_TYPE_STRUCT(vtpm, VTPM, vtpms,
     .from_xenstore = (device_from_xenstore_fn_t)libxl__vtpm_from_xenstore,
     .set_xenstore_config = (device_set_xenstore_config_fn_t)
                            libxl__set_xenstore_vtpm,
+    .concurrent_attach = 1,
 );
 
 /*
@@ -384,6 +384,9 @@ static int hvm_set_viridian_features(libxl__gc *gc, uint32_t domid,
     if (libxl_bitmap_test(&enlightenments, LIBXL_VIRIDIAN_ENLIGHTENMENT_CPU_HOTPLUG))
         mask |= HVMPV_cpu_hotplug;
 
+    if (libxl_bitmap_test(&enlightenments, LIBXL_VIRIDIAN_ENLIGHTENMENT_HCALL_XMM_INPUT))
+        mask |= HVMPV_hcall_xmm_input;
+
     if (mask != 0 &&
         xc_hvm_param_set(CTX->xch,
                          domid,
@@ -0,0 +1,127 @@
+/*
+ * Times attaching and detaching many devices to an existing domain.
+ *
+ * All the attaches are started at once, so this measures how well the
+ * backend hotplug for the devices overlaps, as it does during domain
+ * creation.  Compare runs with and without LIBXL_HOTPLUG_NATIVE=1 to see
+ * the cost of running the hotplug scripts.
+ */
+
+#include "test_common.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+
+static double elapsed(const struct timeval *start)
+{
+    struct timeval end;
+
+    gettimeofday(&end, NULL);
+    return (end.tv_sec - start->tv_sec) +
+           (end.tv_usec - start->tv_usec) / 1e6;
+}
+
+/* Waits for n outstanding asynchronous operations, returns failures. */
+static int wait_ops(int n)
+{
+    libxl_event *event;
+    int rc, failed = 0;
+
+    while (n--) {
+        rc = libxl_event_wait(ctx, &event, LIBXL_EVENTMASK_ALL, 0, 0);
+        assert(!rc);
+        assert(event->type == LIBXL_EVENT_TYPE_OPERATION_COMPLETE);
+        if (event->u.operation_complete.rc) {
+            fprintf(stderr, "operation %lu failed: %d\n",
+                    (unsigned long)event->for_user,
+                    event->u.operation_complete.rc);
+            failed++;
+        }
+        libxl_event_free(ctx, event);
+    }
+    return failed;
+}
+
+int main(int argc, char **argv)
+{
+    libxl_device_nic *nics;
+    libxl_device_disk *disks;
+    libxl_asyncop_how how;
+    struct timeval start;
+    const char *bridge, *blockdev;
+    uint32_t domid;
+    int count, ndisks, i, rc, failed;
+
+    if (argc < 4 || argc > 5) {
+        fprintf(stderr,
+                "usage: %s DOMID COUNT BRIDGE [BLOCKDEV]\n"
+                "  attaches COUNT vifs on BRIDGE (and COUNT read-only vbds\n"
+                "  backed by BLOCKDEV) to DOMID concurrently, then removes\n"
+                "  them again, and reports the time taken\n", argv[0]);
+        return 2;
+    }
+    domid = atoi(argv[1]);
+    count = atoi(argv[2]);
+    bridge = argv[3];
+    blockdev = argc > 4 ? argv[4] : NULL;
+    ndisks = blockdev ? count : 0;
+    assert(count > 0 && count <= 26);
+
+    test_common_setup(XTL_INFO);
+
+    nics = calloc(count, sizeof(*nics));
+    disks = calloc(count, sizeof(*disks));
+    assert(nics && disks);
+
+    how.callback = NULL;
+
+    gettimeofday(&start, NULL);
+    for (i = 0; i < count; i++) {
+        libxl_device_nic_init(&nics[i]);
+        nics[i].devid = -1;
+        nics[i].bridge = strdup(bridge);
+        how.u.for_event = i;
+        rc = libxl_device_nic_add(ctx, domid, &nics[i], &how);
+        assert(!rc);
+    }
+    for (i = 0; i < ndisks; i++) {
+        libxl_device_disk_init(&disks[i]);
+        disks[i].pdev_path = strdup(blockdev);
+        disks[i].vdev = malloc(5);
+        assert(disks[i].vdev);
+        snprintf(disks[i].vdev, 5, "xvd%c", 'a' + i);
+        disks[i].format = LIBXL_DISK_FORMAT_RAW;
+        disks[i].backend = LIBXL_DISK_BACKEND_PHY;
+        disks[i].readwrite = 0;
+        how.u.for_event = count + i;
+        rc = libxl_device_disk_add(ctx, domid, &disks[i], &how);
+        assert(!rc);
+    }
+    failed = wait_ops(count + ndisks);
+    printf("attach: %d vifs, %d vbds, %d failed, %.3fs\n",
+           count, ndisks, failed, elapsed(&start));
+
+    gettimeofday(&start, NULL);
+    for (i = 0; i < count; i++) {
+        how.u.for_event = i;
+        rc = libxl_device_nic_remove(ctx, domid, &nics[i], &how);
+        assert(!rc);
+    }
+    for (i = 0; i < ndisks; i++) {
+        how.u.for_event = count + i;
+        rc = libxl_device_disk_remove(ctx, domid, &disks[i], &how);
+        assert(!rc);
+    }
+    failed += wait_ops(count + ndisks);
+    printf("detach: %.3fs\n", elapsed(&start));
+
+    for (i = 0; i < count; i++)
+        libxl_device_nic_dispose(&nics[i]);
+    for (i = 0; i < ndisks; i++)
+        libxl_device_disk_dispose(&disks[i]);
+    free(nics);
+    free(disks);
+
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,92 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "test_common.h"
+#include "libxl_test_domconfig.h"
+
+#define ITERATIONS 100
+
+/* Where libxl_retrieve_domain_configuration finds the configuration. */
+enum source { FROM_JSON, FROM_BIN, FROM_CACHE };
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Average time to retrieve the configurations of n guests, in ns. */
+static uint64_t time_retrieve(const uint32_t *domids, int n, enum source src)
+{
+    libxl_domain_config d_config;
+    uint64_t t, total = 0;
+    int i, j, rc;
+
+    for (i = 0; i < ITERATIONS; i++) {
+        if (src == FROM_JSON)
+            for (j = 0; j < n; j++)
+                libxl_userdata_unlink(ctx, domids[j], "libxl-bin");
+        if (src != FROM_CACHE)
+            libxl_test_domconfig_cache_flush(ctx);
+
+        t = now_ns();
+        for (j = 0; j < n; j++) {
+            libxl_domain_config_init(&d_config);
+            rc = libxl_retrieve_domain_configuration(ctx, domids[j],
+                                                     &d_config, NULL);
+            assert(!rc);
+            libxl_domain_config_dispose(&d_config);
+        }
+        total += now_ns() - t;
+    }
+
+    return total / ITERATIONS;
+}
+
+int main(int argc, char **argv) {
+    libxl_domain_config d_config;
+    libxl_dominfo *info;
+    uint32_t *domids;
+    int nr_info, nr = 0, n, i, rc;
+
+    test_common_setup(XTL_ERROR);
+
+    info = libxl_list_domain(ctx, &nr_info);
+    assert(info);
+    domids = calloc(nr_info, sizeof(*domids));
+    assert(domids);
+
+    /* Only guests created by libxl have a configuration to retrieve. */
+    for (i = 0; i < nr_info; i++) {
+        libxl_domain_config_init(&d_config);
+        if (!libxl_retrieve_domain_configuration(ctx, info[i].domid,
+                                                 &d_config, NULL)) {
+            rc = libxl_test_domconfig_roundtrip(ctx, &d_config);
+            assert(!rc);
+            domids[nr++] = info[i].domid;
+        }
+        libxl_domain_config_dispose(&d_config);
+    }
+    libxl_dominfo_list_free(info, nr_info);
+
+    if (!nr) {
+        printf("no guests with a libxl configuration, nothing to time\n");
+        return 0;
+    }
+
+    for (n = 1; ; n = n * 2 < nr ? n * 2 : nr) {
+        printf("%3d guests: json %8"PRIu64" ns, bin %8"PRIu64" ns, "
+               "cached %8"PRIu64" ns per guest\n", n,
+               time_retrieve(domids, n, FROM_JSON) / n,
+               time_retrieve(domids, n, FROM_BIN) / n,
+               time_retrieve(domids, n, FROM_CACHE) / n);
+        if (n == nr)
+            break;
+    }
+
+    free(domids);
+    return 0;
+}
@@ -67,13 +67,99 @@
 #define LARGE_RING_OFFSET 2048
 
 // if you go over this size, you'll have too many grants to fit in the shared page.
-#define MAX_RING_SHIFT 20
+#define MAX_DIRECT_RING_SHIFT 20
+// larger rings put their grants in separate grant list pages
+#define MAX_RING_SHIFT 24
 #define MAX_RING_SIZE (1 << MAX_RING_SHIFT)
+#define GRANTS_PER_PAGE (PAGE_SIZE / sizeof(uint32_t))
+
+/* Number of grant list pages used by a ring of the given order */
+static int ring_list_pages(int order)
+{
+	int pages;
+
+	if (order <= MAX_DIRECT_RING_SHIFT)
+		return 0;
+	pages = 1 << (order - PAGE_SHIFT);
+	return (pages + GRANTS_PER_PAGE - 1) / GRANTS_PER_PAGE;
+}
+
+/* Number of entries a ring of the given order uses in ring->grants */
+static int ring_grants(int order)
+{
+	if (order < PAGE_SHIFT)
+		return 0;
+	if (order <= MAX_DIRECT_RING_SHIFT)
+		return 1 << (order - PAGE_SHIFT);
+	return ring_list_pages(order);
+}
+
+static void *share_ring(struct libxenvchan *ctrl, int domain, int order,
+                        uint32_t *grants, void **list_r)
+{
+	int pages = 1 << (order - PAGE_SHIFT);
+	int list_pages = ring_list_pages(order);
+	void *list, *buffer;
+
+	*list_r = NULL;
+	if (!list_pages)
+		return xengntshr_share_pages(ctrl->gntshr, domain, pages, grants, 1);
+
+	list = xengntshr_share_pages(ctrl->gntshr, domain, list_pages, grants, 0);
+	if (!list)
+		return NULL;
+	buffer = xengntshr_share_pages(ctrl->gntshr, domain, pages, list, 1);
+	if (!buffer) {
+		xengntshr_unshare(ctrl->gntshr, list, list_pages);
+		return NULL;
+	}
+	*list_r = list;
+	return buffer;
+}
+
+static void *map_ring(struct libxenvchan *ctrl, int domain, int order,
+                      uint32_t *grants, int prot)
+{
+	int pages = 1 << (order - PAGE_SHIFT);
+	int list_pages = ring_list_pages(order);
+	uint32_t *list, *refs;
+	void *buffer;
+
+	if (!list_pages)
+		return xengnttab_map_domain_grant_refs(ctrl->gnttab, pages,
+			domain, grants, prot);
+
+	list = xengnttab_map_domain_grant_refs(ctrl->gnttab, list_pages,
+		domain, grants, PROT_READ);
+	if (!list)
+		return NULL;
+	/* copy the list, so that it cannot change while we are mapping it */
+	refs = malloc(pages * sizeof(*refs));
+	if (refs)
+		memcpy(refs, list, pages * sizeof(*refs));
+	xengnttab_unmap(ctrl->gnttab, list, list_pages);
+	if (!refs)
+		return NULL;
+	buffer = xengnttab_map_domain_grant_refs(ctrl->gnttab, pages,
+		domain, refs, prot);
+	free(refs);
+	return buffer;
+}
+
+void close_grant_lists(struct libxenvchan *ctrl)
+{
+	if (ctrl->read_grant_list)
+		xengntshr_unshare(ctrl->gntshr, ctrl->read_grant_list,
+		                  ring_list_pages(ctrl->read.order));
+	if (ctrl->write_grant_list)
+		xengntshr_unshare(ctrl->gntshr, ctrl->write_grant_list,
+		                  ring_list_pages(ctrl->write.order));
+	ctrl->read_grant_list = ctrl->write_grant_list = NULL;
+}
 
 static int init_gnt_srv(struct libxenvchan *ctrl, int domain)
 {
 	int pages_left = ctrl->read.order >= PAGE_SHIFT ? 1 << (ctrl->read.order - PAGE_SHIFT) : 0;
-	int pages_right = ctrl->write.order >= PAGE_SHIFT ? 1 << (ctrl->write.order - PAGE_SHIFT) : 0;
 	uint32_t ring_ref = -1;
 	void *ring;
 
@@ -103,8 +189,8 @@ static int init_gnt_srv(struct libxenvchan *ctrl, int domain)
 		ctrl->read.buffer = ((void*)ctrl->ring) + LARGE_RING_OFFSET;
 		break;
 	default:
-		ctrl->read.buffer = xengntshr_share_pages(ctrl->gntshr, domain,
-			pages_left, ctrl->ring->grants, 1);
+		ctrl->read.buffer = share_ring(ctrl, domain, ctrl->read.order,
+			ctrl->ring->grants, &ctrl->read_grant_list);
 		if (!ctrl->read.buffer)
 			goto out_ring;
 	}
@@ -117,8 +203,9 @@ static int init_gnt_srv(struct libxenvchan *ctrl, int domain)
 		ctrl->write.buffer = ((void*)ctrl->ring) + LARGE_RING_OFFSET;
 		break;
 	default:
-		ctrl->write.buffer = xengntshr_share_pages(ctrl->gntshr, domain,
-			pages_right, ctrl->ring->grants + pages_left, 1);
+		ctrl->write.buffer = share_ring(ctrl, domain, ctrl->write.order,
+			ctrl->ring->grants + ring_grants(ctrl->read.order),
+			&ctrl->write_grant_list);
 		if (!ctrl->write.buffer)
 			goto out_unmap_left;
 	}
@@ -128,6 +215,7 @@ out:
 out_unmap_left:
 	if (pages_left)
 		xengntshr_unshare(ctrl->gntshr, ctrl->read.buffer, pages_left);
+	close_grant_lists(ctrl);
 out_ring:
 	xengntshr_unshare(ctrl->gntshr, ring, 1);
 	ring_ref = -1;
@@ -169,14 +257,11 @@ static int init_gnt_cli(struct libxenvchan *ctrl, int domain, uint32_t ring_ref)
 		ctrl->write.buffer = ((void*)ctrl->ring) + LARGE_RING_OFFSET;
 		break;
 	default:
-		{
-			int pages_left = 1 << (ctrl->write.order - PAGE_SHIFT);
-			ctrl->write.buffer = xengnttab_map_domain_grant_refs(ctrl->gnttab,
-				pages_left, domain, grants, PROT_READ|PROT_WRITE);
-			if (!ctrl->write.buffer)
-				goto out_unmap_ring;
-			grants += pages_left;
-		}
+		ctrl->write.buffer = map_ring(ctrl, domain, ctrl->write.order,
+			grants, PROT_READ|PROT_WRITE);
+		if (!ctrl->write.buffer)
+			goto out_unmap_ring;
+		grants += ring_grants(ctrl->write.order);
 	}
 
 	switch (ctrl->read.order) {
@@ -187,13 +272,10 @@ static int init_gnt_cli(struct libxenvchan *ctrl, int domain, uint32_t ring_ref)
 		ctrl->read.buffer = ((void*)ctrl->ring) + LARGE_RING_OFFSET;
 		break;
 	default:
-		{
-			int pages_right = 1 << (ctrl->read.order - PAGE_SHIFT);
-			ctrl->read.buffer = xengnttab_map_domain_grant_refs(ctrl->gnttab,
-				pages_right, domain, grants, PROT_READ);
-			if (!ctrl->read.buffer)
-				goto out_unmap_left;
-		}
+		ctrl->read.buffer = map_ring(ctrl, domain, ctrl->read.order,
+			grants, PROT_READ);
+		if (!ctrl->read.buffer)
+			goto out_unmap_left;
 	}
 
 	rv = 0;
@@ -343,6 +425,9 @@ struct libxenvchan *libxenvchan_server_init(struct xentoollog_logger *logger,
 	ctrl->event = NULL;
 	ctrl->is_server = 1;
 	ctrl->server_persist = 0;
+	ctrl->read_grant_list = ctrl->write_grant_list = NULL;
+	ctrl->notify_threshold = 0;
+	ctrl->unsignalled_write = ctrl->unsignalled_read = 0;
 
 	ctrl->read.order = min_order(left_min);
 	ctrl->write.order = min_order(right_min);
@@ -427,6 +512,9 @@ struct libxenvchan *libxenvchan_client_init(struct xentoollog_logger *logger,
 	ctrl->gnttab = NULL;
 	ctrl->write.order = ctrl->read.order = 0;
 	ctrl->is_server = 0;
+	ctrl->read_grant_list = ctrl->write_grant_list = NULL;
+	ctrl->notify_threshold = 0;
+	ctrl->unsignalled_write = ctrl->unsignalled_read = 0;
 
 	xs = xs_open(0);
 	if (!xs)
@@ -196,9 +196,65 @@ int libxenvchan_buffer_space(struct libxenvchan *ctrl)
 	return raw_get_buffer_space(ctrl);
 }
 
+/*
+ * Account for size bytes having been written (VCHAN_NOTIFY_WRITE) or
+ * consumed (VCHAN_NOTIFY_READ), and notify the peer unless the notification
+ * can be held back under the notify threshold.  A full (or empty) ring is
+ * always signalled, as the peer may be waiting for exactly that.
+ */
+static inline int batch_notify(struct libxenvchan *ctrl, uint8_t bit, size_t size)
+{
+	size_t *unsignalled;
+	int more;
+
+	if (!ctrl->notify_threshold)
+		return send_notify(ctrl, bit);
+
+	if (bit == VCHAN_NOTIFY_WRITE) {
+		unsignalled = &ctrl->unsignalled_write;
+		more = raw_get_buffer_space(ctrl);
+	} else {
+		unsignalled = &ctrl->unsignalled_read;
+		more = raw_get_data_ready(ctrl);
+	}
+	*unsignalled += size;
+	if (*unsignalled < ctrl->notify_threshold && more)
+		return 0;
+	*unsignalled = 0;
+	return send_notify(ctrl, bit);
+}
+
+void libxenvchan_set_notify_threshold(struct libxenvchan *ctrl, size_t threshold)
+{
+	ctrl->notify_threshold = threshold;
+	if (!threshold)
+		libxenvchan_notify_flush(ctrl);
+}
+
+int libxenvchan_notify_flush(struct libxenvchan *ctrl)
+{
+	int ret = 0;
+
+	if (ctrl->unsignalled_write) {
+		ctrl->unsignalled_write = 0;
+		if (send_notify(ctrl, VCHAN_NOTIFY_WRITE))
+			ret = -1;
+	}
+	if (ctrl->unsignalled_read) {
+		ctrl->unsignalled_read = 0;
+		if (send_notify(ctrl, VCHAN_NOTIFY_READ))
+			ret = -1;
+	}
+	return ret;
+}
+
 int libxenvchan_wait(struct libxenvchan *ctrl)
 {
-	int ret = xenevtchn_pending(ctrl->event);
+	int ret;
+	/* we are about to sleep, so the peer must not wait on us either */
+	if (libxenvchan_notify_flush(ctrl))
+		return -1;
+	ret = xenevtchn_pending(ctrl->event);
 	if (ret < 0)
 		return -1;
 	xenevtchn_unmask(ctrl->event, ret);
@@ -225,7 +281,7 @@ static int do_send(struct libxenvchan *ctrl, const void *data, size_t size)
 	}
 	xen_wmb(); /* write data /then/ notify */
 	wr_prod(ctrl) += size;
-	if (send_notify(ctrl, VCHAN_NOTIFY_WRITE))
+	if (batch_notify(ctrl, VCHAN_NOTIFY_WRITE, size))
 		return -1;
 	return size;
 }
@@ -301,7 +357,7 @@ static int do_recv(struct libxenvchan *ctrl, void *data, size_t size)
 	}
 	xen_mb(); /* consume /then/ notify */
 	rd_cons(ctrl) += size;
-	if (send_notify(ctrl, VCHAN_NOTIFY_READ))
+	if (batch_notify(ctrl, VCHAN_NOTIFY_READ, size))
 		return -1;
 	return size;
 }
@@ -344,6 +400,77 @@ int libxenvchan_read(struct libxenvchan *ctrl, void *data, size_t size)
 	}
 }
 
+int libxenvchan_read_acquire(struct libxenvchan *ctrl, const void **data)
+{
+	while (1) {
+		int avail = fast_get_data_ready(ctrl, 1);
+		if (avail) {
+			int real_idx = rd_cons(ctrl) & (rd_ring_size(ctrl) - 1);
+			int avail_contig = rd_ring_size(ctrl) - real_idx;
+			if (avail_contig > avail)
+				avail_contig = avail;
+			xen_rmb(); /* data read must happen /after/ rd_cons read */
+			*data = rd_ring(ctrl) + real_idx;
+			return avail_contig;
+		}
+		if (!libxenvchan_is_open(ctrl))
+			return -1;
+		if (!ctrl->blocking)
+			return 0;
+		if (libxenvchan_wait(ctrl))
+			return -1;
+	}
+}
+
+int libxenvchan_read_commit(struct libxenvchan *ctrl, size_t size)
+{
+	if (size > raw_get_data_ready(ctrl))
+		return -1;
+	if (!size)
+		return 0;
+	xen_mb(); /* consume /then/ notify */
+	rd_cons(ctrl) += size;
+	if (batch_notify(ctrl, VCHAN_NOTIFY_READ, size))
+		return -1;
+	return 0;
+}
+
+int libxenvchan_write_acquire(struct libxenvchan *ctrl, void **data)
+{
+	while (1) {
+		int avail;
+		if (!libxenvchan_is_open(ctrl))
+			return -1;
+		avail = fast_get_buffer_space(ctrl, 1);
+		if (avail) {
+			int real_idx = wr_prod(ctrl) & (wr_ring_size(ctrl) - 1);
+			int avail_contig = wr_ring_size(ctrl) - real_idx;
+			if (avail_contig > avail)
+				avail_contig = avail;
+			xen_mb(); /* read indexes /then/ write data */
+			*data = wr_ring(ctrl) + real_idx;
+			return avail_contig;
+		}
+		if (!ctrl->blocking)
+			return 0;
+		if (libxenvchan_wait(ctrl))
+			return -1;
+	}
+}
+
+int libxenvchan_write_commit(struct libxenvchan *ctrl, size_t size)
+{
+	if (size > raw_get_buffer_space(ctrl))
+		return -1;
+	if (!size)
+		return 0;
+	xen_wmb(); /* write data /then/ notify */
+	wr_prod(ctrl) += size;
+	if (batch_notify(ctrl, VCHAN_NOTIFY_WRITE, size))
+		return -1;
+	return 0;
+}
+
 int libxenvchan_is_open(struct libxenvchan* ctrl)
 {
 	if (ctrl->is_server)
@@ -365,6 +492,8 @@ void libxenvchan_close(struct libxenvchan *ctrl)
 		munmap(ctrl->read.buffer, 1 << ctrl->read.order);
 	if (ctrl->write.order >= PAGE_SHIFT)
 		munmap(ctrl->write.buffer, 1 << ctrl->write.order);
+	if (ctrl->is_server)
+		close_grant_lists(ctrl);
 	if (ctrl->ring) {
 		if (ctrl->is_server) {
 			ctrl->ring->srv_live = 0;
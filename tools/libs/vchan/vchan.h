@@ -27,5 +27,6 @@
 #define LIBVCHAN_H
 
 void close_xs_srv(struct libxenvchan *ctrl);
+void close_grant_lists(struct libxenvchan *ctrl);
 
 #endif /* LIBVCHAN_H */
@@ -37,10 +37,12 @@
 #include <unistd.h>
 #include <sys/mman.h>
 #include <poll.h>
+#include <getopt.h>
 
 #define XC_WANT_COMPAT_DEVICEMODEL_API
 #include <xenctrl.h>
 #include <xenevtchn.h>
+#include <xenforeignmemory.h>
 #include <xen/vm_event.h>
 
 #include <xen-tools/common-macros.h>
@@ -70,6 +72,10 @@ typedef struct vm_event {
     vm_event_back_ring_t back_ring;
     uint32_t evtchn_port;
     void *ring_page;
+    /* Frames of a Xen-allocated ring, or 0 for the guest's ring page. */
+    unsigned int nr_frames;
+    xenforeignmemory_handle *fmem;
+    xenforeignmemory_resource_handle *fres;
 } vm_event_t;
 
 typedef struct xenaccess {
@@ -83,11 +89,52 @@ typedef struct xenaccess {
 static int interrupted;
 bool evtchn_bind = 0, evtchn_open = 0, mem_access_enable = 0;
 
+/* Benchmark mode: no per-event output, report the event rate instead. */
+static bool benchmark;
+static unsigned long bench_events, bench_interval_events;
+static struct timespec bench_start, bench_last;
+
 static void close_handler(int sig)
 {
     interrupted = sig;
 }
 
+static void log_event(const char *fmt, ...)
+{
+    va_list ap;
+
+    if ( benchmark )
+        return;
+
+    va_start(ap, fmt);
+    vprintf(fmt, ap);
+    va_end(ap);
+}
+
+static double elapsed(const struct timespec *from, const struct timespec *to)
+{
+    return (to->tv_sec - from->tv_sec) + (to->tv_nsec - from->tv_nsec) / 1e9;
+}
+
+/* Report the event rate about once a second. */
+static void bench_tick(void)
+{
+    struct timespec now;
+    double secs;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    secs = elapsed(&bench_last, &now);
+    if ( secs < 1.0 )
+        return;
+
+    printf("%lu events in %.2fs: %.0f events/s\n",
+           bench_interval_events, secs, bench_interval_events / secs);
+    fflush(stdout);
+
+    bench_interval_events = 0;
+    bench_last = now;
+}
+
 int xc_wait_for_event_or_timeout(xc_interface *xch, xenevtchn_handle *xce, unsigned long ms)
 {
     struct pollfd fd = { .fd = xenevtchn_fd(xce), .events = POLLIN | POLLERR };
@@ -137,9 +184,15 @@ int xenaccess_teardown(xc_interface *xch, xenaccess_t *xenaccess)
         return 0;
 
     /* Tear down domain xenaccess in Xen */
-    if ( xenaccess->vm_event.ring_page )
+    if ( xenaccess->vm_event.fres )
+        xenforeignmemory_unmap_resource(xenaccess->vm_event.fmem,
+                                        xenaccess->vm_event.fres);
+    else if ( xenaccess->vm_event.ring_page )
         munmap(xenaccess->vm_event.ring_page, XC_PAGE_SIZE);
 
+    if ( xenaccess->vm_event.fmem )
+        xenforeignmemory_close(xenaccess->vm_event.fmem);
+
     if ( mem_access_enable )
     {
         rc = xc_monitor_disable(xenaccess->xc_handle,
@@ -188,7 +241,8 @@ int xenaccess_teardown(xc_interface *xch, xenaccess_t *xenaccess)
     return 0;
 }
 
-xenaccess_t *xenaccess_init(xc_interface **xch_r, domid_t domain_id)
+xenaccess_t *xenaccess_init(xc_interface **xch_r, domid_t domain_id,
+                            unsigned int nr_frames)
 {
     xenaccess_t *xenaccess = 0;
     xc_interface *xch;
@@ -210,12 +264,41 @@ xenaccess_t *xenaccess_init(xc_interface **xch_r, domid_t domain_id)
 
     /* Set domain id */
     xenaccess->vm_event.domain_id = domain_id;
+    xenaccess->vm_event.nr_frames = nr_frames;
 
     /* Enable mem_access */
-    xenaccess->vm_event.ring_page =
-            xc_monitor_enable(xenaccess->xc_handle,
-                              xenaccess->vm_event.domain_id,
-                              &xenaccess->vm_event.evtchn_port);
+    if ( nr_frames )
+    {
+        xenaccess->vm_event.fmem = xenforeignmemory_open(NULL, 0);
+        if ( xenaccess->vm_event.fmem == NULL )
+        {
+            ERROR("Failed to open foreign memory interface");
+            goto err;
+        }
+
+        rc = xc_monitor_enable_frames(xenaccess->xc_handle,
+                                      xenaccess->vm_event.domain_id, nr_frames,
+                                      &xenaccess->vm_event.evtchn_port);
+        if ( rc == 0 )
+        {
+            mem_access_enable = 1;
+            xenaccess->vm_event.fres = xenforeignmemory_map_resource(
+                xenaccess->vm_event.fmem, xenaccess->vm_event.domain_id,
+                XENMEM_resource_vm_event, XEN_DOMCTL_VM_EVENT_OP_MONITOR,
+                0, nr_frames, &xenaccess->vm_event.ring_page,
+                PROT_READ | PROT_WRITE, 0);
+            if ( xenaccess->vm_event.fres == NULL )
+            {
+                PERROR("Failed to map the %u frame ring", nr_frames);
+                goto err;
+            }
+        }
+    }
+    else
+        xenaccess->vm_event.ring_page =
+                xc_monitor_enable(xenaccess->xc_handle,
+                                  xenaccess->vm_event.domain_id,
+                                  &xenaccess->vm_event.evtchn_port);
     if ( xenaccess->vm_event.ring_page == NULL )
     {
         switch ( errno ) {
@@ -254,11 +337,12 @@ xenaccess_t *xenaccess_init(xc_interface **xch_r, domid_t domain_id)
     evtchn_bind = 1;
     xenaccess->vm_event.port = rc;
 
-    /* Initialise ring */
-    SHARED_RING_INIT((vm_event_sring_t *)xenaccess->vm_event.ring_page);
+    /* Initialise ring.  Xen has already done so for rings it allocated. */
+    if ( !nr_frames )
+        SHARED_RING_INIT((vm_event_sring_t *)xenaccess->vm_event.ring_page);
     BACK_RING_INIT(&xenaccess->vm_event.back_ring,
                    (vm_event_sring_t *)xenaccess->vm_event.ring_page,
-                   XC_PAGE_SIZE);
+                   (nr_frames ?: 1) * XC_PAGE_SIZE);
 
     /* Get max_gpfn */
     rc = xc_domain_maximum_gpfn(xenaccess->xc_handle,
@@ -319,6 +403,20 @@ static void get_request(vm_event_t *vm_event, vm_event_request_t *req)
     back_ring->sring->req_event = req_cons + 1;
 }
 
+/*
+ * Whether there are requests to consume.  Before saying no, re-arm req_event
+ * so that Xen kicks us for the next one, and catch any which raced with
+ * doing so.
+ */
+static int more_requests(vm_event_t *vm_event)
+{
+    int more;
+
+    RING_FINAL_CHECK_FOR_REQUESTS(&vm_event->back_ring, more);
+
+    return more;
+}
+
 /*
  * X86 control register names
  */
@@ -352,14 +450,13 @@ static void put_response(vm_event_t *vm_event, vm_event_response_t *rsp)
     memcpy(RING_GET_RESPONSE(back_ring, rsp_prod), rsp, sizeof(*rsp));
     rsp_prod++;
 
-    /* Update ring */
+    /* Update ring; responses are pushed to Xen a batch at a time. */
     back_ring->rsp_prod_pvt = rsp_prod;
-    RING_PUSH_RESPONSES(back_ring);
 }
 
 void usage(char* progname)
 {
-    fprintf(stderr, "Usage: %s [-m] <domain_id> write|exec", progname);
+    fprintf(stderr, "Usage: %s [-m] [-b] [-r frames] <domain_id> write|exec", progname);
 #if defined(__i386__) || defined(__x86_64__)
             fprintf(stderr, "|breakpoint|altp2m_write|altp2m_exec|debug|cpuid|desc_access|write_ctrlreg_cr4|altp2m_write_no_gpt");
 #elif defined(__arm__) || defined(__aarch64__)
@@ -369,7 +466,10 @@ void usage(char* progname)
             "\n"
             "Logs first page writes, execs, or breakpoint traps that occur on the domain.\n"
             "\n"
-            "-m requires this program to run, or else the domain may pause\n");
+            "-m requires this program to run, or else the domain may pause\n"
+            "-b benchmark: don't log events, report events per second instead\n"
+            "-r use a ring of this many frames, allocated by Xen, rather than\n"
+            "   the guest's single ring page\n");
 }
 
 int main(int argc, char *argv[])
@@ -396,23 +496,36 @@ int main(int argc, char *argv[])
     int write_ctrlreg_cr4 = 0;
     int altp2m_write_no_gpt = 0;
     uint16_t altp2m_view_id = 0;
+    unsigned int nr_frames = 0;
+    int opt, notify;
 
     char* progname = argv[0];
-    argv++;
-    argc--;
 
-    if ( argc == 3 && argv[0][0] == '-' )
+    while ( (opt = getopt(argc, argv, "mbr:")) != -1 )
     {
-        if ( !strcmp(argv[0], "-m") )
-            required = 1;
-        else
+        switch ( opt )
         {
+        case 'm':
+            required = 1;
+            break;
+        case 'b':
+            benchmark = true;
+            break;
+        case 'r':
+            nr_frames = strtoul(optarg, NULL, 0);
+            if ( !nr_frames )
+            {
+                usage(progname);
+                return -1;
+            }
+            break;
+        default:
             usage(progname);
             return -1;
         }
-        argv++;
-        argc--;
     }
+    argv += optind;
+    argc -= optind;
 
     if ( argc != 2 )
     {
@@ -488,7 +601,7 @@ int main(int argc, char *argv[])
         return -1;
     }
 
-    xenaccess = xenaccess_init(&xch, domain_id);
+    xenaccess = xenaccess_init(&xch, domain_id, nr_frames);
     if ( xenaccess == NULL )
     {
         ERROR("Error initialising xenaccess");
@@ -647,6 +760,12 @@ int main(int argc, char *argv[])
         }
     }
 
+    if ( benchmark )
+    {
+        clock_gettime(CLOCK_MONOTONIC, &bench_start);
+        bench_last = bench_start;
+    }
+
     /* Wait for access */
     for (;;)
     {
@@ -691,12 +810,12 @@ int main(int argc, char *argv[])
             interrupted = -1;
             continue;
         }
-        else if ( rc != -1 )
+        else if ( rc != -1 && !benchmark )
         {
             DPRINTF("Got event from Xen\n");
         }
 
-        while ( RING_HAS_UNCONSUMED_REQUESTS(&xenaccess->vm_event.back_ring) )
+        while ( more_requests(&xenaccess->vm_event) )
         {
             get_request(&xenaccess->vm_event, &req);
 
@@ -731,20 +850,20 @@ int main(int argc, char *argv[])
                     }
                 }
 
-                printf("PAGE ACCESS: %c%c%c for GFN %"PRIx64" (offset %06"
-                       PRIx64") gla %016"PRIx64" (valid: %c; fault in gpt: %c; fault with gla: %c) (vcpu %u [%c], altp2m view %u)\n",
-                       (req.u.mem_access.flags & MEM_ACCESS_R) ? 'r' : '-',
-                       (req.u.mem_access.flags & MEM_ACCESS_W) ? 'w' : '-',
-                       (req.u.mem_access.flags & MEM_ACCESS_X) ? 'x' : '-',
-                       req.u.mem_access.gfn,
-                       req.u.mem_access.offset,
-                       req.u.mem_access.gla,
-                       (req.u.mem_access.flags & MEM_ACCESS_GLA_VALID) ? 'y' : 'n',
-                       (req.u.mem_access.flags & MEM_ACCESS_FAULT_IN_GPT) ? 'y' : 'n',
-                       (req.u.mem_access.flags & MEM_ACCESS_FAULT_WITH_GLA) ? 'y': 'n',
-                       req.vcpu_id,
-                       (req.flags & VM_EVENT_FLAG_VCPU_PAUSED) ? 'p' : 'r',
-                       req.altp2m_idx);
+                log_event("PAGE ACCESS: %c%c%c for GFN %"PRIx64" (offset %06"
+                          PRIx64") gla %016"PRIx64" (valid: %c; fault in gpt: %c; fault with gla: %c) (vcpu %u [%c], altp2m view %u)\n",
+                          (req.u.mem_access.flags & MEM_ACCESS_R) ? 'r' : '-',
+                          (req.u.mem_access.flags & MEM_ACCESS_W) ? 'w' : '-',
+                          (req.u.mem_access.flags & MEM_ACCESS_X) ? 'x' : '-',
+                          req.u.mem_access.gfn,
+                          req.u.mem_access.offset,
+                          req.u.mem_access.gla,
+                          (req.u.mem_access.flags & MEM_ACCESS_GLA_VALID) ? 'y' : 'n',
+                          (req.u.mem_access.flags & MEM_ACCESS_FAULT_IN_GPT) ? 'y' : 'n',
+                          (req.u.mem_access.flags & MEM_ACCESS_FAULT_WITH_GLA) ? 'y': 'n',
+                          req.vcpu_id,
+                          (req.flags & VM_EVENT_FLAG_VCPU_PAUSED) ? 'p' : 'r',
+                          req.altp2m_idx);
 
                 if ( altp2m && req.flags & VM_EVENT_FLAG_ALTERNATE_P2M)
                 {
@@ -769,10 +888,10 @@ int main(int argc, char *argv[])
                 rsp.u.mem_access = req.u.mem_access;
                 break;
             case VM_EVENT_REASON_SOFTWARE_BREAKPOINT:
-                printf("Breakpoint: rip=%016"PRIx64", gfn=%"PRIx64" (vcpu %d)\n",
-                       req.data.regs.x86.rip,
-                       req.u.software_breakpoint.gfn,
-                       req.vcpu_id);
+                log_event("Breakpoint: rip=%016"PRIx64", gfn=%"PRIx64" (vcpu %d)\n",
+                          req.data.regs.x86.rip,
+                          req.u.software_breakpoint.gfn,
+                          req.vcpu_id);
 
                 /* Reinject */
                 rc = xc_hvm_inject_trap(xch, domain_id, req.vcpu_id,
@@ -787,23 +906,23 @@ int main(int argc, char *argv[])
                 }
                 break;
             case VM_EVENT_REASON_PRIVILEGED_CALL:
-                printf("Privileged call: pc=%"PRIx64" (vcpu %d)\n",
-                       req.data.regs.arm.pc,
-                       req.vcpu_id);
+                log_event("Privileged call: pc=%"PRIx64" (vcpu %d)\n",
+                          req.data.regs.arm.pc,
+                          req.vcpu_id);
 
                 rsp.data.regs.arm = req.data.regs.arm;
                 rsp.data.regs.arm.pc += 4;
                 rsp.flags |= VM_EVENT_FLAG_SET_REGISTERS;
                 break;
             case VM_EVENT_REASON_SINGLESTEP:
-                printf("Singlestep: rip=%016"PRIx64", vcpu %d, altp2m %u\n",
-                       req.data.regs.x86.rip,
-                       req.vcpu_id,
-                       req.altp2m_idx);
+                log_event("Singlestep: rip=%016"PRIx64", vcpu %d, altp2m %u\n",
+                          req.data.regs.x86.rip,
+                          req.vcpu_id,
+                          req.altp2m_idx);
 
                 if ( altp2m )
                 {
-                    printf("\tSwitching altp2m to view %u!\n", altp2m_view_id);
+                    log_event("\tSwitching altp2m to view %u!\n", altp2m_view_id);
 
                     rsp.flags |= VM_EVENT_FLAG_ALTERNATE_P2M;
                     rsp.altp2m_idx = altp2m_view_id;
@@ -813,12 +932,12 @@ int main(int argc, char *argv[])
 
                 break;
             case VM_EVENT_REASON_DEBUG_EXCEPTION:
-                printf("Debug exception: rip=%016"PRIx64", vcpu %d. Type: %u. Length: %u. Pending dbg 0x%08"PRIx64"\n",
-                       req.data.regs.x86.rip,
-                       req.vcpu_id,
-                       req.u.debug_exception.type,
-                       req.u.debug_exception.insn_length,
-                       req.u.debug_exception.pending_dbg);
+                log_event("Debug exception: rip=%016"PRIx64", vcpu %d. Type: %u. Length: %u. Pending dbg 0x%08"PRIx64"\n",
+                          req.data.regs.x86.rip,
+                          req.vcpu_id,
+                          req.u.debug_exception.type,
+                          req.u.debug_exception.insn_length,
+                          req.u.debug_exception.pending_dbg);
 
                 /* Reinject */
                 rc = xc_hvm_inject_trap(xch, domain_id, req.vcpu_id,
@@ -835,39 +954,39 @@ int main(int argc, char *argv[])
 
                 break;
             case VM_EVENT_REASON_CPUID:
-                printf("CPUID executed: rip=%016"PRIx64", vcpu %d. Insn length: %"PRIu32" " \
-                       "0x%"PRIx32" 0x%"PRIx32": EAX=0x%"PRIx64" EBX=0x%"PRIx64" ECX=0x%"PRIx64" EDX=0x%"PRIx64"\n",
-                       req.data.regs.x86.rip,
-                       req.vcpu_id,
-                       req.u.cpuid.insn_length,
-                       req.u.cpuid.leaf,
-                       req.u.cpuid.subleaf,
-                       req.data.regs.x86.rax,
-                       req.data.regs.x86.rbx,
-                       req.data.regs.x86.rcx,
-                       req.data.regs.x86.rdx);
+                log_event("CPUID executed: rip=%016"PRIx64", vcpu %d. Insn length: %"PRIu32" " \
+                          "0x%"PRIx32" 0x%"PRIx32": EAX=0x%"PRIx64" EBX=0x%"PRIx64" ECX=0x%"PRIx64" EDX=0x%"PRIx64"\n",
+                          req.data.regs.x86.rip,
+                          req.vcpu_id,
+                          req.u.cpuid.insn_length,
+                          req.u.cpuid.leaf,
+                          req.u.cpuid.subleaf,
+                          req.data.regs.x86.rax,
+                          req.data.regs.x86.rbx,
+                          req.data.regs.x86.rcx,
+                          req.data.regs.x86.rdx);
                 rsp.flags |= VM_EVENT_FLAG_SET_REGISTERS;
                 rsp.data = req.data;
                 rsp.data.regs.x86.rip += req.u.cpuid.insn_length;
                 break;
             case VM_EVENT_REASON_DESCRIPTOR_ACCESS:
-                printf("Descriptor access: rip=%016"PRIx64", vcpu %d: "\
-                       "VMExit info=0x%"PRIx32", descriptor=%d, is write=%d\n",
-                       req.data.regs.x86.rip,
-                       req.vcpu_id,
-                       req.u.desc_access.arch.vmx.instr_info,
-                       req.u.desc_access.descriptor,
-                       req.u.desc_access.is_write);
+                log_event("Descriptor access: rip=%016"PRIx64", vcpu %d: "\
+                          "VMExit info=0x%"PRIx32", descriptor=%d, is write=%d\n",
+                          req.data.regs.x86.rip,
+                          req.vcpu_id,
+                          req.u.desc_access.arch.vmx.instr_info,
+                          req.u.desc_access.descriptor,
+                          req.u.desc_access.is_write);
                 rsp.flags |= VM_EVENT_FLAG_EMULATE;
                 break;
             case VM_EVENT_REASON_WRITE_CTRLREG:
-                printf("Control register written: rip=%016"PRIx64", vcpu %d: "
-                       "reg=%s, old_value=%016"PRIx64", new_value=%016"PRIx64"\n",
-                       req.data.regs.x86.rip,
-                       req.vcpu_id,
-                       get_x86_ctrl_reg_name(req.u.write_ctrlreg.index),
-                       req.u.write_ctrlreg.old_value,
-                       req.u.write_ctrlreg.new_value);
+                log_event("Control register written: rip=%016"PRIx64", vcpu %d: "
+                          "reg=%s, old_value=%016"PRIx64", new_value=%016"PRIx64"\n",
+                          req.data.regs.x86.rip,
+                          req.vcpu_id,
+                          get_x86_ctrl_reg_name(req.u.write_ctrlreg.index),
+                          req.u.write_ctrlreg.old_value,
+                          req.u.write_ctrlreg.new_value);
                 break;
             case VM_EVENT_REASON_EMUL_UNIMPLEMENTED:
                 if ( altp2m_write_no_gpt && req.flags & VM_EVENT_FLAG_ALTERNATE_P2M )
@@ -885,23 +1004,49 @@ int main(int argc, char *argv[])
 
             /* Put the response on the ring */
             put_response(&xenaccess->vm_event, &rsp);
+
+            bench_events++;
+            bench_interval_events++;
         }
 
-        /* Tell Xen page is ready */
-        rc = xenevtchn_notify(xenaccess->vm_event.xce_handle,
-                              xenaccess->vm_event.port);
 
-        if ( rc != 0 )
+        /*
+         * Tell Xen page is ready.  A ring Xen allocated tells us whether Xen
+         * is waiting for the kick; the guest's ring page always needs one.
+         */
+        RING_PUSH_RESPONSES_AND_CHECK_NOTIFY(&xenaccess->vm_event.back_ring,
+                                             notify);
+        if ( notify || !nr_frames )
         {
-            ERROR("Error resuming page");
-            interrupted = -1;
+            rc = xenevtchn_notify(xenaccess->vm_event.xce_handle,
+                                  xenaccess->vm_event.port);
+
+            if ( rc != 0 )
+            {
+                ERROR("Error resuming page");
+                interrupted = -1;
+            }
         }
 
+        if ( benchmark )
+            bench_tick();
+
         if ( shutting_down )
             break;
     }
     DPRINTF("xenaccess shut down on signal %d\n", interrupted);
 
+    if ( benchmark )
+    {
+        struct timespec now;
+        double secs;
+
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        secs = elapsed(&bench_start, &now);
+        printf("%lu events in %.2fs: %.0f events/s average\n",
+               bench_events, secs, secs ? bench_events / secs : 0);
+    }
+
 exit:
     if ( altp2m )
     {
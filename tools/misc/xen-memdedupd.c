@@ -0,0 +1,592 @@
+/*
+ * xen-memdedupd: find identical pages in HVM guests and share them.
+ *
+ * Guest memory is read through foreign mappings, a few pages at a time and
+ * at a limited rate.  Every page is hashed into an index, and a hit in the
+ * index is compared byte for byte with the page already there.  Duplicates
+ * are handed to Xen in batches, and Xen shares each pair after checking
+ * once more, with both pages read-only, that their contents still match.
+ *
+ * A page is only considered if it hashed the same on the previous pass, so
+ * that pages being written to aren't shared just to be unshared again.
+ */
+
+#include <errno.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include <xenctrl.h>
+#include <xenforeignmemory.h>
+
+/* Pages mapped at a time. */
+#define CHUNK_PAGES     64
+#define MAX_DOMAINS     1024
+
+#define BITS_PER_UL     (sizeof(unsigned long) * 8)
+
+static xc_interface *xch;
+static xenforeignmemory_handle *fmem;
+
+static unsigned long rate = 25000;      /* pages per second, 0 = no limit */
+static unsigned int batch_size = 256;
+static unsigned int interval = 60;
+static unsigned int forget_passes = 10;
+static bool once;
+static domid_t only_doms[MAX_DOMAINS];
+static unsigned int nr_only_doms;
+
+static volatile sig_atomic_t quit;
+
+/* Per guest state, kept from one pass to the next. */
+struct dom {
+    domid_t domid;
+    xen_domain_handle_t handle;
+    unsigned long nr_gfns;
+    uint32_t *last_hash;        /* tag of each page on the previous pass */
+    unsigned long *shared;      /* gfns we believe are already shared */
+    bool present;
+    bool skip;                  /* sharing can't be enabled */
+};
+
+static struct dom *doms;
+static unsigned int nr_doms;
+
+/* One page per distinct hash. */
+struct index_entry {
+    uint64_t hash;
+    uint64_t gfn;
+    domid_t domid;
+};
+
+static struct index_entry *index_tbl;
+static unsigned long index_size;
+
+/* Pairs waiting to be shared, per (source, client) domain pair. */
+struct batch {
+    domid_t source, client;
+    unsigned int nr;
+    xen_mem_sharing_batch_entry_t *ent;
+};
+
+static struct batch *batches;
+static unsigned int nr_batches;
+
+static struct {
+    unsigned long scanned;
+    unsigned long unstable;
+    unsigned long candidates;
+    unsigned long collisions;
+    unsigned long shared;
+    unsigned long changed;
+    unsigned long failed;
+} stats;
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [options] [domid...]\n"
+            "Shares identical pages between the given HVM guests, or all of\n"
+            "them if none are given.\n"
+            "options:\n"
+            "  -r PAGES  pages to scan per second (default %lu, 0 = no limit)\n"
+            "  -b PAIRS  pairs to share per hypercall (default %u)\n"
+            "  -i SECS   pause between passes (default %u)\n"
+            "  -f PASSES passes after which shared pages are looked at\n"
+            "            again (default %u)\n"
+            "  -1        do two passes (enough to share stable pages) and exit\n",
+            prog, rate, batch_size, interval, forget_passes);
+    exit(2);
+}
+
+static double now(clockid_t clk)
+{
+    struct timespec ts;
+
+    clock_gettime(clk, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void set_bit_ul(unsigned long nr, unsigned long *map)
+{
+    map[nr / BITS_PER_UL] |= 1UL << (nr % BITS_PER_UL);
+}
+
+static bool test_bit_ul(unsigned long nr, const unsigned long *map)
+{
+    return map[nr / BITS_PER_UL] & (1UL << (nr % BITS_PER_UL));
+}
+
+static uint64_t page_hash(const void *page)
+{
+    const uint64_t *p = page;
+    uint64_t h = 0x9e3779b97f4a7c15ULL;
+    unsigned int i;
+
+    for ( i = 0; i < XC_PAGE_SIZE / sizeof(*p); i++ )
+    {
+        h ^= p[i];
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 32;
+    }
+
+    return h;
+}
+
+static struct dom *find_dom(domid_t domid)
+{
+    unsigned int i;
+
+    for ( i = 0; i < nr_doms; i++ )
+        if ( doms[i].domid == domid )
+            return &doms[i];
+
+    return NULL;
+}
+
+static void free_dom(struct dom *d)
+{
+    free(d->last_hash);
+    free(d->shared);
+    *d = doms[--nr_doms];
+}
+
+static bool wanted(domid_t domid)
+{
+    unsigned int i;
+
+    if ( !nr_only_doms )
+        return true;
+
+    for ( i = 0; i < nr_only_doms; i++ )
+        if ( only_doms[i] == domid )
+            return true;
+
+    return false;
+}
+
+/*
+ * Bring the list of guests up to date.  Guests which went away are
+ * forgotten, new ones have sharing enabled, and guests which grew get their
+ * per-page state extended.
+ */
+static int refresh_domains(void)
+{
+    static xc_domaininfo_t info[MAX_DOMAINS];
+    unsigned int i;
+    int n;
+
+    n = xc_domain_getinfolist(xch, 1, MAX_DOMAINS, info);
+    if ( n < 0 )
+    {
+        perror("xc_domain_getinfolist");
+        return -1;
+    }
+
+    for ( i = 0; i < nr_doms; i++ )
+        doms[i].present = false;
+
+    for ( i = 0; i < n; i++ )
+    {
+        struct dom *d = find_dom(info[i].domain);
+        xen_pfn_t max_gpfn;
+        unsigned long nr_gfns;
+
+        if ( !(info[i].flags & XEN_DOMINF_hvm_guest) ||
+             (info[i].flags & (XEN_DOMINF_dying | XEN_DOMINF_shutdown)) ||
+             !wanted(info[i].domain) )
+            continue;
+
+        /* A different domain with a recycled domid? */
+        if ( d && memcmp(d->handle, info[i].handle, sizeof(d->handle)) )
+        {
+            free_dom(d);
+            d = NULL;
+        }
+
+        if ( !d )
+        {
+            struct dom *nd = realloc(doms, (nr_doms + 1) * sizeof(*doms));
+
+            if ( !nd )
+                return -1;
+            doms = nd;
+            d = &doms[nr_doms++];
+            memset(d, 0, sizeof(*d));
+            d->domid = info[i].domain;
+            memcpy(d->handle, info[i].handle, sizeof(d->handle));
+
+            if ( xc_memshr_control(xch, d->domid, 1) )
+            {
+                fprintf(stderr, "d%u: cannot enable sharing: %s\n",
+                        d->domid, strerror(errno));
+                d->skip = true;
+            }
+        }
+
+        d->present = true;
+        if ( d->skip )
+            continue;
+
+        if ( xc_domain_maximum_gpfn(xch, d->domid, &max_gpfn) )
+            continue;
+        nr_gfns = max_gpfn + 1;
+
+        if ( nr_gfns > d->nr_gfns )
+        {
+            size_t old_words = (d->nr_gfns + BITS_PER_UL - 1) / BITS_PER_UL;
+            size_t new_words = (nr_gfns + BITS_PER_UL - 1) / BITS_PER_UL;
+            uint32_t *lh = realloc(d->last_hash, nr_gfns * sizeof(*lh));
+            unsigned long *sh;
+
+            if ( !lh )
+                return -1;
+            d->last_hash = lh;
+            sh = realloc(d->shared, new_words * sizeof(*sh));
+            if ( !sh )
+                return -1;
+            d->shared = sh;
+
+            memset(lh + d->nr_gfns, 0, (nr_gfns - d->nr_gfns) * sizeof(*lh));
+            memset(sh + old_words, 0, (new_words - old_words) * sizeof(*sh));
+            d->nr_gfns = nr_gfns;
+        }
+    }
+
+    for ( i = 0; i < nr_doms; )
+        if ( !doms[i].present )
+            free_dom(&doms[i]);
+        else
+            i++;
+
+    return 0;
+}
+
+static int index_reset(void)
+{
+    unsigned long total = 0, size = 1024, i;
+
+    for ( i = 0; i < nr_doms; i++ )
+        if ( !doms[i].skip )
+            total += doms[i].nr_gfns;
+
+    while ( size < total * 2 )
+        size <<= 1;
+
+    if ( size != index_size )
+    {
+        free(index_tbl);
+        index_tbl = malloc(size * sizeof(*index_tbl));
+        index_size = index_tbl ? size : 0;
+        if ( !index_tbl )
+            return -1;
+    }
+
+    for ( i = 0; i < index_size; i++ )
+        index_tbl[i].domid = DOMID_INVALID;
+
+    return 0;
+}
+
+/* Returns the entry for hash, or the empty slot where it belongs. */
+static struct index_entry *index_lookup(uint64_t hash)
+{
+    unsigned long i = hash & (index_size - 1);
+
+    while ( index_tbl[i].domid != DOMID_INVALID && index_tbl[i].hash != hash )
+        i = (i + 1) & (index_size - 1);
+
+    return &index_tbl[i];
+}
+
+static bool page_matches(domid_t domid, uint64_t gfn, const void *page)
+{
+    xen_pfn_t pfn = gfn;
+    void *map;
+    int err;
+    bool same;
+
+    map = xenforeignmemory_map(fmem, domid, PROT_READ, 1, &pfn, &err);
+    if ( !map )
+        return false;
+
+    same = !err && !memcmp(map, page, XC_PAGE_SIZE);
+    xenforeignmemory_unmap(fmem, map, 1);
+
+    return same;
+}
+
+static struct batch *get_batch(domid_t source, domid_t client)
+{
+    struct batch *b;
+    unsigned int i;
+
+    for ( i = 0; i < nr_batches; i++ )
+        if ( batches[i].source == source && batches[i].client == client )
+            return &batches[i];
+
+    b = realloc(batches, (nr_batches + 1) * sizeof(*batches));
+    if ( !b )
+        return NULL;
+    batches = b;
+
+    b = &batches[nr_batches];
+    /* Room for a chunk's worth of pairs beyond batch_size, see scan_domain */
+    b->ent = malloc((batch_size + CHUNK_PAGES) * sizeof(*b->ent));
+    if ( !b->ent )
+        return NULL;
+    b->source = source;
+    b->client = client;
+    b->nr = 0;
+    nr_batches++;
+
+    return b;
+}
+
+static void flush_batch(struct batch *b)
+{
+    struct dom *sd = find_dom(b->source), *cd = find_dom(b->client);
+    unsigned int i;
+
+    if ( !b->nr )
+        return;
+
+    if ( xc_memshr_share_batch(xch, b->source, b->client, b->ent, b->nr) )
+        fprintf(stderr, "d%u/d%u: sharing batch failed: %s\n",
+                b->source, b->client, strerror(errno));
+
+    for ( i = 0; i < b->nr; i++ )
+    {
+        const xen_mem_sharing_batch_entry_t *e = &b->ent[i];
+
+        if ( e->rc == 0 )
+        {
+            stats.shared++;
+            if ( sd && e->source_gfn < sd->nr_gfns )
+                set_bit_ul(e->source_gfn, sd->shared);
+            if ( cd && e->client_gfn < cd->nr_gfns )
+                set_bit_ul(e->client_gfn, cd->shared);
+        }
+        else if ( e->rc == -EAGAIN )
+            stats.changed++;
+        else
+            stats.failed++;
+    }
+
+    b->nr = 0;
+}
+
+static void flush_batches(bool all)
+{
+    unsigned int i;
+
+    for ( i = 0; i < nr_batches; i++ )
+        if ( all || batches[i].nr >= batch_size )
+            flush_batch(&batches[i]);
+}
+
+static void scan_page(struct dom *d, uint64_t gfn, const void *page)
+{
+    uint64_t hash = page_hash(page);
+    uint32_t tag = (hash >> 32) | 1;
+    struct index_entry *e;
+    struct batch *b;
+    bool stable;
+
+    stats.scanned++;
+
+    stable = d->last_hash[gfn] == tag;
+    d->last_hash[gfn] = tag;
+    if ( !stable )
+    {
+        stats.unstable++;
+        return;
+    }
+
+    e = index_lookup(hash);
+    if ( e->domid == DOMID_INVALID )
+    {
+        e->hash = hash;
+        e->gfn = gfn;
+        e->domid = d->domid;
+        return;
+    }
+
+    if ( test_bit_ul(gfn, d->shared) )
+        return;
+
+    stats.candidates++;
+    if ( !page_matches(e->domid, e->gfn, page) )
+    {
+        stats.collisions++;
+        return;
+    }
+
+    b = get_batch(e->domid, d->domid);
+    if ( !b )
+        return;
+
+    b->ent[b->nr].source_gfn = e->gfn;
+    b->ent[b->nr].client_gfn = gfn;
+    b->ent[b->nr].rc = 1;           /* not processed */
+    b->ent[b->nr]._pad = 0;
+    b->nr++;
+}
+
+static void throttle(double start)
+{
+    double ahead;
+    struct timespec ts;
+
+    if ( !rate )
+        return;
+
+    ahead = (double)stats.scanned / rate - (now(CLOCK_MONOTONIC) - start);
+    if ( ahead <= 0 )
+        return;
+
+    ts.tv_sec = ahead;
+    ts.tv_nsec = (ahead - ts.tv_sec) * 1e9;
+    nanosleep(&ts, NULL);
+}
+
+static void scan_domain(struct dom *d, double start)
+{
+    xen_pfn_t gfns[CHUNK_PAGES];
+    int errs[CHUNK_PAGES];
+    unsigned long gfn;
+    unsigned int i, n;
+    char *map;
+
+    for ( gfn = 0; gfn < d->nr_gfns && !quit; gfn += n )
+    {
+        n = d->nr_gfns - gfn < CHUNK_PAGES ? d->nr_gfns - gfn : CHUNK_PAGES;
+
+        for ( i = 0; i < n; i++ )
+            gfns[i] = gfn + i;
+
+        map = xenforeignmemory_map(fmem, d->domid, PROT_READ, n, gfns, errs);
+        if ( !map )
+            continue;
+
+        for ( i = 0; i < n; i++ )
+            if ( !errs[i] )
+                scan_page(d, gfn + i, map + i * XC_PAGE_SIZE);
+
+        /*
+         * Our mappings hold references which would stop Xen from
+         * nominating the pages, so only share once they are gone.
+         */
+        xenforeignmemory_unmap(fmem, map, n);
+        flush_batches(false);
+
+        throttle(start);
+    }
+}
+
+static void do_pass(unsigned int pass)
+{
+    double wall, cpu;
+    unsigned int i;
+    long saved;
+
+    if ( refresh_domains() || index_reset() )
+    {
+        fprintf(stderr, "Out of memory\n");
+        quit = 1;
+        return;
+    }
+
+    if ( forget_passes && pass && !(pass % forget_passes) )
+        for ( i = 0; i < nr_doms; i++ )
+            memset(doms[i].shared, 0,
+                   (doms[i].nr_gfns + BITS_PER_UL - 1) / BITS_PER_UL *
+                   sizeof(unsigned long));
+
+    memset(&stats, 0, sizeof(stats));
+    wall = now(CLOCK_MONOTONIC);
+    cpu = now(CLOCK_PROCESS_CPUTIME_ID);
+
+    for ( i = 0; i < nr_doms && !quit; i++ )
+        if ( !doms[i].skip )
+            scan_domain(&doms[i], wall);
+    flush_batches(true);
+
+    wall = now(CLOCK_MONOTONIC) - wall;
+    cpu = now(CLOCK_PROCESS_CPUTIME_ID) - cpu;
+    saved = xc_sharing_freed_pages(xch);
+
+    printf("pass %u: %u guests, %lu pages in %.1fs, cpu %.2fs (%.0f ns/page)\n"
+           "  %lu unstable, %lu candidates, %lu hash collisions\n"
+           "  %lu shared, %lu changed before sharing, %lu failed\n"
+           "  %ld pages saved in total\n",
+           pass, nr_doms, stats.scanned, wall, cpu,
+           stats.scanned ? cpu * 1e9 / stats.scanned : 0.0,
+           stats.unstable, stats.candidates, stats.collisions,
+           stats.shared, stats.changed, stats.failed, saved);
+    fflush(stdout);
+}
+
+static void handle_signal(int sig)
+{
+    quit = 1;
+}
+
+int main(int argc, char **argv)
+{
+    struct sigaction sa = { .sa_handler = handle_signal };
+    unsigned int pass, s;
+    int opt;
+
+    while ( (opt = getopt(argc, argv, "r:b:i:f:1h")) != -1 )
+    {
+        switch ( opt )
+        {
+        case 'r': rate = strtoul(optarg, NULL, 0); break;
+        case 'b': batch_size = strtoul(optarg, NULL, 0); break;
+        case 'i': interval = strtoul(optarg, NULL, 0); break;
+        case 'f': forget_passes = strtoul(optarg, NULL, 0); break;
+        case '1': once = true; break;
+        default: usage(argv[0]);
+        }
+    }
+
+    if ( !batch_size || argc - optind > MAX_DOMAINS )
+        usage(argv[0]);
+    for ( ; optind < argc; optind++ )
+        only_doms[nr_only_doms++] = strtoul(argv[optind], NULL, 0);
+
+    xch = xc_interface_open(NULL, NULL, 0);
+    fmem = xenforeignmemory_open(NULL, 0);
+    if ( !xch || !fmem )
+    {
+        perror("Failed to open Xen interfaces");
+        return 1;
+    }
+
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    for ( pass = 0; !quit; pass++ )
+    {
+        do_pass(pass);
+
+        if ( once && pass == 1 )
+            break;
+
+        for ( s = 0; s < interval && !quit && !(once && !pass); s++ )
+            sleep(1);
+    }
+
+    xenforeignmemory_close(fmem);
+    xc_interface_close(xch);
+
+    return 0;
+}
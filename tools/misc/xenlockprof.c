@@ -17,104 +17,499 @@
 #include <errno.h>
 #include <string.h>
 #include <inttypes.h>
+#include <unistd.h>
 
-int main(int argc, char *argv[])
+struct snapshot {
+    uint64_t            time;
+    uint32_t            nr_locks, nr_sites, nr_cpus;
+    xc_lockprof_data_t *locks;
+    xc_lockprof_site_t *sites;
+    xc_lockprof_cpu_t  *cpus;
+};
+
+static void usage(const char *prog)
 {
-    xc_interface      *xc_handle;
-    uint32_t           i, j, n;
-    uint64_t           time;
-    double             l, b, sl, sb;
-    char               name[100];
+    printf("%s: [-r] | [-i secs] [-s n] [-c] [-f hold|wait]\n", prog);
+    printf("no args: print lock profile data\n");
+    printf("    -r : reset profile data\n");
+    printf("    -i : report what happened during an interval of secs seconds\n");
+    printf("         rather than since profiling was last reset\n");
+    printf("    -s : print the n call sites which waited longest for locks,\n");
+    printf("         with hold and wait time histograms\n");
+    printf("    -c : print the time spent holding and waiting for locks\n");
+    printf("         on each CPU\n");
+    printf("    -f : print time held or waited for per lock and call site\n");
+    printf("         as folded stacks, for flamegraph.pl\n");
+}
+
+static int get_locks(xc_interface *xc_handle, struct snapshot *s)
+{
+    uint32_t n = 0, i;
     DECLARE_HYPERCALL_BUFFER(xc_lockprof_data_t, data);
 
-    if ( (argc > 2) || ((argc == 2) && (strcmp(argv[1], "-r") != 0)) )
+    if ( xc_lockprof_query_number(xc_handle, &n) != 0 )
     {
-        printf("%s: [-r]\n", argv[0]);
-        printf("no args: print lock profile data\n");
-        printf("    -r : reset profile data\n");
-        return 1;
+        fprintf(stderr, "Error getting number of profile records: %d (%s)\n",
+                errno, strerror(errno));
+        return -1;
     }
 
-    if ( (xc_handle = xc_interface_open(0,0,0)) == 0 )
+    n += 32;    /* just to be sure */
+    data = xc_hypercall_buffer_alloc(xc_handle, data, sizeof(*data) * n);
+    s->locks = malloc(sizeof(*data) * n);
+    if ( data == NULL || s->locks == NULL )
     {
-        fprintf(stderr, "Error opening xc interface: %d (%s)\n",
+        fprintf(stderr, "Could not allocate buffers: %d (%s)\n",
                 errno, strerror(errno));
-        return 1;
+        return -1;
     }
 
-    if ( argc > 1 )
+    i = n;
+    if ( xc_lockprof_query(xc_handle, &i, &s->time,
+                           HYPERCALL_BUFFER(data)) != 0 )
     {
-        if ( xc_lockprof_reset(xc_handle) != 0 )
-        {
-            fprintf(stderr, "Error resetting profile data: %d (%s)\n",
-                    errno, strerror(errno));
-            return 1;
-        }
-        return 0;
+        fprintf(stderr, "Error getting profile records: %d (%s)\n",
+                errno, strerror(errno));
+        return -1;
     }
 
-    n = 0;
-    if ( xc_lockprof_query_number(xc_handle, &n) != 0 )
+    if ( i > n )
     {
-        fprintf(stderr, "Error getting number of profile records: %d (%s)\n",
+        printf("data incomplete, %d records are missing!\n\n", i - n);
+        i = n;
+    }
+
+    memcpy(s->locks, data, sizeof(*data) * i);
+    s->nr_locks = i;
+
+    xc_hypercall_buffer_free(xc_handle, data);
+
+    return 0;
+}
+
+static int get_sites(xc_interface *xc_handle, struct snapshot *s)
+{
+    uint32_t n = 0, i;
+
+    if ( xc_lockprof_query_sites(xc_handle, &n, NULL, NULL) != 0 )
+    {
+        fprintf(stderr, "Error getting number of call site records: %d (%s)\n",
                 errno, strerror(errno));
-        return 1;
+        return -1;
     }
 
-    n += 32;    /* just to be sure */
-    data = xc_hypercall_buffer_alloc(xc_handle, data, sizeof(*data) * n);
-    if ( data == NULL )
+    n += 64;    /* just to be sure */
+    s->sites = malloc(sizeof(*s->sites) * n);
+    if ( s->sites == NULL )
     {
         fprintf(stderr, "Could not allocate buffers: %d (%s)\n",
                 errno, strerror(errno));
-        return 1;
+        return -1;
     }
 
     i = n;
-    if ( xc_lockprof_query(xc_handle, &i, &time, HYPERCALL_BUFFER(data)) != 0 )
+    if ( xc_lockprof_query_sites(xc_handle, &i, NULL, s->sites) != 0 )
     {
-        fprintf(stderr, "Error getting profile records: %d (%s)\n",
+        fprintf(stderr, "Error getting call site records: %d (%s)\n",
                 errno, strerror(errno));
-        return 1;
+        return -1;
     }
 
     if ( i > n )
     {
-        printf("data incomplete, %d records are missing!\n\n", i - n);
+        printf("data incomplete, %d call site records are missing!\n\n",
+               i - n);
         i = n;
     }
+    s->nr_sites = i;
 
-    sl = 0;
-    sb = 0;
-    for ( j = 0; j < i; j++ )
+    return 0;
+}
+
+static int get_cpus(xc_interface *xc_handle, struct snapshot *s)
+{
+    uint32_t n = 0;
+
+    if ( xc_lockprof_query_cpus(xc_handle, &n, NULL) != 0 )
+    {
+        fprintf(stderr, "Error getting number of CPUs: %d (%s)\n",
+                errno, strerror(errno));
+        return -1;
+    }
+
+    s->cpus = calloc(n, sizeof(*s->cpus));
+    if ( s->cpus == NULL )
+    {
+        fprintf(stderr, "Could not allocate buffers: %d (%s)\n",
+                errno, strerror(errno));
+        return -1;
+    }
+
+    if ( xc_lockprof_query_cpus(xc_handle, &n, s->cpus) != 0 )
     {
-        switch ( data[j].type )
+        fprintf(stderr, "Error getting per CPU records: %d (%s)\n",
+                errno, strerror(errno));
+        return -1;
+    }
+    s->nr_cpus = n;
+
+    return 0;
+}
+
+static int get_snapshot(xc_interface *xc_handle, struct snapshot *s)
+{
+    memset(s, 0, sizeof(*s));
+
+    if ( get_locks(xc_handle, s) || get_sites(xc_handle, s) ||
+         get_cpus(xc_handle, s) )
+        return -1;
+
+    return 0;
+}
+
+static void free_snapshot(struct snapshot *s)
+{
+    free(s->locks);
+    free(s->sites);
+    free(s->cpus);
+}
+
+static int same_lock(const char *name1, int32_t type1, int32_t idx1,
+                     const char *name2, int32_t type2, int32_t idx2)
+{
+    return type1 == type2 && idx1 == idx2 &&
+           !strncmp(name1, name2, sizeof(((xc_lockprof_data_t *)0)->name));
+}
+
+/* Turn s into the difference between s and the earlier snapshot old. */
+static void snapshot_sub(struct snapshot *s, const struct snapshot *old)
+{
+    uint32_t i, j, k;
+
+    s->time -= old->time;
+
+    for ( i = 0; i < s->nr_locks; i++ )
+    {
+        xc_lockprof_data_t *d = &s->locks[i];
+
+        for ( j = 0; j < old->nr_locks; j++ )
         {
-        case LOCKPROF_TYPE_GLOBAL:
-            sprintf(name, "global lock %s", data[j].name);
-            break;
-        case LOCKPROF_TYPE_PERDOM:
-            sprintf(name, "domain %d lock %s", data[j].idx, data[j].name);
+            const xc_lockprof_data_t *o = &old->locks[j];
+
+            if ( !same_lock(d->name, d->type, d->idx,
+                            o->name, o->type, o->idx) )
+                continue;
+
+            d->lock_cnt -= o->lock_cnt;
+            d->block_cnt -= o->block_cnt;
+            d->lock_time -= o->lock_time;
+            d->block_time -= o->block_time;
             break;
-        default:
-            sprintf(name, "unknown type(%d) %d lock %s", data[j].type,
-                    data[j].idx, data[j].name);
+        }
+    }
+
+    for ( i = 0; i < s->nr_sites; i++ )
+    {
+        xc_lockprof_site_t *d = &s->sites[i];
+
+        for ( j = 0; j < old->nr_sites; j++ )
+        {
+            const xc_lockprof_site_t *o = &old->sites[j];
+
+            if ( !same_lock(d->name, d->type, d->idx,
+                            o->name, o->type, o->idx) ||
+                 strncmp(d->site, o->site, sizeof(d->site)) )
+                continue;
+
+            d->lock_cnt -= o->lock_cnt;
+            d->block_cnt -= o->block_cnt;
+            d->lock_time -= o->lock_time;
+            d->block_time -= o->block_time;
+            for ( k = 0; k < XEN_SYSCTL_LOCKPROF_HIST_BUCKETS; k++ )
+            {
+                d->hold_hist[k] -= o->hold_hist[k];
+                d->block_hist[k] -= o->block_hist[k];
+            }
             break;
         }
-        l = (double)(data[j].lock_time) / 1E+09;
-        b = (double)(data[j].block_time) / 1E+09;
+    }
+
+    for ( i = 0; i < s->nr_cpus && i < old->nr_cpus; i++ )
+    {
+        s->cpus[i].lock_cnt -= old->cpus[i].lock_cnt;
+        s->cpus[i].block_cnt -= old->cpus[i].block_cnt;
+        s->cpus[i].lock_time -= old->cpus[i].lock_time;
+        s->cpus[i].block_time -= old->cpus[i].block_time;
+    }
+}
+
+static void lock_name(char *name, size_t size, const char *lock,
+                      int32_t type, int32_t idx)
+{
+    switch ( type )
+    {
+    case LOCKPROF_TYPE_GLOBAL:
+        snprintf(name, size, "global lock %s", lock);
+        break;
+    case LOCKPROF_TYPE_PERDOM:
+        snprintf(name, size, "domain %d lock %s", idx, lock);
+        break;
+    case LOCKPROF_TYPE_PERCPU:
+        snprintf(name, size, "cpu %d lock %s", idx, lock);
+        break;
+    default:
+        snprintf(name, size, "unknown type(%d) %d lock %s", type, idx, lock);
+        break;
+    }
+}
+
+static void print_locks(const struct snapshot *s)
+{
+    uint32_t j;
+    double l, b, sl, sb;
+    char name[100];
+
+    sl = 0;
+    sb = 0;
+    for ( j = 0; j < s->nr_locks; j++ )
+    {
+        const xc_lockprof_data_t *d = &s->locks[j];
+
+        lock_name(name, sizeof(name), d->name, d->type, d->idx);
+        l = (double)(d->lock_time) / 1E+09;
+        b = (double)(d->block_time) / 1E+09;
         sl += l;
         sb += b;
         printf("%-50s: lock:%12"PRId64"(%20.9fs), "
                "block:%12"PRId64"(%20.9fs)\n",
-               name, data[j].lock_cnt, l, data[j].block_cnt, b);
+               name, d->lock_cnt, l, d->block_cnt, b);
     }
-    l = (double)time / 1E+09;
+    l = (double)s->time / 1E+09;
     printf("total profiling time: %20.9fs\n", l);
     printf("total locked time:    %20.9fs\n", sl);
     printf("total blocked time:   %20.9fs\n", sb);
+}
 
-    xc_hypercall_buffer_free(xc_handle, data);
+/* Upper bound of a histogram bucket, see XEN_SYSCTL_LOCKPROF_HIST_BUCKETS. */
+static void bucket_name(char *buf, size_t size, unsigned int b)
+{
+    uint64_t ns = 128ULL << b;
+
+    if ( b == XEN_SYSCTL_LOCKPROF_HIST_BUCKETS - 1 )
+        ns >>= 1;
+
+    if ( ns < 1000 )
+        snprintf(buf, size, "%"PRIu64"ns", ns);
+    else if ( ns < 1000000 )
+        snprintf(buf, size, "%.1fus", ns / 1E+03);
+    else
+        snprintf(buf, size, "%.1fms", ns / 1E+06);
+}
+
+static void print_hist(const char *what, const uint32_t *hist)
+{
+    unsigned int b;
+    char bound[16];
+
+    printf("    %-5s", what);
+    for ( b = 0; b < XEN_SYSCTL_LOCKPROF_HIST_BUCKETS; b++ )
+    {
+        if ( !hist[b] )
+            continue;
+        bucket_name(bound, sizeof(bound), b);
+        printf(" %s%s:%"PRIu32,
+               b == XEN_SYSCTL_LOCKPROF_HIST_BUCKETS - 1 ? ">=" : "<",
+               bound, hist[b]);
+    }
+    printf("\n");
+}
+
+static int cmp_block_time(const void *a, const void *b)
+{
+    const xc_lockprof_site_t *sa = *(xc_lockprof_site_t * const *)a;
+    const xc_lockprof_site_t *sb = *(xc_lockprof_site_t * const *)b;
+
+    if ( sa->block_time != sb->block_time )
+        return sa->block_time < sb->block_time ? 1 : -1;
+    return sa->block_cnt < sb->block_cnt ? 1 : sa->block_cnt > sb->block_cnt;
+}
+
+static void print_top_sites(const struct snapshot *s, unsigned int top)
+{
+    xc_lockprof_site_t **order;
+    uint32_t i;
+    char name[100];
+
+    order = malloc(sizeof(*order) * (s->nr_sites ?: 1));
+    if ( order == NULL )
+    {
+        fprintf(stderr, "Could not allocate buffers: %d (%s)\n",
+                errno, strerror(errno));
+        return;
+    }
+
+    for ( i = 0; i < s->nr_sites; i++ )
+        order[i] = &s->sites[i];
+    qsort(order, s->nr_sites, sizeof(*order), cmp_block_time);
+
+    printf("top %u contended call sites:\n", top);
+    for ( i = 0; i < s->nr_sites && i < top; i++ )
+    {
+        const xc_lockprof_site_t *d = order[i];
+
+        if ( !d->block_cnt )
+            break;
+
+        lock_name(name, sizeof(name), d->name, d->type, d->idx);
+        printf("%-50s %s\n", name, d->site);
+        printf("    block:%12"PRIu64"(%20.9fs), lock:%12"PRIu64"(%20.9fs)\n",
+               d->block_cnt, d->block_time / 1E+09,
+               d->lock_cnt, d->lock_time / 1E+09);
+        print_hist("wait:", d->block_hist);
+        print_hist("hold:", d->hold_hist);
+    }
+
+    free(order);
+}
+
+static void print_cpus(const struct snapshot *s)
+{
+    uint32_t i;
+
+    printf("per CPU lock times:\n");
+    for ( i = 0; i < s->nr_cpus; i++ )
+    {
+        const xc_lockprof_cpu_t *c = &s->cpus[i];
+
+        if ( !c->lock_cnt && !c->block_cnt )
+            continue;
+
+        printf("cpu%-4u: lock:%12"PRIu64"(%20.9fs), "
+               "block:%12"PRIu64"(%20.9fs)\n",
+               i, c->lock_cnt, c->lock_time / 1E+09,
+               c->block_cnt, c->block_time / 1E+09);
+    }
+}
+
+/* One "lock;call site nanoseconds" line per call site. */
+static void print_folded(const struct snapshot *s, int hold)
+{
+    uint32_t i;
+    char name[100];
+
+    for ( i = 0; i < s->nr_sites; i++ )
+    {
+        const xc_lockprof_site_t *d = &s->sites[i];
+        uint64_t ns = hold ? d->lock_time : d->block_time;
+
+        if ( !ns )
+            continue;
+
+        lock_name(name, sizeof(name), d->name, d->type, d->idx);
+        printf("%s;%s %"PRIu64"\n", name, d->site, ns);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    xc_interface      *xc_handle;
+    struct snapshot    snap, old;
+    unsigned int       interval = 0, top = 0;
+    int                opt, reset = 0, cpus = 0, folded = -1;
+
+    while ( (opt = getopt(argc, argv, "ri:s:cf:")) != -1 )
+    {
+        switch ( opt )
+        {
+        case 'r':
+            reset = 1;
+            break;
+        case 'i':
+            interval = strtoul(optarg, NULL, 0);
+            break;
+        case 's':
+            top = strtoul(optarg, NULL, 0);
+            break;
+        case 'c':
+            cpus = 1;
+            break;
+        case 'f':
+            if ( !strcmp(optarg, "hold") )
+                folded = 1;
+            else if ( !strcmp(optarg, "wait") )
+                folded = 0;
+            else
+            {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if ( optind != argc ||
+         (reset && (interval || top || cpus || folded >= 0)) )
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if ( (xc_handle = xc_interface_open(0,0,0)) == 0 )
+    {
+        fprintf(stderr, "Error opening xc interface: %d (%s)\n",
+                errno, strerror(errno));
+        return 1;
+    }
+
+    if ( reset )
+    {
+        if ( xc_lockprof_reset(xc_handle) != 0 )
+        {
+            fprintf(stderr, "Error resetting profile data: %d (%s)\n",
+                    errno, strerror(errno));
+            return 1;
+        }
+        return 0;
+    }
+
+    if ( interval )
+    {
+        if ( get_snapshot(xc_handle, &old) )
+            return 1;
+        sleep(interval);
+    }
+
+    if ( get_snapshot(xc_handle, &snap) )
+        return 1;
+
+    if ( interval )
+    {
+        snapshot_sub(&snap, &old);
+        free_snapshot(&old);
+    }
+
+    if ( folded >= 0 )
+        print_folded(&snap, folded);
+    else
+    {
+        print_locks(&snap);
+        if ( top )
+        {
+            printf("\n");
+            print_top_sites(&snap, top);
+        }
+        if ( cpus )
+        {
+            printf("\n");
+            print_cpus(&snap);
+        }
+    }
+
+    free_snapshot(&snap);
+    xc_interface_close(xc_handle);
 
     return 0;
 }
@@ -16,6 +16,10 @@
 #include <sys/mman.h>
 #include <errno.h>
 #include <string.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
 
 #define X(name) [__HYPERVISOR_##name] = #name
 static const char *const hypercall_name_table[64] =
@@ -78,6 +82,426 @@ static const char *const hypercall_name_table[64] =
 };
 #undef X
 
+/*
+ * Sample files start with a struct sample_hdr, followed by nr_sel counter
+ * labels of LABEL_LEN bytes each.  Then there is one record per interval:
+ * the nanoseconds elapsed since the previous sample, followed by the
+ * change of every selected counter on each CPU since then (counter major).
+ * All record fields are zigzag encoded LEB128 varints, so idle counters
+ * take a single byte.
+ */
+#define SAMPLE_MAGIC   "XENPERFS"
+#define SAMPLE_VERSION 1
+#define LABEL_LEN      96
+
+struct sample_hdr {
+    char     magic[8];
+    uint32_t version;
+    uint32_t nr_sel;
+    uint32_t nr_cpus;
+    uint32_t interval_ms;
+    uint64_t start;      /* Xen system time of the first sample, in ns */
+};
+
+static volatile sig_atomic_t stop_sampling;
+
+static void stop_handler(int sig)
+{
+    stop_sampling = 1;
+}
+
+static void put_varint(FILE *f, int64_t v)
+{
+    uint64_t u = ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+
+    while ( u >= 0x80 )
+    {
+        putc((u & 0x7f) | 0x80, f);
+        u >>= 7;
+    }
+    putc(u, f);
+}
+
+static int get_varint(FILE *f, int64_t *v)
+{
+    uint64_t u = 0;
+    unsigned int shift = 0;
+    int c;
+
+    do {
+        if ( (c = getc(f)) == EOF || shift > 63 )
+            return -1;
+        u |= (uint64_t)(c & 0x7f) << shift;
+        shift += 7;
+    } while ( c & 0x80 );
+
+    *v = (int64_t)(u >> 1) ^ -(int64_t)(u & 1);
+
+    return 0;
+}
+
+/*
+ * Parse a comma separated list of counters, each either a counter name or
+ * name[element].  Elements of "hypercalls" may also be given by name.
+ */
+static int parse_sel(const char *list, const xc_perfc_desc_t *pcd,
+                     int num_desc, xc_perfc_sel_t *sel,
+                     char (*label)[LABEL_LEN])
+{
+    char *copy = strdup(list), *tok, *save = NULL;
+    int n = 0;
+
+    if ( copy == NULL )
+        return -1;
+
+    for ( tok = strtok_r(copy, ",", &save); tok;
+          tok = strtok_r(NULL, ",", &save) )
+    {
+        char *idx = strchr(tok, '[');
+        int i, j;
+
+        if ( n == XEN_SYSCTL_PERFC_MAX_SEL )
+        {
+            fprintf(stderr, "Too many counters selected\n");
+            goto err;
+        }
+
+        if ( idx )
+            *idx++ = '\0';
+
+        for ( i = 0; i < num_desc; i++ )
+            if ( strcmp(pcd[i].name, tok) == 0 )
+                break;
+        if ( i == num_desc )
+        {
+            fprintf(stderr, "Unknown counter %s\n", tok);
+            goto err;
+        }
+
+        sel[n].counter = i;
+        sel[n].element = XEN_SYSCTL_PERFC_ELEMENT_ALL;
+
+        if ( idx )
+        {
+            char *end;
+
+            idx[strcspn(idx, "]")] = '\0';
+            sel[n].element = strtoul(idx, &end, 0);
+            if ( (*end || idx == end) && strcmp(tok, "hypercalls") == 0 )
+            {
+                for ( j = 0; j < 64; j++ )
+                    if ( hypercall_name_table[j] &&
+                         strcmp(hypercall_name_table[j], idx) == 0 )
+                        break;
+                sel[n].element = j;
+                if ( j < 64 )
+                    end = idx + strlen(idx);
+            }
+            if ( *end || idx == end )
+            {
+                fprintf(stderr, "Bad element %s of counter %s\n", idx, tok);
+                goto err;
+            }
+            snprintf(label[n], LABEL_LEN, "%s[%s]", tok, idx);
+        }
+        else
+            snprintf(label[n], LABEL_LEN, "%s", tok);
+
+        n++;
+    }
+
+    free(copy);
+    return n;
+
+ err:
+    free(copy);
+    return -1;
+}
+
+/* Sample the selected counters every interval_ms into a sample file. */
+static int record(xc_interface *xc_handle, const char *file,
+                  const char *list, unsigned int interval_ms,
+                  unsigned long count)
+{
+    DECLARE_HYPERCALL_BUFFER(xc_perfc_desc_t, pcd);
+    DECLARE_HYPERCALL_BUFFER(xc_perfc_val_t, pcv);
+    DECLARE_HYPERCALL_BUFFER(xc_perfc_sel_t, sel);
+    DECLARE_HYPERCALL_BUFFER(xc_perfc_val_t, val);
+    char (*label)[LABEL_LEN] = NULL;
+    xc_perfc_val_t *prev = NULL;
+    struct sample_hdr hdr = { .magic = SAMPLE_MAGIC,
+                              .version = SAMPLE_VERSION,
+                              .interval_ms = interval_ms };
+    struct sigaction act = { .sa_handler = stop_handler };
+    struct timespec next;
+    uint64_t now, prev_now = 0;
+    uint32_t nr_cpus = 0, i;
+    int num_desc, num_val, nr_sel, rc = 1;
+    FILE *f = NULL;
+
+    /* Counter names are only needed once, to resolve the selection. */
+    if ( xc_perfc_query_number(xc_handle, &num_desc, &num_val) != 0 )
+    {
+        fprintf(stderr, "Error getting number of perf counters: %d (%s)\n",
+                errno, strerror(errno));
+        return 1;
+    }
+
+    pcd = xc_hypercall_buffer_alloc(xc_handle, pcd, sizeof(*pcd) * num_desc);
+    pcv = xc_hypercall_buffer_alloc(xc_handle, pcv, sizeof(*pcv) * num_val);
+    sel = xc_hypercall_buffer_alloc(xc_handle, sel,
+                                    sizeof(*sel) * XEN_SYSCTL_PERFC_MAX_SEL);
+    label = calloc(XEN_SYSCTL_PERFC_MAX_SEL, sizeof(*label));
+    if ( pcd == NULL || pcv == NULL || sel == NULL || label == NULL )
+    {
+        fprintf(stderr, "Could not allocate buffers: %d (%s)\n",
+                errno, strerror(errno));
+        goto out;
+    }
+
+    if ( xc_perfc_query(xc_handle, HYPERCALL_BUFFER(pcd),
+                        HYPERCALL_BUFFER(pcv)) != 0 )
+    {
+        fprintf(stderr, "Error getting perf counter: %d (%s)\n",
+                errno, strerror(errno));
+        goto out;
+    }
+
+    if ( list )
+        nr_sel = parse_sel(list, pcd, num_desc, sel, label);
+    else
+    {
+        for ( nr_sel = 0; nr_sel < num_desc &&
+                          nr_sel < XEN_SYSCTL_PERFC_MAX_SEL; nr_sel++ )
+        {
+            sel[nr_sel].counter = nr_sel;
+            sel[nr_sel].element = XEN_SYSCTL_PERFC_ELEMENT_ALL;
+            snprintf(label[nr_sel], LABEL_LEN, "%s", pcd[nr_sel].name);
+        }
+    }
+    if ( nr_sel <= 0 )
+        goto out;
+
+    if ( xc_perfc_sample(xc_handle, HYPERCALL_BUFFER(sel), 0,
+                         HYPERCALL_BUFFER(HYPERCALL_BUFFER_NULL),
+                         &nr_cpus, NULL) != 0 )
+    {
+        fprintf(stderr, "Error sampling perf counters: %d (%s)\n",
+                errno, strerror(errno));
+        goto out;
+    }
+
+    val = xc_hypercall_buffer_alloc(xc_handle, val,
+                                    sizeof(*val) * nr_sel * nr_cpus);
+    prev = malloc(sizeof(*prev) * nr_sel * nr_cpus);
+    if ( val == NULL || prev == NULL )
+    {
+        fprintf(stderr, "Could not allocate buffers: %d (%s)\n",
+                errno, strerror(errno));
+        goto out;
+    }
+
+    f = strcmp(file, "-") ? fopen(file, "w") : stdout;
+    if ( f == NULL )
+    {
+        fprintf(stderr, "Could not open %s: %d (%s)\n",
+                file, errno, strerror(errno));
+        goto out;
+    }
+
+    sigaction(SIGINT, &act, NULL);
+    sigaction(SIGTERM, &act, NULL);
+
+    clock_gettime(CLOCK_MONOTONIC, &next);
+
+    for ( ; ; )
+    {
+        uint32_t cpus = nr_cpus;
+
+        if ( xc_perfc_sample(xc_handle, HYPERCALL_BUFFER(sel), nr_sel,
+                             HYPERCALL_BUFFER(val), &cpus, &now) != 0 )
+        {
+            fprintf(stderr, "Error sampling perf counters: %d (%s)\n",
+                    errno, strerror(errno));
+            goto out;
+        }
+
+        if ( !hdr.start )
+        {
+            hdr.nr_sel = nr_sel;
+            hdr.nr_cpus = nr_cpus;
+            hdr.start = now;
+            if ( fwrite(&hdr, sizeof(hdr), 1, f) != 1 ||
+                 fwrite(label, LABEL_LEN, nr_sel, f) != (size_t)nr_sel )
+                goto write_err;
+        }
+        else
+        {
+            put_varint(f, now - prev_now);
+            for ( i = 0; i < nr_sel * nr_cpus; i++ )
+                put_varint(f, (int32_t)(val[i] - prev[i]));
+            if ( fflush(f) )
+                goto write_err;
+            if ( count && !--count )
+                break;
+        }
+
+        memcpy(prev, val, sizeof(*prev) * nr_sel * nr_cpus);
+        prev_now = now;
+
+        next.tv_nsec += (interval_ms % 1000) * 1000000L;
+        next.tv_sec += interval_ms / 1000 + next.tv_nsec / 1000000000L;
+        next.tv_nsec %= 1000000000L;
+        while ( !stop_sampling &&
+                clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME,
+                                &next, NULL) == EINTR )
+            ;
+        if ( stop_sampling )
+            break;
+    }
+
+    rc = 0;
+    goto out;
+
+ write_err:
+    fprintf(stderr, "Error writing %s: %d (%s)\n",
+            file, errno, strerror(errno));
+ out:
+    if ( f && f != stdout )
+        fclose(f);
+    free(prev);
+    free(label);
+    xc_hypercall_buffer_free(xc_handle, val);
+    xc_hypercall_buffer_free(xc_handle, sel);
+    xc_hypercall_buffer_free(xc_handle, pcd);
+    xc_hypercall_buffer_free(xc_handle, pcv);
+    return rc;
+}
+
+static void print_rates(double t, const char (*label)[LABEL_LEN],
+                        const int64_t *acc, uint64_t ns,
+                        const struct sample_hdr *hdr, unsigned int per_cpu)
+{
+    uint32_t s, c;
+
+    printf("%10.1f", t);
+    for ( s = 0; s < hdr->nr_sel; s++ )
+    {
+        int64_t sum = 0;
+
+        for ( c = 0; c < hdr->nr_cpus; c++ )
+            sum += acc[s * hdr->nr_cpus + c];
+        printf(" %*.0f", (int)strlen(label[s]) > 12 ? (int)strlen(label[s]) : 12,
+               sum * 1E+09 / ns);
+    }
+    printf("\n");
+
+    for ( c = 0; per_cpu && c < hdr->nr_cpus; c++ )
+    {
+        char cpu[16];
+
+        for ( s = 0; s < hdr->nr_sel; s++ )
+            if ( acc[s * hdr->nr_cpus + c] )
+                break;
+        if ( s == hdr->nr_sel )
+            continue;
+
+        snprintf(cpu, sizeof(cpu), "cpu%u", c);
+        printf("%10s", cpu);
+        for ( s = 0; s < hdr->nr_sel; s++ )
+            printf(" %*.0f",
+                   (int)strlen(label[s]) > 12 ? (int)strlen(label[s]) : 12,
+                   acc[s * hdr->nr_cpus + c] * 1E+09 / ns);
+        printf("\n");
+    }
+}
+
+/* Print the per second rates of the counters in a sample file. */
+static int replay(const char *file, unsigned int per_cpu)
+{
+    struct sample_hdr hdr;
+    char (*label)[LABEL_LEN] = NULL;
+    int64_t *acc = NULL, v;
+    uint64_t ns = 0, elapsed = 0;
+    uint32_t i, nr;
+    int rc = 1;
+    FILE *f;
+
+    f = strcmp(file, "-") ? fopen(file, "r") : stdin;
+    if ( f == NULL )
+    {
+        fprintf(stderr, "Could not open %s: %d (%s)\n",
+                file, errno, strerror(errno));
+        return 1;
+    }
+
+    if ( fread(&hdr, sizeof(hdr), 1, f) != 1 ||
+         memcmp(hdr.magic, SAMPLE_MAGIC, sizeof(hdr.magic)) ||
+         hdr.version != SAMPLE_VERSION ||
+         hdr.nr_sel > XEN_SYSCTL_PERFC_MAX_SEL || !hdr.nr_cpus ||
+         hdr.nr_cpus > 65536 )
+    {
+        fprintf(stderr, "%s is not a xenperf sample file\n", file);
+        goto out;
+    }
+
+    nr = hdr.nr_sel * hdr.nr_cpus;
+    label = calloc(hdr.nr_sel, sizeof(*label));
+    acc = calloc(nr, sizeof(*acc));
+    if ( label == NULL || acc == NULL ||
+         fread(label, LABEL_LEN, hdr.nr_sel, f) != hdr.nr_sel )
+    {
+        fprintf(stderr, "Error reading %s\n", file);
+        goto out;
+    }
+
+    printf("%10s", "time");
+    for ( i = 0; i < hdr.nr_sel; i++ )
+    {
+        label[i][LABEL_LEN - 1] = '\0';
+        printf(" %12s", label[i]);
+    }
+    printf("\n");
+
+    while ( get_varint(f, &v) == 0 )
+    {
+        for ( i = 0; i < nr; i++ )
+        {
+            int64_t d;
+
+            if ( get_varint(f, &d) )
+                break;
+            acc[i] += d;
+        }
+        if ( i < nr )
+        {
+            fprintf(stderr, "%s is truncated\n", file);
+            break;
+        }
+
+        ns += v;
+        elapsed += v;
+        if ( ns >= 1000000000ULL )
+        {
+            print_rates(elapsed / 1E+09, label, acc, ns, &hdr, per_cpu);
+            memset(acc, 0, sizeof(*acc) * nr);
+            ns = 0;
+        }
+    }
+
+    if ( ns )
+        print_rates(elapsed / 1E+09, label, acc, ns, &hdr, per_cpu);
+
+    rc = 0;
+
+ out:
+    free(acc);
+    free(label);
+    if ( f != stdin )
+        fclose(f);
+    return rc;
+}
+
 int main(int argc, char *argv[])
 {
     int              i, j;
@@ -87,40 +511,69 @@ int main(int argc, char *argv[])
     xc_perfc_val_t  *val;
     int num_desc, num_val;
     unsigned int     reset = 0, full = 0, pretty = 0;
+    unsigned int     interval_ms = 1000;
+    unsigned long    count = 0;
+    const char      *out = NULL, *in = NULL, *list = NULL;
     char hypercall_name[36];
+    int opt;
 
-    if ( argc > 1 )
+    while ( (opt = getopt(argc, argv, "fpro:i:n:c:R:")) != -1 )
     {
-        char *p = argv[1];
-        if ( p[0] == '-' )
+        switch ( opt )
         {
-            switch ( p[1] )
-            {
-            case 'f':
-                full = 1;
-                break;
-            case 'p':
-                full = 1;
-                pretty = 1;
-                break;
-            case 'r':
-                reset = 1;
-                break;
-            default:
-                goto error;
-            }
+        case 'f':
+            full = 1;
+            break;
+        case 'p':
+            full = 1;
+            pretty = 1;
+            break;
+        case 'r':
+            reset = 1;
+            break;
+        case 'o':
+            out = optarg;
+            break;
+        case 'i':
+            interval_ms = strtoul(optarg, NULL, 0);
+            break;
+        case 'n':
+            count = strtoul(optarg, NULL, 0);
+            break;
+        case 'c':
+            list = optarg;
+            break;
+        case 'R':
+            in = optarg;
+            break;
+        default:
+            goto error;
         }
-        else
-        {
-        error:
-            printf("%s: [-r]\n", argv[0]);
-            printf("no args: print digested counters\n");
-            printf("    -f : print full arrays/histograms\n");
-            printf("    -p : print full arrays/histograms in pretty format\n");
-            printf("    -r : reset counters\n");
-            return 0;
-        }
-    }   
+    }
+
+    if ( optind != argc || !interval_ms || (out && in) )
+    {
+    error:
+        printf("%s: [-f|-p|-r]\n", argv[0]);
+        printf("       %s -o file [-i ms] [-n count] [-c counter,...]\n",
+               argv[0]);
+        printf("       %s -R file [-f]\n", argv[0]);
+        printf("no args: print digested counters\n");
+        printf("    -f : print full arrays/histograms\n");
+        printf("    -p : print full arrays/histograms in pretty format\n");
+        printf("    -r : reset counters\n");
+        printf("    -o : sample counters per CPU into file until interrupted\n");
+        printf("    -i : sampling interval in ms (default 1000)\n");
+        printf("    -n : stop after count intervals\n");
+        printf("    -c : counters to sample, as name or name[element]\n");
+        printf("         (default all counters)\n");
+        printf("    -R : print per second rates from a sample file,\n");
+        printf("         with -f also per CPU\n");
+        return 0;
+    }
+
+    if ( in )
+        return replay(in, full);
 
     if ( (xc_handle = xc_interface_open(0,0,0)) == 0 )
     {
@@ -129,6 +582,9 @@ int main(int argc, char *argv[])
         return 1;
     }
     
+    if ( out )
+        return record(xc_handle, out, list, interval_ms, count);
+
     if ( reset )
     {
         if ( xc_perfc_reset(xc_handle) != 0 )
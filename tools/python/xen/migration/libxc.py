@@ -58,6 +58,12 @@ REC_TYPE_checkpoint_dirty_pfn_list  = 0x0000000f
 REC_TYPE_static_data_end            = 0x00000010
 REC_TYPE_x86_cpuid_policy           = 0x00000011
 REC_TYPE_x86_msr_policy             = 0x00000012
+REC_TYPE_stripe_start               = 0x00000013
+REC_TYPE_stripe_end                 = 0x00000014
+REC_TYPE_postcopy_pfns              = 0x00000015
+REC_TYPE_postcopy_begin             = 0x00000016
+REC_TYPE_postcopy_transition        = 0x00000017
+REC_TYPE_postcopy_fault             = 0x00000018
 
 rec_type_to_str = {
     REC_TYPE_end                        : "End",
@@ -79,6 +85,12 @@ rec_type_to_str = {
     REC_TYPE_static_data_end            : "Static data end",
     REC_TYPE_x86_cpuid_policy           : "x86 CPUID policy",
     REC_TYPE_x86_msr_policy             : "x86 MSR policy",
+    REC_TYPE_stripe_start               : "Stripe start",
+    REC_TYPE_stripe_end                 : "Stripe end",
+    REC_TYPE_postcopy_pfns              : "Postcopy pfns",
+    REC_TYPE_postcopy_begin             : "Postcopy begin",
+    REC_TYPE_postcopy_transition        : "Postcopy transition",
+    REC_TYPE_postcopy_fault             : "Postcopy fault",
 }
 
 # page_data
@@ -122,6 +134,12 @@ X86_CPUID_POLICY_FORMAT   = "IIIIII"
 # x86_msr_policy => xen_msr_entry_t[]
 X86_MSR_POLICY_FORMAT     = "QII"
 
+# stripe_{start,end}
+STRIPE_FORMAT             = "II"
+
+# postcopy_{pfns,fault}
+POSTCOPY_PFNS_FORMAT      = "II"
+
 class VerifyLibxc(VerifyBase):
     """ Verify a Libxc v2 (or later) stream """
 
@@ -476,6 +494,72 @@ class VerifyLibxc(VerifyBase):
                               (contentsz, sz))
 
 
+    def verify_record_stripe_start(self, content):
+        """ stripe start record """
+
+        sz = calcsize(STRIPE_FORMAT)
+
+        if len(content) != sz:
+            raise RecordError("Length should be %u bytes" % (sz, ))
+
+        window, count = unpack(STRIPE_FORMAT, content)
+
+        if count == 0:
+            raise RecordError("Stripe start with no auxiliary streams")
+
+        self.info("  Window %u, across %u auxiliary streams" %
+                  (window, count))
+
+
+    def verify_record_stripe_end(self, _):
+        """ stripe end record """
+        raise RecordError("Found stripe end record in main stream")
+
+
+    def verify_record_postcopy_pfns(self, content):
+        """ postcopy pfns record """
+
+        sz = calcsize(POSTCOPY_PFNS_FORMAT)
+
+        if len(content) < sz:
+            raise RecordError("Length should be at least %u bytes" % (sz, ))
+
+        count, res1 = unpack(POSTCOPY_PFNS_FORMAT, content[:sz])
+
+        if res1 != 0:
+            raise StreamError(
+                "Reserved bits set in POSTCOPY_PFNS record 0x%04x" % (res1, ))
+
+        if count == 0:
+            raise RecordError("Postcopy pfns record with no pfns")
+
+        if len(content) != sz + count * 8:
+            raise RecordError("Length expected to be %u, not %u" %
+                              (sz + count * 8, len(content)))
+
+        self.info("  %u pfns left for post-copy" % (count, ))
+
+
+    def verify_record_postcopy_begin(self, content):
+        """ postcopy begin record """
+
+        if len(content) != 0:
+            raise RecordError("Postcopy begin record with non-zero length")
+
+
+    def verify_record_postcopy_transition(self, content):
+        """ postcopy transition record """
+
+        if len(content) != 0:
+            raise RecordError("Postcopy transition record with non-zero"
+                              " length")
+
+
+    def verify_record_postcopy_fault(self, _):
+        """ postcopy fault record """
+        raise RecordError("Found postcopy fault record in stream")
+
+
 record_verifiers = {
     REC_TYPE_end:
         VerifyLibxc.verify_record_end,
@@ -525,4 +609,18 @@ record_verifiers = {
         VerifyLibxc.verify_record_x86_cpuid_policy,
     REC_TYPE_x86_msr_policy:
         VerifyLibxc.verify_record_x86_msr_policy,
+
+    REC_TYPE_stripe_start:
+        VerifyLibxc.verify_record_stripe_start,
+    REC_TYPE_stripe_end:
+        VerifyLibxc.verify_record_stripe_end,
+
+    REC_TYPE_postcopy_pfns:
+        VerifyLibxc.verify_record_postcopy_pfns,
+    REC_TYPE_postcopy_begin:
+        VerifyLibxc.verify_record_postcopy_begin,
+    REC_TYPE_postcopy_transition:
+        VerifyLibxc.verify_record_postcopy_transition,
+    REC_TYPE_postcopy_fault:
+        VerifyLibxc.verify_record_postcopy_fault,
     }
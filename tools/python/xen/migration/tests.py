@@ -27,6 +27,8 @@ class TestLibxc(unittest.TestCase):
                          (libxc.HVM_PARAMS_FORMAT, 8),
                          (libxc.X86_CPUID_POLICY_FORMAT, 24),
                          (libxc.X86_MSR_POLICY_FORMAT, 16),
+                         (libxc.STRIPE_FORMAT, 8),
+                         (libxc.POSTCOPY_PFNS_FORMAT, 8),
                          ):
             self.assertEqual(calcsize(fmt), sz)
 
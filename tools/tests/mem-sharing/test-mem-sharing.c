@@ -0,0 +1,173 @@
+#include <err.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include <xenctrl.h>
+#include <xenforeignmemory.h>
+#include <xen-tools/common-macros.h>
+
+static unsigned int nr_failures;
+#define fail(fmt, ...)                          \
+({                                              \
+    nr_failures++;                              \
+    (void)printf(fmt, ##__VA_ARGS__);           \
+})
+
+static xc_interface *xch;
+static xenforeignmemory_handle *fh;
+static uint32_t source, client;
+
+static struct xen_domctl_createdomain create = {
+    .flags = XEN_DOMCTL_CDF_hvm | XEN_DOMCTL_CDF_hap,
+    .max_vcpus = 1,
+    .max_grant_frames = 1,
+    .grant_opts = XEN_DOMCTL_GRANT_version(1),
+
+    .arch = {
+        .emulation_flags = XEN_X86_EMU_LAPIC,
+    },
+};
+
+#define NR_GFNS 2
+
+/* Give the domain NR_GFNS pages, filled with the given bytes. */
+static int populate(uint32_t domid, const uint8_t *fill)
+{
+    xen_pfn_t physmap[NR_GFNS];
+    int errs[NR_GFNS];
+    uint8_t *p;
+    unsigned int i;
+
+    for ( i = 0; i < NR_GFNS; i++ )
+        physmap[i] = i;
+
+    if ( xc_domain_setmaxmem(xch, domid, -1) ||
+         xc_domain_populate_physmap_exact(xch, domid, NR_GFNS, 0, 0,
+                                          physmap) )
+        return -1;
+
+    p = xenforeignmemory_map(fh, domid, PROT_READ | PROT_WRITE, NR_GFNS,
+                             physmap, errs);
+    if ( !p )
+        return -1;
+
+    for ( i = 0; i < NR_GFNS; i++ )
+        memset(p + i * XC_PAGE_SIZE, fill[i], XC_PAGE_SIZE);
+
+    return xenforeignmemory_unmap(fh, p, NR_GFNS);
+}
+
+static void check_shr_pages(uint32_t domid, uint64_t expected)
+{
+    xc_domaininfo_t info;
+
+    if ( xc_domain_getinfo_single(xch, domid, &info) )
+        return fail("  Fail: getinfo d%u: %d - %s\n",
+                    domid, errno, strerror(errno));
+
+    if ( info.shr_pages != expected )
+        fail("  Fail: d%u has %"PRIu64" shared pages, expected %"PRIu64"\n",
+             domid, (uint64_t)info.shr_pages, expected);
+}
+
+static void run_tests(void)
+{
+    static const uint8_t source_fill[NR_GFNS] = { 0xaa, 0xaa };
+    static const uint8_t client_fill[NR_GFNS] = { 0xaa, 0x55 };
+    xen_mem_sharing_batch_entry_t entries[NR_GFNS] = {
+        { .source_gfn = 0, .client_gfn = 0 },
+        { .source_gfn = 1, .client_gfn = 1 },
+    };
+    int rc;
+
+    if ( xc_memshr_control(xch, source, 1) ||
+         xc_memshr_control(xch, client, 1) )
+    {
+        if ( errno == EOPNOTSUPP || errno == ENODEV || errno == EXDEV )
+            printf("  Skip: %d - %s\n", errno, strerror(errno));
+        else
+            fail("  Fail: enable sharing: %d - %s\n", errno, strerror(errno));
+        return;
+    }
+
+    if ( populate(source, source_fill) || populate(client, client_fill) )
+        return fail("  Fail: populate: %d - %s\n", errno, strerror(errno));
+
+    printf("Test a batch with matching and mismatched pages\n");
+
+    rc = xc_memshr_share_batch(xch, source, client, entries, NR_GFNS);
+    if ( rc )
+        return fail("  Fail: share batch: %d - %s\n", errno, strerror(errno));
+
+    if ( entries[0].rc )
+        fail("  Fail: matching pages: rc %d, expected 0\n", entries[0].rc);
+    if ( entries[1].rc != -EAGAIN )
+        fail("  Fail: mismatched pages: rc %d, expected %d\n",
+             entries[1].rc, -EAGAIN);
+
+    /* The mismatched pages must not be left nominated. */
+    check_shr_pages(source, 1);
+    check_shr_pages(client, 1);
+}
+
+int main(int argc, char **argv)
+{
+    int rc;
+
+    printf("Memory sharing tests\n");
+
+    xch = xc_interface_open(NULL, NULL, 0);
+    if ( !xch )
+        err(1, "xc_interface_open");
+
+    fh = xenforeignmemory_open(NULL, 0);
+    if ( !fh )
+        err(1, "xenforeignmemory_open");
+
+    rc = xc_domain_create(xch, &source, &create);
+    if ( rc )
+    {
+        if ( errno == EINVAL || errno == EOPNOTSUPP )
+            printf("  Skip: %d - %s\n", errno, strerror(errno));
+        else
+            fail("  Domain create failure: %d - %s\n",
+                 errno, strerror(errno));
+        goto out;
+    }
+
+    rc = xc_domain_create(xch, &client, &create);
+    if ( rc )
+    {
+        fail("  Domain create failure: %d - %s\n", errno, strerror(errno));
+        goto destroy_source;
+    }
+
+    printf("  Created d%u and d%u\n", source, client);
+
+    run_tests();
+
+    rc = xc_domain_destroy(xch, client);
+    if ( rc )
+        fail("  Failed to destroy domain: %d - %s\n",
+             errno, strerror(errno));
+ destroy_source:
+    rc = xc_domain_destroy(xch, source);
+    if ( rc )
+        fail("  Failed to destroy domain: %d - %s\n",
+             errno, strerror(errno));
+ out:
+    return !!nr_failures;
+}
+
+/*
+ * Local variables:
+ * mode: C
+ * c-file-style: "BSD"
+ * c-basic-offset: 4
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
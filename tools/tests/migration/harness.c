@@ -0,0 +1,114 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * Stubs shared by the migration unit tests.
+ */
+
+#include <stdarg.h>
+#include <sys/uio.h>
+
+#include "harness.h"
+
+unsigned int failures;
+char last_error[256];
+
+/* The parts of libxenctrl used by the stream code. */
+int read_exact(int fd, void *data, size_t size)
+{
+    size_t offset = 0;
+    ssize_t len;
+
+    while ( offset < size )
+    {
+        len = read(fd, (char *)data + offset, size - offset);
+        if ( len == -1 && errno == EINTR )
+            continue;
+        if ( len == 0 )
+            errno = 0;
+        if ( len <= 0 )
+            return -1;
+        offset += len;
+    }
+
+    return 0;
+}
+
+int writev_exact(int fd, const struct iovec *iov, int iovcnt)
+{
+    struct iovec local[iovcnt];
+    struct iovec *v = local;
+    ssize_t len;
+
+    memcpy(local, iov, sizeof(local));
+
+    while ( iovcnt )
+    {
+        if ( !v->iov_len )
+        {
+            v++;
+            iovcnt--;
+            continue;
+        }
+
+        len = writev(fd, v, iovcnt);
+        if ( len == -1 && errno == EINTR )
+            continue;
+        if ( len <= 0 )
+            return -1;
+
+        while ( len && len >= v->iov_len )
+        {
+            len -= v->iov_len;
+            v++;
+            iovcnt--;
+        }
+        if ( len )
+        {
+            v->iov_base = (char *)v->iov_base + len;
+            v->iov_len -= len;
+        }
+    }
+
+    return 0;
+}
+
+const char *xc_strerror(xc_interface *xch, int errcode)
+{
+    return strerror(errcode);
+}
+
+void xc_report_error(xc_interface *xch, int code, const char *fmt, ...)
+{
+    va_list args;
+
+    va_start(args, fmt);
+    vsnprintf(last_error, sizeof(last_error), fmt, args);
+    va_end(args);
+}
+
+void xc_report(xc_interface *xch, xentoollog_logger *lg,
+               xentoollog_level level, int code, const char *fmt, ...)
+{
+}
+
+const char *xc_set_progress_prefix(xc_interface *xch, const char *doing)
+{
+    return NULL;
+}
+
+void xc_report_progress_single(xc_interface *xch, const char *doing)
+{
+}
+
+void xc_report_progress_step(xc_interface *xch,
+                             unsigned long done, unsigned long total)
+{
+}
+
+/*
+ * Local variables:
+ * mode: C
+ * c-file-style: "BSD"
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
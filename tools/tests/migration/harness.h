@@ -0,0 +1,32 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * Unit tests for live migration.
+ *
+ * The stream code is built from the libxenguest sources, against the stubs
+ * in harness.c for the parts of libxenctrl it uses.  Errors reported by it
+ * are kept in last_error, for the tests to check or print.
+ */
+
+#ifndef _TEST_HARNESS_
+#define _TEST_HARNESS_
+
+#include "xg_sr_common.h"
+
+extern unsigned int failures;
+extern char last_error[256];
+
+#define fail(fmt, ...) ({                                       \
+    printf("FAIL: " fmt "\n", ##__VA_ARGS__);                   \
+    failures++;                                                 \
+})
+
+#endif
+
+/*
+ * Local variables:
+ * mode: C
+ * c-file-style: "BSD"
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
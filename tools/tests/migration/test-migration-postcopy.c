@@ -0,0 +1,667 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * Unit tests for the post-copy phase of live migration.
+ *
+ * A saver thread leaves a quarter of the guest's pages for the post-copy
+ * phase, and sends them to a restorer over a Unix socket.  The restorer pages
+ * them out of a simulated guest, whose vcpus are threads which touch pages at
+ * random once the guest has resumed, faulting on those not yet received, as
+ * the paging ring would report them.  Checks that every page arrives intact,
+ * that the vcpus are only let go once their page has, and reports how long
+ * faulting accesses took.
+ */
+
+#include <err.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include <xenevtchn.h>
+#include <xen/vm_event.h>
+
+#include "harness.h"
+
+#define NR_PFNS (4 * 1024) /* 16MB of guest memory. */
+#define NR_VCPUS 2
+#define NR_ACCESSES 256 /* Per vcpu. */
+
+#define RING_PFN 0xfeff0
+#define RING_PORT 7
+
+/* Sent with the guest's state, and by the postcopy_transition() callbacks. */
+#define REC_TYPE_TEST_STATE (REC_TYPE_OPTIONAL | 0x100)
+#define REC_TYPE_TEST_TOOLSTACK (REC_TYPE_OPTIONAL | 0x101)
+
+static char restore_error[256];
+
+static uint8_t *src_mem, *dst_mem;
+static unsigned long *dirty;
+
+/*
+ * The simulated guest, under guest_lock: which of its pages are paged out,
+ * and its vcpus, paused while their page is.
+ */
+static pthread_mutex_t guest_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t guest_cond = PTHREAD_COND_INITIALIZER;
+static bool paged[NR_PFNS], paging;
+static bool vcpu_paused[NR_VCPUS];
+static void *ring_page;
+static vm_event_front_ring_t front_ring;
+static int evtchn_pipe[2];
+static unsigned int nr_faults;
+static uint64_t fault_ns, max_fault_ns;
+
+/* Pages left for the post-copy phase, which the restorer can't page out. */
+static bool busy_pfn(unsigned int pfn)
+{
+    return pfn % 97 == 3;
+}
+
+static uint64_t wall_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+int xc_hvm_param_get(xc_interface *handle, uint32_t dom, uint32_t param,
+                     uint64_t *value)
+{
+    *value = param == HVM_PARAM_PAGING_RING_PFN ? RING_PFN : 0;
+
+    return 0;
+}
+
+void *xc_vm_event_enable(xc_interface *xch, uint32_t domain_id, int param,
+                         uint32_t *port)
+{
+    pthread_mutex_lock(&guest_lock);
+    ring_page = calloc(1, XC_PAGE_SIZE);
+    paging = ring_page;
+    pthread_mutex_unlock(&guest_lock);
+
+    *port = RING_PORT;
+
+    return ring_page;
+}
+
+int xenforeignmemory_unmap(xenforeignmemory_handle *fmem,
+                           void *addr, size_t pages)
+{
+    pthread_mutex_lock(&guest_lock);
+    if ( addr != ring_page )
+        fail("unmapped %p rather than the ring", addr);
+    free(ring_page);
+    ring_page = NULL;
+    pthread_mutex_unlock(&guest_lock);
+
+    return 0;
+}
+
+int xc_mem_paging_disable(xc_interface *xch, uint32_t domain_id)
+{
+    unsigned int i;
+
+    pthread_mutex_lock(&guest_lock);
+    for ( i = 0; i < NR_VCPUS; i++ )
+        if ( vcpu_paused[i] )
+            fail("paging disabled with vcpu%u paused", i);
+    paging = false;
+    pthread_mutex_unlock(&guest_lock);
+
+    return 0;
+}
+
+int xc_mem_paging_nominate(xc_interface *xch, uint32_t domain_id,
+                           uint64_t gfn)
+{
+    if ( busy_pfn(gfn) )
+    {
+        errno = EBUSY;
+        return -1;
+    }
+
+    return 0;
+}
+
+int xc_mem_paging_evict(xc_interface *xch, uint32_t domain_id, uint64_t gfn)
+{
+    pthread_mutex_lock(&guest_lock);
+    paged[gfn] = true;
+    memset(&dst_mem[gfn * PAGE_SIZE], 0xee, PAGE_SIZE);
+    pthread_mutex_unlock(&guest_lock);
+
+    return 0;
+}
+
+int xc_mem_paging_load(xc_interface *xch, uint32_t domain_id,
+                       uint64_t gfn, void *buffer)
+{
+    pthread_mutex_lock(&guest_lock);
+    if ( !paged[gfn] )
+        fail("pfn %#"PRIx64" loaded, but not paged out", gfn);
+    memcpy(&dst_mem[gfn * PAGE_SIZE], buffer, PAGE_SIZE);
+    paged[gfn] = false;
+    pthread_mutex_unlock(&guest_lock);
+
+    return 0;
+}
+
+int xc_domain_pause(xc_interface *xch, uint32_t domid)
+{
+    return 0;
+}
+
+int xc_domain_unpause(xc_interface *xch, uint32_t domid)
+{
+    return 0;
+}
+
+xenevtchn_handle *xenevtchn_open(struct xentoollog_logger *logger,
+                                 unsigned int flags)
+{
+    if ( pipe(evtchn_pipe) )
+        return NULL;
+
+    return (xenevtchn_handle *)evtchn_pipe;
+}
+
+int xenevtchn_close(xenevtchn_handle *xce)
+{
+    close(evtchn_pipe[0]);
+    close(evtchn_pipe[1]);
+
+    return 0;
+}
+
+xenevtchn_port_or_error_t
+xenevtchn_bind_interdomain(xenevtchn_handle *xce, uint32_t domid,
+                           evtchn_port_t remote_port)
+{
+    if ( remote_port != RING_PORT )
+        fail("bound port %u rather than the ring's", remote_port);
+
+    return RING_PORT;
+}
+
+int xenevtchn_unbind(xenevtchn_handle *xce, evtchn_port_t port)
+{
+    return 0;
+}
+
+int xenevtchn_fd(xenevtchn_handle *xce)
+{
+    return evtchn_pipe[0];
+}
+
+xenevtchn_port_or_error_t xenevtchn_pending(xenevtchn_handle *xce)
+{
+    char c;
+
+    return read_exact(evtchn_pipe[0], &c, 1) ? -1 : RING_PORT;
+}
+
+int xenevtchn_unmask(xenevtchn_handle *xce, evtchn_port_t port)
+{
+    return 0;
+}
+
+/* Consume the responses on the ring, as Xen would, and unpause the vcpus. */
+int xenevtchn_notify(xenevtchn_handle *xce, evtchn_port_t port)
+{
+    vm_event_response_t *rsp;
+
+    pthread_mutex_lock(&guest_lock);
+    while ( RING_HAS_UNCONSUMED_RESPONSES(&front_ring) )
+    {
+        rsp = RING_GET_RESPONSE(&front_ring, front_ring.rsp_cons++);
+        if ( rsp->version != VM_EVENT_INTERFACE_VERSION ||
+             rsp->vcpu_id >= NR_VCPUS ||
+             !(rsp->flags & VM_EVENT_FLAG_VCPU_PAUSED) )
+        {
+            fail("unexpected response for vcpu%u, flags %#x",
+                 rsp->vcpu_id, rsp->flags);
+            continue;
+        }
+
+        if ( paged[rsp->u.mem_paging.gfn] )
+            fail("vcpu%u let go with pfn %#"PRIx64" paged out",
+                 rsp->vcpu_id, rsp->u.mem_paging.gfn);
+        vcpu_paused[rsp->vcpu_id] = false;
+    }
+    pthread_cond_broadcast(&guest_cond);
+    pthread_mutex_unlock(&guest_lock);
+
+    return 0;
+}
+
+/* Touch pages at random, waiting for those paged out, as a vcpu would. */
+static void *vcpu_thread(void *arg)
+{
+    unsigned int vcpu = (uintptr_t)arg, seed = vcpu, i, pfn;
+    vm_event_request_t *req;
+    uint64_t ns;
+    char c = 0;
+
+    for ( i = 0; i < NR_ACCESSES; i++ )
+    {
+        pfn = rand_r(&seed) % NR_PFNS;
+
+        pthread_mutex_lock(&guest_lock);
+        if ( paged[pfn] )
+        {
+            if ( !paging )
+                fail("vcpu%u touched pfn %#x paged out, without paging",
+                     vcpu, pfn);
+
+            req = RING_GET_REQUEST(&front_ring, front_ring.req_prod_pvt++);
+            memset(req, 0, sizeof(*req));
+            req->version = VM_EVENT_INTERFACE_VERSION;
+            req->reason = VM_EVENT_REASON_MEM_PAGING;
+            req->flags = VM_EVENT_FLAG_VCPU_PAUSED;
+            req->vcpu_id = vcpu;
+            req->u.mem_paging.gfn = pfn;
+            RING_PUSH_REQUESTS(&front_ring);
+            vcpu_paused[vcpu] = true;
+            nr_faults++;
+
+            if ( write(evtchn_pipe[1], &c, 1) != 1 )
+                fail("vcpu%u failed to notify", vcpu);
+
+            ns = wall_ns();
+            while ( vcpu_paused[vcpu] )
+                pthread_cond_wait(&guest_cond, &guest_lock);
+            ns = wall_ns() - ns;
+
+            fault_ns += ns;
+            if ( ns > max_fault_ns )
+                max_fault_ns = ns;
+        }
+
+        if ( memcmp(&dst_mem[pfn * PAGE_SIZE], &src_mem[pfn * PAGE_SIZE],
+                    PAGE_SIZE) )
+            fail("vcpu%u found pfn %#x corrupt", vcpu, pfn);
+        pthread_mutex_unlock(&guest_lock);
+
+        usleep(50);
+    }
+
+    return NULL;
+}
+
+/* The saver's batches are a PAGE_DATA record each. */
+int send_pages(struct xc_sr_context *ctx, const xen_pfn_t *pfns,
+               unsigned int nr)
+{
+    struct xc_sr_rhdr rhdr = {
+        .type = REC_TYPE_PAGE_DATA,
+        .length = sizeof(struct xc_sr_rec_page_data_header) +
+                  nr * (sizeof(uint64_t) + PAGE_SIZE),
+    };
+    struct xc_sr_rec_page_data_header hdr = { .count = nr };
+    uint64_t pfn[MAX_BATCH_SIZE];
+    struct iovec iov[3 + MAX_BATCH_SIZE] = {
+        { .iov_base = &rhdr, .iov_len = sizeof(rhdr) },
+        { .iov_base = &hdr, .iov_len = sizeof(hdr) },
+        { .iov_base = pfn, .iov_len = nr * sizeof(*pfn) },
+    };
+    unsigned int i;
+
+    if ( nr > MAX_BATCH_SIZE )
+        return -1;
+
+    for ( i = 0; i < nr; i++ )
+    {
+        pfn[i] = pfns[i];
+        iov[3 + i].iov_base = &src_mem[pfns[i] * PAGE_SIZE];
+        iov[3 + i].iov_len = PAGE_SIZE;
+    }
+
+    return writev_exact(ctx->fd, iov, 3 + nr);
+}
+
+/* The guest's memory is all populated already. */
+int populate_pfns(struct xc_sr_context *ctx, unsigned int count,
+                  const xen_pfn_t *original_pfns, const uint32_t *types)
+{
+    return 0;
+}
+
+/* The first few pages left behind are needed before the guest runs. */
+static int eager_pfns(struct xc_sr_context *ctx, xen_pfn_t *pfns,
+                      unsigned int max)
+{
+    unsigned int nr = 0, pfn;
+
+    for ( pfn = 0; pfn < NR_PFNS && nr < 4 && nr < max; pfn++ )
+        if ( test_bit(pfn, dirty) )
+            pfns[nr++] = pfn;
+
+    return nr;
+}
+
+static int save_transition(void *data)
+{
+    struct xc_sr_context *ctx = data;
+    struct xc_sr_record rec = { .type = REC_TYPE_TEST_TOOLSTACK };
+
+    return write_record(ctx, &rec);
+}
+
+static struct save_callbacks save_callbacks = {
+    .postcopy_transition = save_transition,
+};
+
+struct saver {
+    struct xc_sr_context ctx;
+    int rc;
+};
+
+static int save(struct xc_sr_context *ctx)
+{
+    struct xc_sr_record rec = { .type = REC_TYPE_TEST_STATE };
+
+    if ( postcopy_save_init(ctx) || postcopy_begin(ctx, dirty) ||
+         write_record(ctx, &rec) || postcopy_send(ctx) )
+        return -1;
+
+    rec.type = REC_TYPE_END;
+
+    return write_record(ctx, &rec) ?: postcopy_finish(ctx);
+}
+
+static void *saver_thread(void *arg)
+{
+    struct saver *s = arg;
+
+    s->rc = save(&s->ctx);
+    postcopy_cleanup(&s->ctx);
+
+    return NULL;
+}
+
+static bool pfn_is_valid(const struct xc_sr_context *ctx, xen_pfn_t pfn)
+{
+    return pfn < NR_PFNS;
+}
+
+static unsigned int nr_completed;
+
+static int stream_complete(struct xc_sr_context *ctx)
+{
+    nr_completed++;
+
+    return 0;
+}
+
+static pthread_t vcpus[NR_VCPUS];
+static bool state_restored;
+
+/* Restore the toolstack's records, check the guest and let its vcpus go. */
+static int restore_transition(void *data)
+{
+    struct xc_sr_context *ctx = data;
+    struct xc_sr_record rec;
+    unsigned int pfn, i;
+
+    if ( read_record(ctx, ctx->fd, &rec) )
+        return -1;
+    free(rec.data);
+
+    if ( rec.type != REC_TYPE_TEST_TOOLSTACK )
+    {
+        fail("record %#x rather than the toolstack's", rec.type);
+        return -1;
+    }
+
+    if ( !state_restored || nr_completed != 1 )
+        fail("guest resumed before its state was restored");
+
+    for ( pfn = 0, i = 0; pfn < NR_PFNS; pfn++ )
+    {
+        if ( !test_bit(pfn, dirty) )
+            continue;
+
+        if ( (i++ < 4 || busy_pfn(pfn)) && paged[pfn] )
+            fail("pfn %#x needed before the guest runs paged out", pfn);
+    }
+
+    FRONT_RING_INIT(&front_ring, (vm_event_sring_t *)ring_page,
+                    XC_PAGE_SIZE);
+
+    for ( i = 0; i < NR_VCPUS; i++ )
+        if ( pthread_create(&vcpus[i], NULL, vcpu_thread, (void *)(uintptr_t)i) )
+            errx(1, "pthread_create");
+
+    return 0;
+}
+
+static struct restore_callbacks restore_callbacks = {
+    .postcopy_transition = restore_transition,
+};
+
+/* The records before the POSTCOPY_TRANSITION record, as restore() would. */
+static int restore(struct xc_sr_context *ctx)
+{
+    struct xc_sr_rec_page_data_header *hdr;
+    struct xc_sr_record rec;
+    unsigned int i;
+    uint8_t *data;
+    int rc;
+
+    do {
+        if ( read_record(ctx, ctx->fd, &rec) )
+            return -1;
+
+        switch ( rec.type )
+        {
+        case REC_TYPE_PAGE_DATA:
+            hdr = rec.data;
+            data = (uint8_t *)&hdr->pfn[hdr->count];
+            for ( i = 0; i < hdr->count; i++, data += PAGE_SIZE )
+            {
+                if ( hdr->pfn[i] >= NR_PFNS || paged[hdr->pfn[i]] )
+                    fail("pfn %#"PRIx64" sent before the transition, but"
+                         " paged out", hdr->pfn[i]);
+                else
+                    memcpy(&dst_mem[hdr->pfn[i] * PAGE_SIZE], data,
+                           PAGE_SIZE);
+            }
+            rc = 0;
+            break;
+
+        case REC_TYPE_POSTCOPY_PFNS:
+            rc = handle_postcopy_pfns(ctx, &rec);
+            break;
+
+        case REC_TYPE_POSTCOPY_BEGIN:
+            rc = handle_postcopy_begin(ctx);
+            break;
+
+        case REC_TYPE_TEST_STATE:
+            state_restored = true;
+            rc = 0;
+            break;
+
+        case REC_TYPE_POSTCOPY_TRANSITION:
+            rc = 0;
+            break;
+
+        default:
+            fail("unexpected record %#x", rec.type);
+            rc = -1;
+            break;
+        }
+
+        free(rec.data);
+    } while ( !rc && rec.type != REC_TYPE_POSTCOPY_TRANSITION );
+
+    return rc ?: postcopy_restore(ctx);
+}
+
+static void test_postcopy(void)
+{
+    static struct xc_interface_core xch;
+    struct xc_sr_context ctx = {
+        .xch = &xch,
+        .restore = {
+            .guest_type = DHDR_TYPE_X86_HVM,
+            .callbacks = &restore_callbacks,
+            .ops = {
+                .pfn_is_valid = pfn_is_valid,
+                .stream_complete = stream_complete,
+            },
+        },
+    };
+    struct saver s = {
+        .ctx = {
+            .xch = &xch,
+            .dominfo.flags = XEN_DOMINF_hvm_guest,
+            .save = {
+                .live = true,
+                .p2m_size = NR_PFNS,
+                .callbacks = &save_callbacks,
+                .ops.eager_pfns = eager_pfns,
+            },
+        },
+    };
+    unsigned int pfn, nr_dirty = 0, i;
+    pthread_t thread;
+    int fds[2], rc;
+
+    printf("Testing post-copy\n");
+
+    if ( socketpair(AF_UNIX, SOCK_STREAM, 0, fds) )
+        err(1, "socketpair");
+
+    /* The back channel is the same socket, the other way. */
+    s.ctx.fd = s.ctx.save.recv_fd = fds[0];
+    ctx.fd = ctx.restore.send_back_fd = fds[1];
+    save_callbacks.data = &s.ctx;
+    restore_callbacks.data = &ctx;
+
+    /* The pages which stayed clean were sent during precopy. */
+    for ( pfn = 0; pfn < NR_PFNS; pfn++ )
+    {
+        if ( !((pfn * 2654435761U >> 8) % 4) )
+        {
+            set_bit(pfn, dirty);
+            memset(&dst_mem[pfn * PAGE_SIZE], 0xff, PAGE_SIZE);
+            nr_dirty++;
+        }
+        else
+            memcpy(&dst_mem[pfn * PAGE_SIZE], &src_mem[pfn * PAGE_SIZE],
+                   PAGE_SIZE);
+    }
+
+    if ( pthread_create(&thread, NULL, saver_thread, &s) )
+        errx(1, "pthread_create");
+
+    rc = restore(&ctx);
+    if ( rc )
+        strcpy(restore_error, last_error);
+
+    /* Unblock the saver, and any vcpu left waiting, if restoring failed. */
+    close(fds[1]);
+    pthread_mutex_lock(&guest_lock);
+    memset(vcpu_paused, 0, sizeof(vcpu_paused));
+    pthread_cond_broadcast(&guest_cond);
+    pthread_mutex_unlock(&guest_lock);
+
+    postcopy_cleanup(&ctx);
+
+    pthread_join(thread, NULL);
+    if ( state_restored )
+        for ( i = 0; i < NR_VCPUS; i++ )
+            pthread_join(vcpus[i], NULL);
+    close(fds[0]);
+
+    if ( rc )
+    {
+        fail("restoring failed: %s", restore_error);
+        return;
+    }
+    if ( s.rc )
+        fail("saving failed: %s", last_error);
+
+    if ( ring_page || paging )
+        fail("paging still enabled");
+
+    for ( pfn = 0; pfn < NR_PFNS; pfn++ )
+        if ( paged[pfn] ||
+             memcmp(&dst_mem[pfn * PAGE_SIZE], &src_mem[pfn * PAGE_SIZE],
+                    PAGE_SIZE) )
+            fail("pfn %#x not as sent", pfn);
+
+    printf("%u pages left for post-copy, %u faults", nr_dirty, nr_faults);
+    if ( nr_faults )
+        printf(", %"PRIu64" us mean, %"PRIu64" us max",
+               fault_ns / nr_faults / 1000, max_fault_ns / 1000);
+    printf("\n");
+}
+
+static void test_not_live(void)
+{
+    static struct xc_interface_core xch;
+    struct xc_sr_context ctx = {
+        .xch = &xch,
+        .dominfo.flags = XEN_DOMINF_hvm_guest,
+        .save = {
+            .p2m_size = NR_PFNS,
+            .recv_fd = 0,
+            .callbacks = &save_callbacks,
+        },
+    };
+
+    printf("Testing post-copy of a non-live save\n");
+
+    if ( !postcopy_save_init(&ctx) )
+        fail("post-copy of a non-live save accepted");
+    else if ( errno != EINVAL || !strstr(last_error, "live migration") )
+        fail("unexpected error: %d, %s", errno, last_error);
+
+    postcopy_cleanup(&ctx);
+}
+
+int main(int argc, char **argv)
+{
+    unsigned int pfn;
+
+    /* Failing streams are reported by the stream code. */
+    signal(SIGPIPE, SIG_IGN);
+
+    src_mem = malloc(NR_PFNS * PAGE_SIZE);
+    dst_mem = malloc(NR_PFNS * PAGE_SIZE);
+    dirty = bitmap_alloc(NR_PFNS);
+    if ( !src_mem || !dst_mem || !dirty )
+        err(1, "malloc");
+
+    for ( pfn = 0; pfn < NR_PFNS; pfn++ )
+    {
+        memset(&src_mem[pfn * PAGE_SIZE], pfn & 0xff, PAGE_SIZE);
+        memcpy(&src_mem[pfn * PAGE_SIZE], &pfn, sizeof(pfn));
+    }
+
+    test_postcopy();
+    test_not_live();
+
+    if ( failures )
+    {
+        printf("%u failures\n", failures);
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+/*
+ * Local variables:
+ * mode: C
+ * c-file-style: "BSD"
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,250 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * Unit tests for the precopy phase of live migration.
+ *
+ * Checks the default policy's decisions with and without tunables, the
+ * dirty rate, bandwidth and downtime measured over a simulated iteration,
+ * and the throttling of a guest through its credit2 cap, against a stubbed
+ * scheduler.
+ */
+
+#include <time.h>
+
+#include "harness.h"
+
+/* The guest's credit2 parameters, and whether it is in a credit2 cpupool. */
+static struct xen_domctl_sched_credit2 sched = { .weight = 256 };
+static bool credit2 = true;
+static unsigned int nr_sets;
+
+int xc_sched_credit2_domain_get(xc_interface *xch, uint32_t domid,
+                                struct xen_domctl_sched_credit2 *sdom)
+{
+    if ( !credit2 )
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    *sdom = sched;
+
+    return 0;
+}
+
+int xc_sched_credit2_domain_set(xc_interface *xch, uint32_t domid,
+                                struct xen_domctl_sched_credit2 *sdom)
+{
+    if ( !credit2 )
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if ( sdom->weight )
+        sched.weight = sdom->weight;
+    sched.cap = sdom->cap;
+    nr_sets++;
+
+    return 0;
+}
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void test_policy(void)
+{
+    static const struct {
+        struct xc_precopy_params params;
+        unsigned int iteration;
+        long dirty_count;
+        unsigned long bandwidth, downtime_ms;
+        int decision;
+    } tests[] = {
+        /* The defaults: fewer than 50 pages dirty, or 5 iterations. */
+        { {}, 0, -1, 0, 0, XGS_POLICY_CONTINUE_PRECOPY },
+        { {}, 1, 1000, 1000, 1000, XGS_POLICY_CONTINUE_PRECOPY },
+        { {}, 1, 49, 1000, 49, XGS_POLICY_STOP_AND_COPY },
+        { {}, 4, 1000, 1000, 1000, XGS_POLICY_CONTINUE_PRECOPY },
+        { {}, 5, 1000, 1000, 1000, XGS_POLICY_STOP_AND_COPY },
+        { { .max_iterations = 8 }, 5, 1000, 1000, 1000,
+          XGS_POLICY_CONTINUE_PRECOPY },
+        { { .max_iterations = 8 }, 8, 1000, 1000, 1000,
+          XGS_POLICY_STOP_AND_COPY },
+        /* A maximum downtime, only once a bandwidth is known. */
+        { { .max_downtime_ms = 300 }, 1, 1000, 1000, 1000,
+          XGS_POLICY_CONTINUE_PRECOPY },
+        { { .max_downtime_ms = 300 }, 1, 1000, 4000, 250,
+          XGS_POLICY_STOP_AND_COPY },
+        { { .max_downtime_ms = 300 }, 1, 1000, 0, 0,
+          XGS_POLICY_CONTINUE_PRECOPY },
+    };
+    unsigned int i;
+
+    printf("Testing the precopy policy\n");
+
+    for ( i = 0; i < ARRAY_SIZE(tests); i++ )
+    {
+        struct precopy_stats stats = {
+            .iteration = tests[i].iteration,
+            .dirty_count = tests[i].dirty_count,
+            .bandwidth = tests[i].bandwidth,
+            .downtime_ms = tests[i].downtime_ms,
+        };
+        int decision = xc_precopy_policy(stats, &tests[i].params);
+
+        if ( decision != tests[i].decision )
+            fail("  Test %u: expected decision %d, got %d",
+                 i, tests[i].decision, decision);
+    }
+
+    if ( xc_precopy_policy((struct precopy_stats){ .dirty_count = 10 },
+                           NULL) != XGS_POLICY_STOP_AND_COPY )
+        fail("  Expected the defaults without parameters");
+}
+
+/* 1000 pages sent in 500ms, 500 more dirtied in 1s, 100 deferred. */
+static void collect(struct xc_sr_context *ctx)
+{
+    ctx->save.stats.iteration++;
+    ctx->save.stats.dirty_count = 500;
+    ctx->save.nr_deferred_pages = 100;
+    ctx->save.collect_ns = now_ns() - 1000000000ULL;
+    ctx->save.send_ns = 500000000ULL;
+    ctx->save.nr_sent = 1000;
+
+    precopy_collected(ctx);
+}
+
+static void test_collected(void)
+{
+    static struct xc_interface_core xch;
+    struct xc_sr_context ctx = { .xch = &xch };
+    struct precopy_stats *stats = &ctx.save.stats;
+
+    printf("Testing precopy measurements\n");
+
+    collect(&ctx);
+
+    /* Allow for the time taken since. */
+    if ( stats->iteration_ms < 1000 || stats->iteration_ms > 1100 )
+        fail("  Expected an iteration of 1000ms, got %lu", stats->iteration_ms);
+    if ( stats->dirty_rate < 450 || stats->dirty_rate > 500 )
+        fail("  Expected 500 pages/s dirtied, got %lu", stats->dirty_rate);
+    if ( stats->bandwidth != 2000 )
+        fail("  Expected 2000 pages/s sent, got %lu", stats->bandwidth);
+    if ( stats->downtime_ms != 300 )
+        fail("  Expected 300ms of downtime, got %lu", stats->downtime_ms);
+    if ( ctx.save.nr_sent )
+        fail("  Expected the pages sent to be reset");
+
+    /* Nothing sent: the last bandwidth stands. */
+    ctx.save.collect_ns = now_ns();
+    stats->dirty_count = 1000;
+    precopy_collected(&ctx);
+
+    if ( stats->bandwidth != 2000 || stats->downtime_ms != 550 )
+        fail("  Expected 2000 pages/s and 550ms of downtime, got %lu and %lu",
+             stats->bandwidth, stats->downtime_ms);
+}
+
+static void test_throttle(void)
+{
+    static struct xc_interface_core xch;
+    struct xc_sr_context ctx = {
+        .xch = &xch,
+        .dominfo.max_vcpu_id = 1,
+        .save.precopy.max_throttle = 35,
+    };
+    struct precopy_stats *stats = &ctx.save.stats;
+    static const unsigned int caps[] = { 160, 140, 130, 130 };
+    unsigned int i;
+
+    printf("Testing precopy throttling\n");
+
+    /* Dirtying pages at a quarter of the bandwidth needs no throttling. */
+    stats->dirty_rate = 500;
+    stats->bandwidth = 2000;
+    precopy_throttle(&ctx);
+    if ( nr_sets || stats->throttle )
+        fail("  Unexpected throttling at %lu pages/s", stats->dirty_rate);
+
+    /* Three quarters: 20%, then 10% more each time, up to 35%, of 2 vcpus. */
+    stats->dirty_rate = 1500;
+    for ( i = 0; i < ARRAY_SIZE(caps); i++ )
+    {
+        precopy_throttle(&ctx);
+        if ( sched.cap != caps[i] )
+            fail("  Iteration %u: expected a cap of %u, got %u",
+                 i, caps[i], sched.cap);
+    }
+    if ( nr_sets != 3 || stats->throttle != 35 )
+        fail("  Expected 3 throttles to 35%%, got %u to %u%%",
+             nr_sets, stats->throttle);
+    if ( sched.weight != 256 )
+        fail("  Expected the weight to be left alone, got %u", sched.weight);
+
+    precopy_cleanup(&ctx);
+    if ( sched.cap )
+        fail("  Expected the cap to be lifted, got %u", sched.cap);
+
+    /* An existing cap is throttled, and restored. */
+    ctx = (struct xc_sr_context){
+        .xch = &xch,
+        .save.precopy.max_throttle = 50,
+        .save.stats = { .dirty_rate = 1500, .bandwidth = 2000 },
+    };
+    sched.cap = 50;
+    precopy_throttle(&ctx);
+    if ( sched.cap != 40 )
+        fail("  Expected a cap of 40, got %u", sched.cap);
+    precopy_cleanup(&ctx);
+    if ( sched.cap != 50 )
+        fail("  Expected the cap of 50 to be restored, got %u", sched.cap);
+
+    /* Outside of credit2, throttling is given up on. */
+    ctx = (struct xc_sr_context){
+        .xch = &xch,
+        .save.precopy.max_throttle = 50,
+        .save.stats = { .dirty_rate = 1500, .bandwidth = 2000 },
+    };
+    credit2 = false;
+    nr_sets = 0;
+    precopy_throttle(&ctx);
+    if ( ctx.save.precopy.max_throttle || ctx.save.throttled ||
+         stats->throttle )
+        fail("  Expected throttling to be disabled outside of credit2");
+    precopy_cleanup(&ctx);
+    if ( nr_sets )
+        fail("  Unexpected credit2 calls outside of credit2");
+    credit2 = true;
+}
+
+int main(int argc, char **argv)
+{
+    test_policy();
+    test_collected();
+    test_throttle();
+
+    if ( failures )
+    {
+        printf("%u failures\n", failures);
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+/*
+ * Local variables:
+ * mode: C
+ * c-file-style: "BSD"
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,389 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * Unit tests for striping migration streams across auxiliary streams.
+ *
+ * A saver thread sends windows of PAGE_DATA records, each followed by a
+ * record on the main stream, to a restorer over Unix sockets.  The restorer
+ * checks that every page of a window arrives before the record following it,
+ * and that the last copy of each page sent wins.  Then the throughput is
+ * measured for increasing numbers of auxiliary streams.
+ */
+
+#include <err.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include "harness.h"
+
+#define NR_PFNS (16 * 1024) /* 64MB of guest memory. */
+
+/* Sent on the main stream after each window: the window, and its pages. */
+#define REC_TYPE_TEST_WINDOW (REC_TYPE_OPTIONAL | 0x100)
+
+struct test_window {
+    uint32_t window;
+    uint32_t pages;
+};
+
+static char restore_error[256];
+
+static uint8_t *src_mem, *dst_mem;
+
+/* Windows after the first resend a different subset of the pages. */
+static bool sent_in(unsigned int window, unsigned int pfn)
+{
+    return !window || !((pfn * 2654435761U >> 8) % (window + 1));
+}
+
+static void stamp(uint8_t *page, unsigned int window, unsigned int pfn)
+{
+    memset(page, (pfn + window) & 0xff, PAGE_SIZE);
+    memcpy(page, &pfn, sizeof(pfn));
+    memcpy(page + sizeof(pfn), &window, sizeof(window));
+}
+
+struct saver {
+    struct xc_sr_context ctx;
+    unsigned int windows;
+    /* Send a stamped copy of each page, rather than src_mem itself. */
+    bool stamped;
+    int rc;
+};
+
+struct batch {
+    struct xc_sr_rhdr rhdr;
+    struct xc_sr_rec_page_data_header hdr;
+    uint64_t pfns[MAX_BATCH_SIZE];
+    struct iovec iov[3];
+    uint8_t pages[];
+};
+
+static int send_batch(struct saver *s, unsigned int window,
+                      const unsigned int *pfns, unsigned int nr)
+{
+    struct batch *b;
+    unsigned int i;
+
+    b = malloc(sizeof(*b) + (s->stamped ? nr * PAGE_SIZE : 0));
+    if ( !b )
+        return -1;
+
+    b->rhdr.type = REC_TYPE_PAGE_DATA;
+    b->rhdr.length = sizeof(b->hdr) + nr * (sizeof(*b->pfns) + PAGE_SIZE);
+    b->hdr.count = nr;
+    b->hdr._res1 = 0;
+    for ( i = 0; i < nr; i++ )
+    {
+        b->pfns[i] = pfns[i];
+        if ( s->stamped )
+            stamp(&b->pages[i * PAGE_SIZE], window, pfns[i]);
+    }
+
+    b->iov[0].iov_base = &b->rhdr;
+    b->iov[0].iov_len = sizeof(b->rhdr) + sizeof(b->hdr);
+    b->iov[1].iov_base = b->pfns;
+    b->iov[1].iov_len = nr * sizeof(*b->pfns);
+    /* Unstamped batches are of consecutive pfns. */
+    b->iov[2].iov_base = s->stamped ? b->pages : &src_mem[pfns[0] * PAGE_SIZE];
+    b->iov[2].iov_len = nr * PAGE_SIZE;
+
+    if ( s->ctx.stripe )
+        return stripe_write_batch(&s->ctx, b->iov, ARRAY_SIZE(b->iov),
+                                  free, b);
+
+    i = writev_exact(s->ctx.fd, b->iov, ARRAY_SIZE(b->iov));
+    free(b);
+
+    return i ? -1 : 0;
+}
+
+static int save(struct saver *s)
+{
+    struct xc_sr_record end = { .type = REC_TYPE_END };
+    unsigned int pfns[MAX_BATCH_SIZE];
+    unsigned int window, pfn, nr;
+    struct test_window tw;
+    struct xc_sr_record rec = {
+        .type = REC_TYPE_TEST_WINDOW,
+        .length = sizeof(tw),
+        .data = &tw,
+    };
+
+    for ( window = 0; window < s->windows; window++ )
+    {
+        tw.window = window;
+        tw.pages = 0;
+
+        for ( pfn = 0, nr = 0; pfn <= NR_PFNS; pfn++ )
+        {
+            if ( nr == MAX_BATCH_SIZE || (pfn == NR_PFNS && nr) )
+            {
+                if ( send_batch(s, window, pfns, nr) )
+                    return -1;
+                tw.pages += nr;
+                nr = 0;
+            }
+
+            if ( pfn < NR_PFNS && (!s->stamped || sent_in(window, pfn)) )
+                pfns[nr++] = pfn;
+        }
+
+        if ( s->ctx.stripe && stripe_flush(&s->ctx) )
+            return -1;
+        if ( write_record(&s->ctx, &rec) )
+            return -1;
+    }
+
+    if ( s->ctx.stripe && stripe_finish(&s->ctx) )
+        return -1;
+
+    return write_record(&s->ctx, &end);
+}
+
+static void *saver_thread(void *arg)
+{
+    struct saver *s = arg;
+
+    s->rc = s->ctx.nr_aux_fds ? stripe_init(&s->ctx, true) : 0;
+    if ( !s->rc )
+        s->rc = save(s);
+    stripe_cleanup(&s->ctx);
+
+    return NULL;
+}
+
+/* Returns the page data received, or -1 on error. */
+static long long restore(struct xc_sr_context *ctx, bool stamped)
+{
+    struct xc_sr_rec_page_data_header *hdr;
+    struct test_window *tw;
+    struct xc_sr_record rec;
+    unsigned int window = 0, pages = 0, i;
+    long long bytes = 0;
+    uint8_t *data;
+    uint32_t pfn, seen;
+
+    for ( ;; )
+    {
+        if ( ctx->stripe ? stripe_read_record(ctx, &rec)
+                         : read_record(ctx, ctx->fd, &rec) )
+            return -1;
+
+        switch ( rec.type )
+        {
+        case REC_TYPE_PAGE_DATA:
+            hdr = rec.data;
+            data = (uint8_t *)&hdr->pfn[hdr->count];
+            for ( i = 0; i < hdr->count; i++, data += PAGE_SIZE )
+            {
+                pfn = hdr->pfn[i];
+                if ( pfn >= NR_PFNS )
+                {
+                    fail("pfn %#x out of range", pfn);
+                    continue;
+                }
+
+                memcpy(&dst_mem[pfn * PAGE_SIZE], data, PAGE_SIZE);
+                if ( !stamped )
+                    continue;
+
+                memcpy(&seen, data + sizeof(pfn), sizeof(seen));
+                if ( seen != window )
+                    fail("pfn %#x of window %u received in window %u",
+                         pfn, seen, window);
+            }
+            pages += hdr->count;
+            bytes += hdr->count * PAGE_SIZE;
+            break;
+
+        case REC_TYPE_TEST_WINDOW:
+            tw = rec.data;
+            if ( tw->window != window || tw->pages != pages )
+                fail("window %u of %u pages ended after window %u of %u"
+                     " pages", tw->window, tw->pages, window, pages);
+            window++;
+            pages = 0;
+            break;
+
+        case REC_TYPE_END:
+            return bytes;
+
+        default:
+            fail("unexpected record %#x", rec.type);
+            break;
+        }
+
+        free(rec.data);
+    }
+}
+
+/* The pages as the last window including them left them. */
+static void check_pages(unsigned int windows)
+{
+    uint8_t page[PAGE_SIZE];
+    unsigned int pfn, window;
+
+    for ( pfn = 0; pfn < NR_PFNS; pfn++ )
+    {
+        for ( window = windows - 1; !sent_in(window, pfn); window-- )
+            ;
+
+        stamp(page, window, pfn);
+        if ( memcmp(page, &dst_mem[pfn * PAGE_SIZE], PAGE_SIZE) )
+            fail("pfn %#x not as sent in window %u", pfn, window);
+    }
+}
+
+static uint64_t wall_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ * Migrate with @nr_streams auxiliary streams, of which the restorer is given
+ * @nr_restore.  Returns the page data received, or -1 if restoring failed.
+ */
+static long long migrate(unsigned int nr_streams, unsigned int nr_restore,
+                         unsigned int windows, bool stamped, uint64_t *ns)
+{
+    int fds[1 + XC_MAX_AUX_STREAMS][2];
+    int save_aux[XC_MAX_AUX_STREAMS], restore_aux[XC_MAX_AUX_STREAMS];
+    struct xc_sr_context ctx = {};
+    struct saver s = {
+        .windows = windows,
+        .stamped = stamped,
+    };
+    pthread_t thread;
+    long long bytes;
+    unsigned int i;
+
+    for ( i = 0; i <= nr_streams; i++ )
+        if ( socketpair(AF_UNIX, SOCK_STREAM, 0, fds[i]) )
+            err(1, "socketpair");
+
+    for ( i = 0; i < nr_streams; i++ )
+    {
+        save_aux[i] = fds[i + 1][0];
+        restore_aux[i] = fds[i + 1][1];
+    }
+
+    s.ctx.fd = fds[0][0];
+    s.ctx.aux_fds = save_aux;
+    s.ctx.nr_aux_fds = nr_streams;
+    ctx.fd = fds[0][1];
+    ctx.aux_fds = restore_aux;
+    ctx.nr_aux_fds = nr_restore;
+
+    *ns = wall_ns();
+
+    if ( pthread_create(&thread, NULL, saver_thread, &s) )
+        errx(1, "pthread_create");
+
+    if ( nr_restore && stripe_init(&ctx, false) )
+        errx(1, "stripe_init: %s", last_error);
+
+    bytes = restore(&ctx, stamped);
+    if ( bytes < 0 )
+        strcpy(restore_error, last_error);
+    stripe_cleanup(&ctx);
+
+    *ns = wall_ns() - *ns;
+
+    /* Unblock the saver, if restoring failed. */
+    for ( i = 0; i <= nr_streams; i++ )
+        close(fds[i][1]);
+
+    pthread_join(thread, NULL);
+
+    for ( i = 0; i <= nr_streams; i++ )
+        close(fds[i][0]);
+
+    if ( bytes >= 0 && s.rc )
+        fail("%u streams: saving failed: %s", nr_streams, last_error);
+
+    return bytes;
+}
+
+static void test_windows(unsigned int nr_streams)
+{
+    uint64_t ns;
+
+    printf("Testing %u auxiliary streams\n", nr_streams);
+
+    memset(dst_mem, 0, NR_PFNS * PAGE_SIZE);
+    if ( migrate(nr_streams, nr_streams, 8, true, &ns) < 0 )
+        fail("%u streams: restoring failed: %s", nr_streams, restore_error);
+    else
+        check_pages(8);
+}
+
+static void test_mismatch(void)
+{
+    uint64_t ns;
+
+    printf("Testing fewer auxiliary streams on restore\n");
+
+    if ( migrate(4, 2, 2, true, &ns) >= 0 )
+        fail("restored 4 streams with 2");
+    else if ( !strstr(restore_error, "striped across 4 auxiliary streams") )
+        fail("unexpected error: %s", restore_error);
+}
+
+static void bench(unsigned int nr_streams)
+{
+    long long bytes;
+    uint64_t ns;
+
+    bytes = migrate(nr_streams, nr_streams, 4, false, &ns);
+    if ( bytes < 0 )
+    {
+        fail("%u streams: restoring failed: %s", nr_streams, restore_error);
+        return;
+    }
+
+    printf("%u auxiliary streams: %4llu MB/s\n", nr_streams,
+           bytes * 1000 / ns);
+}
+
+int main(int argc, char **argv)
+{
+    unsigned int i;
+
+    /* Failing streams are reported by the stream code. */
+    signal(SIGPIPE, SIG_IGN);
+
+    src_mem = malloc(NR_PFNS * PAGE_SIZE);
+    dst_mem = malloc(NR_PFNS * PAGE_SIZE);
+    if ( !src_mem || !dst_mem )
+        err(1, "malloc");
+    memset(src_mem, 0x5a, NR_PFNS * PAGE_SIZE);
+
+    for ( i = 0; i <= 8; i = i ? i * 2 : 1 )
+        test_windows(i);
+    test_mismatch();
+    if ( failures )
+    {
+        printf("%u failures\n", failures);
+        return EXIT_FAILURE;
+    }
+
+    for ( i = 0; i <= 8; i = i ? i * 2 : 1 )
+        bench(i);
+
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/*
+ * Local variables:
+ * mode: C
+ * c-file-style: "BSD"
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
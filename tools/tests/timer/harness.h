@@ -0,0 +1,139 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * Unit tests for timers.
+ *
+ * The hypervisor timer code is built against a simulated system: time only
+ * advances when the test says so, and softirqs and the timer hardware of
+ * each CPU are modelled by the test.
+ */
+
+#ifndef _TEST_HARNESS_
+#define _TEST_HARNESS_
+
+#include <assert.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <xen-tools/common-macros.h>
+
+#define __init
+#define __read_mostly
+#define __cacheline_aligned __attribute__((__aligned__(64)))
+#define cf_check
+
+#define smp_wmb()
+#define block_lock_speculation()
+
+#define likely(x)   (x)
+#define unlikely(x) (x)
+
+#define BUG() abort()
+#define BUG_ON(x) assert(!(x))
+#define ASSERT(x) assert(x)
+#define WARN_ON(x) assert(!(x))
+
+typedef int64_t s_time_t;
+#define STIME_MAX ((s_time_t)((uint64_t)~0ULL >> 1))
+
+#define NR_CPUS 4
+#define CONFIG_NR_CPUS NR_CPUS
+
+/* Simulated system state, owned by the test. */
+extern s_time_t harness_now;
+extern unsigned int harness_cpu;
+extern bool harness_online[NR_CPUS];
+extern bool harness_softirq[NR_CPUS];
+extern void (*harness_timer_softirq)(void);
+extern struct notifier_block *harness_cpu_notifier;
+
+#define NOW()              harness_now
+#define smp_processor_id() harness_cpu
+#define cpu_online(cpu)    harness_online[cpu]
+#define for_each_online_cpu(cpu) \
+    for ( (cpu) = 0; (cpu) < NR_CPUS; (cpu)++ ) if ( !cpu_online(cpu) ) ; else
+/* CPU0 is never taken offline. */
+#define cpu_online_map     harness_online
+#define cpumask_any(m)     ((void)(m), 0U)
+
+#define park_offline_cpus  false
+#define system_state       0
+#define SYS_STATE_suspend  1
+
+#define DECLARE_PER_CPU(type, name) extern __typeof__(type) per_cpu__##name[NR_CPUS]
+#define DEFINE_PER_CPU(type, name)  __typeof__(type) per_cpu__##name[NR_CPUS]
+#define per_cpu(name, cpu)          (per_cpu__##name[cpu])
+#define this_cpu(name)              per_cpu(name, smp_processor_id())
+
+#define read_atomic(p)     (*(p))
+#define write_atomic(p, v) (*(p) = (v))
+#define cpu_relax()        BUG()
+
+/* All CPUs are simulated from a single thread: locks are never contended. */
+typedef bool spinlock_t;
+#define spin_lock_init(l)   (*(l) = false)
+#define spin_lock(l)        ({ assert(!*(l)); *(l) = true; })
+#define spin_unlock(l)      ({ assert(*(l)); *(l) = false; })
+#define _spin_lock          spin_lock
+#define spin_lock_irq       spin_lock
+#define spin_unlock_irq     spin_unlock
+#define spin_lock_irqsave(l, f)      ((f) = 0, spin_lock(l))
+#define spin_unlock_irqrestore(l, f) ((void)(f), spin_unlock(l))
+#define local_irq_save(f)    ((f) = 0)
+#define local_irq_restore(f) ((void)(f))
+
+#define DEFINE_RCU_READ_LOCK(l) int l
+#define rcu_read_lock(l)        ((void)(l))
+#define rcu_read_unlock(l)      ((void)(l))
+
+#define TIMER_SOFTIRQ 0
+#define open_softirq(nr, fn)    (harness_timer_softirq = (fn))
+#define cpu_raise_softirq(c, nr) (harness_softirq[c] = true)
+#define raise_softirq(nr)       cpu_raise_softirq(smp_processor_id(), nr)
+
+struct notifier_block {
+    int (*notifier_call)(struct notifier_block *nfb, unsigned long action,
+                         void *hcpu);
+    int priority;
+};
+#define NOTIFY_DONE            0
+#define notifier_from_errno(e) (0x8000 | -(e))
+#define CPU_UP_PREPARE    1
+#define CPU_UP_CANCELED   2
+#define CPU_DEAD          3
+#define CPU_RESUME_FAILED 4
+#define CPU_REMOVE        5
+#define register_cpu_notifier(nb) (harness_cpu_notifier = (nb))
+
+#define integer_param(name, var)
+#define register_keyhandler(key, fn, desc, diag) ((void)(fn))
+
+#define xmalloc(type)          ((type *)malloc(sizeof(type)))
+#define xmalloc_array(type, n) ((type *)malloc(sizeof(type) * (n)))
+#define xfree                  free
+#define XFREE(p)               do { free(p); (p) = NULL; } while ( 0 )
+
+#define XENLOG_WARNING
+#define printk                 printf
+#define printk_once            printf
+
+#define ffs64 __builtin_ffsll
+
+#include "list.h"
+#include "timer.h"
+
+#endif
+
+/*
+ * Local variables:
+ * mode: C
+ * c-file-style: "BSD"
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,415 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * Unit tests for timers.
+ *
+ * A randomised workload is checked against a model of which timers are
+ * active, then a few synthetic workloads are timed, so that running the
+ * heap and wheel builds side by side compares the two backends.
+ */
+
+#include <time.h>
+
+#include "harness.h"
+
+#ifdef CONFIG_TIMER_WHEEL
+#define BACKEND "wheel"
+#else
+#define BACKEND "heap"
+#endif
+
+#define TIMER_SLOP 50000 /* Default of timer.c */
+
+s_time_t harness_now = 1000000000; /* 1s */
+unsigned int harness_cpu;
+bool harness_online[NR_CPUS];
+bool harness_softirq[NR_CPUS];
+void (*harness_timer_softirq)(void);
+struct notifier_block *harness_cpu_notifier;
+
+/* Deadline programmed in the timer hardware of each CPU, 0 if none. */
+static s_time_t programmed[NR_CPUS];
+
+int reprogram_timer(s_time_t timeout)
+{
+    if ( timeout && timeout <= NOW() )
+        return 0;
+
+    programmed[smp_processor_id()] = timeout;
+
+    return 1;
+}
+
+struct test_timer {
+    struct timer timer;
+    /* Model of the timer state. */
+    bool active;
+    s_time_t expires;
+    s_time_t period;
+};
+
+static unsigned int failures;
+static unsigned long softirqs, expiries;
+static s_time_t late_total, late_max;
+
+#define fail(fmt, ...) ({                                       \
+    printf(BACKEND ": " fmt "\n", ##__VA_ARGS__);               \
+    failures++;                                                 \
+})
+
+static void timer_fn(void *data)
+{
+    struct test_timer *tt = data;
+
+    if ( !tt->active )
+        fail("inactive timer %p ran", tt);
+    else if ( tt->expires >= NOW() )
+        fail("timer %p ran %"PRId64"ns early", tt, tt->expires - NOW());
+    if ( tt->timer.cpu != smp_processor_id() )
+        fail("timer %p of CPU%u ran on CPU%u", tt, tt->timer.cpu,
+             smp_processor_id());
+
+    expiries++;
+    late_total += NOW() - tt->expires;
+    late_max = max(late_max, NOW() - tt->expires);
+    tt->active = false;
+
+    if ( tt->period )
+    {
+        tt->expires += tt->period;
+        tt->active = true;
+        set_timer(&tt->timer, tt->expires);
+    }
+}
+
+/* Deliver the timer interrupts due by now, and all raised softirqs. */
+static void run_softirqs(void)
+{
+    unsigned int cpu;
+
+    for ( cpu = 0; cpu < NR_CPUS; cpu++ )
+    {
+        if ( !harness_online[cpu] )
+            continue;
+
+        if ( programmed[cpu] && programmed[cpu] <= NOW() )
+        {
+            programmed[cpu] = 0;
+            harness_softirq[cpu] = true;
+        }
+
+        harness_cpu = cpu;
+        while ( harness_softirq[cpu] )
+        {
+            harness_softirq[cpu] = false;
+            harness_timer_softirq();
+            softirqs++;
+        }
+    }
+
+    harness_cpu = 0;
+}
+
+/* Just after the earliest programmed deadline, STIME_MAX if there is none. */
+static s_time_t next_deadline(void)
+{
+    s_time_t next = STIME_MAX;
+    unsigned int cpu;
+
+    for ( cpu = 0; cpu < NR_CPUS; cpu++ )
+        if ( harness_online[cpu] && programmed[cpu] )
+            next = min(next, programmed[cpu] + 1);
+
+    return next;
+}
+
+/* Advance to the next programmed deadline, but no further than @to. */
+static void advance(s_time_t to)
+{
+    harness_now = max(harness_now, min(to, next_deadline()));
+    run_softirqs();
+}
+
+static void cpu_up(unsigned int cpu)
+{
+    int rc = harness_cpu_notifier->notifier_call(harness_cpu_notifier,
+                                                 CPU_UP_PREPARE,
+                                                 (void *)(long)cpu);
+
+    assert(rc == NOTIFY_DONE);
+    harness_online[cpu] = true;
+}
+
+static void cpu_down(unsigned int cpu)
+{
+    harness_online[cpu] = false;
+    programmed[cpu] = 0;
+    harness_softirq[cpu] = false;
+    harness_cpu_notifier->notifier_call(harness_cpu_notifier, CPU_DEAD,
+                                        (void *)(long)cpu);
+}
+
+static unsigned int random_cpu(void)
+{
+    unsigned int cpu;
+
+    do {
+        cpu = rand() % NR_CPUS;
+    } while ( !harness_online[cpu] );
+
+    return cpu;
+}
+
+/* Expiries from the past to hours ahead, biased towards the near future. */
+static s_time_t random_expiry(void)
+{
+    switch ( rand() % 8 )
+    {
+    case 0:
+        return NOW() - rand() % 1000000;
+    case 1:
+        return NOW() + (s_time_t)(rand() % 3600) * 1000000000;
+    case 2:
+        return NOW() + (s_time_t)(rand() % 1000) * 1000000;
+    default:
+        return NOW() + rand() % 2000000;
+    }
+}
+
+/* Check the model against the timers, after softirqs have run. */
+static void check_timers(const struct test_timer *tts, unsigned int nr)
+{
+    s_time_t earliest[NR_CPUS];
+    unsigned int i, cpu;
+
+    for ( cpu = 0; cpu < NR_CPUS; cpu++ )
+        earliest[cpu] = STIME_MAX;
+
+    for ( i = 0; i < nr; i++ )
+    {
+        const struct test_timer *tt = &tts[i];
+
+        if ( timer_is_active(&tt->timer) != tt->active )
+            fail("timer %u is %sactive", i, tt->active ? "in" : "");
+        if ( !tt->active )
+            continue;
+
+        if ( !harness_online[tt->timer.cpu] )
+            fail("timer %u is on offline CPU%u", i, tt->timer.cpu);
+        else if ( tt->expires < NOW() - TIMER_SLOP )
+            fail("timer %u is %"PRId64"ns overdue", i, NOW() - tt->expires);
+        earliest[tt->timer.cpu] = min(earliest[tt->timer.cpu], tt->expires);
+    }
+
+    for ( cpu = 0; cpu < NR_CPUS; cpu++ )
+    {
+        if ( !harness_online[cpu] || earliest[cpu] == STIME_MAX )
+            continue;
+
+        if ( !programmed[cpu] ||
+             programmed[cpu] > max(earliest[cpu], NOW() + TIMER_SLOP) )
+            fail("CPU%u deadline %"PRId64" after earliest timer %"PRId64,
+                 cpu, programmed[cpu], earliest[cpu]);
+    }
+}
+
+static void test_random(unsigned int nr, unsigned int ops)
+{
+    struct test_timer *tts = calloc(nr, sizeof(*tts));
+    s_time_t next;
+    unsigned int i;
+
+    assert(tts);
+
+    for ( i = 0; i < nr; i++ )
+    {
+        init_timer(&tts[i].timer, timer_fn, &tts[i], random_cpu());
+        if ( !(i % 16) )
+            tts[i].period = 100000 + rand() % 10000000;
+    }
+
+    for ( i = 0; i < ops; i++ )
+    {
+        struct test_timer *tt = &tts[rand() % nr];
+
+        switch ( rand() % 16 )
+        {
+        case 0 ... 5:
+            tt->expires = random_expiry();
+            tt->active = true;
+            set_timer(&tt->timer, tt->expires);
+            break;
+
+        case 6 ... 7:
+            tt->active = false;
+            stop_timer(&tt->timer);
+            break;
+
+        case 8:
+            migrate_timer(&tt->timer, random_cpu());
+            break;
+
+        case 9:
+            if ( timer_expires_before(&tt->timer, tt->expires + 1) !=
+                 tt->active )
+                fail("timer %p expiry mismatch", tt);
+            break;
+
+        case 10:
+            if ( !(rand() % 64) )
+            {
+                unsigned int cpu = 1 + rand() % (NR_CPUS - 1);
+
+                if ( harness_online[cpu] )
+                    cpu_down(cpu);
+                else
+                    cpu_up(cpu);
+            }
+            break;
+
+        default:
+            advance(NOW() + rand() % 500000);
+            check_timers(tts, nr);
+            break;
+        }
+    }
+
+    /* Stop the periodic timers, and let all the others run. */
+    for ( i = 0; i < nr; i++ )
+        if ( tts[i].period )
+        {
+            tts[i].active = false;
+            stop_timer(&tts[i].timer);
+        }
+    run_softirqs();
+    while ( (next = next_deadline()) != STIME_MAX )
+        advance(next);
+    check_timers(tts, nr);
+    for ( i = 0; i < nr; i++ )
+        if ( tts[i].active )
+            fail("timer %u never ran", i);
+
+    for ( i = 0; i < nr; i++ )
+        kill_timer(&tts[i].timer);
+    free(tts);
+}
+
+static uint64_t wall_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ * Timers constantly re-armed before they expire, as for timeouts and
+ * scheduler slices.
+ */
+static void bench_rearm(unsigned int nr, unsigned int ops)
+{
+    struct test_timer *tts = calloc(nr, sizeof(*tts));
+    uint64_t set, stop;
+    unsigned int i;
+
+    assert(tts);
+
+    for ( i = 0; i < nr; i++ )
+    {
+        init_timer(&tts[i].timer, timer_fn, &tts[i], 0);
+        set_timer(&tts[i].timer, NOW() + 1000000 + rand() % 100000000);
+    }
+    run_softirqs();
+
+    set = wall_ns();
+    for ( i = 0; i < ops; i++ )
+        set_timer(&tts[rand() % nr].timer, NOW() + 1000000 + rand() % 100000000);
+    set = wall_ns() - set;
+
+    stop = wall_ns();
+    for ( i = 0; i < nr; i++ )
+        stop_timer(&tts[i].timer);
+    stop = wall_ns() - stop;
+
+    printf(BACKEND ": re-arm   %6u timers: %5"PRIu64" ns per set, %5"PRIu64
+           " ns per stop\n", nr, set / ops, stop / nr);
+
+    run_softirqs();
+    for ( i = 0; i < nr; i++ )
+        kill_timer(&tts[i].timer);
+    free(tts);
+}
+
+/* Periodic timers running to expiry, as for guest ticks and watchdogs. */
+static void bench_periodic(unsigned int nr, s_time_t duration)
+{
+    struct test_timer *tts = calloc(nr, sizeof(*tts));
+    s_time_t end = NOW() + duration;
+    uint64_t wall;
+    unsigned int i;
+
+    assert(tts);
+
+    for ( i = 0; i < nr; i++ )
+    {
+        tts[i].period = 1000000 + rand() % 9000000;
+        tts[i].expires = NOW() + rand() % tts[i].period;
+        tts[i].active = true;
+        init_timer(&tts[i].timer, timer_fn, &tts[i], 0);
+        set_timer(&tts[i].timer, tts[i].expires);
+    }
+    run_softirqs();
+
+    softirqs = expiries = 0;
+    late_total = late_max = 0;
+
+    wall = wall_ns();
+    while ( NOW() < end )
+        advance(end);
+    wall = wall_ns() - wall;
+
+    printf(BACKEND ": periodic %6u timers: %5"PRIu64" ns per expiry, %8lu"
+           " expiries in %8lu softirqs, %3"PRId64"us late on average,"
+           " %3"PRId64"us at most\n", nr, wall / expiries, expiries, softirqs,
+           late_total / (s_time_t)expiries / 1000, late_max / 1000);
+
+    for ( i = 0; i < nr; i++ )
+        kill_timer(&tts[i].timer);
+    free(tts);
+}
+
+int main(int argc, char **argv)
+{
+    unsigned int i;
+
+    srand(1);
+
+    harness_online[0] = true;
+    timer_init();
+    for ( i = 1; i < NR_CPUS; i++ )
+        cpu_up(i);
+
+    printf(BACKEND ": random workload\n");
+    test_random(1000, 200000);
+    if ( failures )
+    {
+        printf(BACKEND ": %u failures\n", failures);
+        return EXIT_FAILURE;
+    }
+
+    for ( i = 64; i <= 16384; i <<= 4 )
+        bench_rearm(i, 1000000);
+    for ( i = 64; i <= 16384; i <<= 4 )
+        bench_periodic(i, 1000000000);
+
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/*
+ * Local variables:
+ * mode: C
+ * c-file-style: "BSD"
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,230 @@
+/**
+ * @file
+ * @section LICENSE
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this program; If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @section DESCRIPTION
+ *
+ * Throughput benchmark for libxenvchan.  One side writes a fixed amount of
+ * data in fixed size messages, the other reads it, and both report the
+ * rate achieved.  Data can be moved either with libxenvchan_write() and
+ * libxenvchan_read(), or in place with the acquire/commit interface.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <time.h>
+
+#include <libxenvchan.h>
+
+static size_t total = 256 << 20;
+static size_t msg_size = 4096;
+static int zero_copy;
+
+static void usage(char **argv)
+{
+	fprintf(stderr, "usage:\n"
+		"%s [options] [client|server] [read|write] domid nodepath\n"
+		"options:\n"
+		"  -r BYTES  minimum ring size (server only, default 64k)\n"
+		"  -m BYTES  message size (default 4096)\n"
+		"  -n BYTES  amount of data to transfer (default 256M)\n"
+		"  -t BYTES  notify threshold (default 0, notify every time)\n"
+		"  -z        use the zero-copy acquire/commit interface\n"
+		"Both sides must be given the same -m and -n.  Start the server\n"
+		"first; its timing includes waiting for the client to connect.\n",
+		argv[0]);
+	exit(1);
+}
+
+static size_t parse_size(const char *s)
+{
+	char *end;
+	size_t v = strtoul(s, &end, 0);
+
+	switch (*end) {
+	case 'k': case 'K': v <<= 10; break;
+	case 'm': case 'M': v <<= 20; break;
+	case 'g': case 'G': v <<= 30; break;
+	case '\0': break;
+	default: return 0;
+	}
+	return v;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void write_copy(struct libxenvchan *ctrl, char *buf)
+{
+	size_t done = 0;
+	int ret, pos;
+
+	while (done < total) {
+		memset(buf, (char)done, msg_size);
+		for (pos = 0; pos < msg_size; pos += ret) {
+			ret = libxenvchan_write(ctrl, buf + pos, msg_size - pos);
+			if (ret <= 0) {
+				perror("vchan write");
+				exit(1);
+			}
+		}
+		done += msg_size;
+	}
+}
+
+static void write_zero_copy(struct libxenvchan *ctrl)
+{
+	size_t done = 0, pos, len;
+	void *data;
+	int ret;
+
+	while (done < total) {
+		for (pos = 0; pos < msg_size; pos += len) {
+			ret = libxenvchan_write_acquire(ctrl, &data);
+			if (ret <= 0) {
+				perror("vchan write_acquire");
+				exit(1);
+			}
+			len = msg_size - pos < ret ? msg_size - pos : ret;
+			memset(data, (char)done, len);
+			if (libxenvchan_write_commit(ctrl, len)) {
+				perror("vchan write_commit");
+				exit(1);
+			}
+		}
+		done += msg_size;
+	}
+}
+
+static void read_copy(struct libxenvchan *ctrl, char *buf)
+{
+	size_t done = 0;
+	int ret;
+
+	while (done < total) {
+		ret = libxenvchan_read(ctrl, buf, msg_size);
+		if (ret <= 0) {
+			perror("vchan read");
+			exit(1);
+		}
+		done += ret;
+	}
+}
+
+static void read_zero_copy(struct libxenvchan *ctrl)
+{
+	size_t done = 0;
+	const void *data;
+	volatile char sink;
+	int ret;
+
+	while (done < total) {
+		ret = libxenvchan_read_acquire(ctrl, &data);
+		if (ret <= 0) {
+			perror("vchan read_acquire");
+			exit(1);
+		}
+		/* touch the data, as a real consumer would */
+		sink = ((const char *)data)[ret - 1];
+		(void)sink;
+		if (libxenvchan_read_commit(ctrl, ret)) {
+			perror("vchan read_commit");
+			exit(1);
+		}
+		done += ret;
+	}
+}
+
+int main(int argc, char **argv)
+{
+	struct libxenvchan *ctrl = NULL;
+	size_t ring_size = 65536, threshold = 0;
+	double start, elapsed;
+	int wr = 0, opt;
+	char *buf;
+
+	while ((opt = getopt(argc, argv, "r:m:n:t:z")) != -1) {
+		switch (opt) {
+		case 'r': ring_size = parse_size(optarg); break;
+		case 'm': msg_size = parse_size(optarg); break;
+		case 'n': total = parse_size(optarg); break;
+		case 't': threshold = parse_size(optarg); break;
+		case 'z': zero_copy = 1; break;
+		default: usage(argv);
+		}
+	}
+	argc -= optind - 1;
+	argv += optind - 1;
+	if (argc != 5 || !msg_size || !total)
+		usage(argv);
+
+	if (!strcmp(argv[2], "read"))
+		wr = 0;
+	else if (!strcmp(argv[2], "write"))
+		wr = 1;
+	else
+		usage(argv);
+
+	if (!strcmp(argv[1], "server"))
+		ctrl = libxenvchan_server_init(NULL, atoi(argv[3]), argv[4],
+		                               wr ? 0 : ring_size,
+		                               wr ? ring_size : 0);
+	else if (!strcmp(argv[1], "client"))
+		ctrl = libxenvchan_client_init(NULL, atoi(argv[3]), argv[4]);
+	else
+		usage(argv);
+	if (!ctrl) {
+		perror("libxenvchan_*_init");
+		exit(1);
+	}
+	ctrl->blocking = 1;
+	libxenvchan_set_notify_threshold(ctrl, threshold);
+
+	buf = malloc(msg_size);
+	if (!buf) {
+		perror("malloc");
+		exit(1);
+	}
+
+	start = now();
+	if (wr && zero_copy)
+		write_zero_copy(ctrl);
+	else if (wr)
+		write_copy(ctrl, buf);
+	else if (zero_copy)
+		read_zero_copy(ctrl);
+	else
+		read_copy(ctrl, buf);
+	libxenvchan_notify_flush(ctrl);
+	elapsed = now() - start;
+
+	printf("%s %zu bytes in %zu byte messages (%s, threshold %zu): "
+	       "%.3fs, %.1f MB/s\n", wr ? "wrote" : "read", total, msg_size,
+	       zero_copy ? "zero-copy" : "copy", threshold,
+	       elapsed, total / elapsed / (1 << 20));
+
+	free(buf);
+	libxenvchan_close(ctrl);
+	return 0;
+}
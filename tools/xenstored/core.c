@@ -2852,6 +2852,8 @@ int main(int argc, char *argv[])
 			}
 		}
 
+		domain_notify_flush();
+
 		initialize_fds(&timeout);
 	}
 }
@@ -115,6 +115,9 @@ struct domain
 	/* Event channel port */
 	evtchn_port_t port;
 
+	/* Is a notification of the port queued in notify_doms? */
+	bool notify_pending;
+
 	/* Domain path in store. */
 	char *path;
 
@@ -165,6 +168,11 @@ struct changed_domain
 
 static struct hashtable *domhash;
 
+/* Domains to notify at the end of this main loop iteration. */
+static struct domain **notify_doms;
+static evtchn_port_t *notify_ports;
+static unsigned int notify_nr, notify_max;
+
 /* Write rate limiting */
 
 /* Satisfies non-overflow condition for wrl_xfer_credit. */
@@ -383,6 +391,66 @@ void wrl_apply_debit_trans_commit(struct connection *conn)
 	wrl_apply_debit_actual(conn->domain);
 }
 
+/*
+ * Queue a notification of the domain, so that all the domains whose rings
+ * were serviced in one main loop iteration are notified in a single call.
+ */
+static void domain_notify(struct domain *domain)
+{
+	if (domain->notify_pending)
+		return;
+
+	if (notify_nr == notify_max) {
+		unsigned int max = notify_max ? notify_max * 2 : 16;
+		struct domain **doms;
+		evtchn_port_t *ports;
+
+		doms = realloc(notify_doms, max * sizeof(*doms));
+		if (doms)
+			notify_doms = doms;
+		ports = realloc(notify_ports, max * sizeof(*ports));
+		if (ports)
+			notify_ports = ports;
+		if (!doms || !ports) {
+			xenevtchn_notify(xce_handle, domain->port);
+			return;
+		}
+		notify_max = max;
+	}
+
+	notify_doms[notify_nr++] = domain;
+	domain->notify_pending = true;
+}
+
+static void domain_notify_cancel(struct domain *domain)
+{
+	unsigned int i;
+
+	if (!domain->notify_pending)
+		return;
+
+	for (i = 0; notify_doms[i] != domain; i++)
+		;
+	notify_doms[i] = notify_doms[--notify_nr];
+	domain->notify_pending = false;
+}
+
+void domain_notify_flush(void)
+{
+	unsigned int i;
+
+	if (!notify_nr)
+		return;
+
+	for (i = 0; i < notify_nr; i++) {
+		notify_ports[i] = notify_doms[i]->port;
+		notify_doms[i]->notify_pending = false;
+	}
+
+	xenevtchn_notify_many(xce_handle, notify_ports, notify_nr);
+	notify_nr = 0;
+}
+
 static bool check_indexes(XENSTORE_RING_IDX cons, XENSTORE_RING_IDX prod)
 {
 	return ((prod - cons) <= XENSTORE_RING_SIZE);
@@ -434,7 +502,7 @@ static int writechn(struct connection *conn,
 	xen_mb();
 	intf->rsp_prod += len;
 
-	xenevtchn_notify(xce_handle, conn->domain->port);
+	domain_notify(conn->domain);
 
 	return len;
 }
@@ -464,7 +532,7 @@ static int readchn(struct connection *conn, void *data, unsigned int len)
 	xen_mb();
 	intf->req_cons += len;
 
-	xenevtchn_notify(xce_handle, conn->domain->port);
+	domain_notify(conn->domain);
 
 	return len;
 }
@@ -603,6 +671,8 @@ static int destroy_domain(void *_domain)
 
 	hashtable_remove(domhash, &domain->domid);
 
+	domain_notify_cancel(domain);
+
 	if (!domain->introduced)
 		return 0;
 
@@ -89,6 +89,9 @@ void stubdom_init(void);
 void domain_deinit(void);
 void ignore_connection(struct connection *conn, unsigned int err);
 
+/* Send the ring notifications queued during this main loop iteration. */
+void domain_notify_flush(void);
+
 /* Returns the implicit path of a connection (only domains have this) */
 const char *get_implicit_path(const struct connection *conn);
 
@@ -389,6 +389,8 @@ static bool do_lu_start(struct delayed_request *req)
 	}
 
 	assert(req->in == lu_status->in);
+	/* Don't leave guests waiting for notifications the new binary lacks. */
+	domain_notify_flush();
 	/* Dump out internal state, including "OK" for live update. */
 	ret = lu_dump_state(req->in, conn);
 	if (!ret) {
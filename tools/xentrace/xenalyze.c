@@ -946,6 +946,7 @@ enum {
     HVM_EVENT_TRAP,
     HVM_EVENT_TRAP_DEBUG,
     HVM_EVENT_VLAPIC,
+    HVM_EVENT_VIRIDIAN_HCALL=0x28, /* 0x26-27 are 64-bit only */
     HVM_EVENT_HANDLER_MAX
 };
 const char * hvm_event_handler_name[HVM_EVENT_HANDLER_MAX] = {
@@ -981,7 +982,8 @@ const char * hvm_event_handler_name[HVM_EVENT_HANDLER_MAX] = {
     "realmode_emulate",
     "trap",
     "trap_debug",
-    "vlapic"
+    "vlapic",
+    [HVM_EVENT_VIRIDIAN_HCALL]="viridian_hcall"
 };
 
 enum {
@@ -1099,6 +1101,33 @@ const char *hypercall_name[HYPERCALL_MAX] = {
     [HYPERCALL_kexec_op]="kexec_op"
 };
 
+/* Viridian hypercalls implemented by Xen */
+enum {
+    VIRIDIAN_HCALL_flush_space,
+    VIRIDIAN_HCALL_flush_list,
+    VIRIDIAN_HCALL_spin_wait,
+    VIRIDIAN_HCALL_send_ipi,
+    VIRIDIAN_HCALL_flush_space_ex,
+    VIRIDIAN_HCALL_flush_list_ex,
+    VIRIDIAN_HCALL_send_ipi_ex,
+    VIRIDIAN_HCALL_other,
+    VIRIDIAN_HCALL_MAX
+};
+
+const struct {
+    unsigned int code;
+    const char *name;
+} viridian_hcall[VIRIDIAN_HCALL_MAX] = {
+    [VIRIDIAN_HCALL_flush_space]    = { 0x0002, "flush_space" },
+    [VIRIDIAN_HCALL_flush_list]     = { 0x0003, "flush_list" },
+    [VIRIDIAN_HCALL_spin_wait]      = { 0x0008, "spin_wait" },
+    [VIRIDIAN_HCALL_send_ipi]       = { 0x000b, "send_ipi" },
+    [VIRIDIAN_HCALL_flush_space_ex] = { 0x0013, "flush_space_ex" },
+    [VIRIDIAN_HCALL_flush_list_ex]  = { 0x0014, "flush_list_ex" },
+    [VIRIDIAN_HCALL_send_ipi_ex]    = { 0x0015, "send_ipi_ex" },
+    [VIRIDIAN_HCALL_other]          = { 0, "other" },
+};
+
 enum {
     PF_XEN_EMUL_LVL_0,
     PF_XEN_EMUL_LVL_1,
@@ -1326,6 +1355,8 @@ struct hvm_data {
         struct cycle_summary cr_write[CR_MAX];
         struct cycle_summary cr3_write_resyncs[RESYNCS_MAX+1];
         struct cycle_summary vmcall[HYPERCALL_MAX+1];
+        /* Viridian hypercalls, with input in memory or registers */
+        struct cycle_summary viridian[VIRIDIAN_HCALL_MAX][2];
         struct cycle_summary generic[HVM_EVENT_HANDLER_MAX];
         struct cycle_summary mmio[NONPF_MMIO_MAX];
         struct hvm_gi_struct {
@@ -1367,6 +1398,9 @@ struct hvm_data {
             } generic;
             struct {
                 unsigned eax;
+                unsigned viridian:1,
+                    viridian_fast:1,
+                    viridian_hcall:30;
             } vmcall;
             struct {
                 unsigned vec;
@@ -1866,6 +1900,11 @@ void __fill_in_record_info(struct pcpu_info *p);
 
 #define INTERVAL_DOMAIN_GUEST_INTERRUPT_MAX 10
 
+#define CSCHED_STEAL_LEVELS 4
+static const char *const csched_steal_level_name[CSCHED_STEAL_LEVELS] = {
+    "sibling", "llc", "node", "remote",
+};
+
 struct {
     int max_active_pcpu;
     off_t last_epoch_offset;
@@ -1900,6 +1939,14 @@ struct {
             } domain;
         };
     } interval;
+
+    /* Credit load balancing, by distance of the peer CPUs */
+    struct {
+        unsigned long long balances, llcs, probes;
+        unsigned long long stolen[CSCHED_STEAL_LEVELS];
+        unsigned long long checked[CSCHED_STEAL_LEVELS];
+        unsigned long long skipped[CSCHED_STEAL_LEVELS];
+    } csched_balance;
 } P = { 0 };
 
 /* Function prototypes */
@@ -4316,6 +4363,13 @@ void hvm_vmcall_summary(struct hvm_data *h, void *d)
     }
     PRINT_SUMMARY(h->summary.vmcall[HYPERCALL_MAX],
                   "    [%10s] ", "max");
+    for ( i=0; i<VIRIDIAN_HCALL_MAX ; i++)
+    {
+        PRINT_SUMMARY(h->summary.viridian[i][0],
+                      "    [viridian %14s memory] ", viridian_hcall[i].name);
+        PRINT_SUMMARY(h->summary.viridian[i][1],
+                      "    [viridian %14s   fast] ", viridian_hcall[i].name);
+    }
 }
 
 void hvm_vmcall_postprocess(struct hvm_data *h)
@@ -4324,7 +4378,11 @@ void hvm_vmcall_postprocess(struct hvm_data *h)
 
     if(opt.summary)
     {
-        if ( eax < HYPERCALL_MAX )
+        if ( h->inflight.vmcall.viridian )
+            update_cycles(&h->summary.viridian[h->inflight.vmcall.viridian_hcall]
+                                              [h->inflight.vmcall.viridian_fast],
+                          h->arc_cycles);
+        else if ( eax < HYPERCALL_MAX )
             update_cycles(&h->summary.vmcall[eax],
                        h->arc_cycles);
         else
@@ -4353,11 +4411,47 @@ void hvm_vmcall_process(struct record_info *ri, struct hvm_data *h)
     }
 
     h->inflight.vmcall.eax = r->eax;
+    h->inflight.vmcall.viridian = 0;
 
     if ( hvm_set_postprocess(h, hvm_vmcall_postprocess) )
         fprintf(warn, "%s: Strange, postprocess already set\n", __func__);
 }
 
+/* Follows the vmcall record of a Viridian hypercall */
+void hvm_viridian_hcall_process(struct record_info *ri, struct hvm_data *h)
+{
+    struct {
+        unsigned int code, fast, rep_count;
+    } *r = (typeof(r))h->d;
+    int i;
+
+    if ( ri->extra_words < 3 )
+    {
+        fprintf(warn, "%s: Strange, only %d extra words\n",
+                __func__, ri->extra_words);
+        return;
+    }
+
+    for ( i=0; i<VIRIDIAN_HCALL_other; i++ )
+        if ( viridian_hcall[i].code == r->code )
+            break;
+
+    if ( opt.dump_all )
+        printf(" %s viridian_hcall %04x (%s) %s reps %u\n",
+               ri->dump_header, r->code, viridian_hcall[i].name,
+               r->fast ? "fast" : "memory", r->rep_count);
+
+    if ( h->post_process != hvm_vmcall_postprocess )
+    {
+        fprintf(warn, "%s: Strange, no vmcall in flight\n", __func__);
+        return;
+    }
+
+    h->inflight.vmcall.viridian = 1;
+    h->inflight.vmcall.viridian_fast = !!r->fast;
+    h->inflight.vmcall.viridian_hcall = i;
+}
+
 void hvm_inj_exc_process(struct record_info *ri, struct hvm_data *h)
 {
     struct {
@@ -4800,6 +4894,10 @@ void hvm_handler_process(struct record_info *ri, struct hvm_data *h) {
     case TRC_HVM_INTR_WINDOW:
         hvm_intr_window_process(ri, h);
         break;
+        /* Records adding to the vmcall, which don't replace its handler */
+    case TRC_HVM_VIRIDIAN_HCALL:
+        hvm_viridian_hcall_process(ri, h);
+        break;
     case TRC_HVM_OP_DESTROY_PROC:
         if(h->v->cr3.data) {
             struct cr3_value_struct *cur = h->v->cr3.data;
@@ -7491,6 +7589,24 @@ void sched_summary_vcpu(struct vcpu_data *v)
     }
 }
 
+void sched_summary_csched_balance(void)
+{
+    int i;
+
+    if(!P.csched_balance.balances)
+        return;
+
+    printf("--- Credit load balancing ---\n");
+    printf(" %llu balances, %.2lf LLCs read and %.2lf runqs probed each\n",
+           P.csched_balance.balances,
+           (double)P.csched_balance.llcs / P.csched_balance.balances,
+           (double)P.csched_balance.probes / P.csched_balance.balances);
+    for(i=0; i<CSCHED_STEAL_LEVELS; i++)
+        printf("  %8s: %llu checked, %llu skipped, %llu stolen\n",
+               csched_steal_level_name[i], P.csched_balance.checked[i],
+               P.csched_balance.skipped[i], P.csched_balance.stolen[i]);
+}
+
 void sched_summary_domain(struct domain_data *d)
 {
     int i;
@@ -7748,16 +7864,52 @@ void sched_process(struct pcpu_info *p)
             }
             break;
         case TRC_SCHED_CLASS_EVT(CSCHED, 11): /* STEAL_CHECK   */
+        {
+            struct {
+                unsigned int peer_cpu, check, level;
+            } *r = (typeof(r))ri->d;
+            /* Older hypervisors don't report how far peer_cpu is. */
+            bool has_level = ri->extra_words > 2 &&
+                             r->level < CSCHED_STEAL_LEVELS;
+
+            if(has_level) {
+                if(r->check)
+                    P.csched_balance.checked[r->level]++;
+                else
+                    P.csched_balance.skipped[r->level]++;
+            }
             if(opt.dump_all) {
-                struct {
-                    unsigned int peer_cpu, check;
-                } *r = (typeof(r))ri->d;
+                printf(" %s csched:load_balance %s %u", ri->dump_header,
+                       r->check ? "checking" : "skipping", r->peer_cpu);
+                if(has_level)
+                    printf(" (%s)", csched_steal_level_name[r->level]);
+                printf("\n");
+            }
+            break;
+        }
+        case TRC_SCHED_CLASS_EVT(CSCHED, 12): /* LOAD_BALANCE  */
+        {
+            struct {
+                unsigned int cpu, llcs, probes, level;
+            } *r = (typeof(r))ri->d;
 
-                printf(" %s csched:load_balance %s %u\n",
-                       ri->dump_header, r->check ? "checking" : "skipping",
-                       r->peer_cpu);
+            P.csched_balance.balances++;
+            P.csched_balance.llcs += r->llcs;
+            P.csched_balance.probes += r->probes;
+            if(r->level < CSCHED_STEAL_LEVELS)
+                P.csched_balance.stolen[r->level]++;
+            if(opt.dump_all) {
+                printf(" %s csched:load_balance cpu %u, %u LLCs read, "
+                       "%u runqs probed, ", ri->dump_header, r->cpu,
+                       r->llcs, r->probes);
+                if(r->level < CSCHED_STEAL_LEVELS)
+                    printf("stole from %s\n",
+                           csched_steal_level_name[r->level]);
+                else
+                    printf("nothing stolen\n");
             }
             break;
+        }
         /* CREDIT 2 (TRC_CSCHED2_xxx) */
         case TRC_SCHED_CLASS_EVT(CSCHED2, 1): /* TICK              */
         case TRC_SCHED_CLASS_EVT(CSCHED2, 4): /* CREDIT_ADD        */
@@ -10036,6 +10188,7 @@ void summary(void) {
         printf(" - cpu %d -\n", i);
         volume_summary(&p->volume.total);
     }
+    sched_summary_csched_balance();
     domain_summary();
 }
 
@@ -385,8 +385,9 @@ int main(int argc, char **argv)
     void *config_data = 0;
     int config_len = 0;
     unsigned int xtl_flags = 0;
+    const char *server = NULL;
 
-    while ((opt = getopt(argc, argv, "+vftTN")) >= 0) {
+    while ((opt = getopt(argc, argv, "+vftTNS:")) >= 0) {
         switch (opt) {
         case 'v':
             if (minmsglevel > 0) minmsglevel--;
@@ -403,6 +404,9 @@ int main(int argc, char **argv)
         case 'T':
             timestamps = 1;
             break;
+        case 'S':
+            server = optarg;
+            break;
         default:
             fprintf(stderr, "unknown global option\n");
             exit(EXIT_FAILURE);
@@ -417,6 +421,14 @@ int main(int argc, char **argv)
     }
     opterr = 0;
 
+    /* Client mode: leave all the work to "xl serve". */
+    if (server) {
+        argv += optind;
+        argc -= optind;
+        optind = 1;
+        return rpc_client(server, argc, argv);
+    }
+
     if (progress_use_cr)
         xtl_flags |= XTL_STDIOSTREAM_PROGRESS_USE_CR;
     if (timestamps)
@@ -175,7 +175,11 @@ const struct cmd_spec cmd_table[] = {
       "                of the domain.\n"
       "--debug         Print huge (!) amount of debug during the migration process.\n"
       "-p              Do not unpause domain after migrating it.\n"
-      "-D              Preserve the domain id"
+      "-D              Preserve the domain id\n"
+      "--max-downtime=MS Suspend the domain once its remaining memory is\n"
+      "                predicted to be sent within MS milliseconds.\n"
+      "--max-throttle=PCT Cap the domain's CPU time by up to PCT percent\n"
+      "                if it dirties memory too fast (credit2 only)."
     },
     { "restore",
       &main_restore, 0, 1,
@@ -556,6 +560,14 @@ const struct cmd_spec cmd_table[] = {
       "-F                      Run in the foreground.\n"
       "-p, --pidfile [FILE]    Write PID to pidfile when daemonizing.",
     },
+    { "serve",
+      &main_serve, 0, 1,
+      "Daemon that serves JSON-RPC requests from \"xl -S\" and other clients",
+      "[options]",
+      "-F                      Run in the foreground.\n"
+      "-p, --pidfile [FILE]    Write PID to pidfile when daemonizing.\n"
+      "-s, --socket [PATH]     Listen on PATH instead of " XEN_RUN_DIR "/xl.sock.",
+    },
 #if defined(__i386__) || defined(__x86_64__)
     { "psr-hwinfo",
       &main_psr_hwinfo, 0, 1,
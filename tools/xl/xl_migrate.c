@@ -178,6 +178,7 @@ static void migrate_do_preamble(int send_fd, int recv_fd, pid_t child,
 
 static void migrate_domain(uint32_t domid, int preserve_domid,
                            const char *rune, int debug,
+                           const libxl_domain_precopy_params *precopy,
                            const char *override_config_file)
 {
     pid_t child = -1;
@@ -206,7 +207,8 @@ static void migrate_domain(uint32_t domid, int preserve_domid,
 
     if (debug)
         flags |= LIBXL_SUSPEND_DEBUG;
-    rc = libxl_domain_suspend(ctx, domid, send_fd, flags, NULL);
+    rc = libxl_domain_suspend_streams(ctx, domid, send_fd, NULL, 0, precopy,
+                                      flags, NULL);
     if (rc) {
         fprintf(stderr, "migration sender: libxl_domain_suspend failed"
                 " (rc=%d)\n", rc);
@@ -539,12 +541,18 @@ int main_migrate(int argc, char **argv)
     char *host;
     int opt, daemonize = 1, monitor = 1, debug = 0, pause_after_migration = 0;
     int preserve_domid = 0;
+    libxl_domain_precopy_params precopy;
+    char *endptr;
     static struct option opts[] = {
         {"debug", 0, 0, 0x100},
         {"live", 0, 0, 0x200},
+        {"max-downtime", 1, 0, 0x300},
+        {"max-throttle", 1, 0, 0x400},
         COMMON_LONG_OPTS
     };
 
+    libxl_domain_precopy_params_init(&precopy);
+
     SWITCH_FOREACH_OPT(opt, "FC:s:epD", opts, "migrate", 2) {
     case 'C':
         config_filename = optarg;
@@ -571,6 +579,21 @@ int main_migrate(int argc, char **argv)
     case 0x200: /* --live */
         /* ignored for compatibility with xm */
         break;
+    case 0x300: /* --max-downtime */
+        precopy.max_downtime_ms = strtoul(optarg, &endptr, 10);
+        if (!*optarg || *endptr) {
+            fprintf(stderr, "Invalid maximum downtime '%s'\n", optarg);
+            return EXIT_FAILURE;
+        }
+        break;
+    case 0x400: /* --max-throttle */
+        precopy.max_throttle = strtoul(optarg, &endptr, 10);
+        if (!*optarg || *endptr || precopy.max_throttle >= 100) {
+            fprintf(stderr, "Invalid maximum throttle '%s'"
+                    " (a percentage below 100)\n", optarg);
+            return EXIT_FAILURE;
+        }
+        break;
     }
 
     domid = find_domain(argv[optind]);
@@ -602,7 +625,9 @@ int main_migrate(int argc, char **argv)
                   pause_after_migration ? " -p" : "");
     }
 
-    migrate_domain(domid, preserve_domid, rune, debug, config_filename);
+    migrate_domain(domid, preserve_domid, rune, debug, &precopy,
+                   config_filename);
+    libxl_domain_precopy_params_dispose(&precopy);
     return EXIT_SUCCESS;
 }
 
@@ -0,0 +1,985 @@
+/*
+ * Copyright 2009-2017 Citrix Ltd and other contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; version 2.1 only. with the special
+ * exception on linking described in file LICENSE.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ */
+
+/*
+ * xl serve: a long running xl which keeps its libxl context, and so its
+ * xenstore, hypercall and event channel handles, and serves requests
+ * from a Unix socket.
+ *
+ * The protocol is JSON-RPC 2.0 with one request or batch (an array of
+ * requests) per line, answered by one response or array of responses
+ * per line.  Domains, devices and domain configurations use the JSON
+ * representation generated from libxl_types.idl.  Each connection is
+ * served by its own thread; requests on a connection, including those
+ * in a batch, are executed in order.
+ *
+ * "xl -S <socket> <command>" is a thin client which talks to the server
+ * instead of setting up a libxl context of its own.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <libxl.h>
+#include <libxl_json.h>
+#include <libxl_utils.h>
+#include <libxlutil.h>
+#include <xen/xen.h>
+#include <xen-tools/common-macros.h>
+
+#include "xl.h"
+#include "xl_utils.h"
+
+#ifdef HAVE_YAJL_V2
+
+#include <yajl/yajl_tree.h>
+
+#define XL_RPC_SOCKET XEN_RUN_DIR "/xl.sock"
+#define XL_RPC_MAX_LINE (16 << 20)
+
+/* JSON-RPC 2.0 error codes. */
+#define RPC_PARSE_ERROR      -32700
+#define RPC_INVALID_REQUEST  -32600
+#define RPC_METHOD_NOT_FOUND -32601
+#define RPC_INVALID_PARAMS   -32602
+#define RPC_INTERNAL_ERROR   -32603
+
+/* Domain creation is serialised, as it is for xl create. */
+static pthread_mutex_t create_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static yajl_val json_get(yajl_val obj, const char *key)
+{
+    size_t i;
+
+    if (!YAJL_IS_OBJECT(obj))
+        return NULL;
+
+    for (i = 0; i < obj->u.object.len; i++)
+        if (!strcmp(obj->u.object.keys[i], key))
+            return obj->u.object.values[i];
+
+    return NULL;
+}
+
+static yajl_gen_status json_gen_string(yajl_gen hand, const char *s)
+{
+    return yajl_gen_string(hand, (const unsigned char *)s, strlen(s));
+}
+
+static yajl_gen_status json_gen_val(yajl_gen hand, yajl_val v)
+{
+    yajl_gen_status s = yajl_gen_status_ok;
+    size_t i;
+
+    if (!v)
+        return yajl_gen_null(hand);
+
+    switch (v->type) {
+    case yajl_t_string:
+        return json_gen_string(hand, v->u.string);
+    case yajl_t_number:
+        return yajl_gen_number(hand, v->u.number.r, strlen(v->u.number.r));
+    case yajl_t_object:
+        s = yajl_gen_map_open(hand);
+        for (i = 0; s == yajl_gen_status_ok && i < v->u.object.len; i++) {
+            s = json_gen_string(hand, v->u.object.keys[i]);
+            if (s == yajl_gen_status_ok)
+                s = json_gen_val(hand, v->u.object.values[i]);
+        }
+        return s == yajl_gen_status_ok ? yajl_gen_map_close(hand) : s;
+    case yajl_t_array:
+        s = yajl_gen_array_open(hand);
+        for (i = 0; s == yajl_gen_status_ok && i < v->u.array.len; i++)
+            s = json_gen_val(hand, v->u.array.values[i]);
+        return s == yajl_gen_status_ok ? yajl_gen_array_close(hand) : s;
+    case yajl_t_true:
+        return yajl_gen_bool(hand, 1);
+    case yajl_t_false:
+        return yajl_gen_bool(hand, 0);
+    default:
+        return yajl_gen_null(hand);
+    }
+}
+
+/* Re-serialise a parsed value, for the libxl_<type>_from_json() parsers. */
+static char *json_val_to_string(yajl_val v)
+{
+    const unsigned char *buf;
+    char *str = NULL;
+    size_t len;
+    yajl_gen hand;
+
+    hand = yajl_gen_alloc(NULL);
+    if (!hand)
+        return NULL;
+
+    if (json_gen_val(hand, v) == yajl_gen_status_ok &&
+        yajl_gen_get_buf(hand, &buf, &len) == yajl_gen_status_ok)
+        str = strdup((const char *)buf);
+
+    yajl_gen_free(hand);
+    return str;
+}
+
+/* ---------------------------------------------------------------------- */
+/* Server                                                                 */
+
+/*
+ * Each method either fails, returning a libxl error or a JSON-RPC error
+ * code without generating anything, or calls rpc_result() and generates
+ * the result value.
+ */
+typedef int (*rpc_method_fn)(yajl_gen hand, yajl_val params);
+
+static yajl_gen_status rpc_result(yajl_gen hand)
+{
+    return json_gen_string(hand, "result");
+}
+
+static int rpc_domid(yajl_val params, uint32_t *domid)
+{
+    yajl_val dom = json_get(params, "domain");
+
+    if (YAJL_IS_INTEGER(dom)) {
+        if (YAJL_GET_INTEGER(dom) < 0 ||
+            YAJL_GET_INTEGER(dom) >= DOMID_FIRST_RESERVED)
+            return RPC_INVALID_PARAMS;
+        *domid = YAJL_GET_INTEGER(dom);
+        return 0;
+    }
+
+    if (YAJL_IS_STRING(dom))
+        return libxl_domain_qualifier_to_domid(ctx, dom->u.string,
+                                               domid) ? ERROR_INVAL : 0;
+
+    return RPC_INVALID_PARAMS;
+}
+
+static int rpc_list(yajl_gen hand, yajl_val params)
+{
+    libxl_dominfo *info;
+    int i, nb_domain;
+    char *name;
+
+    info = libxl_list_domain(ctx, &nb_domain);
+    if (!info)
+        return ERROR_FAIL;
+
+    rpc_result(hand);
+    yajl_gen_array_open(hand);
+    for (i = 0; i < nb_domain; i++) {
+        yajl_gen_map_open(hand);
+        json_gen_string(hand, "domid");
+        yajl_gen_integer(hand, info[i].domid);
+        json_gen_string(hand, "name");
+        name = libxl_domid_to_name(ctx, info[i].domid);
+        if (name)
+            json_gen_string(hand, name);
+        else
+            yajl_gen_null(hand);
+        free(name);
+        json_gen_string(hand, "info");
+        libxl_dominfo_gen_json(hand, &info[i]);
+        yajl_gen_map_close(hand);
+    }
+    yajl_gen_array_close(hand);
+
+    libxl_dominfo_list_free(info, nb_domain);
+    return 0;
+}
+
+static int rpc_info(yajl_gen hand, yajl_val params)
+{
+    libxl_domain_config d_config;
+    uint32_t domid;
+    int rc;
+
+    rc = rpc_domid(params, &domid);
+    if (rc)
+        return rc;
+
+    libxl_domain_config_init(&d_config);
+    rc = libxl_retrieve_domain_configuration(ctx, domid, &d_config, NULL);
+    if (!rc) {
+        /* Same layout as "xl list -l". */
+        rpc_result(hand);
+        yajl_gen_map_open(hand);
+        json_gen_string(hand, "domid");
+        yajl_gen_integer(hand, domid);
+        json_gen_string(hand, "config");
+        libxl_domain_config_gen_json(hand, &d_config);
+        yajl_gen_map_close(hand);
+    }
+    libxl_domain_config_dispose(&d_config);
+
+    return rc;
+}
+
+static int rpc_create(yajl_gen hand, yajl_val params)
+{
+    libxl_domain_config d_config;
+    uint32_t domid = INVALID_DOMID;
+    yajl_val config = json_get(params, "config");
+    bool paused = YAJL_IS_TRUE(json_get(params, "paused"));
+    char *json;
+    int rc;
+
+    if (!YAJL_IS_OBJECT(config))
+        return RPC_INVALID_PARAMS;
+
+    json = json_val_to_string(config);
+    if (!json)
+        return ERROR_NOMEM;
+
+    libxl_domain_config_init(&d_config);
+    rc = libxl_domain_config_from_json(ctx, &d_config, json);
+    free(json);
+    if (rc) {
+        rc = RPC_INVALID_PARAMS;
+        goto out;
+    }
+
+    pthread_mutex_lock(&create_lock);
+    rc = libxl_domain_create_new(ctx, &d_config, &domid, NULL, NULL);
+    pthread_mutex_unlock(&create_lock);
+    if (rc)
+        goto out;
+
+    if (!paused) {
+        rc = libxl_domain_unpause(ctx, domid, NULL);
+        if (rc) {
+            libxl_domain_destroy(ctx, domid, NULL);
+            goto out;
+        }
+    }
+
+    rpc_result(hand);
+    yajl_gen_map_open(hand);
+    json_gen_string(hand, "domid");
+    yajl_gen_integer(hand, domid);
+    yajl_gen_map_close(hand);
+
+ out:
+    libxl_domain_config_dispose(&d_config);
+    return rc;
+}
+
+#define RPC_DOMAIN_OP(name, fn)                                 \
+static int rpc_##name(yajl_gen hand, yajl_val params)           \
+{                                                               \
+    uint32_t domid;                                             \
+    int rc;                                                     \
+                                                                \
+    rc = rpc_domid(params, &domid);                             \
+    if (!rc)                                                    \
+        rc = fn(ctx, domid, NULL);                              \
+    if (!rc) {                                                  \
+        rpc_result(hand);                                       \
+        yajl_gen_null(hand);                                    \
+    }                                                           \
+    return rc;                                                  \
+}
+
+RPC_DOMAIN_OP(destroy, libxl_domain_destroy)
+RPC_DOMAIN_OP(shutdown, libxl_domain_shutdown)
+RPC_DOMAIN_OP(reboot, libxl_domain_reboot)
+RPC_DOMAIN_OP(pause, libxl_domain_pause)
+RPC_DOMAIN_OP(unpause, libxl_domain_unpause)
+
+#undef RPC_DOMAIN_OP
+
+static int rpc_device(yajl_gen hand, yajl_val params, bool add)
+{
+    yajl_val type = json_get(params, "type");
+    yajl_val device = json_get(params, "device");
+    uint32_t domid;
+    char *json;
+    int rc;
+
+    rc = rpc_domid(params, &domid);
+    if (rc)
+        return rc;
+
+    if (!YAJL_IS_STRING(type) || !YAJL_IS_OBJECT(device))
+        return RPC_INVALID_PARAMS;
+
+    json = json_val_to_string(device);
+    if (!json)
+        return ERROR_NOMEM;
+
+    if (!strcmp(type->u.string, "disk")) {
+        libxl_device_disk disk;
+
+        libxl_device_disk_init(&disk);
+        rc = libxl_device_disk_from_json(ctx, &disk, json);
+        if (rc)
+            rc = RPC_INVALID_PARAMS;
+        else if (add)
+            rc = libxl_device_disk_add(ctx, domid, &disk, NULL);
+        else
+            rc = libxl_device_disk_remove(ctx, domid, &disk, NULL);
+        libxl_device_disk_dispose(&disk);
+    } else if (!strcmp(type->u.string, "nic")) {
+        libxl_device_nic nic;
+
+        libxl_device_nic_init(&nic);
+        rc = libxl_device_nic_from_json(ctx, &nic, json);
+        if (rc)
+            rc = RPC_INVALID_PARAMS;
+        else if (add)
+            rc = libxl_device_nic_add(ctx, domid, &nic, NULL);
+        else
+            rc = libxl_device_nic_remove(ctx, domid, &nic, NULL);
+        libxl_device_nic_dispose(&nic);
+    } else
+        rc = RPC_INVALID_PARAMS;
+
+    free(json);
+
+    if (!rc) {
+        rpc_result(hand);
+        yajl_gen_null(hand);
+    }
+    return rc;
+}
+
+static int rpc_device_add(yajl_gen hand, yajl_val params)
+{
+    return rpc_device(hand, params, true);
+}
+
+static int rpc_device_remove(yajl_gen hand, yajl_val params)
+{
+    return rpc_device(hand, params, false);
+}
+
+static const struct {
+    const char *name;
+    rpc_method_fn fn;
+} rpc_methods[] = {
+    { "list", rpc_list },
+    { "info", rpc_info },
+    { "create", rpc_create },
+    { "destroy", rpc_destroy },
+    { "shutdown", rpc_shutdown },
+    { "reboot", rpc_reboot },
+    { "pause", rpc_pause },
+    { "unpause", rpc_unpause },
+    { "device-add", rpc_device_add },
+    { "device-remove", rpc_device_remove },
+};
+
+/* libxl_rc, if not 0, is the libxl error behind the failure. */
+static void rpc_error(yajl_gen hand, int code, const char *message,
+                      int libxl_rc)
+{
+    json_gen_string(hand, "error");
+    yajl_gen_map_open(hand);
+    json_gen_string(hand, "code");
+    yajl_gen_integer(hand, code);
+    json_gen_string(hand, "message");
+    json_gen_string(hand, message);
+    if (libxl_rc) {
+        json_gen_string(hand, "data");
+        yajl_gen_integer(hand, libxl_rc);
+    }
+    yajl_gen_map_close(hand);
+}
+
+/*
+ * A notification is a well formed request without an id.  It is executed,
+ * but nothing is sent back for it, not even an error.
+ */
+static bool rpc_is_notification(yajl_val req)
+{
+    return YAJL_IS_OBJECT(req) && !json_get(req, "id") &&
+           YAJL_IS_STRING(json_get(req, "method"));
+}
+
+static void rpc_call(yajl_gen hand, yajl_val req)
+{
+    yajl_val method = json_get(req, "method");
+    yajl_gen discard = NULL;
+    unsigned int i;
+    int rc;
+
+    if (rpc_is_notification(req)) {
+        discard = yajl_gen_alloc(NULL);
+        if (!discard)
+            return;
+        hand = discard;
+    }
+
+    yajl_gen_map_open(hand);
+    json_gen_string(hand, "jsonrpc");
+    json_gen_string(hand, "2.0");
+    json_gen_string(hand, "id");
+    json_gen_val(hand, json_get(req, "id"));
+
+    if (!YAJL_IS_STRING(method)) {
+        rpc_error(hand, RPC_INVALID_REQUEST, "Invalid Request", 0);
+        goto out;
+    }
+
+    for (i = 0; i < ARRAY_SIZE(rpc_methods); i++)
+        if (!strcmp(rpc_methods[i].name, method->u.string))
+            break;
+
+    if (i == ARRAY_SIZE(rpc_methods)) {
+        rpc_error(hand, RPC_METHOD_NOT_FOUND, "Method not found", 0);
+        goto out;
+    }
+
+    rc = rpc_methods[i].fn(hand, json_get(req, "params"));
+    if (rc == RPC_INVALID_PARAMS)
+        rpc_error(hand, rc, "Invalid params", 0);
+    else if (rc)
+        rpc_error(hand, RPC_INTERNAL_ERROR,
+                  libxl_error_to_string(rc) ?: "Internal error", rc);
+
+ out:
+    yajl_gen_map_close(hand);
+    if (discard)
+        yajl_gen_free(discard);
+}
+
+static void rpc_process_line(yajl_gen hand, const char *line)
+{
+    char errbuf[256];
+    yajl_val req;
+    size_t i;
+    bool reply = false;
+
+    req = yajl_tree_parse(line, errbuf, sizeof(errbuf));
+    if (!req || (YAJL_IS_ARRAY(req) && !req->u.array.len)) {
+        yajl_gen_map_open(hand);
+        json_gen_string(hand, "jsonrpc");
+        json_gen_string(hand, "2.0");
+        json_gen_string(hand, "id");
+        yajl_gen_null(hand);
+        if (req)
+            rpc_error(hand, RPC_INVALID_REQUEST, "Invalid Request", 0);
+        else
+            rpc_error(hand, RPC_PARSE_ERROR, "Parse error", 0);
+        yajl_gen_map_close(hand);
+    } else if (YAJL_IS_ARRAY(req)) {
+        /* A batch of only notifications gets no response at all. */
+        for (i = 0; i < req->u.array.len; i++)
+            reply = reply || !rpc_is_notification(req->u.array.values[i]);
+        if (reply)
+            yajl_gen_array_open(hand);
+        for (i = 0; i < req->u.array.len; i++)
+            rpc_call(hand, req->u.array.values[i]);
+        if (reply)
+            yajl_gen_array_close(hand);
+    } else
+        rpc_call(hand, req);
+
+    yajl_tree_free(req);
+}
+
+static int write_all(int fd, const void *buf, size_t len)
+{
+    const char *p = buf;
+    ssize_t r;
+
+    while (len) {
+        r = write(fd, p, len);
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r <= 0)
+            return -1;
+        p += r;
+        len -= r;
+    }
+
+    return 0;
+}
+
+static void *rpc_conn_thread(void *arg)
+{
+    int fd = (intptr_t)arg;
+    size_t len = 0, size = 0, done;
+    char *buf = NULL, *nl, *tmp;
+    const unsigned char *out;
+    size_t outlen;
+    yajl_gen hand;
+    ssize_t r;
+    int ok;
+
+    for (;;) {
+        if (len + 4096 > size) {
+            if (size >= XL_RPC_MAX_LINE)
+                break;
+            size = size ? size * 2 : 65536;
+            tmp = realloc(buf, size + 1);
+            if (!tmp)
+                break;
+            buf = tmp;
+        }
+
+        r = read(fd, buf + len, size - len);
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r <= 0)
+            break;
+        len += r;
+        buf[len] = '\0';
+
+        /* Serve every complete line received so far. */
+        done = 0;
+        while ((nl = memchr(buf + done, '\n', len - done)) != NULL) {
+            *nl = '\0';
+            if (nl > buf + done) {
+                hand = yajl_gen_alloc(NULL);
+                if (!hand)
+                    goto out;
+                rpc_process_line(hand, buf + done);
+                yajl_gen_get_buf(hand, &out, &outlen);
+                ok = !outlen ||
+                     (!write_all(fd, out, outlen) && !write_all(fd, "\n", 1));
+                yajl_gen_free(hand);
+                if (!ok)
+                    goto out;
+            }
+            done = nl + 1 - buf;
+        }
+        memmove(buf, buf + done, len - done);
+        len -= done;
+    }
+
+ out:
+    free(buf);
+    close(fd);
+    return NULL;
+}
+
+static int rpc_listen(const char *path)
+{
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    mode_t old_umask;
+    int fd;
+
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "socket path too long: %s\n", path);
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        perror("socket");
+        return -1;
+    }
+
+    unlink(path);
+    old_umask = umask(077);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) ||
+        listen(fd, 64)) {
+        fprintf(stderr, "unable to listen on %s: %s\n", path, strerror(errno));
+        umask(old_umask);
+        close(fd);
+        return -1;
+    }
+    umask(old_umask);
+
+    return fd;
+}
+
+int main_serve(int argc, char **argv)
+{
+    const char *pidfile = NULL, *path = XL_RPC_SOCKET;
+    int opt, ret, lfd, fd, daemonize = 1;
+    pthread_attr_t attr;
+    pthread_t thread;
+    static const struct option opts[] = {
+        {"pidfile", 1, 0, 'p'},
+        {"socket", 1, 0, 's'},
+        COMMON_LONG_OPTS,
+        {0, 0, 0, 0}
+    };
+
+    SWITCH_FOREACH_OPT(opt, "Fp:s:", opts, "serve", 0) {
+    case 'F':
+        daemonize = 0;
+        break;
+    case 'p':
+        pidfile = optarg;
+        break;
+    case 's':
+        path = optarg;
+        break;
+    }
+
+    lfd = rpc_listen(path);
+    if (lfd < 0)
+        return EXIT_FAILURE;
+
+    if (daemonize) {
+        ret = do_daemonize("xlserve", pidfile);
+        if (ret) {
+            close(lfd);
+            return (ret == 1) ? 0 : ret;
+        }
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+    for (;;) {
+        fd = accept(lfd, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            perror("accept");
+            break;
+        }
+        /* Keep connections out of hotplug scripts and other children. */
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+
+        if (pthread_create(&thread, &attr, rpc_conn_thread,
+                           (void *)(intptr_t)fd)) {
+            fprintf(stderr, "unable to create connection thread\n");
+            close(fd);
+        }
+    }
+
+    pthread_attr_destroy(&attr);
+    close(lfd);
+    return EXIT_FAILURE;
+}
+
+/* ---------------------------------------------------------------------- */
+/* Client                                                                 */
+
+static int rpc_connect(const char *path)
+{
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    int fd;
+
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "socket path too long: %s\n", path);
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        perror("socket");
+        return -1;
+    }
+
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr))) {
+        fprintf(stderr, "unable to connect to %s: %s\n", path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+/* Newlines delimit requests; outside strings, JSON allows any whitespace. */
+static void rpc_flatten(char *json, size_t len)
+{
+    size_t i;
+
+    for (i = 0; i < len; i++)
+        if (json[i] == '\n' || json[i] == '\r')
+            json[i] = ' ';
+}
+
+static char *rpc_read_all(int fd, size_t *len_r)
+{
+    size_t len = 0, size = 0;
+    char *buf = NULL, *tmp;
+    ssize_t r;
+
+    for (;;) {
+        if (len + 4096 > size) {
+            size = size ? size * 2 : 65536;
+            tmp = realloc(buf, size + 1);
+            if (!tmp) {
+                free(buf);
+                return NULL;
+            }
+            buf = tmp;
+        }
+        r = read(fd, buf + len, size - len);
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r < 0) {
+            free(buf);
+            return NULL;
+        }
+        if (r == 0)
+            break;
+        len += r;
+    }
+
+    buf[len] = '\0';
+    *len_r = len;
+    return buf;
+}
+
+/*
+ * Send one request line and print the response.  For a single request
+ * the result is printed as indented JSON and an error fails the command;
+ * batch responses are printed as received.  Raw requests may consist of
+ * notifications only, which get no response.
+ */
+static int rpc_transact(const char *path, const char *req, size_t len,
+                        bool raw)
+{
+    yajl_val resp, err, msg;
+    char *buf, errbuf[256];
+    size_t resplen;
+    yajl_gen hand;
+    const unsigned char *out;
+    size_t outlen;
+    int fd, ret = EXIT_FAILURE;
+
+    fd = rpc_connect(path);
+    if (fd < 0)
+        return EXIT_FAILURE;
+
+    if (write_all(fd, req, len) || write_all(fd, "\n", 1) ||
+        shutdown(fd, SHUT_WR)) {
+        perror("sending request");
+        close(fd);
+        return EXIT_FAILURE;
+    }
+
+    buf = rpc_read_all(fd, &resplen);
+    close(fd);
+    if (!buf || (!resplen && !raw)) {
+        fprintf(stderr, "no response from %s\n", path);
+        free(buf);
+        return EXIT_FAILURE;
+    }
+    if (!resplen) {
+        free(buf);
+        return EXIT_SUCCESS;
+    }
+
+    resp = yajl_tree_parse(buf, errbuf, sizeof(errbuf));
+    if (!resp) {
+        fprintf(stderr, "malformed response: %s\n", errbuf);
+        goto out;
+    }
+
+    if (YAJL_IS_ARRAY(resp)) {
+        fputs(buf, stdout);
+        ret = EXIT_SUCCESS;
+        goto out;
+    }
+
+    err = json_get(resp, "error");
+    if (err) {
+        msg = json_get(err, "message");
+        fprintf(stderr, "%s\n", YAJL_IS_STRING(msg) ? msg->u.string
+                                                    : "request failed");
+        goto out;
+    }
+
+    ret = EXIT_SUCCESS;
+    if (YAJL_IS_NULL(json_get(resp, "result")))
+        goto out;
+
+    hand = libxl_yajl_gen_alloc(NULL);
+    if (hand) {
+        json_gen_val(hand, json_get(resp, "result"));
+        yajl_gen_get_buf(hand, &out, &outlen);
+        printf("%s\n", out);
+        yajl_gen_free(hand);
+    }
+
+ out:
+    yajl_tree_free(resp);
+    free(buf);
+    return ret;
+}
+
+static void rpc_gen_domain(yajl_gen hand, const char *dom)
+{
+    char *end;
+    unsigned long domid = strtoul(dom, &end, 10);
+
+    json_gen_string(hand, "domain");
+    if (*dom && !*end && domid < DOMID_FIRST_RESERVED)
+        yajl_gen_integer(hand, domid);
+    else
+        json_gen_string(hand, dom);
+}
+
+int rpc_client(const char *path, int argc, char **argv)
+{
+    const char *cmd = argv[0];
+    const unsigned char *req;
+    size_t reqlen, len;
+    char *config = NULL, *batch;
+    yajl_gen hand;
+    int fd, opt, ret, paused = 0;
+
+    /* Raw requests, including batches, from the command line or stdin. */
+    if (!strcmp(cmd, "rpc")) {
+        if (argc > 2) {
+            fprintf(stderr, "Usage: xl -S <socket> rpc [request]\n");
+            return EXIT_FAILURE;
+        }
+        if (argc == 2)
+            batch = strdup(argv[1]);
+        else
+            batch = rpc_read_all(0, &len);
+        if (!batch) {
+            perror("reading request");
+            return EXIT_FAILURE;
+        }
+        len = strlen(batch);
+        rpc_flatten(batch, len);
+        ret = rpc_transact(path, batch, len, true);
+        free(batch);
+        return ret;
+    }
+
+    hand = yajl_gen_alloc(NULL);
+    if (!hand)
+        return EXIT_FAILURE;
+
+    yajl_gen_map_open(hand);
+    json_gen_string(hand, "jsonrpc");
+    json_gen_string(hand, "2.0");
+    json_gen_string(hand, "id");
+    yajl_gen_integer(hand, 1);
+    json_gen_string(hand, "method");
+
+    if (!strcmp(cmd, "list")) {
+        if (argc > 2)
+            goto usage;
+        json_gen_string(hand, argc == 2 ? "info" : "list");
+        json_gen_string(hand, "params");
+        yajl_gen_map_open(hand);
+        if (argc == 2)
+            rpc_gen_domain(hand, argv[1]);
+        yajl_gen_map_close(hand);
+    } else if (!strcmp(cmd, "create")) {
+        while ((opt = getopt(argc, argv, "p")) != -1) {
+            if (opt != 'p')
+                goto usage;
+            paused = 1;
+        }
+        if (optind != argc - 1)
+            goto usage;
+        fd = open(argv[optind], O_RDONLY | O_CLOEXEC);
+        if (fd >= 0) {
+            config = rpc_read_all(fd, &len);
+            close(fd);
+        }
+        if (!config) {
+            fprintf(stderr, "Failed to read %s: %s\n", argv[optind],
+                    strerror(errno));
+            goto fail;
+        }
+        json_gen_string(hand, "create");
+        json_gen_string(hand, "params");
+        yajl_gen_map_open(hand);
+        json_gen_string(hand, "paused");
+        yajl_gen_bool(hand, paused);
+        /* The configuration itself is appended verbatim below. */
+        json_gen_string(hand, "config");
+        yajl_gen_null(hand);
+        yajl_gen_map_close(hand);
+    } else if (!strcmp(cmd, "destroy") || !strcmp(cmd, "shutdown") ||
+               !strcmp(cmd, "reboot") || !strcmp(cmd, "pause") ||
+               !strcmp(cmd, "unpause")) {
+        if (argc != 2)
+            goto usage;
+        json_gen_string(hand, cmd);
+        json_gen_string(hand, "params");
+        yajl_gen_map_open(hand);
+        rpc_gen_domain(hand, argv[1]);
+        yajl_gen_map_close(hand);
+    } else {
+        fprintf(stderr, "command not supported by the xl server\n");
+        goto fail;
+    }
+    yajl_gen_map_close(hand);
+    yajl_gen_get_buf(hand, &req, &reqlen);
+
+    if (config) {
+        /*
+         * The client does not parse the configuration, which must be in
+         * the JSON format used by "xl create -N".  Splice it in place of
+         * the "null" placeholder, which closes the params and request
+         * objects.
+         */
+        len = strlen(config);
+        rpc_flatten(config, len);
+        batch = malloc(reqlen + len + 1);
+        if (!batch)
+            goto fail;
+        reqlen -= strlen("null}}");
+        memcpy(batch, req, reqlen);
+        memcpy(batch + reqlen, config, len);
+        memcpy(batch + reqlen + len, "}}", 2);
+        ret = rpc_transact(path, batch, reqlen + len + 2, false);
+        free(batch);
+    } else
+        ret = rpc_transact(path, (const char *)req, reqlen, false);
+
+    free(config);
+    yajl_gen_free(hand);
+    return ret;
+
+ usage:
+    fprintf(stderr, "Invalid arguments for %s in client mode.\n", cmd);
+ fail:
+    free(config);
+    yajl_gen_free(hand);
+    return EXIT_FAILURE;
+}
+
+#else /* !HAVE_YAJL_V2 */
+
+int main_serve(int argc, char **argv)
+{
+    fprintf(stderr, "xl serve requires yajl 2\n");
+    return EXIT_FAILURE;
+}
+
+int rpc_client(const char *path, int argc, char **argv)
+{
+    fprintf(stderr, "xl client mode requires yajl 2\n");
+    return EXIT_FAILURE;
+}
+
+#endif /* HAVE_YAJL_V2 */
+
+/*
+ * Local variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
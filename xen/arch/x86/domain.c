@@ -30,11 +30,13 @@
 #include <xen/livepatch.h>
 #include <xen/multicall.h>
 #include <xen/paging.h>
+#include <xen/param.h>
 #include <xen/pci.h>
 #include <xen/percpu.h>
 #include <xen/sched.h>
 #include <xen/smp.h>
 #include <xen/softirq.h>
+#include <xen/tasklet.h>
 #include <xen/wait.h>
 
 #include <asm/amd.h>
@@ -2353,6 +2355,182 @@ static int relinquish_memory(
     return ret;
 }
 
+/*
+ * Large domains spend most of their teardown dropping the allocation
+ * reference of every page, one page at a time.  For unpinned pages this
+ * needs no ordering against anything else, so it is split into chunks
+ * which the destroying CPU and tasklets on otherwise idle CPUs take off
+ * the page list concurrently.  Pages are taken off the list, and freed
+ * (and queued for scrubbing) once their last reference goes, in batches,
+ * so that neither d->page_alloc_lock nor the heap lock is taken per page.
+ * Pinned pages are left to the serial relinquish_memory() passes.
+ */
+static unsigned int __read_mostly opt_teardown_workers = 8;
+integer_param("teardown-workers", opt_teardown_workers);
+
+#define RELMEM_CHUNK              512
+#define RELMEM_BATCH              64
+#define RELMEM_PARALLEL_MIN_PAGES (1UL << (30 - PAGE_SHIFT))
+
+struct relmem_pool {
+    struct domain *d;
+    s_time_t start;
+    unsigned long pages;
+    unsigned int nr_workers;
+    struct relmem_worker {
+        struct tasklet tasklet;
+        struct relmem_pool *pool;
+        unsigned int cpu;
+    } worker[];
+};
+
+/*
+ * Returns the number of pages taken off the page list.  They are handled
+ * in batches, each taking d->page_alloc_lock twice, and the heap lock once
+ * for the pages it frees.
+ */
+static unsigned int relinquish_chunk(struct domain *d)
+{
+    unsigned int done = 0, n;
+
+    while ( done < RELMEM_CHUNK )
+    {
+        PAGE_LIST_HEAD(batch);
+        PAGE_LIST_HEAD(dead);
+        struct page_info *page;
+
+        nrspin_lock(&d->page_alloc_lock);
+
+        for ( n = 0; n < RELMEM_BATCH; n++ )
+        {
+            page = page_list_remove_head(&d->page_list);
+            if ( !page )
+                break;
+
+            /* Grab a reference to the page so it won't disappear from under us. */
+            if ( likely(get_page(page, d)) )
+                page_list_add_tail(page, &batch);
+            else
+                /* Couldn't get a reference -- someone is freeing this page. */
+                page_list_add_tail(page, &d->arch.relmem_list);
+        }
+
+        nrspin_unlock(&d->page_alloc_lock);
+
+        if ( !n )
+            break;
+        done += n;
+
+        /* Our references keep these from being the last ones. */
+        page_list_for_each ( page, &batch )
+            if ( !(page->u.inuse.type_info & PGT_pinned) )
+                put_page_alloc_ref(page);
+
+        /*
+         * Pages still referenced elsewhere go back on a page list of the
+         * domain before we drop our reference, so that whoever drops the
+         * last one can free them.  free_domheap_pages() takes the lock to
+         * do so, after they are on the list.  The others are freed here.
+         */
+        nrspin_lock(&d->page_alloc_lock);
+        while ( (page = page_list_remove_head(&batch)) )
+            page_list_add_tail(page, put_page_nofree(page)
+                                     ? &dead : &d->arch.relmem_list);
+        nrspin_unlock(&d->page_alloc_lock);
+
+        free_domheap_page_list(d, &dead);
+    }
+
+    return done;
+}
+
+static void cf_check relmem_worker(void *data)
+{
+    struct relmem_worker *w = data;
+
+    relinquish_chunk(w->pool->d);
+}
+
+static int relinquish_memory_parallel(struct domain *d)
+{
+    struct relmem_pool *pool = d->arch.relmem_pool;
+    unsigned int i, cpu;
+
+    if ( !pool )
+    {
+        if ( !opt_teardown_workers ||
+             domain_tot_pages(d) < RELMEM_PARALLEL_MIN_PAGES )
+            return 0;
+
+        pool = xzalloc_flex_struct(struct relmem_pool, worker,
+                                   opt_teardown_workers);
+        if ( !pool )
+            return 0;
+
+        pool->d = d;
+        pool->start = NOW();
+        pool->pages = domain_tot_pages(d);
+
+        for_each_online_cpu ( cpu )
+        {
+            struct relmem_worker *w = &pool->worker[pool->nr_workers];
+
+            if ( cpu == smp_processor_id() )
+                continue;
+
+            w->pool = pool;
+            w->cpu = cpu;
+            tasklet_init(&w->tasklet, relmem_worker, w);
+            if ( ++pool->nr_workers == opt_teardown_workers )
+                break;
+        }
+
+        d->arch.relmem_pool = pool;
+    }
+
+    do {
+        /*
+         * Only hand out work to CPUs which are idle and whose worker has
+         * finished its previous chunk, so that guests which become
+         * runnable there get the CPU back between chunks.
+         */
+        for ( i = 0; i < pool->nr_workers; i++ )
+        {
+            struct relmem_worker *w = &pool->worker[i];
+
+            if ( cpu_online(w->cpu) && idle_vcpu[w->cpu]->is_running &&
+                 !tasklet_is_scheduled(&w->tasklet) &&
+                 !tasklet_is_running(&w->tasklet) )
+                tasklet_schedule_on_cpu(&w->tasklet, w->cpu);
+        }
+
+        if ( !relinquish_chunk(d) )
+            break;
+
+        if ( hypercall_preempt_check() )
+            return -ERESTART;
+    } while ( true );
+
+    /* The page list is empty; wait for chunks still being processed. */
+    for ( i = 0; i < pool->nr_workers; i++ )
+        tasklet_kill(&pool->worker[i].tasklet);
+
+    nrspin_lock(&d->page_alloc_lock);
+    page_list_splice(&d->arch.relmem_list, &d->page_list);
+    INIT_PAGE_LIST_HEAD(&d->arch.relmem_list);
+    nrspin_unlock(&d->page_alloc_lock);
+
+    printk(XENLOG_G_INFO
+           "%pd: freed %lu of %lu pages in %"PRI_stime"ms, %u helper CPUs\n",
+           d, pool->pages - domain_tot_pages(d), pool->pages,
+           (NOW() - pool->start) / MILLISECS(1), pool->nr_workers);
+
+    d->arch.relmem_pool = NULL;
+    xfree(pool);
+
+    return 0;
+}
+
 int domain_relinquish_resources(struct domain *d)
 {
     int ret;
@@ -2386,6 +2564,7 @@ int domain_relinquish_resources(struct domain *d)
             PROG_mappings,
             PROG_paging,
             PROG_vcpu_pagetables,
+            PROG_parallel,
             PROG_xen,
             PROG_l4,
             PROG_l3,
@@ -2484,6 +2663,12 @@ int domain_relinquish_resources(struct domain *d)
         INIT_PAGE_LIST_HEAD(&d->arch.relmem_list);
         nrspin_unlock(&d->page_alloc_lock);
 
+    PROGRESS(parallel):
+
+        ret = relinquish_memory_parallel(d);
+        if ( ret )
+            return ret;
+
     PROGRESS(xen):
 
         ret = relinquish_memory(d, &d->xenpage_list, ~0UL);
@@ -12,6 +12,7 @@
 #include <xen/domain_page.h>
 #include <xen/param.h>
 #include <xen/softirq.h>
+#include <xen/trace.h>
 #include <asm/guest/hyperv-tlfs.h>
 #include <asm/paging.h>
 #include <asm/p2m.h>
@@ -76,6 +77,7 @@ typedef union _HV_CRASH_CTL_REG_CONTENTS
 
 /* Viridian CPUID leaf 3, Hypervisor Feature Indication */
 #define CPUID3D_CPU_DYNAMIC_PARTITIONING (1 << 3)
+#define CPUID3D_XMM_FAST_HYPERCALL_INPUT (1 << 4)
 #define CPUID3D_CRASH_MSRS (1 << 10)
 #define CPUID3D_SINT_POLLING (1 << 17)
 
@@ -185,6 +187,8 @@ void cpuid_viridian_leaves(const struct vcpu *v, uint32_t leaf,
             res->d |= CPUID3D_CRASH_MSRS;
         if ( viridian_feature_mask(d) & HVMPV_synic )
             res->d |= CPUID3D_SINT_POLLING;
+        if ( viridian_feature_mask(d) & HVMPV_hcall_xmm_input )
+            res->d |= CPUID3D_XMM_FAST_HYPERCALL_INPUT;
 
         break;
     }
@@ -616,12 +620,74 @@ union hypercall_vpset {
 
 static DEFINE_PER_CPU(union hypercall_vpset, hypercall_vpset);
 
+/*
+ * Input parameters of a hypercall.  These are in guest memory unless the
+ * fast-call convention is used, in which case they are in RDX and R8,
+ * followed by XMM0 to XMM5 if XMM fast hypercall input is available.
+ */
+struct hypercall_args {
+    bool fast;
+    bool xmm;           /* XMM registers not read yet. */
+    unsigned int size;  /* Bytes of fast input read. */
+    paddr_t gpa;
+    union {
+        struct {
+            uint64_t gpr[2];
+            struct {
+                uint64_t q[2];
+            } xmm[6];
+        } regs;
+        uint8_t bytes[(2 + 6 * 2) * sizeof(uint64_t)];
+    };
+};
+
+static void read_xmm_args(struct hypercall_args *args)
+{
+    struct vcpu *curr = current;
+
+    /* The guest's FPU state has to be loaded to read its registers. */
+    if ( !curr->fpu_dirtied )
+        alternative_vcall(hvm_funcs.fpu_dirty_intercept);
+
+    asm volatile ( "movdqu %%xmm0, %0" : "=m" (args->regs.xmm[0]) );
+    asm volatile ( "movdqu %%xmm1, %0" : "=m" (args->regs.xmm[1]) );
+    asm volatile ( "movdqu %%xmm2, %0" : "=m" (args->regs.xmm[2]) );
+    asm volatile ( "movdqu %%xmm3, %0" : "=m" (args->regs.xmm[3]) );
+    asm volatile ( "movdqu %%xmm4, %0" : "=m" (args->regs.xmm[4]) );
+    asm volatile ( "movdqu %%xmm5, %0" : "=m" (args->regs.xmm[5]) );
+
+    args->size = sizeof(args->regs);
+    args->xmm = false;
+}
+
+/* Copy @size bytes at @offset in the input parameters to @buf. */
+static int read_args(struct hypercall_args *args, unsigned int offset,
+                     void *buf, unsigned int size)
+{
+    if ( !args->fast )
+        return hvm_copy_from_guest_phys(buf, args->gpa + offset,
+                                        size) == HVMTRANS_okay ? 0 : -EINVAL;
+
+    /* Only read the XMM registers when the input extends into them. */
+    if ( offset + size > args->size && args->xmm )
+        read_xmm_args(args);
+
+    if ( offset + size > args->size )
+        return -EINVAL;
+
+    memcpy(buf, args->bytes + offset, size);
+
+    return 0;
+}
+
 static unsigned int hv_vpset_nr_banks(struct hv_vpset *vpset)
 {
     return hweight64(vpset->valid_bank_mask);
 }
 
-static int hv_vpset_to_vpmask(const struct hv_vpset *in, paddr_t bank_gpa,
+static int hv_vpset_to_vpmask(const struct hv_vpset *in,
+                              struct hypercall_args *args,
+                              unsigned int bank_offset,
                               struct hypercall_vpmask *vpmask)
 {
 #define NR_VPS_PER_BANK (HV_VPSET_BANK_SIZE * 8)
@@ -649,8 +715,7 @@ static int hv_vpset_to_vpmask(const struct hv_vpset *in, paddr_t bank_gpa,
             return -EINVAL;
         }
 
-        if ( hvm_copy_from_guest_phys(&set->bank_contents, bank_gpa,
-                                      size) != HVMTRANS_okay )
+        if ( read_args(args, bank_offset, &set->bank_contents, size) )
             return -EINVAL;
 
         vpmask_empty(vpmask);
@@ -703,8 +768,7 @@ union hypercall_output {
 
 static int hvcall_flush(const union hypercall_input *input,
                         union hypercall_output *output,
-                        paddr_t input_params_gpa,
-                        paddr_t output_params_gpa)
+                        struct hypercall_args *args)
 {
     struct hypercall_vpmask *vpmask = &this_cpu(hypercall_vpmask);
     struct {
@@ -714,13 +778,8 @@ static int hvcall_flush(const union hypercall_input *input,
     } input_params;
     unsigned long *vcpu_bitmap;
 
-    /* These hypercalls should never use the fast-call convention. */
-    if ( input->fast )
-        return -EINVAL;
-
     /* Get input parameters. */
-    if ( hvm_copy_from_guest_phys(&input_params, input_params_gpa,
-                                  sizeof(input_params)) != HVMTRANS_okay )
+    if ( read_args(args, 0, &input_params, sizeof(input_params)) )
         return -EINVAL;
 
     /*
@@ -751,8 +810,7 @@ static int hvcall_flush(const union hypercall_input *input,
 
 static int hvcall_flush_ex(const union hypercall_input *input,
                            union hypercall_output *output,
-                           paddr_t input_params_gpa,
-                           paddr_t output_params_gpa)
+                           struct hypercall_args *args)
 {
     struct hypercall_vpmask *vpmask = &this_cpu(hypercall_vpmask);
     struct {
@@ -762,13 +820,8 @@ static int hvcall_flush_ex(const union hypercall_input *input,
     } input_params;
     unsigned long *vcpu_bitmap;
 
-    /* These hypercalls should never use the fast-call convention. */
-    if ( input->fast )
-        return -EINVAL;
-
     /* Get input parameters. */
-    if ( hvm_copy_from_guest_phys(&input_params, input_params_gpa,
-                                  sizeof(input_params)) != HVMTRANS_okay )
+    if ( read_args(args, 0, &input_params, sizeof(input_params)) )
         return -EINVAL;
 
     if ( input_params.flags & HV_FLUSH_ALL_PROCESSORS ||
@@ -780,8 +833,7 @@ static int hvcall_flush_ex(const union hypercall_input *input,
                                             set.bank_contents);
         int rc;
 
-        rc = hv_vpset_to_vpmask(&input_params.set,
-                                input_params_gpa + bank_offset,
+        rc = hv_vpset_to_vpmask(&input_params.set, args, bank_offset,
                                 vpmask);
         if ( rc )
             return rc;
@@ -824,60 +876,40 @@ static void send_ipi(struct hypercall_vpmask *vpmask, uint8_t vector)
 
 static int hvcall_ipi(const union hypercall_input *input,
                       union hypercall_output *output,
-                      paddr_t input_params_gpa,
-                      paddr_t output_params_gpa)
+                      struct hypercall_args *args)
 {
     struct hypercall_vpmask *vpmask = &this_cpu(hypercall_vpmask);
-    uint32_t vector;
-    uint64_t vcpu_mask;
+    struct {
+        uint32_t vector;
+        uint8_t target_vtl;
+        uint8_t reserved_zero[3];
+        uint64_t vcpu_mask;
+    } input_params;
 
     /* Get input parameters. */
-    if ( input->fast )
-    {
-        if ( input_params_gpa >> 32 )
-            return -EINVAL;
-
-        vector = input_params_gpa;
-        vcpu_mask = output_params_gpa;
-    }
-    else
-    {
-        struct {
-            uint32_t vector;
-            uint8_t target_vtl;
-            uint8_t reserved_zero[3];
-            uint64_t vcpu_mask;
-        } input_params;
-
-        if ( hvm_copy_from_guest_phys(&input_params, input_params_gpa,
-                                      sizeof(input_params)) != HVMTRANS_okay )
-            return -EINVAL;
-
-        if ( input_params.target_vtl ||
-             input_params.reserved_zero[0] ||
-             input_params.reserved_zero[1] ||
-             input_params.reserved_zero[2] )
-            return -EINVAL;
+    if ( read_args(args, 0, &input_params, sizeof(input_params)) )
+        return -EINVAL;
 
-        vector = input_params.vector;
-        vcpu_mask = input_params.vcpu_mask;
-    }
+    if ( input_params.target_vtl ||
+         input_params.reserved_zero[0] ||
+         input_params.reserved_zero[1] ||
+         input_params.reserved_zero[2] )
+        return -EINVAL;
 
-    if ( vector < 0x10 || vector > 0xff )
+    if ( input_params.vector < 0x10 || input_params.vector > 0xff )
         return -EINVAL;
 
     vpmask_empty(vpmask);
-    vpmask_set(vpmask, 0, vcpu_mask);
+    vpmask_set(vpmask, 0, input_params.vcpu_mask);
 
-    send_ipi(vpmask, vector);
+    send_ipi(vpmask, input_params.vector);
 
     return 0;
 }
 
 static int hvcall_ipi_ex(const union hypercall_input *input,
                          union hypercall_output *output,
-                         paddr_t input_params_gpa,
-                         paddr_t output_params_gpa)
+                         struct hypercall_args *args)
 {
     struct hypercall_vpmask *vpmask = &this_cpu(hypercall_vpmask);
     struct {
@@ -890,13 +922,8 @@ static int hvcall_ipi_ex(const union hypercall_input *input,
                                         set.bank_contents);
     int rc;
 
-    /* These hypercalls should never use the fast-call convention. */
-    if ( input->fast )
-        return -EINVAL;
-
     /* Get input parameters. */
-    if ( hvm_copy_from_guest_phys(&input_params, input_params_gpa,
-                                  sizeof(input_params)) != HVMTRANS_okay )
+    if ( read_args(args, 0, &input_params, sizeof(input_params)) )
         return -EINVAL;
 
     if ( input_params.target_vtl ||
@@ -908,8 +935,7 @@ static int hvcall_ipi_ex(const union hypercall_input *input,
     if ( input_params.vector < 0x10 || input_params.vector > 0xff )
         return -EINVAL;
 
-    rc = hv_vpset_to_vpmask(&input_params.set, input_params_gpa + bank_offset,
-                            vpmask);
+    rc = hv_vpset_to_vpmask(&input_params.set, args, bank_offset, vpmask);
     if ( rc )
         return rc;
 
@@ -928,6 +954,7 @@ int viridian_hypercall(struct cpu_user_regs *regs)
     int rc = 0;
     union hypercall_input input;
     union hypercall_output output = {};
+    struct hypercall_args args;
 
     ASSERT(is_viridian_domain(currd));
 
@@ -949,6 +976,17 @@ int viridian_hypercall(struct cpu_user_regs *regs)
         goto out;
     }
 
+    TRACE(TRC_HVM_VIRIDIAN_HCALL, input.call_code, input.fast,
+          input.rep_count);
+
+    args.fast = input.fast;
+    args.xmm = mode == X86_MODE_64BIT &&
+               (viridian_feature_mask(currd) & HVMPV_hcall_xmm_input);
+    args.size = sizeof(args.regs.gpr);
+    args.gpa = input_params_gpa;
+    args.regs.gpr[0] = input_params_gpa;
+    args.regs.gpr[1] = output_params_gpa;
+
     switch ( input.call_code )
     {
     case HVCALL_NOTIFY_LONG_SPIN_WAIT:
@@ -968,8 +1006,7 @@ int viridian_hypercall(struct cpu_user_regs *regs)
             printk(XENLOG_G_INFO "%pd: VIRIDIAN HVCALL_FLUSH_VIRTUAL_ADDRESS_SPACE/LIST\n",
                    currd);
 
-        rc = hvcall_flush(&input, &output, input_params_gpa,
-                          output_params_gpa);
+        rc = hvcall_flush(&input, &output, &args);
         break;
 
     case HVCALL_FLUSH_VIRTUAL_ADDRESS_SPACE_EX:
@@ -978,8 +1015,7 @@ int viridian_hypercall(struct cpu_user_regs *regs)
             printk(XENLOG_G_INFO "%pd: VIRIDIAN HVCALL_FLUSH_VIRTUAL_ADDRESS_SPACE/LIST_EX\n",
                    currd);
 
-        rc = hvcall_flush_ex(&input, &output, input_params_gpa,
-                             output_params_gpa);
+        rc = hvcall_flush_ex(&input, &output, &args);
         break;
 
     case HVCALL_SEND_IPI:
@@ -987,8 +1023,7 @@ int viridian_hypercall(struct cpu_user_regs *regs)
             printk(XENLOG_G_INFO "%pd: VIRIDIAN HVCALL_SEND_IPI\n",
                    currd);
 
-        rc = hvcall_ipi(&input, &output, input_params_gpa,
-                        output_params_gpa);
+        rc = hvcall_ipi(&input, &output, &args);
         break;
 
     case HVCALL_SEND_IPI_EX:
@@ -996,8 +1031,7 @@ int viridian_hypercall(struct cpu_user_regs *regs)
             printk(XENLOG_G_INFO "%pd: VIRIDIAN HVCALL_SEND_IPI_EX\n",
                    currd);
 
-        rc = hvcall_ipi_ex(&input, &output, input_params_gpa,
-                           output_params_gpa);
+        rc = hvcall_ipi_ex(&input, &output, &args);
         break;
 
     default:
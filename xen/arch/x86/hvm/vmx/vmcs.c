@@ -63,6 +63,7 @@ integer_param("vm-notify-window", vm_notify_window);
 static bool __read_mostly opt_ept_pml = true;
 static int8_t __ro_after_init opt_ept_ad = -1;
 int8_t __read_mostly opt_ept_exec_sp = -1;
+bool __ro_after_init opt_ept_coalesce = true;
 
 static int __init cf_check parse_ept_param(const char *s)
 {
@@ -80,6 +81,8 @@ static int __init cf_check parse_ept_param(const char *s)
             opt_ept_pml = val;
         else if ( (val = parse_boolean("exec-sp", s, ss)) >= 0 )
             opt_ept_exec_sp = val;
+        else if ( (val = parse_boolean("coalesce", s, ss)) >= 0 )
+            opt_ept_coalesce = val;
         else
             rc = -EINVAL;
 
@@ -183,6 +183,13 @@ struct log_dirty_domain {
     unsigned long  fault_count;
     unsigned long  dirty_count;
 
+    /* optional ring of newly dirtied pfns, drained by the toolstack */
+    uint64_t      *ring;
+    unsigned int   ring_size;   /* power of 2 */
+    unsigned int   ring_prod;
+    unsigned int   ring_cons;
+    bool           ring_overflow;
+
     /* functions which are paging mode specific */
     const struct log_dirty_ops {
         int        (*enable  )(struct domain *d);
@@ -222,6 +229,9 @@ struct paging_domain {
                 unsigned long done:PADDR_BITS - PAGE_SHIFT;
                 unsigned long i4:PAGETABLE_ORDER;
                 unsigned long i3:PAGETABLE_ORDER;
+                /* The stats reported by a CLEAN, as it started. */
+                unsigned long fault_count;
+                unsigned long dirty_count;
             } log_dirty;
         };
     } preempt;
@@ -339,6 +349,7 @@ struct arch_domain
     /* Continuable domain_relinquish_resources(). */
     unsigned int rel_priv;
     struct page_list_head relmem_list;
+    struct relmem_pool *relmem_pool;
 
     const struct arch_csw {
         void (*from)(struct vcpu *v);
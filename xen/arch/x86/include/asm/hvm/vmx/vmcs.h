@@ -8,6 +8,8 @@
 #define __ASM_X86_HVM_VMX_VMCS_H__
 
 #include <xen/mm.h>
+#include <xen/tasklet.h>
+#include <xen/timer.h>
 
 extern void vmcs_dump_vcpu(struct vcpu *v);
 extern int vmx_vmcs_init(void);
@@ -42,6 +44,11 @@ struct ept_data {
     };
     /* Set of PCPUs needing an INVEPT before a VMENTER. */
     cpumask_var_t invalidate;
+    /* Re-coalescing of split superpages (host p2m only). */
+    struct timer coalesce_timer;
+    struct tasklet coalesce_tasklet;
+    unsigned long coalesce_gfn;     /* Next GFN to scan. */
+    unsigned long coalesced[2];     /* 2M and 1G mappings re-created. */
 };
 
 #define _VMX_DOMAIN_PML_ENABLED    0
@@ -18,6 +18,7 @@
 #include <asm/hvm/vmx/vmcs.h>
 
 extern int8_t opt_ept_exec_sp;
+extern bool opt_ept_coalesce;
 
 typedef union {
     struct {
@@ -404,6 +404,7 @@ int page_lock_unsafe(struct page_info *page);
 
 void page_unlock(struct page_info *page);
 
+bool put_page_nofree(struct page_info *page);
 void put_page_type(struct page_info *page);
 int  get_page_type(struct page_info *page, unsigned long type);
 int  put_page_type_preemptible(struct page_info *page);
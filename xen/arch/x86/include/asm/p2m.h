@@ -16,6 +16,7 @@
 
 #include <xen/paging.h>
 #include <xen/mem_access.h>
+#include <xen/timer.h>
 #include <asm/mem_sharing.h>
 #include <asm/page.h>    /* for pagetable_t */
 
@@ -337,6 +338,25 @@ struct p2m_domain {
             unsigned long list[NR_POD_MRP_ENTRIES];
             unsigned int idx;
         } mrp;
+
+        /* Background reclaim of zeroed pages, keeping the cache topped up. */
+        struct timer     reclaim_timer;
+        gfn_t            reclaim_cursor; /* Next gfn to sweep */
+        unsigned long    reclaim_budget; /* # of gfns left to sweep */
+        bool             reclaim_armed;  /* reclaim_timer is pending */
+        bool             reclaim_spent;  /* Swept without recovering */
+
+        /* Statistics, for the domain dump. */
+        struct {
+            unsigned long faults,        /* Demand populate calls        */
+                          sync_sweeps,   /* Emergency sweeps on faults   */
+                          reclaimed,     /* Pages reclaimed in background */
+                          reclaim_runs;  /* Background reclaim batches   */
+            s_time_t      fault_time,    /* Total and maximum latency of */
+                          fault_max,     /* demand populate calls        */
+                          reclaim_time,  /* Total and maximum time the   */
+                          reclaim_max;   /* p2m was locked by a batch    */
+        } stats;
         mm_lock_t        lock;         /* Locking of private pod structs,   *
                                         * not relying on the p2m lock.      */
     } pod;
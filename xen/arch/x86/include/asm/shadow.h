@@ -196,11 +196,11 @@ static inline bool pv_l1tf_check_pte(struct domain *d, unsigned int level,
                "d%d L1TF-vulnerable L%ue %016"PRIx64" - Shadowing\n",
                d->domain_id, level, pte);
         /*
-         * Safety consideration for accessing tasklet.scheduled_on without the
-         * tasklet lock.  This is a singleshot tasklet with the side effect of
-         * setting PG_SH_forced (checked just above).  Multiple vcpus can race
-         * to schedule the tasklet, but if we observe it scheduled anywhere,
-         * that is good enough.
+         * Safety consideration for checking whether the tasklet is
+         * scheduled without synchronisation.  This is a singleshot tasklet
+         * with the side effect of setting PG_SH_forced (checked just
+         * above).  Multiple vcpus can race to schedule the tasklet, but if
+         * we observe it scheduled anywhere, that is good enough.
          */
         smp_rmb();
         if ( !tasklet_is_scheduled(t) )
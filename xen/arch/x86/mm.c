@@ -2524,7 +2524,12 @@ static int cleanup_page_mappings(struct page_info *page)
     return rc;
 }
 
-void put_page(struct page_info *page)
+/*
+ * Drop a reference like put_page(), but leave freeing the page to the
+ * caller.  Returns true if that was the last reference, and the page is to
+ * be freed.
+ */
+bool put_page_nofree(struct page_info *page)
 {
     unsigned long nx, x, y = page->count_info;
 
@@ -2535,14 +2540,21 @@ void put_page(struct page_info *page)
     }
     while ( unlikely((y = cmpxchg(&page->count_info, x, nx)) != x) );
 
-    if ( unlikely((nx & PGC_count_mask) == 0) )
-    {
-        if ( !cleanup_page_mappings(page) )
-            free_domheap_page(page);
-        else
-            gdprintk(XENLOG_WARNING,
-                     "Leaking mfn %" PRI_mfn "\n", mfn_x(page_to_mfn(page)));
-    }
+    if ( likely((nx & PGC_count_mask) != 0) )
+        return false;
+
+    if ( !cleanup_page_mappings(page) )
+        return true;
+
+    gdprintk(XENLOG_WARNING,
+             "Leaking mfn %" PRI_mfn "\n", mfn_x(page_to_mfn(page)));
+    return false;
+}
+
+void put_page(struct page_info *page)
+{
+    if ( unlikely(put_page_nofree(page)) )
+        free_domheap_page(page);
 }
 
 
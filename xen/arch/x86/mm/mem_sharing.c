@@ -1499,6 +1499,111 @@ static int range_share(struct domain *d, struct domain *cd,
     return rc;
 }
 
+/*
+ * Compare the contents of two nominated pages.  Neither guest can write to
+ * them any more, so the answer holds until they are shared or unshared.
+ */
+static bool pages_identical(struct domain *sd, gfn_t sgfn,
+                            struct domain *cd, gfn_t cgfn)
+{
+    struct two_gfns tg;
+    p2m_type_t st, ct;
+    mfn_t smfn, cmfn;
+    bool same = false;
+
+    get_two_gfns(sd, sgfn, &st, NULL, &smfn, cd, cgfn, &ct, NULL, &cmfn,
+                 0, &tg, true);
+
+    if ( p2m_is_shared(st) && p2m_is_shared(ct) )
+    {
+        if ( mfn_eq(smfn, cmfn) )
+            same = true;
+        else
+        {
+            const void *sp = map_domain_page(smfn);
+            const void *cp = map_domain_page(cmfn);
+
+            same = !memcmp(sp, cp, PAGE_SIZE);
+
+            unmap_domain_page(cp);
+            unmap_domain_page(sp);
+        }
+    }
+
+    put_two_gfns(&tg);
+
+    return same;
+}
+
+static bool gfn_is_shared(struct domain *d, gfn_t gfn)
+{
+    p2m_type_t t;
+
+    get_gfn_query_unlocked(d, gfn_x(gfn), &t);
+
+    return p2m_is_shared(t);
+}
+
+/*
+ * Undo the nomination of a page which didn't get shared, so that the guest's
+ * next write to it doesn't take an unshare fault for nothing.  Being its
+ * only gfn, this just makes the page private again, without a copy.
+ */
+static int unnominate_page(struct domain *d, gfn_t gfn)
+{
+    return mem_sharing_unshare_page(d, gfn_x(gfn));
+}
+
+static int share_batch(struct domain *d, struct domain *cd,
+                       struct mem_sharing_op_batch *batch)
+{
+    XEN_GUEST_HANDLE_PARAM(xen_mem_sharing_batch_entry_t) entries =
+        guest_handle_cast(batch->entries, xen_mem_sharing_batch_entry_t);
+    xen_mem_sharing_batch_entry_t ent;
+    shr_handle_t sh, ch;
+    bool s_shared, c_shared;
+    int rc;
+
+    while ( batch->done < batch->nr )
+    {
+        if ( copy_from_guest_offset(&ent, entries, batch->done, 1) )
+            return -EFAULT;
+
+        /* Pages shared already are left as they were, whatever happens. */
+        s_shared = gfn_is_shared(d, _gfn(ent.source_gfn));
+        c_shared = gfn_is_shared(cd, _gfn(ent.client_gfn));
+
+        rc = nominate_page(d, _gfn(ent.source_gfn), 0, false, &sh);
+        if ( !rc )
+            rc = nominate_page(cd, _gfn(ent.client_gfn), 0, false, &ch);
+        if ( !rc )
+            rc = pages_identical(d, _gfn(ent.source_gfn),
+                                 cd, _gfn(ent.client_gfn))
+                 ? share_pages(d, _gfn(ent.source_gfn), sh,
+                               cd, _gfn(ent.client_gfn), ch)
+                 : -EAGAIN;
+
+        if ( rc && !s_shared && unnominate_page(d, _gfn(ent.source_gfn)) )
+            rc = -ENOMEM;
+        if ( rc && !c_shared && unnominate_page(cd, _gfn(ent.client_gfn)) )
+            rc = -ENOMEM;
+
+        ent.rc = rc;
+        if ( copy_to_guest_offset(entries, batch->done, &ent, 1) )
+            return -EFAULT;
+
+        /* Individual pages failing is expected, running out of memory not. */
+        if ( rc == -ENOMEM )
+            return rc;
+
+        /* Check for continuation if it's not the last iteration. */
+        if ( ++batch->done < batch->nr && hypercall_preempt_check() )
+            return 1;
+    }
+
+    return 0;
+}
+
 static inline int mem_sharing_control(struct domain *d, bool enable,
                                       uint16_t flags)
 {
@@ -2231,6 +2336,51 @@ int mem_sharing_memop(XEN_GUEST_HANDLE_PARAM(xen_mem_sharing_op_t) arg)
     }
     break;
 
+    case XENMEM_sharing_op_share_batch:
+    {
+        struct domain *cd;
+
+        rc = -EINVAL;
+        if ( mso.u.batch._pad[0] || mso.u.batch._pad[1] ||
+             mso.u.batch._pad[2] || mso.u.batch.done > mso.u.batch.nr )
+            goto out;
+
+        rc = rcu_lock_live_remote_domain_by_id(mso.u.batch.client_domain,
+                                               &cd);
+        if ( rc )
+            goto out;
+
+        /* As for range sharing, reuse the XENMEM_sharing_op_share check. */
+        rc = xsm_mem_sharing_op(XSM_DM_PRIV, d, cd,
+                                XENMEM_sharing_op_share);
+        if ( rc )
+        {
+            rcu_unlock_domain(cd);
+            goto out;
+        }
+
+        if ( !mem_sharing_enabled(cd) )
+        {
+            rcu_unlock_domain(cd);
+            rc = -EINVAL;
+            goto out;
+        }
+
+        rc = share_batch(d, cd, &mso.u.batch);
+        rcu_unlock_domain(cd);
+
+        if ( rc > 0 )
+        {
+            if ( __copy_to_guest(arg, &mso, 1) )
+                rc = -EFAULT;
+            else
+                rc = hypercall_create_continuation(__HYPERVISOR_memory_op,
+                                                   "lh", XENMEM_sharing_op,
+                                                   arg);
+        }
+    }
+    break;
+
     case XENMEM_sharing_op_debug_gfn:
         rc = debug_gfn(d, _gfn(mso.u.debug.u.gfn));
         break;
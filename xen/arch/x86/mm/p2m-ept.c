@@ -244,6 +244,25 @@ static void ept_free_entry(struct p2m_domain *p2m, ept_entry_t *ept_entry, int l
     p2m_free_ptp(p2m, mfn_to_page(_mfn(ept_entry->mfn)));
 }
 
+/* Delay before scanning for split superpages, and retrying when blocked. */
+#define EPT_COALESCE_DELAY SECONDS(10)
+/* 2M ranges scanned per tasklet run. */
+#define EPT_COALESCE_BATCH 64
+
+/*
+ * Superpages split for log-dirty, mem_access or PoD stay split once that
+ * reason has gone.  Schedule a background scan to coalesce them again.
+ */
+static void ept_coalesce_kick(struct p2m_domain *p2m)
+{
+    struct ept_data *ept = &p2m->ept;
+
+    if ( opt_ept_coalesce && p2m_is_hostp2m(p2m) &&
+         p2m->domain->arch.hvm.vmx.exec_sp &&
+         !timer_is_active(&ept->coalesce_timer) )
+        set_timer(&ept->coalesce_timer, NOW() + EPT_COALESCE_DELAY);
+}
+
 static bool ept_split_super_page(
     struct p2m_domain *p2m, ept_entry_t *ept_entry,
     unsigned int level, unsigned int target)
@@ -263,6 +282,8 @@ static bool ept_split_super_page(
     if ( !table )
         return 0;
 
+    ept_coalesce_kick(p2m);
+
     trunk = 1UL << ((level - 1) * EPT_TABLE_ORDER);
 
     for ( i = 0; i < EPT_PAGETABLE_ENTRIES; i++ )
@@ -1373,6 +1394,120 @@ static void cf_check ept_flush_pml_buffers(struct p2m_domain *p2m)
     vmx_domain_flush_pml_buffers(p2m->domain);
 }
 
+/*
+ * If the table below the level @level entry for @gfn maps an aligned MFN
+ * range with identical attributes throughout, replace it with a superpage.
+ * The p2m lock must be held.
+ */
+static void ept_coalesce_one(struct p2m_domain *p2m, unsigned long gfn,
+                             unsigned int level)
+{
+    struct ept_data *ept = &p2m->ept;
+    unsigned int order = level * EPT_TABLE_ORDER;
+    unsigned long stride = 1UL << (order - EPT_TABLE_ORDER);
+    /* Hardware sets A/D bits independently in each entry. */
+    uint64_t mask = ~(ept_entry_t){ .a = 1, .d = 1 }.epte;
+    unsigned long gfn_remainder = gfn;
+    ept_entry_t *table, e, first;
+    unsigned int i;
+    bool ipat;
+
+    table = map_domain_page(pagetable_get_mfn(p2m_get_pagetable(p2m)));
+
+    for ( i = ept->wl; i >= level; i-- )
+    {
+        /* Leave subtrees with outstanding recalculations alone. */
+        e = table[gfn_remainder >> (i * EPT_TABLE_ORDER)];
+        if ( e.recalc || e.emt == MTRR_NUM_TYPES ||
+             ept_next_level(p2m, true, &table, &gfn_remainder, i) !=
+             GUEST_TABLE_NORMAL_PAGE )
+            goto out;
+    }
+
+    /* table now holds the entries which could make up the superpage. */
+    first = table[0];
+    if ( first.sa_p2mt != p2m_ram_rw || !is_epte_present(&first) ||
+         is_epte_superpage(&first) != (level > 1) || first.recalc ||
+         first.emt == MTRR_NUM_TYPES || !first.suppress_ve ||
+         (first.mfn & ((1UL << order) - 1)) )
+        goto out;
+
+    for ( i = 1; i < EPT_PAGETABLE_ENTRIES; i++ )
+    {
+        e = first;
+        e.mfn += i * stride;
+        if ( (table[i].epte ^ e.epte) & mask )
+            goto out;
+    }
+
+    if ( epte_get_entry_emt(p2m->domain, _gfn(gfn), _mfn(first.mfn), order,
+                            &ipat, p2m_ram_rw) != first.emt ||
+         ipat != first.ipat )
+        goto out;
+
+    unmap_domain_page(table);
+
+    if ( !p2m_set_entry(p2m, _gfn(gfn), _mfn(first.mfn), order, p2m_ram_rw,
+                        first.access) )
+        ept->coalesced[level - 1]++;
+
+    return;
+
+ out:
+    unmap_domain_page(table);
+}
+
+static void cf_check ept_coalesce_work(void *data)
+{
+    struct p2m_domain *p2m = data;
+    struct ept_data *ept = &p2m->ept;
+    struct domain *d = p2m->domain;
+    unsigned long gfn = ept->coalesce_gfn;
+    unsigned int budget = EPT_COALESCE_BATCH;
+
+    while ( gfn <= p2m->max_mapped_pfn )
+    {
+        if ( !budget-- || softirq_pending(smp_processor_id()) )
+        {
+            tasklet_schedule(&ept->coalesce_tasklet);
+            break;
+        }
+
+        p2m_lock(p2m);
+
+        if ( d->is_dying )
+        {
+            p2m_unlock(p2m);
+            return;
+        }
+
+        /* Log-dirty and altp2m would only split the superpages again. */
+        if ( paging_mode_log_dirty(d) || altp2m_active(d) )
+        {
+            p2m_unlock(p2m);
+            set_timer(&ept->coalesce_timer, NOW() + EPT_COALESCE_DELAY);
+            break;
+        }
+
+        ept_coalesce_one(p2m, gfn, 1);
+        gfn += 1UL << PAGE_ORDER_2M;
+        if ( hap_has_1gb && !(gfn & ((1UL << PAGE_ORDER_1G) - 1)) )
+            ept_coalesce_one(p2m, gfn - (1UL << PAGE_ORDER_1G), 2);
+
+        p2m_unlock(p2m);
+    }
+
+    /* Start the next scan from the beginning. */
+    ept->coalesce_gfn = gfn <= p2m->max_mapped_pfn ? gfn : 0;
+}
+
+static void cf_check ept_coalesce_timer_fn(void *data)
+{
+    struct p2m_domain *p2m = data;
+
+    tasklet_schedule(&p2m->ept.coalesce_tasklet);
+}
+
 int ept_p2m_init(struct p2m_domain *p2m)
 {
     struct ept_data *ept = &p2m->ept;
@@ -1410,12 +1545,19 @@ int ept_p2m_init(struct p2m_domain *p2m)
      */
     cpumask_setall(ept->invalidate);
 
+    init_timer(&ept->coalesce_timer, ept_coalesce_timer_fn, p2m,
+               smp_processor_id());
+    tasklet_init(&ept->coalesce_tasklet, ept_coalesce_work, p2m);
+
     return 0;
 }
 
 void ept_p2m_uninit(struct p2m_domain *p2m)
 {
     struct ept_data *ept = &p2m->ept;
+
+    kill_timer(&ept->coalesce_timer);
+    tasklet_kill(&ept->coalesce_tasklet);
     free_cpumask_var(ept->invalidate);
 }
 
@@ -1454,7 +1596,8 @@ static void cf_check ept_dump_p2m_table(unsigned char key)
 
         p2m = p2m_get_hostp2m(d);
         ept = &p2m->ept;
-        printk("\ndomain%d EPT p2m table:\n", d->domain_id);
+        printk("\ndomain%d EPT p2m table (re-coalesced: %lu 2M, %lu 1G):\n",
+               d->domain_id, ept->coalesced[0], ept->coalesced[1]);
 
         for ( gfn = 0; gfn <= p2m->max_mapped_pfn; gfn += 1UL << order )
         {
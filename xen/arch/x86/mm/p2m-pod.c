@@ -45,7 +45,8 @@ static inline void unlock_page_alloc(struct p2m_domain *p2m)
 static int
 p2m_pod_cache_add(struct p2m_domain *p2m,
                   struct page_info *page,
-                  unsigned int order)
+                  unsigned int order,
+                  bool scrub)
 {
     unsigned long i;
     struct domain *d = p2m->domain;
@@ -79,8 +80,10 @@ p2m_pod_cache_add(struct p2m_domain *p2m,
      * Pages from domain_alloc and returned by the balloon driver aren't
      * guaranteed to be zero; but by reclaiming zero pages, we implicitly
      * promise to provide zero pages. So we scrub pages before using.
+     * Reclaimed pages have just been checked to be zero, which keeps the
+     * scrubbing off the fault path.
      */
-    for ( i = 0; i < (1UL << order); i++ )
+    for ( i = 0; scrub && i < (1UL << order); i++ )
         clear_domain_page(mfn_add(mfn, i));
 
     /* First, take all pages off the domain list */
@@ -208,7 +211,7 @@ p2m_pod_set_cache_target(struct p2m_domain *p2m, unsigned long pod_target, int p
             goto out;
         }
 
-        p2m_pod_cache_add(p2m, page, order);
+        p2m_pod_cache_add(p2m, page, order, true);
 
         if ( preemptible && pod_target != p2m->pod.count &&
              hypercall_preempt_check() )
@@ -374,6 +377,7 @@ int p2m_pod_empty_cache(struct domain *d)
 
     /* After this barrier no new PoD activities can happen. */
     BUG_ON(!d->is_dying);
+    kill_timer(&p2m->pod.reclaim_timer);
     rspin_barrier(&p2m->pod.lock.lock);
 
     lock_page_alloc(p2m);
@@ -481,7 +485,7 @@ p2m_pod_offline_or_broken_replace(struct page_info *p)
         return;
 
     pod_lock(p2m);
-    p2m_pod_cache_add(p2m, p, PAGE_ORDER_4K);
+    p2m_pod_cache_add(p2m, p, PAGE_ORDER_4K, true);
     pod_unlock(p2m);
     return;
 }
@@ -656,7 +660,7 @@ decrease_reservation(struct domain *d, gfn_t gfn, unsigned int order)
             p2m_tlb_flush_sync(p2m);
             for ( j = 0; j < n; ++j )
                 set_gpfn_from_mfn(mfn_x(mfn), INVALID_M2P_ENTRY);
-            p2m_pod_cache_add(p2m, page, cur_order);
+            p2m_pod_cache_add(p2m, page, cur_order, true);
 
             ioreq_request_mapcache_invalidate(d);
 
@@ -702,6 +706,19 @@ void p2m_pod_dump_data(struct domain *d)
 
     printk("    PoD entries=%ld cachesize=%ld\n",
            p2m->pod.entry_count, p2m->pod.count);
+    if ( p2m->pod.stats.faults )
+        printk("    PoD faults=%lu latency avg=%"PRI_stime"ns max=%"PRI_stime
+               "ns sync sweeps=%lu\n",
+               p2m->pod.stats.faults,
+               p2m->pod.stats.fault_time / (s_time_t)p2m->pod.stats.faults,
+               p2m->pod.stats.fault_max, p2m->pod.stats.sync_sweeps);
+    if ( p2m->pod.stats.reclaim_runs )
+        printk("    PoD background batches=%lu reclaimed=%lu p2m locked avg=%"
+               PRI_stime"ns max=%"PRI_stime"ns total=%"PRI_stime"ns\n",
+               p2m->pod.stats.reclaim_runs, p2m->pod.stats.reclaimed,
+               p2m->pod.stats.reclaim_time /
+               (s_time_t)p2m->pod.stats.reclaim_runs,
+               p2m->pod.stats.reclaim_max, p2m->pod.stats.reclaim_time);
 }
 
 
@@ -861,7 +878,7 @@ p2m_pod_zero_check_superpage(struct p2m_domain *p2m, gfn_t gfn)
      * Finally!  We've passed all the checks, and can add the mfn superpage
      * back on the PoD cache, and account for the new p2m PoD entries.
      */
-    p2m_pod_cache_add(p2m, mfn_to_page(mfn0), PAGE_ORDER_2M);
+    p2m_pod_cache_add(p2m, mfn_to_page(mfn0), PAGE_ORDER_2M, false);
     p2m->pod.entry_count += SUPERPAGE_PAGES;
 
     ioreq_request_mapcache_invalidate(d);
@@ -889,6 +906,14 @@ out:
 #define POD_SWEEP_LIMIT 1024
 #define POD_SWEEP_STRIDE  16
 
+/*
+ * Cache size below which the background reclaim kicks in, how many gfns each
+ * of its batches looks at, and how far apart the batches are.
+ */
+#define POD_CACHE_WATERMARK (4 * SUPERPAGE_PAGES)
+#define POD_RECLAIM_BATCH   64
+#define POD_RECLAIM_PERIOD  MICROSECS(500)
+
 static void
 p2m_pod_zero_check(struct p2m_domain *p2m, const gfn_t *gfns, unsigned int count)
 {
@@ -1033,7 +1058,7 @@ p2m_pod_zero_check(struct p2m_domain *p2m, const gfn_t *gfns, unsigned int count
             }
 
             /* Add to cache, and account for the new p2m PoD entry */
-            p2m_pod_cache_add(p2m, mfn_to_page(mfns[i]), PAGE_ORDER_4K);
+            p2m_pod_cache_add(p2m, mfn_to_page(mfns[i]), PAGE_ORDER_4K, false);
             p2m->pod.entry_count++;
 
             ioreq_request_mapcache_invalidate(d);
@@ -1096,7 +1121,7 @@ p2m_pod_emergency_sweep(struct p2m_domain *p2m)
 
 }
 
-static void pod_eager_reclaim(struct p2m_domain *p2m)
+static void pod_eager_reclaim(struct p2m_domain *p2m, bool drain)
 {
     struct pod_mrp_list *mrp = &p2m->pod.mrp;
     unsigned int i = 0;
@@ -1105,7 +1130,7 @@ static void pod_eager_reclaim(struct p2m_domain *p2m)
      * Always check one page for reclaimation.
      *
      * If the PoD pool is empty, keep checking some space is found, or all
-     * entries have been exhaused.
+     * entries have been exhaused.  When draining, check all entries.
      */
     do
     {
@@ -1132,7 +1157,8 @@ static void pod_eager_reclaim(struct p2m_domain *p2m)
             mrp->list[idx] = gfn_x(INVALID_GFN);
         }
 
-    } while ( (p2m->pod.count == 0) && (i < ARRAY_SIZE(mrp->list)) );
+    } while ( (drain || p2m->pod.count == 0) &&
+              (i < ARRAY_SIZE(mrp->list)) );
 }
 
 static void pod_eager_record(struct p2m_domain *p2m, gfn_t gfn,
@@ -1147,6 +1173,131 @@ static void pod_eager_record(struct p2m_domain *p2m, gfn_t gfn,
     mrp->idx %= ARRAY_SIZE(mrp->list);
 }
 
+static bool pod_below_watermark(const struct p2m_domain *p2m)
+{
+    return p2m->pod.count < POD_CACHE_WATERMARK &&
+           p2m->pod.entry_count > p2m->pod.count;
+}
+
+/*
+ * Reclaim zeroed pages into the cache, from the most recently populated ones
+ * and then sweeping guest memory, until it is back above the watermark or a
+ * full sweep of guest memory found too few.  In the latter case, the
+ * background reclaim is only rearmed once the cache has recovered above the
+ * watermark by other means.
+ *
+ * Each batch holds the p2m lock, stalling the domain's vCPUs as they fault,
+ * so batches are kept small and spaced out by a timer, which runs on another
+ * pCPU than the vCPU which armed it.  The time they hold the lock for is
+ * accounted, alongside the latency of the faults themselves.
+ *
+ * The sweep has its own cursor, leaving p2m_pod_emergency_sweep()'s alone.
+ */
+static void cf_check pod_background_reclaim(void *data)
+{
+    struct p2m_domain *p2m = data;
+    gfn_t gfns[POD_SWEEP_STRIDE];
+    unsigned long i, j = 0, n = 0;
+    long count;
+    s_time_t start, time;
+
+    p2m_lock(p2m);
+    pod_lock(p2m);
+    start = NOW();
+
+    /* See p2m_pod_demand_populate(). */
+    if ( unlikely(p2m->domain->is_dying) )
+    {
+        p2m->pod.reclaim_armed = false;
+        pod_unlock(p2m);
+        p2m_unlock(p2m);
+        return;
+    }
+
+    p2m->defer_nested_flush = true;
+    count = p2m->pod.count;
+
+    pod_eager_reclaim(p2m, true);
+
+    if ( gfn_eq(p2m->pod.reclaim_cursor, _gfn(0)) )
+        p2m->pod.reclaim_cursor = p2m->pod.max_guest;
+
+    for ( i = gfn_x(p2m->pod.reclaim_cursor);
+          i > 0 && n < POD_RECLAIM_BATCH && pod_below_watermark(p2m);
+          i--, n++ )
+    {
+        p2m_type_t t;
+        p2m_access_t a;
+
+        (void)p2m->get_entry(p2m, _gfn(i), &t, &a, 0, NULL, NULL);
+        if ( !p2m_is_ram(t) )
+            continue;
+
+        gfns[j++] = _gfn(i);
+        if ( j == POD_SWEEP_STRIDE )
+        {
+            p2m_pod_zero_check(p2m, gfns, j);
+            j = 0;
+        }
+    }
+
+    if ( j )
+        p2m_pod_zero_check(p2m, gfns, j);
+
+    p2m->pod.reclaim_cursor = _gfn(i);
+    p2m->pod.reclaim_budget -= min(n, p2m->pod.reclaim_budget);
+    p2m->pod.stats.reclaimed += p2m->pod.count - count;
+
+    p2m->pod.reclaim_armed = false;
+    if ( !pod_below_watermark(p2m) )
+        p2m->pod.reclaim_budget = 0;
+    else if ( !p2m->pod.reclaim_budget )
+        p2m->pod.reclaim_spent = true;
+    else
+    {
+        p2m->pod.reclaim_armed = true;
+        set_timer(&p2m->pod.reclaim_timer, NOW() + POD_RECLAIM_PERIOD);
+    }
+
+    time = NOW() - start;
+    p2m->pod.stats.reclaim_runs++;
+    p2m->pod.stats.reclaim_time += time;
+    p2m->pod.stats.reclaim_max = max(p2m->pod.stats.reclaim_max, time);
+
+    pod_unlock_and_flush(p2m);
+    p2m_unlock(p2m);
+}
+
+/* Caller must hold the pod lock. */
+static void pod_arm_reclaim(struct p2m_domain *p2m)
+{
+    unsigned int cpu = smp_processor_id();
+
+    if ( p2m->pod.reclaim_armed )
+        return;
+
+    if ( !p2m->pod.reclaim_budget )
+        p2m->pod.reclaim_budget = gfn_x(p2m->pod.max_guest);
+    p2m->pod.reclaim_armed = true;
+
+    /* Keep the batches off the pCPU of the vCPU which is faulting. */
+    migrate_timer(&p2m->pod.reclaim_timer,
+                  cpumask_cycle(cpu, &cpu_online_map));
+    set_timer(&p2m->pod.reclaim_timer, NOW());
+}
+
+/* Account for a demand populate call, up to the release of the pod lock. */
+static void pod_fault_done(struct p2m_domain *p2m, s_time_t start)
+{
+    s_time_t time = NOW() - start;
+
+    ASSERT(pod_locked_by_me(p2m));
+
+    p2m->pod.stats.faults++;
+    p2m->pod.stats.fault_time += time;
+    p2m->pod.stats.fault_max = max(p2m->pod.stats.fault_max, time);
+}
+
 bool
 p2m_pod_demand_populate(struct p2m_domain *p2m, gfn_t gfn,
                         unsigned int order)
@@ -1156,6 +1307,7 @@ p2m_pod_demand_populate(struct p2m_domain *p2m, gfn_t gfn,
     gfn_t gfn_aligned = _gfn((gfn_x(gfn) >> order) << order);
     mfn_t mfn;
     unsigned long i;
+    s_time_t start = NOW();
 
     if ( !p2m_is_hostp2m(p2m) )
     {
@@ -1183,6 +1335,7 @@ p2m_pod_demand_populate(struct p2m_domain *p2m, gfn_t gfn,
      */
     if ( order == PAGE_ORDER_1G )
     {
+        pod_fault_done(p2m, start);
         pod_unlock(p2m);
         /*
          * Note that we are supposed to call p2m_set_entry() 512 times to
@@ -1199,16 +1352,19 @@ p2m_pod_demand_populate(struct p2m_domain *p2m, gfn_t gfn,
 
     p2m->defer_nested_flush = true;
 
-    /* Only reclaim if we're in actual need of more cache. */
-    if ( p2m->pod.entry_count > p2m->pod.count )
-        pod_eager_reclaim(p2m);
-
     /*
-     * Only sweep if we're actually out of memory.  Doing anything else
+     * Reclaiming is left to pod_background_reclaim(), unless the cache ran
+     * out.  Only sweep if we're actually out of memory.  Doing anything else
      * causes unnecessary time and fragmentation of superpages in the p2m.
      */
     if ( p2m->pod.count == 0 )
+        pod_eager_reclaim(p2m, false);
+
+    if ( p2m->pod.count == 0 )
+    {
+        p2m->pod.stats.sync_sweeps++;
         p2m_pod_emergency_sweep(p2m);
+    }
 
     /* If the sweep failed, give up. */
     if ( p2m->pod.count == 0 )
@@ -1231,7 +1387,7 @@ p2m_pod_demand_populate(struct p2m_domain *p2m, gfn_t gfn,
     if ( p2m_set_entry(p2m, gfn_aligned, mfn, order, p2m_ram_rw,
                        p2m->default_access) )
     {
-        p2m_pod_cache_add(p2m, p, order);
+        p2m_pod_cache_add(p2m, p, order, true);
         goto out_fail;
     }
 
@@ -1246,6 +1402,15 @@ p2m_pod_demand_populate(struct p2m_domain *p2m, gfn_t gfn,
 
     pod_eager_record(p2m, gfn_aligned, order);
 
+    /*
+     * Have the cache topped up in the background, unless the last sweep of
+     * guest memory failed to, and it hasn't recovered since.
+     */
+    if ( !pod_below_watermark(p2m) )
+        p2m->pod.reclaim_spent = false;
+    else if ( !p2m->pod.reclaim_spent )
+        pod_arm_reclaim(p2m);
+
     if ( tb_init_done )
     {
         struct {
@@ -1261,10 +1426,12 @@ p2m_pod_demand_populate(struct p2m_domain *p2m, gfn_t gfn,
         trace(TRC_MEM_POD_POPULATE, sizeof(t), &t);
     }
 
+    pod_fault_done(p2m, start);
     pod_unlock_and_flush(p2m);
     return true;
 
 out_of_memory:
+    pod_fault_done(p2m, start);
     pod_unlock_and_flush(p2m);
 
     printk("%s: Dom%d out of PoD memory! (tot=%"PRIu32" ents=%ld dom%d)\n",
@@ -1274,11 +1441,13 @@ out_of_memory:
     return false;
 
 out_fail:
+    pod_fault_done(p2m, start);
     pod_unlock_and_flush(p2m);
     return false;
 
 remap_and_retry:
     BUG_ON(order != PAGE_ORDER_2M);
+    pod_fault_done(p2m, start);
     pod_unlock_and_flush(p2m);
 
     /*
@@ -1418,6 +1587,8 @@ void p2m_pod_init(struct p2m_domain *p2m)
 
     for ( i = 0; i < ARRAY_SIZE(p2m->pod.mrp.list); ++i )
         p2m->pod.mrp.list[i] = gfn_x(INVALID_GFN);
+
+    init_timer(&p2m->pod.reclaim_timer, pod_background_reclaim, p2m, 0);
 }
 
 bool p2m_pod_active(const struct domain *d)
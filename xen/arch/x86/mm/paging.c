@@ -17,6 +17,7 @@
 #include <asm/event.h>
 #include <asm/hvm/nestedhvm.h>
 #include <xen/numa.h>
+#include <xen/xvmalloc.h>
 #include <xsm/xsm.h>
 #include <public/sched.h> /* SHUTDOWN_suspend */
 
@@ -201,6 +202,208 @@ static int paging_free_log_dirty_bitmap(struct domain *d, int rc)
     return rc;
 }
 
+/*
+ * Dirty ring.  Alongside the bitmap, each pfn is queued on a ring when its
+ * bit first becomes set, so that the toolstack can collect the pages dirtied
+ * since its last pass without walking the whole trie.  Harvested pfns are
+ * re-armed one at a time through the p2m, so the ring is only offered to HAP
+ * guests.
+ */
+#define DIRTY_RING_MAX_ENTRIES  (1U << 20)
+#define DIRTY_RING_BATCH        64
+
+/* Caller must hold the paging lock. */
+static void paging_dirty_ring_push(struct domain *d, pfn_t pfn)
+{
+    struct log_dirty_domain *ld = &d->arch.paging.log_dirty;
+
+    if ( ld->ring_prod - ld->ring_cons == ld->ring_size )
+        ld->ring_overflow = true;
+    else
+        ld->ring[ld->ring_prod++ & (ld->ring_size - 1)] = pfn_x(pfn);
+}
+
+/* Caller must hold the paging lock. */
+static void paging_dirty_ring_reset(struct domain *d)
+{
+    d->arch.paging.log_dirty.ring_prod = 0;
+    d->arch.paging.log_dirty.ring_cons = 0;
+    d->arch.paging.log_dirty.ring_overflow = false;
+}
+
+static void paging_free_dirty_ring(struct domain *d)
+{
+    uint64_t *ring;
+
+    paging_lock(d);
+    ring = d->arch.paging.log_dirty.ring;
+    d->arch.paging.log_dirty.ring = NULL;
+    d->arch.paging.log_dirty.ring_size = 0;
+    paging_dirty_ring_reset(d);
+    paging_unlock(d);
+
+    xvfree(ring);
+}
+
+static int paging_dirty_ring_enable(struct domain *d,
+                                    struct xen_domctl_shadow_op *sc)
+{
+    struct log_dirty_domain *ld = &d->arch.paging.log_dirty;
+    unsigned int size;
+    uint64_t *ring;
+
+    if ( !hap_enabled(d) )
+        return -EOPNOTSUPP;
+
+    if ( !sc->pages || sc->pages > DIRTY_RING_MAX_ENTRIES )
+        return -EINVAL;
+
+    size = 1U << get_count_order(sc->pages);
+    ring = xvmalloc_array(uint64_t, size);
+    if ( !ring )
+        return -ENOMEM;
+
+    paging_lock(d);
+
+    if ( !paging_mode_log_dirty(d) || ld->ring )
+    {
+        paging_unlock(d);
+        xvfree(ring);
+        return -EINVAL;
+    }
+
+    ld->ring = ring;
+    ld->ring_size = size;
+    paging_dirty_ring_reset(d);
+    /* Pages dirtied before now are only in the bitmap. */
+    ld->ring_overflow = ld->dirty_count != 0;
+
+    paging_unlock(d);
+
+    sc->pages = size;
+
+    return 0;
+}
+
+/* Clear a pfn in the log-dirty bitmap.  Caller must hold the paging lock. */
+static void paging_clear_pfn_dirty(struct domain *d, pfn_t pfn)
+{
+    mfn_t mfn, *l4, *l3, *l2;
+    unsigned long *l1;
+
+    mfn = d->arch.paging.log_dirty.top;
+    if ( mfn_eq(mfn, INVALID_MFN) )
+        return;
+
+    l4 = map_domain_page(mfn);
+    mfn = l4[L4_LOGDIRTY_IDX(pfn)];
+    unmap_domain_page(l4);
+    if ( mfn_eq(mfn, INVALID_MFN) )
+        return;
+
+    l3 = map_domain_page(mfn);
+    mfn = l3[L3_LOGDIRTY_IDX(pfn)];
+    unmap_domain_page(l3);
+    if ( mfn_eq(mfn, INVALID_MFN) )
+        return;
+
+    l2 = map_domain_page(mfn);
+    mfn = l2[L2_LOGDIRTY_IDX(pfn)];
+    unmap_domain_page(l2);
+    if ( mfn_eq(mfn, INVALID_MFN) )
+        return;
+
+    l1 = map_domain_page(mfn);
+    __clear_bit(L1_LOGDIRTY_IDX(pfn), l1);
+    unmap_domain_page(l1);
+}
+
+/*
+ * Move up to sc->pages pfns from the ring to the caller's buffer.  Each is
+ * cleared in the bitmap and turned back into logdirty type, which is what
+ * CLEAN does for the whole of memory.  Partial progress is reported rather
+ * than continued: the caller simply asks again if it wants more.
+ */
+static int paging_dirty_ring_harvest(struct domain *d,
+                                     struct xen_domctl_shadow_op *sc)
+{
+    struct log_dirty_domain *ld = &d->arch.paging.log_dirty;
+    struct p2m_domain *p2m = p2m_get_hostp2m(d);
+    uint64_t batch[DIRTY_RING_BATCH];
+    unsigned long done = 0;
+    unsigned int i, n;
+    int rc = 0;
+
+    if ( !ld->ring )
+        return -EINVAL;
+
+    domain_pause(d);
+
+    /* As for CLEAN, pick up dirty GFNs still cached by hardware. */
+    p2m_flush_hardware_cached_dirty(d);
+
+    sc->mode = 0;
+
+    while ( done < sc->pages )
+    {
+        paging_lock(d);
+
+        if ( ld->ring_overflow )
+            sc->mode |= XEN_DOMCTL_SHADOW_DIRTY_RING_OVERFLOW;
+
+        n = min(ld->ring_prod - ld->ring_cons, DIRTY_RING_BATCH + 0U);
+        n = min(sc->pages - done, n + 0UL);
+        for ( i = 0; i < n; i++ )
+            batch[i] = ld->ring[(ld->ring_cons + i) & (ld->ring_size - 1)];
+
+        if ( n && copy_to_guest_offset(sc->dirty_bitmap,
+                                       done * sizeof(*batch),
+                                       (uint8_t *)batch,
+                                       n * sizeof(*batch)) )
+        {
+            paging_unlock(d);
+            rc = -EFAULT;
+            break;
+        }
+
+        for ( i = 0; i < n; i++ )
+            paging_clear_pfn_dirty(d, _pfn(batch[i]));
+        ld->ring_cons += n;
+        /* Each entry was counted when its bit was set, and is now clear. */
+        ASSERT(ld->dirty_count >= n);
+        ld->dirty_count -= n;
+
+        paging_unlock(d);
+
+        if ( !n )
+            break;
+
+        /*
+         * The domain is paused, so its vCPUs can't write these meanwhile.
+         * Backends can, but they mark the page dirty explicitly, whatever
+         * its type, which queues it again.
+         */
+        p2m_lock(p2m);
+        for ( i = 0; i < n; i++ )
+            p2m_change_type_one(d, batch[i], p2m_ram_rw, p2m_ram_logdirty);
+        p2m_unlock(p2m);
+
+        done += n;
+
+        if ( hypercall_preempt_check() )
+            break;
+    }
+
+    if ( done )
+        guest_flush_tlb_mask(d, d->dirty_cpumask);
+
+    domain_unpause(d);
+
+    sc->pages = done;
+
+    return rc;
+}
+
 static int paging_log_dirty_enable(struct domain *d)
 {
     int ret;
@@ -231,6 +434,7 @@ static int paging_log_dirty_disable(struct domain *d, bool resuming)
     if ( !resuming )
     {
         domain_pause(d);
+        paging_free_dirty_ring(d);
         /* Safe because the domain is paused. */
         if ( paging_mode_log_dirty(d) )
         {
@@ -319,6 +523,8 @@ void paging_mark_pfn_dirty(struct domain *d, pfn_t pfn)
                      "d%d: marked mfn %" PRI_mfn " (pfn %" PRI_pfn ")\n",
                      d->domain_id, mfn_x(mfn), pfn_x(pfn));
         d->arch.paging.log_dirty.dirty_count++;
+        if ( d->arch.paging.log_dirty.ring )
+            paging_dirty_ring_push(d, pfn);
     }
 
 out:
@@ -425,8 +631,26 @@ static int paging_log_dirty_op(struct domain *d,
     paging_lock(d);
 
     if ( !d->arch.paging.preempt.dom )
+    {
+        struct log_dirty_domain *ld = &d->arch.paging.log_dirty;
+
         memset(&d->arch.paging.preempt.log_dirty, 0,
                sizeof(d->arch.paging.preempt.log_dirty));
+        /*
+         * The bitmap about to be returned covers everything on the dirty
+         * ring, and in the stats.  Anything dirtied from here on, including
+         * by backends while the bitmap is walked, is counted and queued
+         * afresh, so the count always covers what is on the ring.
+         */
+        if ( sc->op == XEN_DOMCTL_SHADOW_OP_CLEAN )
+        {
+            d->arch.paging.preempt.log_dirty.fault_count = ld->fault_count;
+            d->arch.paging.preempt.log_dirty.dirty_count = ld->dirty_count;
+            ld->fault_count = 0;
+            ld->dirty_count = 0;
+            paging_dirty_ring_reset(d);
+        }
+    }
     else if ( d->arch.paging.preempt.dom != current->domain ||
               d->arch.paging.preempt.op != sc->op )
     {
@@ -444,10 +668,22 @@ static int paging_log_dirty_op(struct domain *d,
                  d->arch.paging.log_dirty.fault_count,
                  d->arch.paging.log_dirty.dirty_count);
 
-    sc->stats.fault_count = min(d->arch.paging.log_dirty.fault_count,
-                                UINT32_MAX + 0UL);
-    sc->stats.dirty_count = min(d->arch.paging.log_dirty.dirty_count,
-                                UINT32_MAX + 0UL);
+    if ( clean )
+    {
+        sc->stats.fault_count =
+            min(d->arch.paging.preempt.log_dirty.fault_count,
+                UINT32_MAX + 0UL);
+        sc->stats.dirty_count =
+            min(d->arch.paging.preempt.log_dirty.dirty_count,
+                UINT32_MAX + 0UL);
+    }
+    else
+    {
+        sc->stats.fault_count = min(d->arch.paging.log_dirty.fault_count,
+                                    UINT32_MAX + 0UL);
+        sc->stats.dirty_count = min(d->arch.paging.log_dirty.dirty_count,
+                                    UINT32_MAX + 0UL);
+    }
 
     if ( guest_handle_is_null(sc->dirty_bitmap) )
         /* caller may have wanted just to clean the state or access stats. */
@@ -531,14 +767,7 @@ static int paging_log_dirty_op(struct domain *d,
         unmap_domain_page(l4);
 
     if ( !rv )
-    {
         d->arch.paging.preempt.dom = NULL;
-        if ( clean )
-        {
-            d->arch.paging.log_dirty.fault_count = 0;
-            d->arch.paging.log_dirty.dirty_count = 0;
-        }
-    }
     else
     {
         d->arch.paging.preempt.dom = current->domain;
@@ -740,6 +969,12 @@ int paging_domctl(struct domain *d, struct xen_domctl_shadow_op *sc,
         if ( sc->mode & ~XEN_DOMCTL_SHADOW_LOGDIRTY_FINAL )
             return -EINVAL;
         return paging_log_dirty_op(d, sc, resuming);
+
+    case XEN_DOMCTL_SHADOW_OP_DIRTY_RING_ENABLE:
+        return paging_dirty_ring_enable(d, sc);
+
+    case XEN_DOMCTL_SHADOW_OP_DIRTY_RING_HARVEST:
+        return paging_dirty_ring_harvest(d, sc);
     }
 
     /* Here, dispatch domctl to the appropriate paging code */
@@ -816,6 +1051,7 @@ int paging_teardown(struct domain *d)
 
 #if PG_log_dirty
     /* clean up log dirty resources. */
+    paging_free_dirty_ring(d);
     rc = paging_free_log_dirty_bitmap(d, 0);
     if ( rc == -ERESTART )
         return rc;
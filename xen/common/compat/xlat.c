@@ -66,6 +66,10 @@ CHECK_evtchn_init_control;
 CHECK_evtchn_reset;
 #undef xen_evtchn_reset
 
+#define xen_evtchn_send_many evtchn_send_many
+CHECK_evtchn_send_many;
+#undef xen_evtchn_send_many
+
 #define xen_evtchn_set_priority evtchn_set_priority
 CHECK_evtchn_set_priority;
 #undef xen_evtchn_set_priority
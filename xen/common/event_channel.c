@@ -27,6 +27,7 @@
 #include <xen/hypercall.h>
 #include <xen/keyhandler.h>
 #include <xen/sections.h>
+#include <xen/softirq.h>
 
 #include <asm/current.h>
 
@@ -899,6 +900,48 @@ out:
     return ret;
 }
 
+static long evtchn_send_many(struct domain *ld,
+                             XEN_GUEST_HANDLE_PARAM(void) arg)
+{
+    /* <nr_ports> is followed by the ports, so index the struct as an array. */
+    XEN_GUEST_HANDLE_PARAM(evtchn_port_t) ports =
+        guest_handle_cast(arg, evtchn_port_t);
+    evtchn_port_t buf[16];
+    unsigned int nr, done, n, i;
+    long rc = 0;
+
+    if ( copy_from_guest(&nr, ports, 1) != 0 )
+        return -EFAULT;
+    if ( nr > EVTCHN_SEND_MANY_MAX )
+        return -E2BIG;
+
+    /* Notifications to vCPUs on the same pCPU then need only one IPI. */
+    cpu_raise_softirq_batch_begin();
+
+    for ( done = 0; done < nr; done += n )
+    {
+        n = min_t(unsigned int, nr - done, ARRAY_SIZE(buf));
+        if ( copy_from_guest_offset(buf, ports, 1 + done, n) != 0 )
+        {
+            if ( !rc )
+                rc = -EFAULT;
+            break;
+        }
+
+        for ( i = 0; i < n; i++ )
+        {
+            int ret = evtchn_send(ld, buf[i]);
+
+            if ( ret && !rc )
+                rc = ret;
+        }
+    }
+
+    cpu_raise_softirq_batch_finish();
+
+    return rc;
+}
+
 bool evtchn_virq_enabled(const struct vcpu *v, unsigned int virq)
 {
     if ( !v )
@@ -1423,6 +1466,10 @@ long do_event_channel_op(int cmd, XEN_GUEST_HANDLE_PARAM(void) arg)
         break;
     }
 
+    case EVTCHNOP_send_many:
+        rc = evtchn_send_many(current->domain, arg);
+        break;
+
     case EVTCHNOP_status: {
         struct evtchn_status status;
         if ( copy_from_guest(&status, arg, 1) != 0 )
@@ -2864,25 +2864,40 @@ struct gnttab_copy_buf {
     bool have_type;
 };
 
+/*
+ * Backends typically copy to or from the same few grants or frames many
+ * times within one batch.  Keep that many source and destination buffers
+ * claimed and mapped across the ops of a GNTTABOP_copy invocation, so that
+ * they are only acquired and released once per batch.
+ */
+#define GNTTAB_COPY_CACHE_SIZE 4
+
+struct gnttab_copy_cache {
+    struct domain *domain;
+    domid_t domid;
+    unsigned int next;                  /* Next entry to replace. */
+    struct gnttab_copy_buf buf[GNTTAB_COPY_CACHE_SIZE];
+};
+
 static int gnttab_copy_lock_domain(domid_t domid, bool is_gref,
-                                   struct gnttab_copy_buf *buf)
+                                   struct gnttab_copy_cache *cache)
 {
     /* Only DOMID_SELF may reference via frame. */
     if ( domid != DOMID_SELF && !is_gref )
         return GNTST_permission_denied;
 
-    buf->domain = rcu_lock_domain_by_any_id(domid);
+    cache->domain = rcu_lock_domain_by_any_id(domid);
 
-    if ( !buf->domain )
+    if ( !cache->domain )
         return GNTST_bad_domain;
 
-    buf->ptr.domid = domid;
+    cache->domid = domid;
 
     return GNTST_okay;
 }
 
-static void gnttab_copy_unlock_domains(struct gnttab_copy_buf *src,
-                                       struct gnttab_copy_buf *dest)
+static void gnttab_copy_unlock_domains(struct gnttab_copy_cache *src,
+                                       struct gnttab_copy_cache *dest)
 {
     if ( src->domain )
     {
@@ -2897,11 +2912,13 @@ static void gnttab_copy_unlock_domains(struct gnttab_copy_buf *src,
 }
 
 static int gnttab_copy_lock_domains(const struct gnttab_copy *op,
-                                    struct gnttab_copy_buf *src,
-                                    struct gnttab_copy_buf *dest)
+                                    struct gnttab_copy_cache *src,
+                                    struct gnttab_copy_cache *dest)
 {
     int rc;
 
+    perfc_incr(gnttab_copy_lock_domains);
+
     rc = gnttab_copy_lock_domain(op->source.domid,
                                  op->flags & GNTCOPY_source_gref, src);
     if ( rc < 0 )
@@ -3015,7 +3032,58 @@ static bool gnttab_copy_buf_valid(
         return 0;
     if ( has_gref )
         return b->have_grant && p->u.ref == b->ptr.u.ref;
-    return p->u.gmfn == b->ptr.u.gmfn;
+    return !b->have_grant && p->u.gmfn == b->ptr.u.gmfn;
+}
+
+static void gnttab_copy_flush_cache(struct gnttab_copy_cache *cache)
+{
+    unsigned int i;
+
+    for ( i = 0; i < ARRAY_SIZE(cache->buf); i++ )
+        gnttab_copy_release_buf(&cache->buf[i]);
+    cache->next = 0;
+}
+
+/*
+ * Find the buffer for ptr in cache, claiming and mapping it in place of
+ * the least recently claimed entry if it isn't there yet.
+ */
+static int gnttab_copy_get_buf(const struct gnttab_copy *op,
+                               const struct gnttab_copy_ptr *ptr,
+                               struct gnttab_copy_cache *cache,
+                               unsigned int gref_flag,
+                               struct gnttab_copy_buf **pbuf)
+{
+    struct gnttab_copy_buf *buf;
+    unsigned int i;
+    int rc;
+
+    for ( i = 0; i < ARRAY_SIZE(cache->buf); i++ )
+    {
+        buf = &cache->buf[i];
+        if ( gnttab_copy_buf_valid(ptr, buf, op->flags & gref_flag) )
+        {
+            perfc_incr(gnttab_copy_cache_hit);
+            *pbuf = buf;
+            return GNTST_okay;
+        }
+    }
+
+    buf = &cache->buf[cache->next];
+    cache->next = (cache->next + 1) % ARRAY_SIZE(cache->buf);
+
+    gnttab_copy_release_buf(buf);
+    buf->domain = cache->domain;
+    perfc_incr(gnttab_copy_claim);
+    rc = gnttab_copy_claim_buf(op, ptr, buf, gref_flag);
+    if ( rc != GNTST_okay )
+    {
+        gnttab_copy_release_buf(buf);
+        return rc;
+    }
+
+    *pbuf = buf;
+    return GNTST_okay;
 }
 
 static int gnttab_copy_buf(const struct gnttab_copy *op,
@@ -3057,19 +3125,20 @@ static int gnttab_copy_buf(const struct gnttab_copy *op,
 }
 
 static int gnttab_copy_one(const struct gnttab_copy *op,
-                           struct gnttab_copy_buf *dest,
-                           struct gnttab_copy_buf *src)
+                           struct gnttab_copy_cache *dest,
+                           struct gnttab_copy_cache *src)
 {
+    struct gnttab_copy_buf *dbuf, *sbuf;
     int rc;
 
     if ( unlikely(!op->len) )
         return GNTST_okay;
 
-    if ( !src->domain || op->source.domid != src->ptr.domid ||
-         !dest->domain || op->dest.domid != dest->ptr.domid )
+    if ( !src->domain || op->source.domid != src->domid ||
+         !dest->domain || op->dest.domid != dest->domid )
     {
-        gnttab_copy_release_buf(src);
-        gnttab_copy_release_buf(dest);
+        gnttab_copy_flush_cache(src);
+        gnttab_copy_flush_cache(dest);
         gnttab_copy_unlock_domains(src, dest);
 
         rc = gnttab_copy_lock_domains(op, src, dest);
@@ -3077,27 +3146,16 @@ static int gnttab_copy_one(const struct gnttab_copy *op,
             goto out;
     }
 
-    /* Different source? */
-    if ( !gnttab_copy_buf_valid(&op->source, src,
-                                op->flags & GNTCOPY_source_gref) )
-    {
-        gnttab_copy_release_buf(src);
-        rc = gnttab_copy_claim_buf(op, &op->source, src, GNTCOPY_source_gref);
-        if ( rc )
-            goto out;
-    }
+    rc = gnttab_copy_get_buf(op, &op->source, src, GNTCOPY_source_gref,
+                             &sbuf);
+    if ( rc )
+        goto out;
 
-    /* Different dest? */
-    if ( !gnttab_copy_buf_valid(&op->dest, dest,
-                                op->flags & GNTCOPY_dest_gref) )
-    {
-        gnttab_copy_release_buf(dest);
-        rc = gnttab_copy_claim_buf(op, &op->dest, dest, GNTCOPY_dest_gref);
-        if ( rc )
-            goto out;
-    }
+    rc = gnttab_copy_get_buf(op, &op->dest, dest, GNTCOPY_dest_gref, &dbuf);
+    if ( rc )
+        goto out;
 
-    rc = gnttab_copy_buf(op, dest, src);
+    rc = gnttab_copy_buf(op, dbuf, sbuf);
  out:
     return rc;
 }
@@ -3115,8 +3173,8 @@ static long gnttab_copy(
 {
     unsigned int i;
     struct gnttab_copy op;
-    struct gnttab_copy_buf src = {};
-    struct gnttab_copy_buf dest = {};
+    struct gnttab_copy_cache src = {};
+    struct gnttab_copy_cache dest = {};
     long rc = 0;
 
     for ( i = 0; i < count; i++ )
@@ -3133,6 +3191,7 @@ static long gnttab_copy(
             break;
         }
 
+        perfc_incr(gnttab_copy_ops);
         rc = gnttab_copy_one(&op, &dest, &src);
         if ( rc > 0 )
         {
@@ -3141,8 +3200,8 @@ static long gnttab_copy(
         }
         if ( rc != GNTST_okay )
         {
-            gnttab_copy_release_buf(&src);
-            gnttab_copy_release_buf(&dest);
+            gnttab_copy_flush_cache(&src);
+            gnttab_copy_flush_cache(&dest);
         }
 
         op.status = rc;
@@ -3155,8 +3214,8 @@ static long gnttab_copy(
         guest_handle_add_offset(uop, 1);
     }
 
-    gnttab_copy_release_buf(&src);
-    gnttab_copy_release_buf(&dest);
+    gnttab_copy_flush_cache(&src);
+    gnttab_copy_flush_cache(&dest);
     gnttab_copy_unlock_domains(&src, &dest);
 
     return rc;
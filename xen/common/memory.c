@@ -26,6 +26,7 @@
 #include <xen/sections.h>
 #include <xen/trace.h>
 #include <xen/types.h>
+#include <xen/vm_event.h>
 #include <asm/current.h>
 #include <asm/hardirq.h>
 #include <asm/p2m.h>
@@ -1039,6 +1040,9 @@ static int construct_memop_from_reservation(
         a->memflags = MEMF_bits(address_bits);
     }
 
+    if ( r->mem_flags & XENMEMF_prefer_scrubbed )
+        a->memflags |= MEMF_prefer_scrubbed;
+
     if ( r->mem_flags & XENMEMF_vnode )
     {
         nodeid_t vnode, pnode;
@@ -1142,7 +1146,7 @@ static unsigned int ioreq_server_max_frames(const struct domain *d)
  * property of the domain), and describe the full resource (i.e. mapping the
  * result of this call will be the entire resource).
  */
-static unsigned int resource_max_frames(const struct domain *d,
+static unsigned int resource_max_frames(struct domain *d,
                                         unsigned int type, unsigned int id)
 {
     switch ( type )
@@ -1156,6 +1160,9 @@ static unsigned int resource_max_frames(const struct domain *d,
     case XENMEM_resource_vmtrace_buf:
         return d->vmtrace_size >> PAGE_SHIFT;
 
+    case XENMEM_resource_vm_event:
+        return vm_event_ring_max_frames(d, id);
+
     default:
         return 0;
     }
@@ -1239,6 +1246,9 @@ static int _acquire_resource(
     case XENMEM_resource_vmtrace_buf:
         return acquire_vmtrace_buf(d, id, frame, nr_frames, mfn_list);
 
+    case XENMEM_resource_vm_event:
+        return vm_event_acquire_ring(d, id, frame, nr_frames, mfn_list);
+
     default:
         ASSERT_UNREACHABLE();
         return -EOPNOTSUPP;
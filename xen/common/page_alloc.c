@@ -851,6 +851,12 @@ static void check_and_stop_scrub(struct page_info *head)
     }
 }
 
+/*
+ * Single pages preferring scrubbed memory break clean buddies of at most this
+ * order, below 2MiB, and leave clean superpages to the requests needing them.
+ */
+#define PREFER_SCRUBBED_MAX_ORDER (21 - PAGE_SHIFT - 1)
+
 static struct page_info *get_free_buddy(unsigned int zone_lo,
                                         unsigned int zone_hi,
                                         unsigned int order, unsigned int memflags,
@@ -858,9 +864,17 @@ static struct page_info *get_free_buddy(unsigned int zone_lo,
 {
     nodeid_t first, node = MEMF_get_node(memflags), req_node = node;
     nodemask_t nodemask = node_online_map;
-    unsigned int j, zone, nodemask_retry = 0;
+    unsigned int j, zone, nodemask_retry = 0, max_order = MAX_ORDER;
     struct page_info *pg;
     bool use_unscrubbed = (memflags & MEMF_no_scrub);
+    bool prefer_scrubbed = order == 0 && (memflags & MEMF_prefer_scrubbed);
+
+    /*
+     * Past that order, a single page is rather taken dirty, by the caller's
+     * MEMF_no_scrub retry, like any other.
+     */
+    if ( prefer_scrubbed && !use_unscrubbed )
+        max_order = PREFER_SCRUBBED_MAX_ORDER;
 
     /*
      * d->node_affinity is our preferred allocation set if provided, but it
@@ -907,7 +921,7 @@ static struct page_info *get_free_buddy(unsigned int zone_lo,
                 continue;
 
             /* Find smallest order which can satisfy the request. */
-            for ( j = order; j <= MAX_ORDER; j++ )
+            for ( j = order; j <= max_order; j++ )
             {
                 if ( (pg = page_list_remove_head(&heap(node, zone, j))) )
                 {
@@ -916,9 +930,10 @@ static struct page_info *get_free_buddy(unsigned int zone_lo,
                     /*
                      * We grab single pages (order=0) even if they are
                      * unscrubbed. Given that scrubbing one page is fairly quick
-                     * it is not worth breaking higher orders.
+                     * it is not worth breaking higher orders.  Callers
+                     * allocating lots of single pages may ask otherwise.
                      */
-                    if ( (order == 0) || use_unscrubbed )
+                    if ( (order == 0 && !prefer_scrubbed) || use_unscrubbed )
                     {
                         check_and_stop_scrub(pg);
                         return pg;
@@ -1486,8 +1501,8 @@ static bool mark_page_free(struct page_info *pg, mfn_t mfn)
 
 static void free_color_heap_page(struct page_info *pg, bool need_scrub);
 
-/* Free 2^@order set of pages. */
-static void free_heap_pages(
+/* Free 2^@order set of pages, with the heap lock held. */
+static void free_heap_pages_locked(
     struct page_info *pg, unsigned int order, bool need_scrub)
 {
     unsigned long mask;
@@ -1497,8 +1512,7 @@ static void free_heap_pages(
     bool pg_offlined = false;
 
     ASSERT(order <= MAX_ORDER);
-
-    spin_lock(&heap_lock);
+    ASSERT(spin_is_locked(&heap_lock));
 
     for ( i = 0; i < (1 << order); i++ )
     {
@@ -1516,7 +1530,6 @@ static void free_heap_pages(
             ASSERT(order == 0);
 
             free_color_heap_page(pg, need_scrub);
-            spin_unlock(&heap_lock);
             return;
         }
     }
@@ -1590,7 +1603,14 @@ static void free_heap_pages(
 
     if ( pg_offlined )
         reserve_offlined_page(pg);
+}
 
+/* Free 2^@order set of pages. */
+static void free_heap_pages(
+    struct page_info *pg, unsigned int order, bool need_scrub)
+{
+    spin_lock(&heap_lock);
+    free_heap_pages_locked(pg, order, need_scrub);
     spin_unlock(&heap_lock);
 }
 
@@ -2779,6 +2799,51 @@ void free_domheap_pages(struct page_info *pg, unsigned int order)
         put_domain(d);
 }
 
+/*
+ * Free a list of order-0 pages of @d whose last reference has gone, taking
+ * d->page_alloc_lock and the heap lock once for the whole list rather than
+ * once per page.  Unlike for free_domheap_pages(), the pages must already
+ * be off the domain's page lists.
+ */
+void free_domheap_page_list(struct domain *d, struct page_list_head *list)
+{
+    struct page_info *pg;
+    unsigned long nr = 0;
+    bool drop_dom_ref, scrub;
+
+    ASSERT_ALLOC_CONTEXT();
+
+    rspin_lock(&d->page_alloc_lock);
+
+    page_list_for_each ( pg, list )
+    {
+        BUG_ON(is_xen_heap_page(pg));
+        BUG_ON(pg->u.inuse.type_info & PGT_count_mask);
+        if ( pg->count_info & PGC_extra )
+        {
+            ASSERT(d->extra_pages);
+            d->extra_pages--;
+        }
+        nr++;
+    }
+
+    drop_dom_ref = nr && !domain_adjust_tot_pages(d, -nr);
+
+    rspin_unlock(&d->page_alloc_lock);
+
+    /* As for free_domheap_pages(). */
+    scrub = d->is_dying || mem_paging_enabled(d) ||
+            scrub_debug || opt_scrub_domheap;
+
+    spin_lock(&heap_lock);
+    while ( (pg = page_list_remove_head(list)) )
+        free_heap_pages_locked(pg, 0, scrub);
+    spin_unlock(&heap_lock);
+
+    if ( drop_dom_ref )
+        put_domain(d);
+}
+
 unsigned long avail_domheap_pages_region(
     unsigned int node, unsigned int min_width, unsigned int max_width)
 {
@@ -234,6 +234,107 @@ static int perfc_copy_info(XEN_GUEST_HANDLE_64(xen_sysctl_perfc_desc_t) desc,
     return 0;
 }
 
+static int perfc_sample(struct xen_sysctl_perfc_op *pc)
+{
+    static unsigned int perfc_offset[NR_PERFCTRS];
+    static bool perfc_offset_valid;
+    unsigned int i, nr_cpus = min(pc->nr_cpus, nr_cpu_ids);
+    xen_sysctl_perfc_val_t *row;
+    int rc = 0;
+
+    pc->now = NOW();
+
+    if ( !pc->nr_sel )
+        goto out;
+    if ( pc->nr_sel > XEN_SYSCTL_PERFC_MAX_SEL )
+        return -E2BIG;
+    if ( !nr_cpus )
+        return -EINVAL;
+
+    /* Offset of each counter's first value in the per-CPU arrays. */
+    if ( !perfc_offset_valid )
+    {
+        unsigned int j = 0;
+
+        for ( i = 0; i < NR_PERFCTRS; i++ )
+        {
+            perfc_offset[i] = j;
+            j += perfc_info[i].type == TYPE_ARRAY ||
+                 perfc_info[i].type == TYPE_S_ARRAY
+                 ? perfc_info[i].nr_elements : 1;
+        }
+        perfc_offset_valid = true;
+    }
+
+    row = xmalloc_array(xen_sysctl_perfc_val_t, nr_cpus);
+    if ( !row )
+        return -ENOMEM;
+
+    for ( i = 0; i < pc->nr_sel; i++ )
+    {
+        struct xen_sysctl_perfc_sel sel;
+        unsigned int cpu, first, nr = 1;
+
+        if ( copy_from_guest_offset(&sel, pc->sel, i, 1) )
+        {
+            rc = -EFAULT;
+            break;
+        }
+
+        if ( sel.counter >= NR_PERFCTRS )
+        {
+            rc = -EINVAL;
+            break;
+        }
+
+        first = perfc_offset[sel.counter];
+        if ( perfc_info[sel.counter].type == TYPE_ARRAY ||
+             perfc_info[sel.counter].type == TYPE_S_ARRAY )
+        {
+            if ( sel.element == XEN_SYSCTL_PERFC_ELEMENT_ALL )
+                nr = perfc_info[sel.counter].nr_elements;
+            else if ( sel.element < perfc_info[sel.counter].nr_elements )
+                first += sel.element;
+            else
+            {
+                rc = -EINVAL;
+                break;
+            }
+        }
+        else if ( sel.element && sel.element != XEN_SYSCTL_PERFC_ELEMENT_ALL )
+        {
+            rc = -EINVAL;
+            break;
+        }
+
+        for ( cpu = 0; cpu < nr_cpus; cpu++ )
+        {
+            const perfc_t *counters;
+            unsigned int k;
+
+            row[cpu] = 0;
+            if ( !cpu_online(cpu) )
+                continue;
+            counters = per_cpu(perfcounters, cpu) + first;
+            for ( k = 0; k < nr; k++ )
+                row[cpu] += counters[k];
+        }
+
+        if ( copy_to_guest_offset(pc->val, i * nr_cpus, row, nr_cpus) )
+        {
+            rc = -EFAULT;
+            break;
+        }
+    }
+
+    xfree(row);
+
+ out:
+    pc->nr_cpus = nr_cpu_ids;
+
+    return rc;
+}
+
 /* Dom0 control of perf counters */
 int perfc_control(struct xen_sysctl_perfc_op *pc)
 {
@@ -253,6 +354,10 @@ int perfc_control(struct xen_sysctl_perfc_op *pc)
         rc = perfc_copy_info(pc->desc, pc->val);
         break;
 
+    case XEN_SYSCTL_PERFCOP_sample:
+        rc = perfc_sample(pc);
+        break;
+
     default:
         rc = -EINVAL;
         break;
@@ -142,6 +142,7 @@
 #define TRC_CSCHED_SCHEDULE      TRC_SCHED_CLASS_EVT(CSCHED, 9)
 #define TRC_CSCHED_RATELIMIT     TRC_SCHED_CLASS_EVT(CSCHED, 10)
 #define TRC_CSCHED_STEAL_CHECK   TRC_SCHED_CLASS_EVT(CSCHED, 11)
+#define TRC_CSCHED_LOAD_BALANCE  TRC_SCHED_CLASS_EVT(CSCHED, 12)
 
 /*
  * Boot parameters
@@ -152,6 +153,17 @@ integer_param("sched_credit_tslice_ms", sched_credit_tslice_ms);
 /*
  * Physical CPU
  */
+/*
+ * Last level cache domain: the CPUs of a package which are in the same
+ * node.
+ */
+struct csched_llc {
+    unsigned int socket;
+    nodeid_t node;
+    /* CPUs with units waiting in their runq, which can be stolen. */
+    cpumask_t stealable;
+};
+
 struct csched_pcpu {
     struct list_head runq;
     uint32_t runq_sort_last;
@@ -159,6 +171,7 @@ struct csched_pcpu {
     unsigned int idle_bias;
     unsigned int nr_runnable;
     s_time_t last_load_balance;
+    struct csched_llc *llc;
 
     unsigned int tick;
     struct timer ticker;
@@ -218,6 +231,12 @@ struct csched_private {
 
     cpumask_var_t idlers;
     cpumask_var_t cpus;
+    /*
+     * The LLC domains of our CPUs.  They are only ever added to, until
+     * csched_deinit(), so load balancing can walk them without the lock.
+     */
+    struct csched_llc **llcs;
+    unsigned int nr_llcs;
     uint32_t *balance_bias;
     uint32_t runq_sort;
     uint32_t ncpus;
@@ -263,20 +282,32 @@ static inline bool is_runq_idle(unsigned int cpu)
            is_idle_unit(__runq_elem(RUNQ(cpu)->next)->unit);
 }
 
+/*
+ * The unit running on a pCPU is accounted in its nr_runnable as well, so
+ * there is something to steal from its runq only when there is more than
+ * one.  Keep the stealable mask of the pCPU's LLC in sync with that, so
+ * load balancing can tell which runqueues are worth looking at without
+ * touching them.  Only the CPUs of an LLC write its mask.
+ */
 static inline void
 inc_nr_runnable(unsigned int cpu)
 {
-    ASSERT(spin_is_locked(get_sched_res(cpu)->schedule_lock));
-    CSCHED_PCPU(cpu)->nr_runnable++;
+    struct csched_pcpu *spc = CSCHED_PCPU(cpu);
 
+    ASSERT(spin_is_locked(get_sched_res(cpu)->schedule_lock));
+    if ( ++spc->nr_runnable == 2 )
+        cpumask_set_cpu(cpu, &spc->llc->stealable);
 }
 
 static inline void
 dec_nr_runnable(unsigned int cpu)
 {
+    struct csched_pcpu *spc = CSCHED_PCPU(cpu);
+
     ASSERT(spin_is_locked(get_sched_res(cpu)->schedule_lock));
-    ASSERT(CSCHED_PCPU(cpu)->nr_runnable >= 1);
-    CSCHED_PCPU(cpu)->nr_runnable--;
+    ASSERT(spc->nr_runnable >= 1);
+    if ( --spc->nr_runnable == 1 )
+        cpumask_clear_cpu(cpu, &spc->llc->stealable);
 }
 
 static inline void
@@ -554,6 +585,7 @@ csched_deinit_pdata(const struct scheduler *ops, void *pcpu, int cpu)
     prv->credit -= prv->credits_per_tslice;
     prv->ncpus--;
     cpumask_clear_cpu(cpu, prv->idlers);
+    cpumask_clear_cpu(cpu, &spc->llc->stealable);
     cpumask_clear_cpu(cpu, prv->cpus);
     if ( (prv->master == cpu) && (prv->ncpus > 0) )
     {
@@ -576,12 +608,54 @@ csched_deinit_pdata(const struct scheduler *ops, void *pcpu, int cpu)
 static void *cf_check
 csched_alloc_pdata(const struct scheduler *ops, int cpu)
 {
+    struct csched_private *prv = CSCHED_PRIV(ops);
     struct csched_pcpu *spc;
+    struct csched_llc *llc = NULL, *llc_new;
+    unsigned long flags;
+    unsigned int i;
 
     /* Allocate per-PCPU info */
     spc = xzalloc(struct csched_pcpu);
-    if ( spc == NULL )
+    /* Prealloc the LLC in case we need it - not allowed with interrupts off. */
+    llc_new = xzalloc(struct csched_llc);
+    if ( spc == NULL || llc_new == NULL )
+    {
+        xfree(llc_new);
+        xfree(spc);
         return ERR_PTR(-ENOMEM);
+    }
+
+    spin_lock_irqsave(&prv->lock, flags);
+
+    for ( i = 0; i < prv->nr_llcs; i++ )
+        if ( prv->llcs[i]->socket == cpu_to_socket(cpu) &&
+             prv->llcs[i]->node == cpu_to_node(cpu) )
+        {
+            llc = prv->llcs[i];
+            break;
+        }
+
+    if ( !llc && prv->nr_llcs < nr_cpu_ids )
+    {
+        llc = llc_new;
+        llc_new = NULL;
+        llc->socket = cpu_to_socket(cpu);
+        llc->node = cpu_to_node(cpu);
+        prv->llcs[prv->nr_llcs] = llc;
+        /* Pairs with the smp_rmb() in csched_load_balance(). */
+        smp_wmb();
+        prv->nr_llcs++;
+    }
+
+    spin_unlock_irqrestore(&prv->lock, flags);
+
+    xfree(llc_new);
+    if ( !llc )
+    {
+        xfree(spc);
+        return ERR_PTR(-ENOSPC);
+    }
+    spc->llc = llc;
 
     return spc;
 }
@@ -618,6 +692,7 @@ init_pdata(struct csched_private *prv, struct csched_pcpu *spc, int cpu)
     /* Start off idling... */
     BUG_ON(!is_idle_unit(curr_on_cpu(cpu)));
     cpumask_set_cpu(cpu, prv->idlers);
+    cpumask_clear_cpu(cpu, &spc->llc->stealable);
     spc->nr_runnable = 0;
 
     spc->last_load_balance = NOW();
@@ -1698,15 +1773,135 @@ csched_runq_steal(int peer_cpu, int cpu, int pri, int balance_step)
 static unsigned int __ro_after_init load_balance_ratelimit_us = CSCHED_DEFAULT_LOAD_BALANCE_RATELIMIT_US;
 integer_param("load-balance-ratelimit", load_balance_ratelimit_us);
 
+/*
+ * Load balancing looks for work to steal from the closest CPUs first: our
+ * SMT siblings, which share all our caches, then the other CPUs in our
+ * LLC, then the other LLCs of our node and, finally, the other nodes.  The
+ * part of a package within a node is the closest approximation of the
+ * last level cache domain that all architectures describe.
+ */
+enum {
+    STEAL_SIBLING,
+    STEAL_LLC,
+    STEAL_NODE,
+    STEAL_REMOTE,
+    STEAL_NONE,
+};
+
+/*
+ * Try stealing a unit from any of the pCPUs in workers, which are all in
+ * the same distance level from cpu.  We start from the next pCPU, with
+ * respect to the one we last stole from in this node, so we don't risk
+ * stealing always from the same ones.
+ */
+static struct csched_unit *
+csched_steal_from(struct csched_private *prv, int cpu,
+                  const struct csched_unit *snext, int bstep,
+                  cpumask_t *workers, unsigned int node, unsigned int level,
+                  unsigned int *probes)
+{
+    const cpumask_t *online = get_sched_res(cpu)->cpupool->res_valid;
+    struct csched_unit *speer;
+    int peer_cpu, first_cpu;
+
+    /* workers are the pCPUs that have work we can steal, as far as we know. */
+    cpumask_and(workers, workers, online);
+    __cpumask_clear_cpu(cpu, workers);
+
+    first_cpu = cpumask_cycle(prv->balance_bias[node], workers);
+    if ( first_cpu >= nr_cpu_ids )
+        return NULL;
+    peer_cpu = first_cpu;
+    do
+    {
+        spinlock_t *lock;
+
+        /*
+         * If there is only one runnable unit on peer_cpu, it means
+         * there's no one to be stolen in its runqueue, so skip it.
+         *
+         * The stealable mask of its LLC said otherwise, but we read it
+         * without holding peer_cpu's lock, so it may already be stale.
+         * Checking nr_runnable without holding the lock is racy too... But
+         * that's the whole point of this optimization!
+         *
+         * In more details:
+         * - if we race with dec_nr_runnable(), we may try to take the
+         *   lock and call csched_runq_steal() for no reason. This is
+         *   not a functional issue, and should be infrequent enough.
+         *   And we can avoid that by re-checking nr_runnable after
+         *   having grabbed the lock, if we want;
+         * - if we race with inc_nr_runnable(), we skip a pCPU that may
+         *   have runnable units in its runqueue, but that's not a
+         *   problem because:
+         *   + if racing with csched_unit_insert() or csched_unit_wake(),
+         *     __runq_tickle() will be called afterwords, so the unit
+         *     won't get stuck in the runqueue for too long;
+         *   + if racing with csched_runq_steal(), it may be that an
+         *     unit that we could have picked up, stays in a runqueue
+         *     until someone else tries to steal it again. But this is
+         *     no worse than what can happen already (without this
+         *     optimization), it the pCPU would schedule right after we
+         *     have taken the lock, and hence block on it.
+         */
+        if ( CSCHED_PCPU(peer_cpu)->nr_runnable <= 1 )
+        {
+            TRACE_TIME(TRC_CSCHED_STEAL_CHECK, peer_cpu, /* skipp'n */ 0,
+                       level);
+            goto next_cpu;
+        }
+
+        /*
+         * Get ahold of the scheduler lock for this peer CPU.
+         *
+         * Note: We don't spin on this lock but simply try it. Spinning
+         * could cause a deadlock if the peer CPU is also load
+         * balancing and trying to lock this CPU.
+         */
+        lock = pcpu_schedule_trylock(peer_cpu);
+        SCHED_STAT_CRANK(steal_trylock);
+        perfc_incra(steal_probe, level);
+        (*probes)++;
+        if ( !lock )
+        {
+            SCHED_STAT_CRANK(steal_trylock_failed);
+            TRACE_TIME(TRC_CSCHED_STEAL_CHECK, peer_cpu, /* skip */ 0, level);
+            goto next_cpu;
+        }
+
+        TRACE_TIME(TRC_CSCHED_STEAL_CHECK, peer_cpu, /* checked */ 1, level);
+
+        /* Any work over there to steal? */
+        speer = cpumask_test_cpu(peer_cpu, online) ?
+            csched_runq_steal(peer_cpu, cpu, snext->pri, bstep) : NULL;
+        pcpu_schedule_unlock(lock, peer_cpu);
+
+        if ( speer != NULL )
+        {
+            prv->balance_bias[cpu_to_node(peer_cpu)] = peer_cpu;
+            return speer;
+        }
+
+ next_cpu:
+        peer_cpu = cpumask_cycle(peer_cpu, workers);
+
+    } while( peer_cpu != first_cpu );
+
+    return NULL;
+}
+
 static struct csched_unit *
 csched_load_balance(struct csched_private *prv, int cpu,
                     struct csched_unit *snext, bool *stolen)
 {
     const struct cpupool *c = get_sched_res(cpu)->cpupool;
+    const struct csched_llc *llc = CSCHED_PCPU(cpu)->llc;
     struct csched_unit *speer;
     cpumask_t workers;
     const cpumask_t *online = c->res_valid;
-    int peer_cpu, first_cpu, peer_node, bstep;
+    const cpumask_t *siblings = per_cpu(cpu_sibling_mask, cpu);
+    unsigned int i, nr_llcs, level, llcs_read = 0, probes = 0;
+    int peer_node, bstep;
     int node = cpu_to_node(cpu);
 
     BUG_ON(get_sched_res(cpu) != snext->unit->res);
@@ -1722,6 +1917,10 @@ csched_load_balance(struct csched_private *prv, int cpu,
     else
         SCHED_STAT_CRANK(load_balance_other);
 
+    /* Pairs with the smp_wmb() in csched_alloc_pdata(). */
+    nr_llcs = ACCESS_ONCE(prv->nr_llcs);
+    smp_rmb();
+
     /*
      * Let's look around for work to steal, taking both hard affinity
      * and soft affinity into account. More specifically, we check all
@@ -1732,110 +1931,75 @@ csched_load_balance(struct csched_private *prv, int cpu,
     for_each_affinity_balance_step( bstep )
     {
         /*
-         * We peek at the non-idling CPUs in a node-wise fashion. In fact,
-         * it is more likely that we find some affine work on our same
-         * node, not to mention that migrating units within the same node
-         * could well expected to be cheaper than across-nodes (memory
-         * stays local, there might be some node-wide cache[s], etc.).
+         * We peek at the CPUs with queued work in order of distance. In
+         * fact, it is more likely that we find some affine work close to
+         * us, not to mention that migrating units between CPUs sharing
+         * caches, or at least a node, is cheaper (caches stay warm,
+         * memory stays local, etc.).
+         */
+        SCHED_STAT_CRANK(steal_llc_read);
+        llcs_read++;
+
+        level = STEAL_SIBLING;
+        cpumask_and(&workers, siblings, &llc->stealable);
+        speer = csched_steal_from(prv, cpu, snext, bstep, &workers, node,
+                                  level, &probes);
+        if ( speer != NULL )
+            goto stolen;
+
+        level = STEAL_LLC;
+        cpumask_andnot(&workers, &llc->stealable, siblings);
+        speer = csched_steal_from(prv, cpu, snext, bstep, &workers, node,
+                                  level, &probes);
+        if ( speer != NULL )
+            goto stolen;
+
+        /*
+         * Then the other LLCs, those in our node first.  Their summaries
+         * tell which ones are worth looking into at all.
          */
+        level = STEAL_NODE;
         peer_node = node;
         do
         {
-            /* Select the pCPUs in this node that have work we can steal. */
-            cpumask_andnot(&workers, online, prv->idlers);
-            cpumask_and(&workers, &workers, &node_to_cpumask(peer_node));
-            __cpumask_clear_cpu(cpu, &workers);
-
-            first_cpu = cpumask_cycle(prv->balance_bias[peer_node], &workers);
-            if ( first_cpu >= nr_cpu_ids )
-                goto next_node;
-            peer_cpu = first_cpu;
-            do
+            for ( i = 0; i < nr_llcs; i++ )
             {
-                spinlock_t *lock;
+                const struct csched_llc *peer_llc = prv->llcs[i];
 
-                /*
-                 * If there is only one runnable unit on peer_cpu, it means
-                 * there's no one to be stolen in its runqueue, so skip it.
-                 *
-                 * Checking this without holding the lock is racy... But that's
-                 * the whole point of this optimization!
-                 *
-                 * In more details:
-                 * - if we race with dec_nr_runnable(), we may try to take the
-                 *   lock and call csched_runq_steal() for no reason. This is
-                 *   not a functional issue, and should be infrequent enough.
-                 *   And we can avoid that by re-checking nr_runnable after
-                 *   having grabbed the lock, if we want;
-                 * - if we race with inc_nr_runnable(), we skip a pCPU that may
-                 *   have runnable units in its runqueue, but that's not a
-                 *   problem because:
-                 *   + if racing with csched_unit_insert() or csched_unit_wake(),
-                 *     __runq_tickle() will be called afterwords, so the unit
-                 *     won't get stuck in the runqueue for too long;
-                 *   + if racing with csched_runq_steal(), it may be that an
-                 *     unit that we could have picked up, stays in a runqueue
-                 *     until someone else tries to steal it again. But this is
-                 *     no worse than what can happen already (without this
-                 *     optimization), it the pCPU would schedule right after we
-                 *     have taken the lock, and hence block on it.
-                 */
-                if ( CSCHED_PCPU(peer_cpu)->nr_runnable <= 1 )
-                {
-                    TRACE_TIME(TRC_CSCHED_STEAL_CHECK, peer_cpu, /* skipp'n */ 0);
-                    goto next_cpu;
-                }
+                if ( peer_llc == llc || peer_llc->node != peer_node )
+                    continue;
 
-                /*
-                 * Get ahold of the scheduler lock for this peer CPU.
-                 *
-                 * Note: We don't spin on this lock but simply try it. Spinning
-                 * could cause a deadlock if the peer CPU is also load
-                 * balancing and trying to lock this CPU.
-                 */
-                lock = pcpu_schedule_trylock(peer_cpu);
-                SCHED_STAT_CRANK(steal_trylock);
-                if ( !lock )
+                SCHED_STAT_CRANK(steal_llc_read);
+                llcs_read++;
+                if ( cpumask_empty(&peer_llc->stealable) )
                 {
-                    SCHED_STAT_CRANK(steal_trylock_failed);
-                    TRACE_TIME(TRC_CSCHED_STEAL_CHECK, peer_cpu, /* skip */ 0);
-                    goto next_cpu;
+                    SCHED_STAT_CRANK(steal_llc_empty);
+                    continue;
                 }
 
-                TRACE_TIME(TRC_CSCHED_STEAL_CHECK, peer_cpu, /* checked */ 1);
-
-                /* Any work over there to steal? */
-                speer = cpumask_test_cpu(peer_cpu, online) ?
-                    csched_runq_steal(peer_cpu, cpu, snext->pri, bstep) : NULL;
-                pcpu_schedule_unlock(lock, peer_cpu);
-
-                /* As soon as one unit is found, balancing ends */
+                cpumask_copy(&workers, &peer_llc->stealable);
+                speer = csched_steal_from(prv, cpu, snext, bstep, &workers,
+                                          peer_node, level, &probes);
                 if ( speer != NULL )
-                {
-                    *stolen = true;
-                    /*
-                     * Next time we'll look for work to steal on this node, we
-                     * will start from the next pCPU, with respect to this one,
-                     * so we don't risk stealing always from the same ones.
-                     */
-                    prv->balance_bias[peer_node] = peer_cpu;
-                    return speer;
-                }
-
- next_cpu:
-                peer_cpu = cpumask_cycle(peer_cpu, &workers);
-
-            } while( peer_cpu != first_cpu );
+                    goto stolen;
+            }
 
- next_node:
+            level = STEAL_REMOTE;
             peer_node = cycle_node(peer_node, node_online_map);
-        } while( peer_node != node );
+        } while ( peer_node != node );
     }
 
  out:
+    TRACE_TIME(TRC_CSCHED_LOAD_BALANCE, cpu, llcs_read, probes, STEAL_NONE);
     /* Failed to find more important work elsewhere... */
     __runq_remove(snext);
     return snext;
+
+ stolen:
+    TRACE_TIME(TRC_CSCHED_LOAD_BALANCE, cpu, llcs_read, probes, level);
+    /* As soon as one unit is found, balancing ends */
+    *stolen = true;
+    return speer;
 }
 
 /*
@@ -2146,6 +2310,10 @@ csched_dump(const struct scheduler *ops)
            prv->unit_migr_delay/ MICROSECS(1));
 
     printk("idlers: %*pb\n", CPUMASK_PR(prv->idlers));
+    for ( loop = 0; loop < prv->nr_llcs; loop++ )
+        printk("LLC socket %u node %u stealable: %*pb\n",
+               prv->llcs[loop]->socket, prv->llcs[loop]->node,
+               CPUMASK_PR(&prv->llcs[loop]->stealable));
 
     printk("active units:\n");
     loop = 0;
@@ -2227,10 +2395,19 @@ csched_init(struct scheduler *ops)
         return -ENOMEM;
     }
 
+    prv->llcs = xzalloc_array(struct csched_llc *, nr_cpu_ids);
+    if ( prv->llcs == NULL )
+    {
+        xfree(prv->balance_bias);
+        xfree(prv);
+        return -ENOMEM;
+    }
+
     if ( !zalloc_cpumask_var(&prv->cpus) ||
          !zalloc_cpumask_var(&prv->idlers) )
     {
         free_cpumask_var(prv->cpus);
+        xfree(prv->llcs);
         xfree(prv->balance_bias);
         xfree(prv);
         return -ENOMEM;
@@ -2259,6 +2436,7 @@ static void cf_check
 csched_deinit(struct scheduler *ops)
 {
     struct csched_private *prv;
+    unsigned int i;
 
     prv = CSCHED_PRIV(ops);
     if ( prv != NULL )
@@ -2266,6 +2444,9 @@ csched_deinit(struct scheduler *ops)
         ops->sched_data = NULL;
         free_cpumask_var(prv->cpus);
         free_cpumask_var(prv->idlers);
+        for ( i = 0; i < prv->nr_llcs; i++ )
+            xfree(prv->llcs[i]);
+        xfree(prv->llcs);
         xfree(prv->balance_bias);
         xfree(prv);
     }
@@ -262,13 +262,85 @@ void spin_debug_disable(void)
 
 #ifdef CONFIG_DEBUG_LOCK_PROFILE
 
+/*
+ * Totals over all profiled locks, per CPU.  Updates aren't atomic, so one
+ * may occasionally be lost to a lock taken by an interrupt handler.
+ */
+static DEFINE_PER_CPU(struct xen_sysctl_lockprof_cpu, lock_profile_cpu);
+
+static unsigned int lock_profile_bucket(s_time_t t)
+{
+    unsigned int b = t < 128 ? 0 : flsl(t) - 7;
+
+    return min(b, XEN_SYSCTL_LOCKPROF_HIST_BUCKETS - 1U);
+}
+
+/*
+ * Find (or claim) the entry for a call site.  Only called with the lock held,
+ * which serialises all updates to its profile.
+ */
+static struct lock_profile_site *lock_profile_site(struct lock_profile *prof,
+                                                   const void *addr)
+{
+    unsigned int i;
+
+    for ( i = 0; i < LOCK_PROFILE_SITES - 1; i++ )
+    {
+        if ( prof->site[i].addr == addr )
+            break;
+        if ( !prof->site[i].addr )
+        {
+            prof->site[i].addr = addr;
+            break;
+        }
+    }
+
+    return &prof->site[i];
+}
+
+static void lock_profile_got(struct lock_profile *prof, s_time_t block,
+                             const void *addr)
+{
+    struct lock_profile_site *site = lock_profile_site(prof, addr);
+    struct xen_sysctl_lockprof_cpu *pcpu = &this_cpu(lock_profile_cpu);
+    s_time_t now = NOW();
+
+    prof->time_locked = now;
+    prof->cur_site = site - prof->site;
+
+    if ( block )
+    {
+        s_time_t wait = now - block;
+
+        prof->time_block += wait;
+        prof->block_cnt++;
+        site->time_block += wait;
+        site->block_cnt++;
+        site->block_hist[lock_profile_bucket(wait)]++;
+        pcpu->block_time += wait;
+        pcpu->block_cnt++;
+    }
+}
+
+static void lock_profile_rel(struct lock_profile *prof)
+{
+    struct lock_profile_site *site = &prof->site[prof->cur_site];
+    struct xen_sysctl_lockprof_cpu *pcpu = &this_cpu(lock_profile_cpu);
+    s_time_t hold = NOW() - prof->time_locked;
+
+    prof->time_hold += hold;
+    prof->lock_cnt++;
+    site->time_hold += hold;
+    site->lock_cnt++;
+    site->hold_hist[lock_profile_bucket(hold)]++;
+    pcpu->lock_time += hold;
+    pcpu->lock_cnt++;
+}
+
 #define LOCK_PROFILE_PAR lock->profile
 #define LOCK_PROFILE_REL                                                     \
     if ( profile )                                                           \
-    {                                                                        \
-        profile->time_hold += NOW() - profile->time_locked;                  \
-        profile->lock_cnt++;                                                 \
-    }
+        lock_profile_rel(profile)
 #define LOCK_PROFILE_VAR(var, val)    s_time_t var = (val)
 #define LOCK_PROFILE_BLOCK(var)       (var) = (var) ? : NOW()
 #define LOCK_PROFILE_BLKACC(tst, val)                                        \
@@ -277,12 +349,13 @@ void spin_debug_disable(void)
         profile->time_block += profile->time_locked - (val);                 \
         profile->block_cnt++;                                                \
     }
+/*
+ * The lock functions embedding this are always_inline, so the return address
+ * is that of the caller of the out-of-line lock function.
+ */
 #define LOCK_PROFILE_GOT(val)                                                \
     if ( profile )                                                           \
-    {                                                                        \
-        profile->time_locked = NOW();                                        \
-        LOCK_PROFILE_BLKACC(val, val);                                       \
-    }
+        lock_profile_got(profile, val, __builtin_return_address(0))
 
 #else
 
@@ -348,7 +421,8 @@ void _spin_lock_irq(spinlock_t *lock)
 {
     ASSERT(local_irq_is_enabled());
     local_irq_disable();
-    _spin_lock(lock);
+    spin_lock_common(&lock->tickets, &lock->debug, LOCK_PROFILE_PAR, NULL,
+                     NULL);
 }
 
 unsigned long _spin_lock_irqsave(spinlock_t *lock)
@@ -356,7 +430,8 @@ unsigned long _spin_lock_irqsave(spinlock_t *lock)
     unsigned long flags;
 
     local_irq_save(flags);
-    _spin_lock(lock);
+    spin_lock_common(&lock->tickets, &lock->debug, LOCK_PROFILE_PAR, NULL,
+                     NULL);
     return flags;
 }
 
@@ -507,7 +582,7 @@ bool _rspin_trylock(rspinlock_t *lock)
     return true;
 }
 
-void _rspin_lock(rspinlock_t *lock)
+static void always_inline rspin_lock_common(rspinlock_t *lock)
 {
     unsigned int cpu = smp_processor_id();
 
@@ -523,12 +598,17 @@ void _rspin_lock(rspinlock_t *lock)
     lock->recurse_cnt++;
 }
 
+void _rspin_lock(rspinlock_t *lock)
+{
+    rspin_lock_common(lock);
+}
+
 unsigned long _rspin_lock_irqsave(rspinlock_t *lock)
 {
     unsigned long flags;
 
     local_irq_save(flags);
-    _rspin_lock(lock);
+    rspin_lock_common(lock);
 
     return flags;
 }
@@ -573,7 +653,8 @@ void _nrspin_lock_irq(rspinlock_t *lock)
 {
     ASSERT(local_irq_is_enabled());
     local_irq_disable();
-    _nrspin_lock(lock);
+    spin_lock_common(&lock->tickets, &lock->debug, LOCK_PROFILE_PAR, NULL,
+                     NULL);
 }
 
 void _nrspin_unlock_irq(rspinlock_t *lock)
@@ -587,7 +668,8 @@ unsigned long _nrspin_lock_irqsave(rspinlock_t *lock)
     unsigned long flags;
 
     local_irq_save(flags);
-    _nrspin_lock(lock);
+    spin_lock_common(&lock->tickets, &lock->debug, LOCK_PROFILE_PAR, NULL,
+                     NULL);
 
     return flags;
 }
@@ -612,6 +694,7 @@ static s_time_t lock_profile_start;
 static struct lock_profile_anc lock_profile_ancs[] = {
     [LOCKPROF_TYPE_GLOBAL] = { .name = "Global" },
     [LOCKPROF_TYPE_PERDOM] = { .name = "Domain" },
+    [LOCKPROF_TYPE_PERCPU] = { .name = "CPU" },
 };
 static struct lock_profile_qhead lock_profile_glb_q;
 static spinlock_t lock_profile_lock = SPIN_LOCK_UNLOCKED;
@@ -633,7 +716,7 @@ static void spinlock_profile_iterate(lock_profile_subfunc *sub, void *par)
 static void cf_check spinlock_profile_print_elem(struct lock_profile *data,
     int32_t type, int32_t idx, void *par)
 {
-    unsigned int cpu;
+    unsigned int cpu, i;
     unsigned int lockval;
 
     if ( data->is_rlock )
@@ -658,6 +741,22 @@ static void cf_check spinlock_profile_print_elem(struct lock_profile *data,
     printk("  lock:%" PRIu64 "(%" PRI_stime "), block:%" PRIu64 "(%" PRI_stime ")\n",
            data->lock_cnt, data->time_hold, (uint64_t)data->block_cnt,
            data->time_block);
+
+    for ( i = 0; i < LOCK_PROFILE_SITES; i++ )
+    {
+        const struct lock_profile_site *site = &data->site[i];
+
+        if ( !site->lock_cnt && !site->block_cnt )
+            continue;
+
+        if ( i == LOCK_PROFILE_SITES - 1 )
+            printk("    other:");
+        else
+            printk("    %ps:", site->addr);
+        printk(" lock:%" PRIu64 "(%" PRI_stime "), block:%" PRIu64 "(%" PRI_stime ")\n",
+               site->lock_cnt, site->time_hold, site->block_cnt,
+               site->time_block);
+    }
 }
 
 void cf_check spinlock_profile_printall(unsigned char key)
@@ -678,16 +777,21 @@ static void cf_check spinlock_profile_reset_elem(struct lock_profile *data,
     data->block_cnt = 0;
     data->time_hold = 0;
     data->time_block = 0;
+    memset(data->site, 0, sizeof(data->site));
 }
 
 void cf_check spinlock_profile_reset(unsigned char key)
 {
     s_time_t now = NOW();
+    unsigned int cpu;
 
     if ( key != '\0' )
         printk("Xen lock profile info RESET (now = %"PRI_stime")\n", now);
     lock_profile_start = now;
     spinlock_profile_iterate(spinlock_profile_reset_elem, NULL);
+    for_each_online_cpu ( cpu )
+        memset(&per_cpu(lock_profile_cpu, cpu), 0,
+               sizeof(per_cpu(lock_profile_cpu, cpu)));
 }
 
 typedef struct {
@@ -721,6 +825,63 @@ static void cf_check spinlock_profile_ucopy_elem(struct lock_profile *data,
         p->pc->nr_elem++;
 }
 
+static void cf_check spinlock_profile_ucopy_sites(struct lock_profile *data,
+    int32_t type, int32_t idx, void *par)
+{
+    spinlock_profile_ucopy_t *p = par;
+    struct xen_sysctl_lockprof_site elem;
+    unsigned int i;
+
+    for ( i = 0; i < LOCK_PROFILE_SITES && !p->rc; i++ )
+    {
+        const struct lock_profile_site *site = &data->site[i];
+
+        if ( !site->lock_cnt && !site->block_cnt )
+            continue;
+
+        if ( p->pc->nr_elem < p->pc->max_elem )
+        {
+            safe_strcpy(elem.name, data->name);
+            elem.type = type;
+            elem.idx = idx;
+            if ( i == LOCK_PROFILE_SITES - 1 )
+                safe_strcpy(elem.site, "other");
+            else
+                snprintf(elem.site, sizeof(elem.site), "%ps", site->addr);
+            elem.lock_cnt = site->lock_cnt;
+            elem.block_cnt = site->block_cnt;
+            elem.lock_time = site->time_hold;
+            elem.block_time = site->time_block;
+            memcpy(elem.hold_hist, site->hold_hist, sizeof(elem.hold_hist));
+            memcpy(elem.block_hist, site->block_hist, sizeof(elem.block_hist));
+            if ( copy_to_guest_offset(p->pc->sites, p->pc->nr_elem, &elem, 1) )
+                p->rc = -EFAULT;
+        }
+
+        if ( !p->rc )
+            p->pc->nr_elem++;
+    }
+}
+
+static int spinlock_profile_ucopy_cpus(struct xen_sysctl_lockprof_op *pc)
+{
+    unsigned int cpu;
+
+    pc->nr_elem = nr_cpu_ids;
+
+    for ( cpu = 0; cpu < min(pc->max_elem, nr_cpu_ids); cpu++ )
+    {
+        struct xen_sysctl_lockprof_cpu elem = {};
+
+        if ( cpu_online(cpu) )
+            elem = per_cpu(lock_profile_cpu, cpu);
+        if ( copy_to_guest_offset(pc->cpus, cpu, &elem, 1) )
+            return -EFAULT;
+    }
+
+    return 0;
+}
+
 /* Dom0 control of lock profiling */
 int spinlock_profile_control(struct xen_sysctl_lockprof_op *pc)
 {
@@ -742,6 +903,20 @@ int spinlock_profile_control(struct xen_sysctl_lockprof_op *pc)
         rc = par.rc;
         break;
 
+    case XEN_SYSCTL_LOCKPROF_query_sites:
+        pc->nr_elem = 0;
+        par.rc = 0;
+        par.pc = pc;
+        spinlock_profile_iterate(spinlock_profile_ucopy_sites, &par);
+        pc->time = NOW() - lock_profile_start;
+        rc = par.rc;
+        break;
+
+    case XEN_SYSCTL_LOCKPROF_query_cpus:
+        rc = spinlock_profile_ucopy_cpus(pc);
+        pc->time = NOW() - lock_profile_start;
+        break;
+
     default:
         rc = -EINVAL;
         break;
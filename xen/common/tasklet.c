@@ -24,83 +24,247 @@ static bool tasklets_initialised;
 
 DEFINE_PER_CPU(unsigned long, tasklet_work_to_do);
 
-static DEFINE_PER_CPU(struct list_head, tasklet_list);
-static DEFINE_PER_CPU(struct list_head, softirq_tasklet_list);
+/*
+ * Each CPU has a queue of tasklets to run in VCPU context, and one of
+ * tasklets to run in softirq context.  Any CPU pushes tasklets onto a
+ * queue without locking, and the owning CPU moves them, oldest first, to
+ * a list it runs them from.  The queue lock protects that list, and is
+ * otherwise only taken by tasklet_kill() and when migrating the tasklets
+ * of an offline CPU.
+ *
+ * Ownership of a tasklet structure goes with TASKLET_STATE_queued: only
+ * the CPU which set it may link the tasklet into a queue, and only the
+ * CPU which takes the tasklet off a queue may clear it.
+ */
+struct tasklet_queue {
+    struct tasklet *pushed;       /* Newest first, updated with cmpxchg(). */
+    spinlock_t lock;
+    struct tasklet *first, *last; /* Oldest first, protected by lock. */
+};
+
+/* The queues of a CPU, which are one structure for lock profiling. */
+struct tasklet_queues {
+    struct tasklet_queue tasklet;
+    struct tasklet_queue softirq_tasklet;
+    struct lock_profile_qhead profile_head;
+};
+
+static DEFINE_PER_CPU(struct tasklet_queues, tasklet_queues);
 
-/* Protects all lists and tasklet structures. */
-static DEFINE_SPINLOCK(tasklet_lock);
+#define TASKLET_STATE_cpu_mask (~0UL << TASKLET_STATE_cpu_shift)
+#define TASKLET_STATE_cpu(cpu) \
+    (((unsigned long)(cpu) + 1) << TASKLET_STATE_cpu_shift)
 
-static void tasklet_enqueue(struct tasklet *t)
+static int tasklet_state_cpu(unsigned long state)
 {
-    unsigned int cpu = t->scheduled_on;
+    return (int)(state >> TASKLET_STATE_cpu_shift) - 1;
+}
+
+static struct tasklet_queue *tasklet_queue_on(const struct tasklet *t,
+                                              unsigned int cpu)
+{
+    return t->is_softirq ? &per_cpu(tasklet_queues, cpu).softirq_tasklet
+                         : &per_cpu(tasklet_queues, cpu).tasklet;
+}
+
+static bool tasklet_queue_empty(const struct tasklet_queue *q)
+{
+    return !ACCESS_ONCE(q->first) && !ACCESS_ONCE(q->pushed);
+}
+
+/* The caller must own t, i.e. have set TASKLET_STATE_queued. */
+static void tasklet_enqueue(struct tasklet *t, unsigned int cpu)
+{
+    struct tasklet_queue *q = tasklet_queue_on(t, cpu);
+    struct tasklet *head = ACCESS_ONCE(q->pushed), *old;
+
+    t->queued_on = cpu;
+    do {
+        old = head;
+        t->next = old;
+        head = cmpxchg(&q->pushed, old, t);
+    } while ( head != old );
 
     if ( t->is_softirq )
     {
-        struct list_head *list = &per_cpu(softirq_tasklet_list, cpu);
-        bool was_empty = list_empty(list);
-        list_add_tail(&t->list, list);
-        if ( was_empty )
+        if ( !old )
             cpu_raise_softirq(cpu, TASKLET_SOFTIRQ);
     }
     else
     {
         unsigned long *work_to_do = &per_cpu(tasklet_work_to_do, cpu);
-        list_add_tail(&t->list, &per_cpu(tasklet_list, cpu));
         if ( !test_and_set_bit(_TASKLET_enqueued, work_to_do) )
             cpu_raise_softirq(cpu, SCHEDULE_SOFTIRQ);
     }
 }
 
-void tasklet_schedule_on_cpu(struct tasklet *t, unsigned int cpu)
+/* Move the pushed tasklets to the end of the list.  Needs q->lock. */
+static void tasklet_queue_splice(struct tasklet_queue *q)
+{
+    struct tasklet *t = xchg(&q->pushed, NULL), *last = t, *first = NULL;
+    struct tasklet *next;
+
+    if ( !t )
+        return;
+
+    for ( ; t; t = next )
+    {
+        next = t->next;
+        t->next = first;
+        first = t;
+    }
+
+    if ( q->last )
+        q->last->next = first;
+    else
+        q->first = first;
+    q->last = last;
+}
+
+static struct tasklet *tasklet_dequeue(struct tasklet_queue *q)
 {
     unsigned long flags;
+    struct tasklet *t;
 
-    spin_lock_irqsave(&tasklet_lock, flags);
+    spin_lock_irqsave(&q->lock, flags);
 
-    if ( tasklets_initialised && !t->is_dead )
+    tasklet_queue_splice(q);
+    t = q->first;
+    if ( t )
     {
-        t->scheduled_on = cpu;
-        if ( !t->is_running )
-        {
-            list_del(&t->list);
-            tasklet_enqueue(t);
-        }
+        q->first = t->next;
+        if ( !q->first )
+            q->last = NULL;
     }
 
-    spin_unlock_irqrestore(&tasklet_lock, flags);
+    spin_unlock_irqrestore(&q->lock, flags);
+
+    return t;
 }
 
-void tasklet_schedule(struct tasklet *t)
+/* Take t off the queue it is on, if it can be found there. */
+static bool tasklet_unqueue(struct tasklet *t)
 {
-    tasklet_schedule_on_cpu(t, smp_processor_id());
+    struct tasklet_queue *q = tasklet_queue_on(t, ACCESS_ONCE(t->queued_on));
+    struct tasklet **pprev, *prev = NULL;
+    unsigned long flags;
+    bool found = false;
+
+    spin_lock_irqsave(&q->lock, flags);
+
+    tasklet_queue_splice(q);
+    for ( pprev = &q->first; *pprev; prev = *pprev, pprev = &prev->next )
+    {
+        if ( *pprev != t )
+            continue;
+        *pprev = t->next;
+        if ( q->last == t )
+            q->last = prev;
+        found = true;
+        break;
+    }
+
+    spin_unlock_irqrestore(&q->lock, flags);
+
+    if ( found )
+        clear_bit(_TASKLET_STATE_queued, &t->state);
+
+    return found;
 }
 
-static void do_tasklet_work(unsigned int cpu, struct list_head *list)
+void tasklet_schedule_on_cpu(struct tasklet *t, unsigned int cpu)
 {
-    struct tasklet *t;
+    unsigned long old, new, state;
 
-    if ( unlikely(list_empty(list) || cpu_is_offline(cpu)) )
+    if ( !tasklets_initialised )
         return;
 
-    t = list_entry(list->next, struct tasklet, list);
-    list_del_init(&t->list);
+    state = ACCESS_ONCE(t->state);
+    do {
+        old = state;
+        if ( old & TASKLET_STATE_dead )
+            return;
+        new = (old & ~TASKLET_STATE_cpu_mask) | TASKLET_STATE_cpu(cpu);
+        /*
+         * A queued tasklet gets forwarded to cpu when dequeued, a running
+         * one gets queued again once it is done.
+         */
+        if ( !(old & TASKLET_STATE_running) )
+            new |= TASKLET_STATE_queued;
+        state = cmpxchg(&t->state, old, new);
+    } while ( state != old );
+
+    if ( !(old & (TASKLET_STATE_queued | TASKLET_STATE_running)) )
+        tasklet_enqueue(t, cpu);
+}
+
+void tasklet_schedule(struct tasklet *t)
+{
+    tasklet_schedule_on_cpu(t, smp_processor_id());
+}
 
-    BUG_ON(t->is_dead || t->is_running || (t->scheduled_on != cpu));
-    t->scheduled_on = -1;
-    t->is_running = 1;
+/*
+ * Run t, which we took off cpu's queue, if it is still scheduled there.
+ * Killed tasklets are dropped, tasklets scheduled on another CPU in the
+ * meantime are forwarded.
+ */
+static bool tasklet_run(struct tasklet *t, unsigned int cpu)
+{
+    unsigned long old, new, state = ACCESS_ONCE(t->state);
+
+    do {
+        old = state;
+        BUG_ON(!(old & TASKLET_STATE_queued) ||
+               (old & TASKLET_STATE_running));
+        if ( old & TASKLET_STATE_dead )
+            new = old & ~TASKLET_STATE_queued;
+        else if ( tasklet_state_cpu(old) != cpu )
+            new = old;
+        else
+            new = (old & ~(TASKLET_STATE_queued | TASKLET_STATE_cpu_mask)) |
+                  TASKLET_STATE_running;
+        state = cmpxchg(&t->state, old, new);
+    } while ( state != old );
+
+    if ( old & TASKLET_STATE_dead )
+        return false;
+
+    if ( tasklet_state_cpu(old) != cpu )
+    {
+        tasklet_enqueue(t, tasklet_state_cpu(old));
+        return false;
+    }
 
-    spin_unlock_irq(&tasklet_lock);
     sync_local_execstate();
     t->func(t->data);
-    spin_lock_irq(&tasklet_lock);
 
-    t->is_running = 0;
+    /* Once running is clear, t may be freed by tasklet_kill(). */
+    state = ACCESS_ONCE(t->state);
+    do {
+        old = state;
+        new = old & ~TASKLET_STATE_running;
+        if ( old & TASKLET_STATE_cpu_mask )
+            new |= TASKLET_STATE_queued;
+        state = cmpxchg(&t->state, old, new);
+    } while ( state != old );
 
-    if ( t->scheduled_on >= 0 )
-    {
-        BUG_ON(t->is_dead || !list_empty(&t->list));
-        tasklet_enqueue(t);
-    }
+    if ( new & TASKLET_STATE_queued )
+        tasklet_enqueue(t, tasklet_state_cpu(new));
+
+    return true;
+}
+
+static void do_tasklet_work(unsigned int cpu, struct tasklet_queue *q)
+{
+    struct tasklet *t;
+
+    if ( unlikely(cpu_is_offline(cpu)) )
+        return;
+
+    /* Run (at most) one tasklet. */
+    while ( (t = tasklet_dequeue(q)) != NULL )
+        if ( tasklet_run(t, cpu) )
+            break;
 }
 
 /* VCPU context work */
@@ -108,7 +272,7 @@ void do_tasklet(void)
 {
     unsigned int cpu = smp_processor_id();
     unsigned long *work_to_do = &per_cpu(tasklet_work_to_do, cpu);
-    struct list_head *list = &per_cpu(tasklet_list, cpu);
+    struct tasklet_queue *q = &per_cpu(tasklet_queues, cpu).tasklet;
 
     /*
      * We want to be sure any caller has checked that a tasklet is both
@@ -121,89 +285,95 @@ void do_tasklet(void)
      */
     ASSERT(tasklet_work_to_do(cpu));
 
-    spin_lock_irq(&tasklet_lock);
-
-    do_tasklet_work(cpu, list);
+    do_tasklet_work(cpu, q);
 
-    if ( list_empty(list) )
+    if ( tasklet_queue_empty(q) )
     {
-        clear_bit(_TASKLET_enqueued, work_to_do);        
+        clear_bit(_TASKLET_enqueued, work_to_do);
+        /*
+         * tasklet_enqueue() only raises SCHEDULE_SOFTIRQ if it sets the
+         * bit, so check for tasklets pushed before we cleared it.
+         */
+        smp_mb__after_atomic();
+        if ( !tasklet_queue_empty(q) )
+            set_bit(_TASKLET_enqueued, work_to_do);
         raise_softirq(SCHEDULE_SOFTIRQ);
     }
-
-    spin_unlock_irq(&tasklet_lock);
 }
 
 /* Softirq context work */
 static void cf_check tasklet_softirq_action(void)
 {
     unsigned int cpu = smp_processor_id();
-    struct list_head *list = &per_cpu(softirq_tasklet_list, cpu);
-
-    spin_lock_irq(&tasklet_lock);
+    struct tasklet_queue *q = &per_cpu(tasklet_queues, cpu).softirq_tasklet;
 
-    do_tasklet_work(cpu, list);
+    do_tasklet_work(cpu, q);
 
-    if ( !list_empty(list) && !cpu_is_offline(cpu) )
+    if ( !tasklet_queue_empty(q) && !cpu_is_offline(cpu) )
         raise_softirq(TASKLET_SOFTIRQ);
-
-    spin_unlock_irq(&tasklet_lock);
 }
 
 void tasklet_kill(struct tasklet *t)
 {
-    unsigned long flags;
-
-    spin_lock_irqsave(&tasklet_lock, flags);
-
-    /* Cope with uninitialised tasklets. */
-    if ( list_head_is_null(&t->list) )
-        goto unlock;
-
-    if ( !list_empty(&t->list) )
-    {
-        BUG_ON(t->is_dead || t->is_running || (t->scheduled_on < 0));
-        list_del_init(&t->list);
-    }
+    unsigned long old, state = ACCESS_ONCE(t->state);
 
-    t->scheduled_on = -1;
-    t->is_dead = 1;
+    /*
+     * Copes with uninitialised (zeroed) tasklets, which are neither queued
+     * nor running.
+     */
+    do {
+        old = state;
+        state = cmpxchg(&t->state, old,
+                        (old & ~TASKLET_STATE_cpu_mask) | TASKLET_STATE_dead);
+    } while ( state != old );
 
-    while ( t->is_running )
+    /*
+     * Nothing can queue t any more.  Take it off the queue it is on, which
+     * may race with its CPU dequeueing or forwarding it, and wait for it to
+     * stop running.
+     */
+    while ( (state = ACCESS_ONCE(t->state)) &
+            (TASKLET_STATE_queued | TASKLET_STATE_running) )
     {
-        spin_unlock_irqrestore(&tasklet_lock, flags);
-        cpu_relax();
-        spin_lock_irqsave(&tasklet_lock, flags);
+        if ( !(state & TASKLET_STATE_queued) || !tasklet_unqueue(t) )
+            cpu_relax();
     }
-
- unlock:
-    spin_unlock_irqrestore(&tasklet_lock, flags);
 }
 
-static void migrate_tasklets_from_cpu(unsigned int cpu, struct list_head *list)
+static void migrate_tasklets_from_cpu(unsigned int cpu,
+                                      struct tasklet_queue *q)
 {
-    unsigned long flags;
-    struct tasklet *t;
+    unsigned int new_cpu = smp_processor_id();
+    unsigned long flags, old, state;
+    struct tasklet *t, *next;
 
-    spin_lock_irqsave(&tasklet_lock, flags);
+    spin_lock_irqsave(&q->lock, flags);
+    tasklet_queue_splice(q);
+    t = q->first;
+    q->first = q->last = NULL;
+    spin_unlock_irqrestore(&q->lock, flags);
 
-    while ( !list_empty(list) )
+    for ( ; t; t = next )
     {
-        t = list_entry(list->next, struct tasklet, list);
-        BUG_ON(t->scheduled_on != cpu);
-        t->scheduled_on = smp_processor_id();
-        list_del(&t->list);
-        tasklet_enqueue(t);
+        next = t->next;
+
+        state = ACCESS_ONCE(t->state);
+        do {
+            old = state;
+            if ( tasklet_state_cpu(old) != cpu )
+                break;
+            state = cmpxchg(&t->state, old,
+                            (old & ~TASKLET_STATE_cpu_mask) |
+                            TASKLET_STATE_cpu(new_cpu));
+        } while ( state != old );
+
+        tasklet_enqueue(t, new_cpu);
     }
-
-    spin_unlock_irqrestore(&tasklet_lock, flags);
 }
 
 void tasklet_init(struct tasklet *t, void (*func)(void *data), void *data)
 {
     memset(t, 0, sizeof(*t));
-    INIT_LIST_HEAD(&t->list);
-    t->scheduled_on = -1;
     t->func = func;
     t->data = data;
 }
@@ -219,17 +389,22 @@ static int cf_check cpu_callback(
     struct notifier_block *nfb, unsigned long action, void *hcpu)
 {
     unsigned int cpu = (unsigned long)hcpu;
+    struct tasklet_queues *qs = &per_cpu(tasklet_queues, cpu);
 
     switch ( action )
     {
     case CPU_UP_PREPARE:
-        INIT_LIST_HEAD(&per_cpu(tasklet_list, cpu));
-        INIT_LIST_HEAD(&per_cpu(softirq_tasklet_list, cpu));
+        /* The queues of a parked CPU still list their previous profiles. */
+        memset(&qs->profile_head, 0, sizeof(qs->profile_head));
+        lock_profile_register_struct(LOCKPROF_TYPE_PERCPU, qs, cpu);
+        spin_lock_init_prof(qs, tasklet.lock);
+        spin_lock_init_prof(qs, softirq_tasklet.lock);
         break;
     case CPU_UP_CANCELED:
     case CPU_DEAD:
-        migrate_tasklets_from_cpu(cpu, &per_cpu(tasklet_list, cpu));
-        migrate_tasklets_from_cpu(cpu, &per_cpu(softirq_tasklet_list, cpu));
+        migrate_tasklets_from_cpu(cpu, &qs->tasklet);
+        migrate_tasklets_from_cpu(cpu, &qs->softirq_tasklet);
+        lock_profile_deregister_struct(LOCKPROF_TYPE_PERCPU, qs);
         break;
     default:
         break;
@@ -31,8 +31,12 @@ integer_param("timer_slop", timer_slop);
 
 struct timers {
     spinlock_t     lock;
+#ifdef CONFIG_TIMER_WHEEL
+    struct timer_wheel *wheel;
+#else
     struct timer **heap;
     struct timer  *list;
+#endif
     struct timer  *running;
     struct list_head inactive;
 } __cacheline_aligned;
@@ -44,6 +48,180 @@ static DEFINE_RCU_READ_LOCK(timer_cpu_read_lock);
 
 DEFINE_PER_CPU(s_time_t, timer_deadline);
 
+#ifdef CONFIG_TIMER_WHEEL
+
+/****************************************************************************
+ * WHEEL OPERATIONS.
+ *
+ * Level 0 of the wheel has a slot per granule of 2^WHEEL_GRANULE_SHIFT ns,
+ * and a slot of each further level spans all the slots of the level below.
+ * A timer is filed in the lowest level whose span covers its expiry, and
+ * moves (cascades) down when the wheel reaches its slot, so a level 0 slot
+ * only holds timers expiring in the same granule.  Timers further away than
+ * the top level covers are filed in its furthest slot, and re-filed when
+ * that is reached.
+ *
+ * Slots with timers are tracked in per level bitmaps, so that the wheel can
+ * skip over empty ones, and the exact earliest expiry is known: it is that
+ * of the first occupied level 0 slot, unless a cascade is due before.
+ */
+
+#define WHEEL_GRANULE_SHIFT 15 /* 32.8 us */
+#define WHEEL_LEVEL_SHIFT   6
+#define WHEEL_SLOTS         (1U << WHEEL_LEVEL_SHIFT)
+#define WHEEL_LEVELS        5  /* 2^45 ns, almost 10 hours */
+
+struct timer_wheel {
+    /* Granule being processed: timers expiring before it have run. */
+    uint64_t clk;
+    /* No active timer expires before this. */
+    s_time_t deadline;
+    uint64_t pending[WHEEL_LEVELS];
+    struct list_head slot[WHEEL_LEVELS][WHEEL_SLOTS];
+};
+
+static struct timer_wheel *alloc_wheel(void)
+{
+    struct timer_wheel *w = xmalloc(struct timer_wheel);
+    unsigned int lvl, slot;
+
+    if ( !w )
+        return NULL;
+
+    w->clk = NOW() >> WHEEL_GRANULE_SHIFT;
+    w->deadline = STIME_MAX;
+    for ( lvl = 0; lvl < WHEEL_LEVELS; lvl++ )
+    {
+        w->pending[lvl] = 0;
+        for ( slot = 0; slot < WHEEL_SLOTS; slot++ )
+            INIT_LIST_HEAD(&w->slot[lvl][slot]);
+    }
+
+    return w;
+}
+
+/* Next granule after w->clk when @lvl has timers to run or cascade. */
+static uint64_t wheel_next(const struct timer_wheel *w, unsigned int lvl)
+{
+    unsigned int shift = lvl * WHEEL_LEVEL_SHIFT;
+    uint64_t pos = (w->clk >> shift) + 1, pending = w->pending[lvl];
+    unsigned int first = pos & (WHEEL_SLOTS - 1);
+
+    if ( !pending )
+        return UINT64_MAX;
+
+    /* Rotate the bitmap so that bit 0 is the slot for pos. */
+    if ( first )
+        pending = (pending >> first) | (pending << (WHEEL_SLOTS - first));
+
+    return (pos + ffs64(pending) - 1) << shift;
+}
+
+/* Add @t to @w. Return TRUE if it expires before any other timer. */
+static int add_to_wheel(struct timer_wheel *w, struct timer *t)
+{
+    uint64_t idx = max(t->expires, (s_time_t)0) >> WHEEL_GRANULE_SHIFT;
+    uint64_t delta;
+    unsigned int lvl, slot;
+
+    if ( idx < w->clk )
+        idx = w->clk;
+    delta = idx - w->clk;
+
+    for ( lvl = 0; lvl < WHEEL_LEVELS - 1; lvl++ )
+        if ( !(delta >> ((lvl + 1) * WHEEL_LEVEL_SHIFT)) )
+            break;
+    if ( delta >> (WHEEL_LEVELS * WHEEL_LEVEL_SHIFT) )
+        idx = w->clk + (1ULL << (WHEEL_LEVELS * WHEEL_LEVEL_SHIFT)) - 1;
+
+    slot = (idx >> (lvl * WHEEL_LEVEL_SHIFT)) & (WHEEL_SLOTS - 1);
+    list_add_tail(&t->wheel, &w->slot[lvl][slot]);
+    w->pending[lvl] |= 1ULL << slot;
+    t->wheel_level = lvl;
+    t->wheel_slot = slot;
+
+    if ( t->expires >= w->deadline )
+        return 0;
+
+    w->deadline = t->expires;
+    return 1;
+}
+
+/* Delete @t from @w. Return TRUE if it may have been the next to expire. */
+static int remove_from_wheel(struct timer_wheel *w, struct timer *t)
+{
+    list_del(&t->wheel);
+    if ( list_empty(&w->slot[t->wheel_level][t->wheel_slot]) )
+        w->pending[t->wheel_level] &= ~(1ULL << t->wheel_slot);
+
+    return t->expires <= w->deadline;
+}
+
+/* Move the timers of the current slot of @lvl to lower levels. */
+static void cascade(struct timer_wheel *w, unsigned int lvl)
+{
+    unsigned int slot =
+        (w->clk >> (lvl * WHEEL_LEVEL_SHIFT)) & (WHEEL_SLOTS - 1);
+    struct timer *t;
+    LIST_HEAD(list);
+
+    if ( !(w->pending[lvl] & (1ULL << slot)) )
+        return;
+
+    list_splice_init(&w->slot[lvl][slot], &list);
+    w->pending[lvl] &= ~(1ULL << slot);
+
+    while ( !list_empty(&list) )
+    {
+        t = list_entry(list.next, struct timer, wheel);
+        list_del(&t->wheel);
+        add_to_wheel(w, t);
+    }
+}
+
+/* Earliest expiry of the timers on @w. */
+static s_time_t wheel_deadline(const struct timer_wheel *w)
+{
+    const struct list_head *slot = &w->slot[0][w->clk & (WHEEL_SLOTS - 1)];
+    uint64_t next0, next = UINT64_MAX;
+    s_time_t deadline = STIME_MAX;
+    const struct timer *t;
+    unsigned int lvl;
+
+    if ( list_empty(slot) )
+    {
+        for ( lvl = 1; lvl < WHEEL_LEVELS; lvl++ )
+            next = min(next, wheel_next(w, lvl));
+
+        /* Timers cascading down may expire in the same granule. */
+        next0 = wheel_next(w, 0);
+        if ( next0 >= next )
+            return next == UINT64_MAX ? STIME_MAX
+                                      : (s_time_t)(next << WHEEL_GRANULE_SHIFT);
+
+        slot = &w->slot[0][next0 & (WHEEL_SLOTS - 1)];
+    }
+
+    list_for_each_entry ( t, slot, wheel )
+        deadline = min(deadline, t->expires);
+
+    return deadline;
+}
+
+static struct timer *wheel_first(const struct timer_wheel *w)
+{
+    unsigned int lvl;
+
+    for ( lvl = 0; lvl < WHEEL_LEVELS; lvl++ )
+        if ( w->pending[lvl] )
+            return list_first_entry(
+                &w->slot[lvl][ffs64(w->pending[lvl]) - 1], struct timer, wheel);
+
+    return NULL;
+}
+
+#else /* !CONFIG_TIMER_WHEEL */
+
 /****************************************************************************
  * HEAP OPERATIONS.
  *
@@ -175,6 +353,8 @@ static int add_to_list(struct timer **pprev, struct timer *t)
     return (_pprev == pprev);
 }
 
+#endif /* CONFIG_TIMER_WHEEL */
+
 
 /****************************************************************************
  * TIMER OPERATIONS.
@@ -187,12 +367,18 @@ static int remove_entry(struct timer *t)
 
     switch ( t->status )
     {
+#ifdef CONFIG_TIMER_WHEEL
+    case TIMER_STATUS_in_wheel:
+        rc = remove_from_wheel(timers->wheel, t);
+        break;
+#else
     case TIMER_STATUS_in_heap:
         rc = remove_from_heap(timers->heap, t);
         break;
     case TIMER_STATUS_in_list:
         rc = remove_from_list(&timers->list, t);
         break;
+#endif
     default:
         rc = 0;
         BUG();
@@ -209,6 +395,11 @@ static int add_entry(struct timer *t)
 
     ASSERT(t->status == TIMER_STATUS_invalid);
 
+#ifdef CONFIG_TIMER_WHEEL
+    t->status = TIMER_STATUS_in_wheel;
+    rc = add_to_wheel(timers->wheel, t);
+    return rc;
+#else
     /* Try to add to heap. t->heap_offset indicates whether we succeed. */
     t->heap_offset = 0;
     t->status = TIMER_STATUS_in_heap;
@@ -219,6 +410,7 @@ static int add_entry(struct timer *t)
     /* Fall back to adding to the slower linked list. */
     t->status = TIMER_STATUS_in_list;
     return add_to_list(&timers->list, t);
+#endif
 }
 
 static inline void activate_timer(struct timer *timer)
@@ -458,44 +650,102 @@ static void execute_timer(struct timers *ts, struct timer *t)
 }
 
 
-static void cf_check timer_softirq_action(void)
-{
-    struct timer  *t, **heap, *next;
-    struct timers *ts;
-    s_time_t       now, deadline;
+#ifdef CONFIG_TIMER_WHEEL
 
-    ts = &this_cpu(timers);
-    heap = ts->heap;
+/*
+ * Execute the ready timers, and return the earliest expiry of the remaining
+ * ones.  Called and returns with ts->lock held.
+ */
+static s_time_t run_timers(struct timers *ts)
+{
+    struct timer_wheel *w = ts->wheel;
+    struct list_head *slot;
+    struct timer *t;
+    s_time_t now = NOW();
+    uint64_t target = now >> WHEEL_GRANULE_SHIFT, next;
+    unsigned int lvl;
+    bool found;
 
-    /* If we overflowed the heap, try to allocate a larger heap. */
-    if ( unlikely(ts->list != NULL) )
+    for ( ; ; )
     {
-        /* old_limit == (2^n)-1; new_limit == (2^(n+4))-1 */
-        unsigned int old_limit = heap_metadata(heap)->limit;
-        unsigned int new_limit = ((old_limit + 1) << 4) - 1;
-        struct timer **newheap = NULL;
-
-        /* Don't grow the heap beyond what is representable in its metadata. */
-        if ( new_limit == (typeof(heap_metadata(heap)->limit))new_limit &&
-             new_limit + 1 )
-            newheap = xmalloc_array(struct timer *, new_limit + 1);
-        else
-            printk_once(XENLOG_WARNING "CPU%u: timer heap limit reached\n",
-                        smp_processor_id());
-        if ( newheap != NULL )
+        /* Execute the ready timers of the current slot. */
+        slot = &w->slot[0][w->clk & (WHEEL_SLOTS - 1)];
+        do {
+            found = false;
+            list_for_each_entry ( t, slot, wheel )
+            {
+                if ( t->expires >= now )
+                    continue;
+                remove_entry(t);
+                execute_timer(ts, t);
+                found = true;
+                break;
+            }
+        } while ( found );
+
+        if ( w->clk >= target )
+            break;
+
+        /*
+         * All timers of earlier granules have run.  Skip to the next slot
+         * with timers, or with timers to cascade.
+         */
+        next = target;
+        for ( lvl = 0; lvl < WHEEL_LEVELS; lvl++ )
+            next = min(next, wheel_next(w, lvl));
+        w->clk = next;
+
+        for ( lvl = 1; lvl < WHEEL_LEVELS; lvl++ )
         {
-            spin_lock_irq(&ts->lock);
-            memcpy(newheap, heap, (old_limit + 1) * sizeof(*heap));
-            heap_metadata(newheap)->limit = new_limit;
-            ts->heap = newheap;
-            spin_unlock_irq(&ts->lock);
-            if ( old_limit != 0 )
-                xfree(heap);
-            heap = newheap;
+            if ( w->clk & ((1ULL << (lvl * WHEEL_LEVEL_SHIFT)) - 1) )
+                break;
+            cascade(w, lvl);
         }
     }
 
-    spin_lock_irq(&ts->lock);
+    w->deadline = wheel_deadline(w);
+
+    return w->deadline;
+}
+
+#else /* !CONFIG_TIMER_WHEEL */
+
+/* If we overflowed the heap, try to allocate a larger heap. */
+static void grow_heap(struct timers *ts)
+{
+    struct timer **heap = ts->heap;
+    /* old_limit == (2^n)-1; new_limit == (2^(n+4))-1 */
+    unsigned int old_limit = heap_metadata(heap)->limit;
+    unsigned int new_limit = ((old_limit + 1) << 4) - 1;
+    struct timer **newheap = NULL;
+
+    /* Don't grow the heap beyond what is representable in its metadata. */
+    if ( new_limit == (typeof(heap_metadata(heap)->limit))new_limit &&
+         new_limit + 1 )
+        newheap = xmalloc_array(struct timer *, new_limit + 1);
+    else
+        printk_once(XENLOG_WARNING "CPU%u: timer heap limit reached\n",
+                    smp_processor_id());
+    if ( newheap != NULL )
+    {
+        spin_lock_irq(&ts->lock);
+        memcpy(newheap, heap, (old_limit + 1) * sizeof(*heap));
+        heap_metadata(newheap)->limit = new_limit;
+        ts->heap = newheap;
+        spin_unlock_irq(&ts->lock);
+        if ( old_limit != 0 )
+            xfree(heap);
+    }
+}
+
+/*
+ * Execute the ready timers, and return the earliest expiry of the remaining
+ * ones.  Called and returns with ts->lock held.
+ */
+static s_time_t run_timers(struct timers *ts)
+{
+    struct timer  *t, **heap = ts->heap, *next;
+    s_time_t       now, deadline;
 
     now = NOW();
 
@@ -530,6 +780,26 @@ static void cf_check timer_softirq_action(void)
         deadline = heap[1]->expires;
     if ( (ts->list != NULL) && (ts->list->expires < deadline) )
         deadline = ts->list->expires;
+
+    return deadline;
+}
+
+#endif /* CONFIG_TIMER_WHEEL */
+
+static void cf_check timer_softirq_action(void)
+{
+    struct timers *ts = &this_cpu(timers);
+    s_time_t       now, deadline;
+
+#ifndef CONFIG_TIMER_WHEEL
+    if ( unlikely(ts->list != NULL) )
+        grow_heap(ts);
+#endif
+
+    spin_lock_irq(&ts->lock);
+
+    deadline = run_timers(ts);
+
     now = NOW();
     this_cpu(timer_deadline) =
         (deadline == STIME_MAX) ? 0 : MAX(deadline, now + timer_slop);
@@ -570,10 +840,19 @@ static void cf_check dump_timerq(unsigned char key)
 
         printk("CPU%02d:\n", i);
         spin_lock_irqsave(&ts->lock, flags);
+#ifdef CONFIG_TIMER_WHEEL
+        for ( j = 0; j < WHEEL_LEVELS * WHEEL_SLOTS; j++ )
+            list_for_each_entry ( t,
+                                  &ts->wheel->slot[j / WHEEL_SLOTS]
+                                                  [j % WHEEL_SLOTS],
+                                  wheel )
+                dump_timer(t, now);
+#else
         for ( j = 1; j <= heap_metadata(ts->heap)->size; j++ )
             dump_timer(ts->heap[j], now);
         for ( t = ts->list; t != NULL; t = t->list_next )
             dump_timer(t, now);
+#endif
         spin_unlock_irqrestore(&ts->lock, flags);
     }
 }
@@ -601,8 +880,12 @@ static void migrate_timers_from_cpu(unsigned int old_cpu)
         spin_lock(&old_ts->lock);
     }
 
+#ifdef CONFIG_TIMER_WHEEL
+    while ( (t = wheel_first(old_ts->wheel)) != NULL )
+#else
     while ( (t = heap_metadata(old_ts->heap)->size
              ? old_ts->heap[1] : old_ts->list) != NULL )
+#endif
     {
         remove_entry(t);
         write_atomic(&t->cpu, new_cpu);
@@ -624,6 +907,18 @@ static void migrate_timers_from_cpu(unsigned int old_cpu)
         cpu_raise_softirq(new_cpu, TIMER_SOFTIRQ);
 }
 
+#ifdef CONFIG_TIMER_WHEEL
+
+static void free_percpu_timers(unsigned int cpu)
+{
+    struct timers *ts = &per_cpu(timers, cpu);
+
+    ASSERT(!wheel_first(ts->wheel));
+    XFREE(ts->wheel);
+}
+
+#else /* !CONFIG_TIMER_WHEEL */
+
 /*
  * All CPUs initially share an empty dummy heap. Only those CPUs that
  * are brought online will be dynamically allocated their own heap.
@@ -645,6 +940,8 @@ static void free_percpu_timers(unsigned int cpu)
         ASSERT(ts->heap == dummy_heap);
 }
 
+#endif /* CONFIG_TIMER_WHEEL */
+
 static int cf_check cpu_callback(
     struct notifier_block *nfb, unsigned long action, void *hcpu)
 {
@@ -654,6 +951,16 @@ static int cf_check cpu_callback(
     switch ( action )
     {
     case CPU_UP_PREPARE:
+#ifdef CONFIG_TIMER_WHEEL
+        /* Only initialise ts once, the wheel is freed when offlining. */
+        if ( !ts->inactive.next )
+        {
+            INIT_LIST_HEAD(&ts->inactive);
+            spin_lock_init(&ts->lock);
+        }
+        if ( !ts->wheel && !(ts->wheel = alloc_wheel()) )
+            return notifier_from_errno(-ENOMEM);
+#else
         /* Only initialise ts once. */
         if ( !ts->heap )
         {
@@ -661,6 +968,7 @@ static int cf_check cpu_callback(
             spin_lock_init(&ts->lock);
             ts->heap = dummy_heap;
         }
+#endif
         break;
 
     case CPU_UP_CANCELED:
@@ -22,6 +22,7 @@
 
 #include <xen/sched.h>
 #include <xen/event.h>
+#include <xen/vmap.h>
 #include <xen/wait.h>
 #include <xen/vm_event.h>
 #include <xen/mem_access.h>
@@ -41,6 +42,113 @@
 #define xen_rmb()  smp_rmb()
 #define xen_wmb()  smp_wmb()
 
+/* Responses copied off the ring per acquisition of the ring lock. */
+#define VM_EVENT_RESUME_BATCH 8
+
+/*
+ * Allocate a ring of nr_frames pages from the domain's heap, for the helper
+ * to map with XENMEM_acquire_resource.  Unlike a ring in a guest frame, the
+ * ring is initialised here: Xen may put requests on it before the helper
+ * has mapped it.
+ */
+static int vm_event_alloc_ring(struct domain *d, struct vm_event_domain *ved,
+                               unsigned int nr_frames)
+{
+    struct page_info *pg;
+    unsigned int i;
+
+    if ( nr_frames > XEN_VM_EVENT_RING_MAX_FRAMES ||
+         (nr_frames & (nr_frames - 1)) )
+        return -EINVAL;
+
+    pg = alloc_domheap_pages(d, get_order_from_pages(nr_frames),
+                             MEMF_no_refcount);
+    if ( !pg )
+        return -ENOMEM;
+
+    for ( i = 0; i < nr_frames; i++ )
+    {
+        if ( unlikely(!get_page_and_type(&pg[i], d, PGT_writable_page)) )
+            goto refcnt_err;
+
+        clear_domain_page(page_to_mfn(&pg[i]));
+    }
+
+    ved->ring_page = vmap_contig(page_to_mfn(pg), nr_frames);
+    if ( !ved->ring_page )
+    {
+        while ( i-- )
+        {
+            put_page_alloc_ref(&pg[i]);
+            put_page_and_type(&pg[i]);
+        }
+
+        return -ENOMEM;
+    }
+
+    ved->ring_pg_struct = pg;
+    ved->nr_frames = nr_frames;
+
+    SHARED_RING_INIT((vm_event_sring_t *)ved->ring_page);
+
+    return 0;
+
+ refcnt_err:
+    /* See vmtrace_alloc_buffer(): free what we safely can, leak the rest. */
+    while ( i-- )
+    {
+        put_page_alloc_ref(&pg[i]);
+        put_page_and_type(&pg[i]);
+    }
+
+    return -ENODATA;
+}
+
+static void vm_event_free_ring(struct vm_event_domain *ved)
+{
+    struct page_info *pg = ved->ring_pg_struct;
+    unsigned int i;
+
+    if ( !ved->nr_frames )
+    {
+        destroy_ring_for_helper(&ved->ring_page, pg);
+        return;
+    }
+
+    if ( !ved->ring_page )
+        return;
+
+    vunmap(ved->ring_page);
+    ved->ring_page = NULL;
+
+    /* Mappings still held by the helper keep their own references. */
+    for ( i = 0; i < ved->nr_frames; i++ )
+    {
+        put_page_alloc_ref(&pg[i]);
+        put_page_and_type(&pg[i]);
+    }
+}
+
+static struct vm_event_domain **vm_event_domain_ptr(struct domain *d,
+                                                    unsigned int mode)
+{
+    switch ( mode )
+    {
+#ifdef CONFIG_MEM_PAGING
+    case XEN_DOMCTL_VM_EVENT_OP_PAGING:
+        return &d->vm_event_paging;
+#endif
+    case XEN_DOMCTL_VM_EVENT_OP_MONITOR:
+        return &d->vm_event_monitor;
+#ifdef CONFIG_MEM_SHARING
+    case XEN_DOMCTL_VM_EVENT_OP_SHARING:
+        return &d->vm_event_share;
+#endif
+    default:
+        return NULL;
+    }
+}
+
 static int vm_event_enable(
     struct domain *d,
     struct xen_domctl_vm_event_op *vec,
@@ -51,6 +159,7 @@ static int vm_event_enable(
 {
     int rc;
     unsigned long ring_gfn = d->arch.hvm.params[param];
+    unsigned int nr_frames = vec->u.enable.nr_frames;
     struct vm_event_domain *ved;
 
     /*
@@ -60,8 +169,8 @@ static int vm_event_enable(
     if ( *p_ved != NULL )
         return -EBUSY;
 
-    /* No chosen ring GFN?  Nothing we can do. */
-    if ( ring_gfn == 0 )
+    /* No chosen ring GFN, nor a request for Xen to allocate the ring? */
+    if ( ring_gfn == 0 && nr_frames == 0 )
         return -EOPNOTSUPP;
 
     ved = xzalloc(struct vm_event_domain);
@@ -77,14 +186,17 @@ static int vm_event_enable(
     if ( rc < 0 )
         goto err;
 
-    rc = prepare_ring_for_helper(d, ring_gfn, &ved->ring_pg_struct,
-                                 &ved->ring_page);
+    if ( nr_frames )
+        rc = vm_event_alloc_ring(d, ved, nr_frames);
+    else
+        rc = prepare_ring_for_helper(d, ring_gfn, &ved->ring_pg_struct,
+                                     &ved->ring_page);
     if ( rc < 0 )
         goto err;
 
     FRONT_RING_INIT(&ved->front_ring,
                     (vm_event_sring_t *)ved->ring_page,
-                    PAGE_SIZE);
+                    (nr_frames ?: 1) * PAGE_SIZE);
 
     rc = alloc_unbound_xen_event_channel(d, 0, current->domain->domain_id,
                                          notification_fn);
@@ -93,13 +205,19 @@ static int vm_event_enable(
 
     ved->xen_port = vec->u.enable.port = rc;
 
-    /* Success.  Fill in the domain's appropriate ved. */
+    /*
+     * Success.  Fill in the domain's appropriate ved.  The domain lock
+     * keeps vm_event_acquire_ring() from seeing it half set up, or after
+     * vm_event_disable() has freed it.
+     */
+    domain_lock(d);
     *p_ved = ved;
+    domain_unlock(d);
 
     return 0;
 
  err:
-    destroy_ring_for_helper(&ved->ring_page, ved->ring_pg_struct);
+    vm_event_free_ring(ved);
     xfree(ved);
 
     return rc;
@@ -210,15 +328,19 @@ static int vm_event_disable(struct domain *d, struct vm_event_domain **p_ved)
             }
         }
 
-        destroy_ring_for_helper(&ved->ring_page, ved->ring_pg_struct);
+        /* Under ved->lock, so vm_event_acquire_ring() sees it gone. */
+        vm_event_free_ring(ved);
 
         vm_event_cleanup_domain(d);
 
         spin_unlock(&ved->lock);
     }
 
-    xfree(ved);
+    domain_lock(d);
     *p_ved = NULL;
+    domain_unlock(d);
+
+    xfree(ved);
 
     return 0;
 }
@@ -264,6 +386,7 @@ void vm_event_put_request(struct domain *d,
     unsigned int avail_req;
     RING_IDX req_prod;
     struct vcpu *curr = current;
+    bool notify = true;
 
     if( !vm_event_check_ring(ved) )
         return;
@@ -291,9 +414,15 @@ void vm_event_put_request(struct domain *d,
     memcpy(RING_GET_REQUEST(front_ring, req_prod), req, sizeof(*req));
     req_prod++;
 
-    /* Update ring */
+    /*
+     * Update ring.  Helpers of Xen-allocated rings use req_event to say when
+     * they next want to be kicked; legacy helpers are kicked every time.
+     */
     front_ring->req_prod_pvt = req_prod;
-    RING_PUSH_REQUESTS(front_ring);
+    if ( ved->nr_frames )
+        RING_PUSH_REQUESTS_AND_CHECK_NOTIFY(front_ring, notify);
+    else
+        RING_PUSH_REQUESTS(front_ring);
 
     /* We've actually *used* our reservation, so release the slot. */
     vm_event_release_slot(d, ved);
@@ -308,42 +437,134 @@ void vm_event_put_request(struct domain *d,
 
     spin_unlock(&ved->lock);
 
-    notify_via_xen_event_channel(d, ved->xen_port);
+    if ( notify )
+        notify_via_xen_event_channel(d, ved->xen_port);
 }
 
-static int vm_event_get_response(struct domain *d, struct vm_event_domain *ved,
-                                 vm_event_response_t *rsp)
+/*
+ * Copy up to nr responses off the ring under a single acquisition of the
+ * lock.  Returns the number copied.
+ */
+static unsigned int vm_event_get_responses(struct domain *d,
+                                           struct vm_event_domain *ved,
+                                           vm_event_response_t *rsp,
+                                           unsigned int nr)
 {
     vm_event_front_ring_t *front_ring;
     RING_IDX rsp_cons;
-    int rc = 0;
+    unsigned int done = 0;
+    int more;
 
     spin_lock(&ved->lock);
 
     front_ring = &ved->front_ring;
     rsp_cons = front_ring->rsp_cons;
 
-    if ( !RING_HAS_UNCONSUMED_RESPONSES(front_ring) )
-        goto out;
-
-    /* Copy response */
-    memcpy(rsp, RING_GET_RESPONSE(front_ring, rsp_cons), sizeof(*rsp));
-    rsp_cons++;
+    while ( done < nr )
+    {
+        if ( !RING_HAS_UNCONSUMED_RESPONSES(front_ring) )
+        {
+            /*
+             * Ring drained: ask to be kicked for the next response, and
+             * catch any which raced with doing so.
+             */
+            RING_FINAL_CHECK_FOR_RESPONSES(front_ring, more);
+            if ( !more )
+                break;
+        }
 
-    /* Update ring */
-    front_ring->rsp_cons = rsp_cons;
-    front_ring->sring->rsp_event = rsp_cons + 1;
+        /* Copy response */
+        memcpy(&rsp[done++], RING_GET_RESPONSE(front_ring, rsp_cons),
+               sizeof(*rsp));
+        rsp_cons++;
+        front_ring->rsp_cons = rsp_cons;
+    }
 
-    /* Kick any waiters -- since we've just consumed an event,
+    /* Kick any waiters -- since we've just consumed events,
      * there may be additional space available in the ring. */
-    vm_event_wake(d, ved);
+    if ( done )
+        vm_event_wake(d, ved);
 
-    rc = 1;
-
- out:
     spin_unlock(&ved->lock);
 
-    return rc;
+    return done;
+}
+
+/* Act on a single response, copied off the ring. */
+static void vm_event_resume_one(struct domain *d, vm_event_response_t *rsp)
+{
+    struct vcpu *v;
+
+    if ( rsp->version != VM_EVENT_INTERFACE_VERSION )
+    {
+        printk(XENLOG_G_WARNING "vm_event interface version mismatch\n");
+        return;
+    }
+
+    /* Validate the vcpu_id in the response. */
+    v = domain_vcpu(d, rsp->vcpu_id);
+    if ( !v )
+        return;
+
+    /*
+     * In some cases the response type needs extra handling, so here
+     * we call the appropriate handlers.
+     */
+
+    /* Check flags which apply only when the vCPU is paused */
+    if ( atomic_read(&v->vm_event_pause_count) )
+    {
+#ifdef CONFIG_MEM_PAGING
+        if ( rsp->reason == VM_EVENT_REASON_MEM_PAGING )
+            p2m_mem_paging_resume(d, rsp);
+#endif
+#ifdef CONFIG_MEM_SHARING
+        if ( mem_sharing_is_fork(d) )
+        {
+            bool reset_state = rsp->flags & VM_EVENT_FLAG_RESET_FORK_STATE;
+            bool reset_mem = rsp->flags & VM_EVENT_FLAG_RESET_FORK_MEMORY;
+
+            if ( (reset_state || reset_mem) &&
+                 mem_sharing_fork_reset(d, reset_state, reset_mem) )
+                ASSERT_UNREACHABLE();
+        }
+#endif
+
+        /*
+         * Check emulation flags in the arch-specific handler only, as it
+         * has to set arch-specific flags when supported, and to avoid
+         * bitmask overhead when it isn't supported.
+         */
+        vm_event_emulate_check(v, rsp);
+
+        /*
+         * Check in arch-specific handler to avoid bitmask overhead when
+         * not supported.
+         */
+        vm_event_register_write_resume(v, rsp);
+
+        /*
+         * Check in arch-specific handler to avoid bitmask overhead when
+         * not supported.
+         */
+        vm_event_toggle_singlestep(d, v, rsp);
+
+        /* Check for altp2m switch */
+        if ( rsp->flags & VM_EVENT_FLAG_ALTERNATE_P2M )
+            p2m_altp2m_check(v, rsp->altp2m_idx);
+
+        if ( rsp->flags & VM_EVENT_FLAG_SET_REGISTERS )
+            vm_event_set_registers(v, rsp);
+
+        if ( rsp->flags & VM_EVENT_FLAG_GET_NEXT_INTERRUPT )
+            vm_event_monitor_next_interrupt(v);
+
+        if ( rsp->flags & VM_EVENT_FLAG_RESET_VMTRACE )
+            vm_event_reset_vmtrace(v);
+
+        if ( rsp->flags & VM_EVENT_FLAG_VCPU_PAUSED )
+            vm_event_vcpu_unpause(v);
+    }
 }
 
 /*
@@ -356,7 +577,8 @@ static int vm_event_get_response(struct domain *d, struct vm_event_domain *ved,
  */
 static int vm_event_resume(struct domain *d, struct vm_event_domain *ved)
 {
-    vm_event_response_t rsp;
+    vm_event_response_t batch[VM_EVENT_RESUME_BATCH];
+    unsigned int nr, i;
 
     /*
      * vm_event_resume() runs in either XEN_DOMCTL_VM_EVENT_OP_*, or
@@ -371,82 +593,11 @@ static int vm_event_resume(struct domain *d, struct vm_event_domain *ved)
     if ( unlikely(!vm_event_check_ring(ved)) )
          return -ENODEV;
 
-    /* Pull all responses off the ring. */
-    while ( vm_event_get_response(d, ved, &rsp) )
-    {
-        struct vcpu *v;
-
-        if ( rsp.version != VM_EVENT_INTERFACE_VERSION )
-        {
-            printk(XENLOG_G_WARNING "vm_event interface version mismatch\n");
-            continue;
-        }
-
-        /* Validate the vcpu_id in the response. */
-        v = domain_vcpu(d, rsp.vcpu_id);
-        if ( !v )
-            continue;
-
-        /*
-         * In some cases the response type needs extra handling, so here
-         * we call the appropriate handlers.
-         */
-
-        /* Check flags which apply only when the vCPU is paused */
-        if ( atomic_read(&v->vm_event_pause_count) )
-        {
-#ifdef CONFIG_MEM_PAGING
-            if ( rsp.reason == VM_EVENT_REASON_MEM_PAGING )
-                p2m_mem_paging_resume(d, &rsp);
-#endif
-#ifdef CONFIG_MEM_SHARING
-            if ( mem_sharing_is_fork(d) )
-            {
-                bool reset_state = rsp.flags & VM_EVENT_FLAG_RESET_FORK_STATE;
-                bool reset_mem = rsp.flags & VM_EVENT_FLAG_RESET_FORK_MEMORY;
-
-                if ( (reset_state || reset_mem) &&
-                     mem_sharing_fork_reset(d, reset_state, reset_mem) )
-                    ASSERT_UNREACHABLE();
-            }
-#endif
-
-            /*
-             * Check emulation flags in the arch-specific handler only, as it
-             * has to set arch-specific flags when supported, and to avoid
-             * bitmask overhead when it isn't supported.
-             */
-            vm_event_emulate_check(v, &rsp);
-
-            /*
-             * Check in arch-specific handler to avoid bitmask overhead when
-             * not supported.
-             */
-            vm_event_register_write_resume(v, &rsp);
-
-            /*
-             * Check in arch-specific handler to avoid bitmask overhead when
-             * not supported.
-             */
-            vm_event_toggle_singlestep(d, v, &rsp);
-
-            /* Check for altp2m switch */
-            if ( rsp.flags & VM_EVENT_FLAG_ALTERNATE_P2M )
-                p2m_altp2m_check(v, rsp.altp2m_idx);
-
-            if ( rsp.flags & VM_EVENT_FLAG_SET_REGISTERS )
-                vm_event_set_registers(v, &rsp);
-
-            if ( rsp.flags & VM_EVENT_FLAG_GET_NEXT_INTERRUPT )
-                vm_event_monitor_next_interrupt(v);
-
-            if ( rsp.flags & VM_EVENT_FLAG_RESET_VMTRACE )
-                vm_event_reset_vmtrace(v);
-
-            if ( rsp.flags & VM_EVENT_FLAG_VCPU_PAUSED )
-                vm_event_vcpu_unpause(v);
-        }
-    }
+    /* Pull all responses off the ring, a batch at a time. */
+    while ( (nr = vm_event_get_responses(d, ved, batch,
+                                         ARRAY_SIZE(batch))) != 0 )
+        for ( i = 0; i < nr; i++ )
+            vm_event_resume_one(d, &batch[i]);
 
     return 0;
 }
@@ -814,6 +965,74 @@ void vm_event_vcpu_unpause(struct vcpu *v)
     vcpu_unpause(v);
 }
 
+/*
+ * XENMEM_resource_vm_event: the frames of a Xen-allocated ring.  The domain
+ * lock keeps the ved from being freed, and the ved's lock keeps the ring
+ * from being freed while its frames are looked up.  Any mapping the caller
+ * then makes holds its own page references; pages freed before that are no
+ * longer the domain's, so mapping them fails.
+ */
+unsigned int vm_event_ring_max_frames(struct domain *d, unsigned int mode)
+{
+    struct vm_event_domain **p_ved = vm_event_domain_ptr(d, mode);
+    struct vm_event_domain *ved;
+    unsigned int nr = 0;
+
+    if ( !p_ved )
+        return 0;
+
+    domain_lock(d);
+    ved = *p_ved;
+    if ( ved )
+    {
+        spin_lock(&ved->lock);
+        if ( vm_event_check_ring(ved) )
+            nr = ved->nr_frames;
+        spin_unlock(&ved->lock);
+    }
+    domain_unlock(d);
+
+    return nr;
+}
+
+int vm_event_acquire_ring(struct domain *d, unsigned int mode,
+                          unsigned int frame, unsigned int nr_frames,
+                          xen_pfn_t mfn_list[])
+{
+    struct vm_event_domain **p_ved = vm_event_domain_ptr(d, mode);
+    struct vm_event_domain *ved;
+    unsigned int i;
+    int rc = -EINVAL;
+
+    if ( !p_ved )
+        return -EINVAL;
+
+    domain_lock(d);
+
+    ved = *p_ved;
+    if ( ved )
+    {
+        spin_lock(&ved->lock);
+
+        if ( vm_event_check_ring(ved) && ved->nr_frames &&
+             frame + nr_frames <= ved->nr_frames )
+        {
+            mfn_t mfn = page_to_mfn(ved->ring_pg_struct);
+
+            for ( i = 0; i < nr_frames; i++ )
+                mfn_list[i] = mfn_x(mfn) + frame + i;
+
+            rc = nr_frames;
+        }
+
+        spin_unlock(&ved->lock);
+    }
+
+    domain_unlock(d);
+
+    return rc;
+}
+
 /*
  * Local variables:
  * mode: C
@@ -30,9 +30,9 @@
  * fields) don't require a change of the version.
  * Stable ops are NOT covered by XEN_DOMCTL_INTERFACE_VERSION!
  *
- * Last version bump: Xen 4.19
+ * Last version bump: Xen 4.21
  */
-#define XEN_DOMCTL_INTERFACE_VERSION 0x00000017
+#define XEN_DOMCTL_INTERFACE_VERSION 0x00000018
 
 /*
  * NB. xen_domctl.domain is an IN/OUT parameter for this operation.
@@ -226,6 +226,27 @@ struct xen_domctl_getpageframeinfo3 {
  /* Return the bitmap but do not modify internal copy. */
 #define XEN_DOMCTL_SHADOW_OP_PEEK        12
 
+/*
+ * Log-dirty ring operations (HAP guests only).  With the ring enabled, each
+ * pfn is also queued on a ring as its bit first becomes set, so a toolstack
+ * can collect the pages dirtied since the previous round without scanning
+ * the whole bitmap.  The bitmap remains authoritative: CLEAN still returns
+ * every dirty page, and empties the ring.
+ */
+ /*
+  * Allocate the ring, with room for pages entries (rounded up to a power of
+  * two).  Log-dirty mode must already be enabled; disabling it frees the
+  * ring again.
+  */
+#define XEN_DOMCTL_SHADOW_OP_DIRTY_RING_ENABLE   13
+ /*
+  * Move up to pages pfns off the ring into dirty_bitmap, which is used as an
+  * array of uint64_t here.  The pfns are cleared in the bitmap and are write
+  * protected again, as CLEAN would do.  pages is updated with the number of
+  * pfns returned.
+  */
+#define XEN_DOMCTL_SHADOW_OP_DIRTY_RING_HARVEST  14
+
 /*
  * Memory allocation accessors.  These APIs are broken and will be removed.
  * Use XEN_DOMCTL_{get,set}_paging_mempool_size instead.
@@ -272,6 +293,13 @@ struct xen_domctl_getpageframeinfo3 {
   */
 #define XEN_DOMCTL_SHADOW_LOGDIRTY_FINAL   (1 << 0)
 
+/* Mode flags returned by XEN_DOMCTL_SHADOW_OP_DIRTY_RING_HARVEST. */
+ /*
+  * The ring filled up and pfns have been dropped from it since the last
+  * CLEAN.  Use CLEAN to collect the remaining dirty pages.
+  */
+#define XEN_DOMCTL_SHADOW_DIRTY_RING_OVERFLOW (1 << 0)
+
 struct xen_domctl_shadow_op_stats {
     uint32_t fault_count;
     uint32_t dirty_count;
@@ -283,12 +311,13 @@ struct xen_domctl_shadow_op {
 
     /* OP_ENABLE: XEN_DOMCTL_SHADOW_ENABLE_* */
     /* OP_PEAK / OP_CLEAN: XEN_DOMCTL_SHADOW_LOGDIRTY_* */
+    /* OP_DIRTY_RING_HARVEST: XEN_DOMCTL_SHADOW_DIRTY_RING_* (OUT) */
     uint32_t       mode;
 
     /* OP_GET_ALLOCATION / OP_SET_ALLOCATION */
     uint32_t       mb;       /* Shadow memory allocation in MB */
 
-    /* OP_PEEK / OP_CLEAN */
+    /* OP_PEEK / OP_CLEAN / OP_DIRTY_RING_{ENABLE,HARVEST} */
     XEN_GUEST_HANDLE_64(uint8) dirty_bitmap;
     uint64_aligned_t pages; /* Size of buffer. Updated with actual size. */
     struct xen_domctl_shadow_op_stats stats;
@@ -891,11 +920,27 @@ struct xen_domctl_vm_event_op {
     union {
         struct {
             uint32_t port;       /* OUT: event channel for ring */
+            /*
+             * IN: 0 to use the single ring page at the gfn named by the
+             * mode's HVM_PARAM_*_RING_PFN.  Otherwise Xen allocates a ring
+             * of this many frames (a power of two, at most
+             * XEN_VM_EVENT_RING_MAX_FRAMES), initialises it, and the helper
+             * maps it with XENMEM_acquire_resource (type
+             * XENMEM_resource_vm_event, id == mode).
+             *
+             * Notifications on such rings follow the req_event/rsp_event
+             * protocol of io/ring.h in both directions, so the helper must
+             * use RING_FINAL_CHECK_FOR_REQUESTS() before waiting and only
+             * needs to kick Xen when RING_PUSH_RESPONSES_AND_CHECK_NOTIFY()
+             * says so.
+             */
+            uint32_t nr_frames;
         } enable;
 
         uint32_t version;
     } u;
 };
+#define XEN_VM_EVENT_RING_MAX_FRAMES 64
 
 /*
  * Memory sharing operations
@@ -60,6 +60,7 @@
 #ifdef __XEN__
 #define EVTCHNOP_reset_cont      14
 #endif
+#define EVTCHNOP_send_many       15
 /* ` } */
 
 typedef uint32_t evtchn_port_t;
@@ -298,6 +299,22 @@ struct evtchn_set_priority {
 };
 typedef struct evtchn_set_priority evtchn_set_priority_t;
 
+/*
+ * EVTCHNOP_send_many: Send an event to the remote end of each of the channels
+ * whose local endpoints are listed in <ports>, as EVTCHNOP_send would.
+ * NOTES:
+ *  1. <nr_ports> may not exceed EVTCHN_SEND_MANY_MAX.
+ *  2. Every port is sent to, even if sending to an earlier one failed. The
+ *     error returned is that of the first port which could not be sent to.
+ */
+#define EVTCHN_SEND_MANY_MAX 128
+struct evtchn_send_many {
+    /* IN parameters. */
+    uint32_t nr_ports;
+    evtchn_port_t ports[XEN_FLEX_ARRAY_DIM];
+};
+typedef struct evtchn_send_many evtchn_send_many_t;
+
 /*
  * ` enum neg_errnoval
  * ` HYPERVISOR_event_channel_op_compat(struct evtchn_op *op)
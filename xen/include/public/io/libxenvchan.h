@@ -54,7 +54,9 @@ struct vchan_interface {
 	 * size of the rings, which determines their location
 	 * 10   - at offset 1024 in ring's page
 	 * 11   - at offset 2048 in ring's page
-	 * 12+  - uses 2^(N-12) grants to describe the multi-page ring
+	 * 12-20 - uses 2^(N-12) grants to describe the multi-page ring
+	 * 21+  - uses max(1, 2^(N-22)) grants of read-only grant list pages,
+	 *        each holding up to 1024 grants which describe the ring
 	 * These should remain constant once the page is shared.
 	 * Only one of the two orders can be 10 (or 11).
 	 */
@@ -76,6 +78,8 @@ struct vchan_interface {
 	/**
 	 * Grant list: ordering is left, right. Must not extend into actual ring
 	 * or grow beyond the end of the initial shared page.
+	 * For rings of order 21 and above, the entries are the grants of the
+	 * grant list pages rather than of the ring itself.
 	 * These should remain constant once the page is shared, to allow
 	 * for possible remapping by a client that restarts.
 	 */
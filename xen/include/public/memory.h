@@ -41,6 +41,12 @@
 #define XENMEMF_exact_node(n) (XENMEMF_node(n) | XENMEMF_exact_node_request)
 /* Flag to indicate the node specified is virtual node */
 #define XENMEMF_vnode  (1<<18)
+/*
+ * Hint to take even single pages from memory which has already been
+ * scrubbed, if there is any short of breaking up a free superpage, rather
+ * than scrubbing dirty pages inline.
+ */
+#define XENMEMF_prefer_scrubbed  (1<<19)
 #endif
 
 struct xen_memory_reservation {
@@ -483,6 +489,7 @@ DEFINE_XEN_GUEST_HANDLE(xen_mem_access_op_t);
 #define XENMEM_sharing_op_range_share       8
 #define XENMEM_sharing_op_fork              9
 #define XENMEM_sharing_op_fork_reset        10
+#define XENMEM_sharing_op_share_batch       11
 
 #define XENMEM_SHARING_OP_S_HANDLE_INVALID  (-10)
 #define XENMEM_SHARING_OP_C_HANDLE_INVALID  (-9)
@@ -500,6 +507,22 @@ DEFINE_XEN_GUEST_HANDLE(xen_mem_access_op_t);
 #define XENMEM_SHARING_OP_FIELD_GET_GREF(field)        \
     ((field) & (~XENMEM_SHARING_OP_FIELD_IS_GREF_FLAG))
 
+/*
+ * One candidate pair for XENMEM_sharing_op_share_batch.  rc is set to 0 once
+ * the pages are shared, or else to why they were not: a negative errno
+ * value or XENMEM_SHARING_OP_{S,C}_HANDLE_INVALID, with -EAGAIN meaning the
+ * contents did not match.  The pages of a pair which is not shared are left
+ * as they were.  Entries not processed are left untouched.
+ */
+struct xen_mem_sharing_batch_entry {
+    uint64_aligned_t source_gfn;    /* IN: the gfn of the source page */
+    uint64_aligned_t client_gfn;    /* IN: the gfn of the client page */
+    int32_t rc;                     /* OUT */
+    uint32_t _pad;                  /* Must be set to 0 */
+};
+typedef struct xen_mem_sharing_batch_entry xen_mem_sharing_batch_entry_t;
+DEFINE_XEN_GUEST_HANDLE(xen_mem_sharing_batch_entry_t);
+
 struct xen_mem_sharing_op {
     uint8_t     op;     /* XENMEM_sharing_op_* */
     domid_t     domain;
@@ -526,6 +549,19 @@ struct xen_mem_sharing_op {
             domid_t client_domain;           /* IN: the client domain id */
             uint16_t _pad[3];                /* Must be set to 0 */
         } range;
+        /*
+         * OP_SHARE_BATCH: nominate and share each pair of pages, but only
+         * if their contents are identical once both have been made
+         * read-only.  Unlike OP_RANGE_SHARE the domains may be running.
+         */
+        struct mem_sharing_op_batch {
+            /* IN/OUT: nr xen_mem_sharing_batch_entry_t */
+            XEN_GUEST_HANDLE_64(void) entries;
+            uint32_t nr;                     /* IN: number of entries */
+            uint32_t done;                   /* Must be set to 0 */
+            domid_t client_domain;           /* IN: the client domain id */
+            uint16_t _pad[3];                /* Must be set to 0 */
+        } batch;
         struct mem_sharing_op_debug {     /* OP_DEBUG_xxx */
             union {
                 uint64_aligned_t gfn;      /* IN: gfn to debug          */
@@ -627,6 +663,7 @@ struct xen_mem_acquire_resource {
 #define XENMEM_resource_ioreq_server 0
 #define XENMEM_resource_grant_table 1
 #define XENMEM_resource_vmtrace_buf 2
+#define XENMEM_resource_vm_event 3
 
     /*
      * IN - a type-specific resource identifier, which must be zero
@@ -634,6 +671,7 @@ struct xen_mem_acquire_resource {
      *
      * type == XENMEM_resource_ioreq_server -> id == ioreq server id
      * type == XENMEM_resource_grant_table -> id defined below
+     * type == XENMEM_resource_vm_event -> id == XEN_DOMCTL_VM_EVENT_OP_*
      */
     uint32_t id;
 
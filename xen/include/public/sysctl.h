@@ -28,7 +28,7 @@
  *
  * Last version bump: Xen 4.17
  */
-#define XEN_SYSCTL_INTERFACE_VERSION 0x00000015
+#define XEN_SYSCTL_INTERFACE_VERSION 0x00000016
 
 /*
  * Read console content from Xen buffer ring.
@@ -141,6 +141,13 @@ struct xen_sysctl_sched_id {
 /* Sub-operations: */
 #define XEN_SYSCTL_PERFCOP_reset 1   /* Reset all counters to zero. */
 #define XEN_SYSCTL_PERFCOP_query 2   /* Get perfctr information. */
+/*
+ * Get the per CPU values of selected counters only.  @val receives
+ * @nr_sel rows of @nr_cpus values, value (s, c) being at index
+ * s * @nr_cpus + c; offline CPUs read as zero.  Passing @nr_sel as zero
+ * just returns the number of CPU columns Xen can supply in @nr_cpus.
+ */
+#define XEN_SYSCTL_PERFCOP_sample 3
 struct xen_sysctl_perfc_desc {
     char         name[80];             /* name of perf counter */
     uint32_t     nr_vals;              /* number of values for this counter */
@@ -149,6 +156,16 @@ typedef struct xen_sysctl_perfc_desc xen_sysctl_perfc_desc_t;
 DEFINE_XEN_GUEST_HANDLE(xen_sysctl_perfc_desc_t);
 typedef uint32_t xen_sysctl_perfc_val_t;
 DEFINE_XEN_GUEST_HANDLE(xen_sysctl_perfc_val_t);
+/* A counter to sample, indexing the array returned by PERFCOP_query. */
+struct xen_sysctl_perfc_sel {
+    uint32_t     counter;
+    /* Element of an array counter, or ..._ELEMENT_ALL for their sum. */
+    uint32_t     element;
+#define XEN_SYSCTL_PERFC_ELEMENT_ALL (~0U)
+};
+typedef struct xen_sysctl_perfc_sel xen_sysctl_perfc_sel_t;
+DEFINE_XEN_GUEST_HANDLE(xen_sysctl_perfc_sel_t);
+#define XEN_SYSCTL_PERFC_MAX_SEL     1024
 
 struct xen_sysctl_perfc_op {
     /* IN variables. */
@@ -160,6 +177,11 @@ struct xen_sysctl_perfc_op {
     XEN_GUEST_HANDLE_64(xen_sysctl_perfc_desc_t) desc;
     /* counter values (or NULL) */
     XEN_GUEST_HANDLE_64(xen_sysctl_perfc_val_t) val;
+    /* PERFCOP_sample only. */
+    XEN_GUEST_HANDLE_64(xen_sysctl_perfc_sel_t) sel; /* IN */
+    uint32_t       nr_sel;            /* IN: number of @sel entries */
+    uint32_t       nr_cpus;           /* IN: columns of @val, OUT: nr_cpu_ids */
+    uint64_aligned_t now;             /* OUT: Xen system time of the sample */
 };
 
 /* XEN_SYSCTL_getdomaininfolist */
@@ -579,10 +601,13 @@ struct xen_sysctl_page_offline_op {
 /* Sub-operations: */
 #define XEN_SYSCTL_LOCKPROF_reset 1   /* Reset all profile data to zero. */
 #define XEN_SYSCTL_LOCKPROF_query 2   /* Get lock profile information. */
+#define XEN_SYSCTL_LOCKPROF_query_sites 3 /* Get per call site information. */
+#define XEN_SYSCTL_LOCKPROF_query_cpus 4  /* Get per CPU information. */
 /* Record-type: */
 #define LOCKPROF_TYPE_GLOBAL      0   /* global lock, idx meaningless */
 #define LOCKPROF_TYPE_PERDOM      1   /* per-domain lock, idx is domid */
-#define LOCKPROF_TYPE_N           2   /* number of types */
+#define LOCKPROF_TYPE_PERCPU      2   /* per-CPU lock, idx is the CPU */
+#define LOCKPROF_TYPE_N           3   /* number of types */
 struct xen_sysctl_lockprof_data {
     char     name[40];     /* lock name (may include up to 2 %d specifiers) */
     int32_t  type;         /* LOCKPROF_TYPE_??? */
@@ -594,6 +619,37 @@ struct xen_sysctl_lockprof_data {
 };
 typedef struct xen_sysctl_lockprof_data xen_sysctl_lockprof_data_t;
 DEFINE_XEN_GUEST_HANDLE(xen_sysctl_lockprof_data_t);
+/*
+ * Hold and wait time histograms are log2 scaled: bucket 0 counts times below
+ * 128ns, bucket n (n > 0) times in [64ns << n, 128ns << n), and the last
+ * bucket also counts everything longer.
+ */
+#define XEN_SYSCTL_LOCKPROF_HIST_BUCKETS 20
+/* A place in Xen a profiled lock is taken from. */
+struct xen_sysctl_lockprof_site {
+    char     name[40];     /* lock name, as for xen_sysctl_lockprof_data */
+    int32_t  type;         /* LOCKPROF_TYPE_??? */
+    int32_t  idx;          /* index (e.g. domain id) */
+    char     site[64];     /* function+offset, or "other" once the lock's
+                              table of call sites is full */
+    uint64_aligned_t lock_cnt;     /* # of locking succeeded */
+    uint64_aligned_t block_cnt;    /* # of wait for lock */
+    uint64_aligned_t lock_time;    /* nsecs lock held */
+    uint64_aligned_t block_time;   /* nsecs waited for lock */
+    uint32_t hold_hist[XEN_SYSCTL_LOCKPROF_HIST_BUCKETS];
+    uint32_t block_hist[XEN_SYSCTL_LOCKPROF_HIST_BUCKETS];
+};
+typedef struct xen_sysctl_lockprof_site xen_sysctl_lockprof_site_t;
+DEFINE_XEN_GUEST_HANDLE(xen_sysctl_lockprof_site_t);
+/* Totals over all profiled locks taken on one CPU, indexed by CPU. */
+struct xen_sysctl_lockprof_cpu {
+    uint64_aligned_t lock_cnt;     /* # of locking succeeded */
+    uint64_aligned_t block_cnt;    /* # of wait for lock */
+    uint64_aligned_t lock_time;    /* nsecs lock held */
+    uint64_aligned_t block_time;   /* nsecs waited for lock */
+};
+typedef struct xen_sysctl_lockprof_cpu xen_sysctl_lockprof_cpu_t;
+DEFINE_XEN_GUEST_HANDLE(xen_sysctl_lockprof_cpu_t);
 struct xen_sysctl_lockprof_op {
     /* IN variables. */
     uint32_t       cmd;               /* XEN_SYSCTL_LOCKPROF_??? */
@@ -603,6 +659,10 @@ struct xen_sysctl_lockprof_op {
     uint64_aligned_t time;            /* nsecs of profile measurement */
     /* profile information (or NULL) */
     XEN_GUEST_HANDLE_64(xen_sysctl_lockprof_data_t) data;
+    /* query_sites: per call site information (or NULL) */
+    XEN_GUEST_HANDLE_64(xen_sysctl_lockprof_site_t) sites;
+    /* query_cpus: per CPU information (or NULL) */
+    XEN_GUEST_HANDLE_64(xen_sysctl_lockprof_cpu_t) cpus;
 };
 
 /* XEN_SYSCTL_cputopoinfo */
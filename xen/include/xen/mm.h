@@ -196,6 +196,8 @@ struct npfec {
 #define  MEMF_no_refcount (1U<<_MEMF_no_refcount)
 #define _MEMF_populate_on_demand 1
 #define  MEMF_populate_on_demand (1U<<_MEMF_populate_on_demand)
+#define _MEMF_prefer_scrubbed 2
+#define  MEMF_prefer_scrubbed (1U<<_MEMF_prefer_scrubbed)
 #define _MEMF_no_dma      3
 #define  MEMF_no_dma      (1U<<_MEMF_no_dma)
 #define _MEMF_exact_node  4
@@ -512,6 +514,8 @@ page_list_splice(struct page_list_head *list, struct page_list_head *head)
     list_for_each_entry_safe_reverse(pos, tmp, head, list)
 #endif
 
+void free_domheap_page_list(struct domain *d, struct page_list_head *list);
+
 static inline unsigned int get_order_from_bytes(paddr_t size)
 {
     unsigned int order;
@@ -59,6 +59,9 @@ PERFCOUNTER(load_balance_other,     "csched: load_balance_other")
 PERFCOUNTER(steal_trylock,          "csched: steal_trylock")
 PERFCOUNTER(steal_trylock_failed,   "csched: steal_trylock_failed")
 PERFCOUNTER(steal_peer_idle,        "csched: steal_peer_idle")
+PERFCOUNTER(steal_llc_read,         "csched: steal_llc_read")
+PERFCOUNTER(steal_llc_empty,        "csched: steal_llc_empty")
+PERFCOUNTER_ARRAY(steal_probe,      "csched: steal_probe", 4)
 PERFCOUNTER(migrate_queued,         "csched: migrate_queued")
 PERFCOUNTER(migrate_kicked_away,    "csched: migrate_kicked_away")
 PERFCOUNTER(unit_hot,               "csched: unit_hot")
@@ -85,4 +88,9 @@ PERFCOUNTER(tickled_cpu_overridden, "csched2: tickled_cpu_overridden")
 
 PERFCOUNTER(need_flush_tlb_flush,   "PG_need_flush tlb flushes")
 
+PERFCOUNTER(gnttab_copy_ops,          "gnttab: copy ops")
+PERFCOUNTER(gnttab_copy_lock_domains, "gnttab: copy domain lookups")
+PERFCOUNTER(gnttab_copy_claim,        "gnttab: copy grant/frame acquisitions")
+PERFCOUNTER(gnttab_copy_cache_hit,    "gnttab: copy cached grant/frame reuses")
+
 /*#endif*/ /* __XEN_PERFC_DEFN_H__ */
@@ -78,6 +78,19 @@ union lock_debug { };
 
 struct spinlock;
 
+/* Call sites tracked per lock.  The last entry collects all further sites. */
+#define LOCK_PROFILE_SITES 8
+
+struct lock_profile_site {
+    const void          *addr;       /* caller of the lock function */
+    uint64_t            lock_cnt;    /* # of complete locking ops */
+    uint64_t            block_cnt;   /* # of complete wait for lock */
+    s_time_t            time_hold;   /* cumulated lock time */
+    s_time_t            time_block;  /* cumulated wait time */
+    uint32_t            hold_hist[XEN_SYSCTL_LOCKPROF_HIST_BUCKETS];
+    uint32_t            block_hist[XEN_SYSCTL_LOCKPROF_HIST_BUCKETS];
+};
+
 struct lock_profile {
     struct lock_profile *next;       /* forward link */
     const char          *name;       /* lock name */
@@ -91,6 +104,8 @@ struct lock_profile {
     s_time_t            time_hold;   /* cumulated lock time */
     s_time_t            time_block;  /* cumulated wait time */
     s_time_t            time_locked; /* system time of last locking */
+    unsigned int        cur_site;    /* site[] entry of the current holder */
+    struct lock_profile_site site[LOCK_PROFILE_SITES];
 };
 
 struct lock_profile_qhead {
@@ -11,28 +11,40 @@
 #define __XEN_TASKLET_H__
 
 #include <xen/types.h>
+#include <xen/lib.h>
 #include <xen/list.h>
 #include <xen/percpu.h>
 
 struct tasklet
 {
-    struct list_head list;
-    int scheduled_on;
+    struct tasklet *next;
+    unsigned long state;
+    unsigned int queued_on;
     bool is_softirq;
-    bool is_running;
-    bool is_dead;
     void (*func)(void *data);
     void *data;
 };
 
-#define _DECLARE_TASKLET(name, func, data, softirq)                     \
+#define _DECLARE_TASKLET(name, fn, arg, softirq)                        \
     struct tasklet name = {                                             \
-        LIST_HEAD_INIT((name).list), -1, softirq, 0, 0, func, data }
+        .is_softirq = softirq, .func = fn, .data = arg }
 #define DECLARE_TASKLET(name, func, data)               \
     _DECLARE_TASKLET(name, func, data, 0)
 #define DECLARE_SOFTIRQ_TASKLET(name, func, data)       \
     _DECLARE_TASKLET(name, func, data, 1)
 
+/*
+ * Tasklet state.  The bits above the flags hold the CPU the tasklet is
+ * scheduled on plus one, or zero if it isn't scheduled.
+ */
+#define _TASKLET_STATE_queued  0 /* Tasklet is on a CPU's queue. */
+#define _TASKLET_STATE_running 1 /* Tasklet function is executing. */
+#define _TASKLET_STATE_dead    2 /* Tasklet was killed. */
+#define TASKLET_STATE_queued   (1UL << _TASKLET_STATE_queued)
+#define TASKLET_STATE_running  (1UL << _TASKLET_STATE_running)
+#define TASKLET_STATE_dead     (1UL << _TASKLET_STATE_dead)
+#define TASKLET_STATE_cpu_shift 3
+
 /* Indicates status of tasklet work on each CPU. */
 DECLARE_PER_CPU(unsigned long, tasklet_work_to_do);
 #define _TASKLET_enqueued  0 /* Tasklet work is enqueued for this CPU. */
@@ -52,7 +64,12 @@ static inline bool tasklet_work_to_do(unsigned int cpu)
 
 static inline bool tasklet_is_scheduled(const struct tasklet *t)
 {
-    return t->scheduled_on != -1;
+    return ACCESS_ONCE(t->state) >> TASKLET_STATE_cpu_shift;
+}
+
+static inline bool tasklet_is_running(const struct tasklet *t)
+{
+    return ACCESS_ONCE(t->state) & TASKLET_STATE_running;
 }
 
 void tasklet_schedule_on_cpu(struct tasklet *t, unsigned int cpu);
@@ -30,12 +30,14 @@
 struct vm_event_domain
 {
     spinlock_t lock;
-    /* The ring has 64 entries */
-    unsigned char foreign_producers;
-    unsigned char target_producers;
-    /* shared ring page */
+    /* Slots claimed but not yet filled */
+    unsigned int foreign_producers;
+    unsigned int target_producers;
+    /* shared ring page(s) */
     void *ring_page;
     struct page_info *ring_pg_struct;
+    /* Frames of a Xen-allocated ring, or 0 for a guest ring page */
+    unsigned int nr_frames;
     /* front-end ring */
     vm_event_front_ring_t front_ring;
     /* event channel port (vcpu0 only) */
@@ -89,6 +91,12 @@ void vm_event_put_request(struct domain *d, struct vm_event_domain *ved,
 /* Clean up on domain destruction */
 void vm_event_cleanup(struct domain *d);
 int vm_event_domctl(struct domain *d, struct xen_domctl_vm_event_op *vec);
+
+/* XENMEM_resource_vm_event support */
+unsigned int vm_event_ring_max_frames(struct domain *d, unsigned int mode);
+int vm_event_acquire_ring(struct domain *d, unsigned int mode,
+                          unsigned int frame, unsigned int nr_frames,
+                          xen_pfn_t mfn_list[]);
 #else /* !CONFIG_VM_EVENT */
 static inline void vm_event_cleanup(struct domain *d) {}
 static inline int vm_event_domctl(struct domain *d,
@@ -96,6 +104,20 @@ static inline int vm_event_domctl(struct domain *d,
 {
     return -EOPNOTSUPP;
 }
+
+static inline unsigned int vm_event_ring_max_frames(struct domain *d,
+                                                    unsigned int mode)
+{
+    return 0;
+}
+
+static inline int vm_event_acquire_ring(struct domain *d, unsigned int mode,
+                                        unsigned int frame,
+                                        unsigned int nr_frames,
+                                        xen_pfn_t mfn_list[])
+{
+    return -EOPNOTSUPP;
+}
 #endif /* !CONFIG_VM_EVENT */
 
 void vm_event_vcpu_pause(struct vcpu *v);
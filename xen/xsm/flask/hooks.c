@@ -1615,6 +1615,8 @@ static int cf_check flask_shadow_control(struct domain *d, uint32_t op)
     case XEN_DOMCTL_SHADOW_OP_ENABLE_LOGDIRTY:
     case XEN_DOMCTL_SHADOW_OP_PEEK:
     case XEN_DOMCTL_SHADOW_OP_CLEAN:
+    case XEN_DOMCTL_SHADOW_OP_DIRTY_RING_ENABLE:
+    case XEN_DOMCTL_SHADOW_OP_DIRTY_RING_HARVEST:
         perm = SHADOW__LOGDIRTY;
         break;
     default: